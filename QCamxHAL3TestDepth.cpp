@@ -49,16 +49,13 @@ void QCamxHAL3TestDepth::capture_post_process(DeviceCallback *cb, camera3_captur
     for (uint32_t i = 0; i < result->num_output_buffers; i++) {
         int index = _device->find_stream_index(buffers[i].stream);
         CameraStream *stream = _device->_camera_streams[index];
-        BufferInfo *info = stream->buffer_manager->get_buffer_info(buffers[i].buffer);
         if (stream->stream_id == DEPTH_IDX) {
-            if (_callbacks && _callbacks->video_cb) {
-                _callbacks->video_cb(info, result->frame_number);
-            }
+            publish_frame(stream, buffers[i].buffer, result->frame_number, DEPTH_TYPE);
             if (_dump_video_num > 0 &&
                 (_dump_interval == 0 ||
                  (_dump_interval > 0 && result->frame_number % _dump_interval == 0))) {
-                QCamxCase::dump_frame(info, result->frame_number, DEPTH_TYPE,
-                                      _config->_video_stream.subformat);
+                dump_frame_async(stream, buffers[i].buffer, result->frame_number, DEPTH_TYPE,
+                                 _config->_video_stream.subformat);
                 if (_dump_interval == 0) {
                     _dump_video_num--;
                 }
@@ -66,27 +63,21 @@ void QCamxHAL3TestDepth::capture_post_process(DeviceCallback *cb, camera3_captur
 
             stream->buffer_manager->return_buffer(buffers[i].buffer);
 
-            if (_config->_show_fps) {
-                show_fps(DEPTH_TYPE);
-            }
+            update_stream_metrics(DEPTH_TYPE, result->frame_number);
         } else if (stream->stream_id == DEPTH_IRBG_IDX) {
-            if (_callbacks != NULL && _callbacks->preview_cb != NULL) {
-                _callbacks->preview_cb(info, result->frame_number);
-            }
+            publish_frame(stream, buffers[i].buffer, result->frame_number, IRBG_TYPE);
             if (_dump_preview_num > 0 &&
                 (_dump_interval == 0 ||
                  (_dump_interval > 0 && result->frame_number % _dump_interval == 0))) {
-                QCamxCase::dump_frame(info, result->frame_number, IRBG_TYPE,
-                                      _config->_preview_stream.subformat);
+                dump_frame_async(stream, buffers[i].buffer, result->frame_number, IRBG_TYPE,
+                                 _config->_preview_stream.subformat);
                 if (_dump_interval == 0) {
                     _dump_preview_num--;
                 }
             }
             stream->buffer_manager->return_buffer(buffers[i].buffer);
 
-            if (_config->_show_fps) {
-                show_fps(IRBG_TYPE);
-            }
+            update_stream_metrics(IRBG_TYPE, result->frame_number);
         }
     }
 
@@ -20,11 +20,9 @@
 #include "qcamx_case.h"
 #include "qcamx_config.h"
 #include "qcamx_log.h"
-#include "qcamx_preview_only_case.h"
+#include "qcamx_pipeline_case.h"
 #include "qcamx_preview_snapshot_case.h"
-#include "qcamx_preview_video_case.h"
 #include "qcamx_signal_monitor.h"
-#include "qcamx_video_only_case.h"
 
 #ifdef LOG_TAG
 #undef LOG_TAG
@@ -147,11 +145,12 @@ static int load_camera_module(const char *id, const char *path,
 #else
 #define CAMERA_HAL_LIBERAY "/vendor/lib64/hw/camera.qcom.so"
 #endif
+static const char *s_camera_hal_path = CAMERA_HAL_LIBERAY;
 int initialize() {
     // Load camera module
     // define in /usr/include/hardware/camera_common.h:37:#define CAMERA_HARDWARE_MODULE_ID "camera"
     int result =
-        load_camera_module(CAMERA_HARDWARE_MODULE_ID, CAMERA_HAL_LIBERAY, &s_camera_module);
+        load_camera_module(CAMERA_HARDWARE_MODULE_ID, s_camera_hal_path, &s_camera_module);
     if (result != 0 || s_camera_module == NULL) {
         QCAMX_ERR("load camera module failed with error %s (%d).", strerror(-result), result);
         return result;
@@ -235,9 +234,10 @@ void print_version() {
 }
 
 char usage[] = " \
-usage: hal3_test [-h] [-f command.txt] \n\
+usage: hal3_test [-h] [-f command.txt] [-l camera_hal.so] \n\
  -h      show usage\n\
  -f      using commands in file\n\
+ -l      load camera HAL from the given library, e.g. /usr/lib/hw/camera.mock.so\n\
 \n\
 command in program: \n\
 <order>:[Params] \n\
@@ -249,6 +249,14 @@ command in program: \n\
      >>A:id=0,psize=1920x1080,pformat=yuv420,ssize=1920x1080,sformat=jpeg\n\
      [Video]\n\
      >>A:id=0,psize=1920x1080,,pformat=yuv420,vsize=1920x1080,ssize=1920x1080,,sformat=jpeg,fpsrange=30-30,codectype=0\n\
+     [ZSL snapshot] the last zsldepth (1-32) yuv/raw snapshot frames are kept, E picks one\n\
+     >>A:id=0,psize=1920x1080,pformat=yuv420,ssize=4000x3000,sformat=yuv420,zsldepth=8\n\
+     [HAL buffers] the HAL requests the buffers when it needs them, the pools grow on demand\n\
+     >>A:id=0,psize=1920x1080,pformat=yuv420,halbuf=1\n\
+     [HFR video] fpsrange 60 and up submits fps/30 requests per batch, hfrbatch=0 one by one\n\
+     >>A:id=0,psize=1280x720,pformat=yuv420,vsize=1280x720,fpsrange=240-240,hfrbatch=1\n\
+     [Pipeline] type:WxH:format[:divider[:dump+encoder+stats+export[:buffers]]] per stream\n\
+     >>A:id=0,pipeline=preview:1920x1080:yuv420:1:stats/video:3840x2160:yuv_ubwc:1:encoder/video:1280x720:yuv420:2:export/raw:4056x3040:raw10:0:dump\n\
   U: Update meta setting \n\
      >>U:manualaemode=1 \n\
   E: Update meta setting and take snapshot\n\
@@ -265,8 +273,13 @@ command in program: \n\
      >>P:2 \n\
   M: set Metadata dump tag \n\
      >>M:expvalue=1,scenemode=0 \n\
+     >>M:filepath=/data/misc/camera/meta.qlog binary log, qcamx-log-decode prints it \n\
+  F: print the Fps, interval and drop metrics of every stream \n\
+     >>F \n\
   W: wait for [N] seconds \n\
      >>W:10 \n\
+  log: set the log level off/err/info/dbg of every LOG_TAG, or of one, QCAMX_LOG_LEVEL too\n\
+     >>log:info,QCamxDevice=dbg \n\
   Q: Quit \n\
 ";
 extern char *optarg;
@@ -274,7 +287,7 @@ static bool parse_command_from_file = false;
 static ifstream s_file_stream;
 int parse_commandline(int argc, char *argv[]) {
     int c;
-    while ((c = getopt(argc, argv, "hf:")) != -1) {
+    while ((c = getopt(argc, argv, "hf:l:")) != -1) {
         QCAMX_PRINT("opt:%c\n", c);
         switch (c) {
             case 'h':
@@ -288,7 +301,11 @@ int parse_commandline(int argc, char *argv[]) {
                     return 1;
                 }
                 parse_command_from_file = true;
+                break;
             }
+            case 'l':
+                s_camera_hal_path = optarg;
+                break;
             default:
                 break;
         }
@@ -347,6 +364,12 @@ int main(int argc, char *argv[]) {
             sleep(second);
             continue;
         }
+        if (ops == "log") {
+            if (qcamx::set_log_levels(param.c_str()) != 0) {
+                QCAMX_PRINT("error log levels:%s\n", param.c_str());
+            }
+            continue;
+        }
 
         QCAMX_PRINT("Test camera:%s \n", order.c_str());
         switch (ops[0]) {
@@ -364,19 +387,10 @@ int main(int argc, char *argv[]) {
                 QCAMX_PRINT("add a camera :%d\n", current_camera_id);
 
                 switch (testConf->_test_mode) {
-                    case TESTMODE_PREVIEW: {
-                        testCase = new QCamxPreviewOnlyCase(s_camera_module, testConf);
-                        break;
-                    }
                     case TESTMODE_DEPTH: {
                         testCase = new QCamxHAL3TestDepth(s_camera_module, testConf);
                         break;
                     }
-                    case TESTMODE_VIDEO_ONLY: {
-                        QCAMX_PRINT("camera id %d TESTMODE_VIDEO_ONLY\n", current_camera_id);
-                        testCase = new QCamxVideoOnlyCase(s_camera_module, testConf);
-                        break;
-                    }
                     case TESTMODE_SNAPSHOT: {
                         testCase = new QCamxPreviewSnapshotCase(s_camera_module, testConf);
                         break;
@@ -385,8 +399,12 @@ int main(int argc, char *argv[]) {
                         testCase = new QCamxHAL3TestVideo(s_camera_module, testConf);
                         break;
                     }
-                    case TESTMODE_PREVIEW_VIDEO_ONLY: {
-                        testCase = new QCamxPreviewVideoCase(s_camera_module, testConf);
+                    // the streams of these come from QCamxConfig::build_pipeline_preset
+                    case TESTMODE_PREVIEW:
+                    case TESTMODE_VIDEO_ONLY:
+                    case TESTMODE_PREVIEW_VIDEO_ONLY:
+                    case TESTMODE_PIPELINE: {
+                        testCase = new QCamxPipelineCase(s_camera_module, testConf);
                         break;
                     }
                     default: {
@@ -414,8 +432,7 @@ int main(int argc, char *argv[]) {
                 QCAMX_PRINT("video request %s\n", param.c_str());
                 if (s_HAL3_test[current_camera_id]->_config->_test_mode == TESTMODE_PREVIEW) {
                     QCAMX_PRINT("video request in preview test mode\n");
-                    QCamxPreviewOnlyCase *testPreview =
-                        (QCamxPreviewOnlyCase *)s_HAL3_test[current_camera_id];
+                    QCamxCase *testPreview = s_HAL3_test[current_camera_id];
 
                     QCamxConfig *testConf = testPreview->_config;
                     result = testConf->parse_commandline_add(size, (char *)param.c_str());
@@ -542,6 +559,18 @@ int main(int argc, char *argv[]) {
                 }
                 break;
             }
+            case 'F': {
+                int RequestCameraId = current_camera_id;
+                if (ops.size() > 1) {
+                    RequestCameraId = atoi(&ops[1]);
+                }
+                if (!s_HAL3_test[RequestCameraId]) {
+                    QCAMX_PRINT("please Add camera before get its metrics\n");
+                    break;
+                }
+                s_HAL3_test[RequestCameraId]->report_stream_metrics();
+                break;
+            }
             case 'Q': {
                 QCAMX_PRINT("quit\n");
                 stop = true;
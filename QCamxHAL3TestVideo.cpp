@@ -54,30 +54,25 @@ void QCamxHAL3TestVideo::capture_post_process(DeviceCallback *cb, camera3_captur
     for (uint32_t i = 0; i < result->num_output_buffers; i++) {
         int index = _device->find_stream_index(buffers[i].stream);
         CameraStream *stream = _device->_camera_streams[index];
-        BufferInfo *info = stream->buffer_manager->get_buffer_info(buffers[i].buffer);
 
         if (stream->stream_id == RAW_SNAPSHOT_IDX) {
-            if (_callbacks && _callbacks->snapshot_cb) {
-                _callbacks->snapshot_cb(info, result->frame_number);
-            }
+            publish_frame(stream, buffers[i].buffer, result->frame_number, RAW_SNAPSHOT_TYPE);
             //QCamxHAL3TestCase::DumpFrame(info, result->frame_number, SNAPSHOT_TYPE, mConfig->mSnapshotStream.subformat);
             stream->buffer_manager->return_buffer(buffers[i].buffer);
+            update_stream_metrics(RAW_SNAPSHOT_TYPE, result->frame_number);
         } else if (stream->stream_id == SNAPSHOT_INDEX) {
-            if (_callbacks && _callbacks->snapshot_cb) {
-                _callbacks->snapshot_cb(info, result->frame_number);
-            }
-            QCamxCase::dump_frame(info, result->frame_number, SNAPSHOT_TYPE,
-                                  _config->_snapshot_stream.subformat);
+            publish_frame(stream, buffers[i].buffer, result->frame_number, SNAPSHOT_TYPE);
+            dump_frame_async(stream, buffers[i].buffer, result->frame_number, SNAPSHOT_TYPE,
+                             _config->_snapshot_stream.subformat);
             stream->buffer_manager->return_buffer(buffers[i].buffer);
+            update_stream_metrics(SNAPSHOT_TYPE, result->frame_number);
         } else if (stream->stream_id == VIDEO_INDEX) {
-            if (_callbacks && _callbacks->video_cb) {
-                _callbacks->video_cb(info, result->frame_number);
-            }
+            publish_frame(stream, buffers[i].buffer, result->frame_number, VIDEO_TYPE);
             if (_dump_video_num > 0 &&
                 (_dump_interval == 0 ||
                  (_dump_interval > 0 && result->frame_number % _dump_interval == 0))) {
-                QCamxCase::dump_frame(info, result->frame_number, VIDEO_TYPE,
-                                      _config->_video_stream.subformat);
+                dump_frame_async(stream, buffers[i].buffer, result->frame_number, VIDEO_TYPE,
+                                 _config->_video_stream.subformat);
                 if (_dump_interval == 0) {
                     _dump_video_num--;
                 }
@@ -87,27 +82,21 @@ void QCamxHAL3TestVideo::capture_post_process(DeviceCallback *cb, camera3_captur
             } else {
                 EnqueueFrameBuffer(stream, buffers[i].buffer);
             }
-            if (_config->_show_fps) {
-                show_fps(VIDEO_TYPE);
-            }
+            update_stream_metrics(VIDEO_TYPE, result->frame_number);
         } else if (stream->stream_id == PREVIEW_INDEX) {
-            if (_callbacks != NULL && _callbacks->preview_cb != NULL) {
-                _callbacks->preview_cb(info, result->frame_number);
-            }
+            publish_frame(stream, buffers[i].buffer, result->frame_number, PREVIEW_TYPE);
             if (_dump_preview_num > 0 &&
                 (_dump_interval == 0 ||
                  (_dump_interval > 0 && result->frame_number % _dump_interval == 0))) {
-                QCamxCase::dump_frame(info, result->frame_number, PREVIEW_TYPE,
-                                      _config->_preview_stream.subformat);
+                dump_frame_async(stream, buffers[i].buffer, result->frame_number, PREVIEW_TYPE,
+                                 _config->_preview_stream.subformat);
                 if (_dump_interval == 0) {
                     _dump_preview_num--;
                 }
             }
             stream->buffer_manager->return_buffer(buffers[i].buffer);
 
-            if (_config->_show_fps) {
-                show_fps(PREVIEW_TYPE);
-            }
+            update_stream_metrics(PREVIEW_TYPE, result->frame_number);
         }
     }
 }
@@ -117,20 +106,13 @@ void QCamxHAL3TestVideo::capture_post_process(DeviceCallback *cb, camera3_captur
 * function: analysis meta info from capture result.
 *************************************************************************/
 void QCamxHAL3TestVideo::handle_metadata(DeviceCallback *cb, camera3_capture_result *result) {
-    android::sp<android::VendorTagDescriptor> vTags =
-        android::VendorTagDescriptor::getGlobalVendorTagDescriptor();
-
     if (result->partial_result >= 1) {
+        scan_metadata(result);
         if ((_config->_meta_dump.SatCamId) >= 0) {
-            camera_metadata_ro_entry entry;
             int camid = 0;
-            int res = 0;
-            uint32_t cam_tag = 0;
-            android::CameraMetadata::getTagFromName("org.quic.camera2.sensormode.info.SATCameraId",
-                                                    vTags.get(), &cam_tag);
-            res = find_camera_metadata_ro_entry(result->result, cam_tag, &entry);
-            if ((0 == res) && (entry.count > 0)) {
-                camid = entry.data.i32[0];
+            int id = _watch_ids[META_WATCH_SAT_CAMERA_ID];
+            if (_metadata_watch.found(id)) {
+                camid = _metadata_watch.get<int32_t>(id, 0, 0);
                 QCAMX_INFO("3 Streams: frame_number: %d, SAT CameraId: %d\n", result->frame_number,
                            camid);
                 _config->_meta_stat.camId = camid;
@@ -138,17 +120,12 @@ void QCamxHAL3TestVideo::handle_metadata(DeviceCallback *cb, camera3_capture_res
         }
 
         if (_config->_meta_dump.SATActiveArray) {
-            camera_metadata_ro_entry entry;
             int activearray[4] = {0};
-            int res = 0;
             int str = 0, str1 = 0;
-            uint32_t active_tag = 0;
-            android::CameraMetadata::getTagFromName(
-                "org.quic.camera2.sensormode.info.SATActiveSensorArray", vTags.get(), &active_tag);
-            res = find_camera_metadata_ro_entry(result->result, active_tag, &entry);
-            if ((0 == res) && (entry.count > 0)) {
+            int id = _watch_ids[META_WATCH_SAT_ACTIVE_ARRAY];
+            if (_metadata_watch.found(id)) {
                 for (str = 0; str < 4; str++) {
-                    activearray[str] = entry.data.i32[str];
+                    activearray[str] = _metadata_watch.get<int32_t>(id, str, 0);
                 }
             }
             if (str == 4) {
@@ -162,17 +139,12 @@ void QCamxHAL3TestVideo::handle_metadata(DeviceCallback *cb, camera3_capture_res
         }
 
         if (_config->_meta_dump.SATCropRegion) {
-            camera_metadata_ro_entry entry;
             int cropregion[4] = {0};
-            int res = 0;
             int str = 0, str1 = 0;
-            uint32_t crop_tag = 0;
-            android::CameraMetadata::getTagFromName(
-                "org.quic.camera2.sensormode.info.SATScalerCropRegion", vTags.get(), &crop_tag);
-            res = find_camera_metadata_ro_entry(result->result, crop_tag, &entry);
-            if ((0 == res) && (entry.count > 0)) {
+            int id = _watch_ids[META_WATCH_SAT_CROP_REGION];
+            if (_metadata_watch.found(id)) {
                 for (str = 0; str < 4; str++) {
-                    cropregion[str] = entry.data.i32[str];
+                    cropregion[str] = _metadata_watch.get<int32_t>(id, str, 0);
                 }
             }
             if (str == 4) {
@@ -189,19 +161,14 @@ void QCamxHAL3TestVideo::handle_metadata(DeviceCallback *cb, camera3_capture_res
     // MasterRawSize metadata just be in final total meta
     if (result->partial_result > 1) {
         if (_config->_meta_dump.rawsize) {
-            camera_metadata_ro_entry entry;
-            int res = 0;
             int width = 0;
             int height = 0;
-            uint32_t raw_tag = 0;
-            android::CameraMetadata::getTagFromName("com.qti.chi.multicamerainfo.MasterRawSize",
-                                                    vTags.get(), &raw_tag);
-            res = find_camera_metadata_ro_entry(result->result, raw_tag, &entry);
-            if ((0 == res) && (entry.count > 0)) {
-                width = entry.data.i32[0];
-                height = entry.data.i32[1];
-                QCAMX_INFO("frame_number: %d, multicamerainfo MasterRawSize:%dx%d, res:%d",
-                           result->frame_number, width, height, res);
+            int id = _watch_ids[META_WATCH_RAW_SIZE];
+            if (_metadata_watch.found(id)) {
+                width = _metadata_watch.get<int32_t>(id, 0, 0);
+                height = _metadata_watch.get<int32_t>(id, 1, 0);
+                QCAMX_INFO("frame_number: %d, multicamerainfo MasterRawSize:%dx%d",
+                           result->frame_number, width, height);
             }
         }
     }
@@ -226,6 +193,11 @@ void QCamxHAL3TestVideo::selectOpMode(uint32_t *operation_mode, int width, int h
     if ((res == 0) && (entry.count > 0)) {
         sensorModeTable = entry.data.i32;
     }
+    if (sensorModeTable == NULL) {
+        // HAL without the sensor mode vendor tag (e.g. the mock HAL), keep the operation mode
+        QCAMX_INFO("no sensor mode table, operation mode %u unchanged\n", *operation_mode);
+        return;
+    }
 
     int modeCount = sensorModeTable[0];
     int modeSize = sensorModeTable[1];
@@ -620,7 +592,6 @@ void QCamxHAL3TestVideo::stop() {
 ************************************************************************/
 void QCamxHAL3TestVideo::request_capture(StreamCapture request) {
     // send a message to request thread
-    pthread_mutex_lock(&_device->_request_thread->mutex);
     CameraRequestMsg *msg = new CameraRequestMsg();
     memset(msg, 0, sizeof(CameraRequestMsg));
     msg->request_number[SNAPSHOT_INDEX] = request.count;
@@ -630,10 +601,8 @@ void QCamxHAL3TestVideo::request_capture(StreamCapture request) {
         msg->mask |= 1 << RAW_SNAPSHOT_IDX;
     }
     msg->message_type = REQUEST_CHANGE;
-    _device->_request_thread->message_queue.push_back(msg);
     // QCAMX_INFO("Msg for capture picture mask %x \n", msg->mask);
-    pthread_cond_signal(&_device->_request_thread->cond);
-    pthread_mutex_unlock(&_device->_request_thread->mutex);
+    _device->post_request_message(msg);
 }
 
 /************************************************************************
@@ -0,0 +1,280 @@
+/**
+ * @file  qcamx_alloc_check.cpp
+ * @brief stream the preview preset of QCamxPipelineCase and fail if the result path allocates in
+ *        steady state, from ProcessCaptureResult on the HAL callback thread through the result
+ *        ring to capture_post_process on the result thread, publish_frame and the subscribers
+*/
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "qcamx_config.h"
+#include "qcamx_log.h"
+#include "qcamx_pipeline_case.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxAllocCheck"
+
+#define ALLOC_CHECK_STALL_SEC (5)  // no frame for this long fails the check
+
+static const char usage[] = "\
+usage: qcamx-alloc-check [-l camera_hal.so] [-w frames] [-n frames] [-s WxH] \n\
+  -l: camera module, default /usr/lib/hw/camera.qcom.so \n\
+  -w: warm up frames not measured, the HAL fills its pools lazily, default 128 \n\
+  -n: frames measured after the warm up, default 300 \n\
+  -s: preview size, default 1920x1080 \n\
+  -l /usr/lib/hw/camera.mock.so runs without a sensor, see QCAMX_MOCK_* of the mock HAL \n\
+";
+
+/*************************allocation counter*****************************/
+
+// glibc entry points, the wrappers below replace malloc for the whole process
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+static std::atomic<uint64_t> s_allocations(0);
+static std::atomic<uint64_t> s_allocated_bytes(0);
+// set on the threads of the result path, initial exec TLS that never allocates itself
+static thread_local bool t_count_allocations = false;
+
+static inline void count_allocation(size_t size) {
+    if (t_count_allocations) {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+        s_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+// operator new of libstdc++ calls malloc, so these count the new expressions too
+extern "C" void *malloc(size_t size) {
+    count_allocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    count_allocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    count_allocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size) {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size) {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    count_allocation(size);
+    void *memory = __libc_memalign(alignment, size);
+    if (memory == NULL) {
+        return ENOMEM;
+    }
+    *ptr = memory;
+    return 0;
+}
+
+/*************************preview case*****************************/
+
+class QCamxAllocCheck : public QCamxPipelineCase {
+public:
+    QCamxAllocCheck(camera_module_t *module, QCamxConfig *config)
+        : QCamxPipelineCase(module, config), _frames(0), _published(0), _queued(0) {}
+    /**
+     * @brief result thread, publishes the preview buffers to the subscribers below
+    */
+    void capture_post_process(DeviceCallback *callback, camera3_capture_result *result) override {
+        t_count_allocations = true;
+        QCamxPipelineCase::capture_post_process(callback, result);
+        _frames.fetch_add(1, std::memory_order_relaxed);
+    }
+    /**
+     * @brief HAL callback thread, called by ProcessCaptureResult for every metadata result
+    */
+    void handle_metadata(DeviceCallback *callback, camera3_capture_result *result) override {
+        t_count_allocations = true;
+        QCamxPipelineCase::handle_metadata(callback, result);
+    }
+    /**
+     * @brief one subscriber called on the result thread and one with a thread of its own
+    */
+    bool subscribe() {
+        return subscribe_frames(PREVIEW_TYPE, on_published_frame, this, 0) >= 0 &&
+               subscribe_frames(PREVIEW_TYPE, on_queued_frame, this, 4) >= 0;
+    }
+    uint64_t get_frames() { return _frames.load(std::memory_order_relaxed); }
+    uint64_t get_published() { return _published.load(std::memory_order_relaxed); }
+    uint64_t get_queued() { return _queued.load(std::memory_order_relaxed); }
+    /**
+     * @brief wait until frames went through capture_post_process
+     * @return 0, -1 if the stream stalled
+    */
+    int wait_frames(uint64_t frames) {
+        uint64_t last = get_frames();
+        time_t last_progress = time(NULL);
+        while (get_frames() < frames) {
+            usleep(1000);
+            if (get_frames() != last) {
+                last = get_frames();
+                last_progress = time(NULL);
+            } else if (time(NULL) - last_progress > ALLOC_CHECK_STALL_SEC) {
+                QCAMX_PRINT("no frame for %ds after frame %" PRIu64 "\n", ALLOC_CHECK_STALL_SEC,
+                            last);
+                return -1;
+            }
+        }
+        return 0;
+    }
+private:
+    static void on_published_frame(QCamxFrame *frame, void *user_data) {
+        QCamxAllocCheck *check = (QCamxAllocCheck *)user_data;
+        check->_published.fetch_add(1, std::memory_order_relaxed);
+    }
+    /**
+     * @brief subscriber thread, holds the frame past the callback as a consumer would
+    */
+    static void on_queued_frame(QCamxFrame *frame, void *user_data) {
+        QCamxAllocCheck *check = (QCamxAllocCheck *)user_data;
+        t_count_allocations = true;
+        frame->acquire();
+        check->_queued.fetch_add(1, std::memory_order_relaxed);
+        frame->release();
+    }
+private:
+    std::atomic<uint64_t> _frames;
+    std::atomic<uint64_t> _published;
+    std::atomic<uint64_t> _queued;
+};
+
+static camera_module_t *load_camera_module(const char *path) {
+    void *handle = dlopen(path, RTLD_NOW);
+    if (handle == NULL) {
+        const char *err_str = dlerror();
+        QCAMX_PRINT("load module %s failed %s\n", path, err_str != NULL ? err_str : "unknown");
+        return NULL;
+    }
+    camera_module_t *camera_module = (camera_module_t *)dlsym(handle, HAL_MODULE_INFO_SYM_AS_STR);
+    if (camera_module == NULL) {
+        QCAMX_PRINT("couldn't find symbol %s\n", HAL_MODULE_INFO_SYM_AS_STR);
+        dlclose(handle);
+        return NULL;
+    }
+    camera_module->common.dso = handle;
+    if (camera_module->init != NULL && camera_module->init() != 0) {
+        QCAMX_PRINT("camera module init failed\n");
+        dlclose(handle);
+        return NULL;
+    }
+    return camera_module;
+}
+
+int main(int argc, char *argv[]) {
+    const char *hal_path = "/usr/lib/hw/camera.qcom.so";
+    // the HAL may fill its per request state on the first use of each slot
+    int warmup_frames = 128;
+    int frames = 300;
+    int width = 1920;
+    int height = 1080;
+    int c;
+    while ((c = getopt(argc, argv, "hl:w:n:s:")) != -1) {
+        switch (c) {
+            case 'l':
+                hal_path = optarg;
+                break;
+            case 'w':
+                warmup_frames = atoi(optarg);
+                break;
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            case 's':
+                if (sscanf(optarg, "%dx%d", &width, &height) != 2) {
+                    width = 0;
+                }
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    if (warmup_frames < 0 || frames <= 0 || width <= 0 || height <= 0) {
+        printf("%s", usage);
+        return 1;
+    }
+
+    camera_module_t *camera_module = load_camera_module(hal_path);
+    if (camera_module == NULL) {
+        return 1;
+    }
+    QCamxConfig config;
+    config._camera_id = 0;
+    config._preview_stream.width = width;
+    config._preview_stream.height = height;
+    config._preview_stream.format = HAL_PIXEL_FORMAT_YCBCR_420_888;
+    config._test_mode = TESTMODE_PREVIEW;
+    config.build_pipeline_preset();
+
+    QCamxAllocCheck *check = new QCamxAllocCheck(camera_module, &config);
+    check->pre_init_stream();
+    if (!check->open_camera()) {
+        delete check;
+        return 1;
+    }
+    if (!check->subscribe()) {
+        check->close_camera();
+        delete check;
+        return 1;
+    }
+    check->run();
+
+    int res = check->wait_frames(warmup_frames);
+    uint64_t allocations = s_allocations.load();
+    uint64_t allocated_bytes = s_allocated_bytes.load();
+    uint64_t first_frame = check->get_frames();
+    if (res == 0) {
+        res = check->wait_frames(first_frame + frames);
+    }
+    allocations = s_allocations.load() - allocations;
+    allocated_bytes = s_allocated_bytes.load() - allocated_bytes;
+    uint64_t measured_frames = check->get_frames() - first_frame;
+
+    check->stop();
+    uint64_t published = check->get_published();
+    uint64_t queued = check->get_queued();
+    check->close_camera();
+    delete check;
+
+    if (res != 0) {
+        return 1;
+    }
+    QCAMX_PRINT("result path: %" PRIu64 " allocations %" PRIu64 " bytes in %" PRIu64
+                " frames after %d warm up frames\n",
+                allocations, allocated_bytes, measured_frames, warmup_frames);
+    QCAMX_PRINT("frame hub: %" PRIu64 " frames to the inline subscriber %" PRIu64
+                " to the queued one\n",
+                published, queued);
+    // no frame to a subscriber means the hub path was not measured
+    return allocations == 0 && published > 0 && queued > 0 ? 0 : 1;
+}
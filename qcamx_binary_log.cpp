@@ -0,0 +1,473 @@
+/**
+ * @file  qcamx_binary_log.cpp
+ * @brief asynchronous binary log backend implementation
+*/
+
+#include "qcamx_binary_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace qcamx {
+
+#define BINARY_LOG_ALIGN(size) (((size) + 7) & ~(size_t)7)
+#define BINARY_LOG_RING_MASK (BINARY_LOG_RING_SIZE - 1)
+
+static int64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*************************public method*****************************/
+
+QCamxBinaryLog *QCamxBinaryLog::get_instance() {
+    static QCamxBinaryLog s_instance;
+    return &s_instance;
+}
+
+int QCamxBinaryLog::register_sink(QCamxBinaryLogSink *sink) {
+    int id = -1;
+    pthread_mutex_lock(&_sink_lock);
+    for (int i = 0; i < BINARY_LOG_SINK_MAX && id < 0; i++) {
+        if (_sinks[i] == NULL) {
+            _sinks[i] = sink;
+            id = i;
+        }
+    }
+    pthread_mutex_unlock(&_sink_lock);
+
+    pthread_mutex_lock(&_lock);
+    if (id >= 0 && !_running) {
+        _running = pthread_create(&_thread, NULL, writer_thread, this) == 0;
+    }
+    pthread_mutex_unlock(&_lock);
+    return id;
+}
+
+void QCamxBinaryLog::unregister_sink(int sink) {
+    if (sink < 0 || sink >= BINARY_LOG_SINK_MAX) {
+        return;
+    }
+    flush();
+    pthread_mutex_lock(&_sink_lock);
+    _sinks[sink] = NULL;
+    pthread_mutex_unlock(&_sink_lock);
+}
+
+int QCamxBinaryLog::write(int sink, const char *format, const BinaryLogArg *args,
+                          int arg_count) {
+    int format_id = get_format_id(format);
+    if (sink < 0 || format_id < 0 || arg_count > BINARY_LOG_ARG_MAX) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+
+    // the types, then 8 bytes per argument and the bytes of the strings
+    size_t string_length[BINARY_LOG_ARG_MAX];
+    size_t size = sizeof(BinaryLogRecord) + BINARY_LOG_ALIGN(arg_count);
+    for (int i = 0; i < arg_count; i++) {
+        size += sizeof(int64_t);
+        if (args[i].type == BINARY_LOG_ARG_STRING) {
+            size_t length = args[i].s != NULL ? strnlen(args[i].s, BINARY_LOG_STRING_MAX) : 0;
+            string_length[i] = length;
+            size += BINARY_LOG_ALIGN(length + 1);
+        }
+    }
+
+    ThreadRing *ring = get_thread_ring();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    size_t offset = head & BINARY_LOG_RING_MASK;
+    size_t contiguous = BINARY_LOG_RING_SIZE - offset;
+    size_t needed = contiguous < size ? contiguous + size : size;
+    if (head + needed - tail > BINARY_LOG_RING_SIZE) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+    if (contiguous < size) {
+        // a record never wraps, the end of the ring is skipped
+        if (contiguous >= sizeof(BinaryLogRecord)) {
+            BinaryLogRecord *padding = (BinaryLogRecord *)(ring->buffer + offset);
+            padding->size = (uint16_t)contiguous;
+            padding->kind = BINARY_LOG_PADDING;
+        }
+        head += contiguous;
+        offset = 0;
+    }
+
+    BinaryLogRecord *record = (BinaryLogRecord *)(ring->buffer + offset);
+    record->size = (uint16_t)size;
+    record->kind = BINARY_LOG_MESSAGE;
+    record->arg_count = (uint8_t)arg_count;
+    record->sink = (uint16_t)sink;
+    record->format_id = (uint16_t)format_id;
+    record->timestamp = monotonic_ns();
+    uint8_t *types = (uint8_t *)(record + 1);
+    uint8_t *value = types + BINARY_LOG_ALIGN(arg_count);
+    for (int i = 0; i < arg_count; i++) {
+        types[i] = args[i].type;
+        if (args[i].type == BINARY_LOG_ARG_STRING) {
+            uint64_t length = string_length[i];
+            memcpy(value, &length, sizeof(length));
+            value += sizeof(length);
+            if (length > 0) {
+                memcpy(value, args[i].s, length);
+            }
+            value[length] = '\0';
+            value += BINARY_LOG_ALIGN(length + 1);
+        } else {
+            memcpy(value, &args[i].i, sizeof(int64_t));
+            value += sizeof(int64_t);
+        }
+    }
+    ring->head.store(head + size, std::memory_order_release);
+    return 0;
+}
+
+void QCamxBinaryLog::flush() {
+    pthread_mutex_lock(&_lock);
+    uint64_t target = ++_flush_requests;
+    pthread_cond_signal(&_cond);
+    while (_running && _flush_done < target) {
+        pthread_cond_wait(&_flush_cond, &_lock);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+/*************************private method*****************************/
+
+QCamxBinaryLog::QCamxBinaryLog() {
+    for (int i = 0; i < BINARY_LOG_FORMAT_MAX; i++) {
+        _formats[i].store(NULL, std::memory_order_relaxed);
+    }
+    _dropped = 0;
+    pthread_mutex_init(&_ring_lock, NULL);
+    _rings = NULL;
+    pthread_mutex_init(&_sink_lock, NULL);
+    memset(_sinks, 0, sizeof(_sinks));
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, NULL);
+    pthread_cond_init(&_flush_cond, NULL);
+    _flush_requests = 0;
+    _flush_done = 0;
+    _stop = false;
+    _running = false;
+}
+
+QCamxBinaryLog::~QCamxBinaryLog() {
+    pthread_mutex_lock(&_lock);
+    bool running = _running;
+    _stop = true;
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+    if (running) {
+        pthread_join(_thread, NULL);
+    }
+    // the rings of the threads still alive at exit are left to the process
+}
+
+QCamxBinaryLog::ThreadRingHolder::~ThreadRingHolder() {
+    if (ring != nullptr) {
+        ring->closed.store(true, std::memory_order_release);
+    }
+}
+
+QCamxBinaryLog::ThreadRing *QCamxBinaryLog::get_thread_ring() {
+    static thread_local ThreadRingHolder holder;
+    if (holder.ring != nullptr) {
+        return holder.ring;
+    }
+    ThreadRing *ring = new ThreadRing();
+    ring->buffer = (uint8_t *)malloc(BINARY_LOG_RING_SIZE);
+    ring->head = 0;
+    ring->tail = 0;
+    ring->closed = false;
+    pthread_mutex_lock(&_ring_lock);
+    ring->next = _rings;
+    _rings = ring;
+    pthread_mutex_unlock(&_ring_lock);
+    holder.ring = ring;
+    return ring;
+}
+
+int QCamxBinaryLog::get_format_id(const char *format) {
+    // open addressing on the address of the format, a literal is found on its first probe
+    size_t hash = ((uintptr_t)format >> 3) * 0x9E3779B97F4A7C15ULL;
+    for (int probe = 0; probe < BINARY_LOG_FORMAT_MAX; probe++) {
+        int id = (int)((hash + probe) % BINARY_LOG_FORMAT_MAX);
+        const char *slot = _formats[id].load(std::memory_order_acquire);
+        if (slot == format) {
+            return id;
+        }
+        if (slot == NULL) {
+            const char *expected = NULL;
+            if (_formats[id].compare_exchange_strong(expected, format,
+                                                     std::memory_order_acq_rel) ||
+                expected == format) {
+                return id;
+            }
+        }
+    }
+    return -1;
+}
+
+void QCamxBinaryLog::drain() {
+    struct Cursor {
+        ThreadRing *ring;
+        uint64_t tail;
+        uint64_t head;
+    };
+    Cursor cursors[64];
+    int count = 0;
+
+    pthread_mutex_lock(&_ring_lock);
+    // drop the rings of the exited threads once they are drained
+    ThreadRing **link = &_rings;
+    while (*link != NULL) {
+        ThreadRing *ring = *link;
+        if (ring->closed.load(std::memory_order_acquire) &&
+            ring->tail.load(std::memory_order_relaxed) ==
+                ring->head.load(std::memory_order_acquire)) {
+            *link = ring->next;
+            free(ring->buffer);
+            delete ring;
+            continue;
+        }
+        link = &ring->next;
+    }
+    ThreadRing *next_ring = _rings;
+    pthread_mutex_unlock(&_ring_lock);
+
+    pthread_mutex_lock(&_sink_lock);
+    // more rings than cursors are drained in several rounds
+    while (next_ring != NULL) {
+        count = 0;
+        for (; next_ring != NULL && count < 64; next_ring = next_ring->next) {
+            cursors[count].ring = next_ring;
+            cursors[count].tail = next_ring->tail.load(std::memory_order_relaxed);
+            cursors[count].head = next_ring->head.load(std::memory_order_acquire);
+            count++;
+        }
+        while (true) {
+            // the oldest record of all the rings goes first
+            BinaryLogRecord *oldest = NULL;
+            int oldest_index = -1;
+            for (int i = 0; i < count; i++) {
+                Cursor *cursor = &cursors[i];
+                while (cursor->tail < cursor->head) {
+                    size_t offset = cursor->tail & BINARY_LOG_RING_MASK;
+                    size_t contiguous = BINARY_LOG_RING_SIZE - offset;
+                    BinaryLogRecord *record = (BinaryLogRecord *)(cursor->ring->buffer + offset);
+                    if (contiguous < sizeof(BinaryLogRecord) ||
+                        record->kind == BINARY_LOG_PADDING) {
+                        cursor->tail += contiguous;
+                        continue;
+                    }
+                    if (oldest == NULL || record->timestamp < oldest->timestamp) {
+                        oldest = record;
+                        oldest_index = i;
+                    }
+                    break;
+                }
+            }
+            if (oldest == NULL) {
+                break;
+            }
+            QCamxBinaryLogSink *sink = _sinks[oldest->sink];
+            const char *format = _formats[oldest->format_id].load(std::memory_order_acquire);
+            if (sink != NULL) {
+                sink->write_record(oldest, format);
+            }
+            cursors[oldest_index].tail += oldest->size;
+        }
+        for (int i = 0; i < count; i++) {
+            cursors[i].ring->tail.store(cursors[i].tail, std::memory_order_release);
+        }
+    }
+    for (int i = 0; i < BINARY_LOG_SINK_MAX; i++) {
+        if (_sinks[i] != NULL) {
+            _sinks[i]->flush_batch();
+        }
+    }
+    pthread_mutex_unlock(&_sink_lock);
+}
+
+void *QCamxBinaryLog::writer_thread(void *data) {
+    QCamxBinaryLog *log = (QCamxBinaryLog *)data;
+    pthread_mutex_lock(&log->_lock);
+    while (true) {
+        bool stop = log->_stop;
+        uint64_t requests = log->_flush_requests;
+        pthread_mutex_unlock(&log->_lock);
+        log->drain();
+        pthread_mutex_lock(&log->_lock);
+        log->_flush_done = requests;
+        pthread_cond_broadcast(&log->_flush_cond);
+        if (stop) {
+            break;
+        }
+        if (log->_flush_requests == requests && !log->_stop) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += BINARY_LOG_WRITER_PERIOD_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&log->_cond, &log->_lock, &deadline);
+        }
+    }
+    log->_running = false;
+    pthread_cond_broadcast(&log->_flush_cond);
+    pthread_mutex_unlock(&log->_lock);
+    return NULL;
+}
+
+/**
+ * @brief next argument of a record, its type is BINARY_LOG_ARG_NONE past the last one
+ */
+static BinaryLogArg next_binary_log_arg(const BinaryLogRecord *record, int *index,
+                                        const uint8_t **value) {
+    BinaryLogArg arg;
+    if (*index >= record->arg_count) {
+        return arg;
+    }
+    const uint8_t *types = (const uint8_t *)(record + 1);
+    arg.type = types[*index];
+    (*index)++;
+    if (arg.type == BINARY_LOG_ARG_STRING) {
+        uint64_t length = 0;
+        memcpy(&length, *value, sizeof(length));
+        arg.s = (const char *)(*value + sizeof(length));
+        *value += sizeof(length) + BINARY_LOG_ALIGN(length + 1);
+    } else {
+        memcpy(&arg.i, *value, sizeof(arg.i));
+        *value += sizeof(int64_t);
+    }
+    return arg;
+}
+
+int format_binary_log_message(const BinaryLogRecord *record, const char *format, char *message,
+                              size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    size_t length = 0;
+    int index = 0;
+    const uint8_t *value =
+        (const uint8_t *)(record + 1) + BINARY_LOG_ALIGN(record->arg_count);
+    const char *p = format != NULL ? format : "";
+    char piece[BINARY_LOG_MESSAGE_LENGTH];
+    while (*p != '\0' && length < size - 1) {
+        if (*p != '%') {
+            message[length++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            message[length++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // one conversion: flags, width, precision and length modifier then the conversion
+        char spec[32];
+        size_t spec_length = 0;
+        spec[spec_length++] = *p++;
+        int star_values[2];
+        int stars = 0;
+        while (*p != '\0' && strchr("-+ #0'", *p) != NULL && spec_length < 16) {
+            spec[spec_length++] = *p++;
+        }
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*p != '.') {
+                    break;
+                }
+                spec[spec_length++] = *p++;
+            }
+            if (*p == '*') {
+                BinaryLogArg star = next_binary_log_arg(record, &index, &value);
+                star_values[stars++] = (int)star.i;
+                spec[spec_length++] = *p++;
+            }
+            while (*p >= '0' && *p <= '9' && spec_length < 24) {
+                spec[spec_length++] = *p++;
+            }
+        }
+        int shorten = 0;  // 1 for h, 2 for hh
+        while (*p != '\0' && strchr("hljztLq", *p) != NULL) {
+            shorten += *p == 'h' ? 1 : 0;
+            p++;
+        }
+        char conversion = *p;
+        if (conversion == '\0') {
+            break;
+        }
+        p++;
+
+        BinaryLogArg arg;
+        if (conversion != 'n') {
+            arg = next_binary_log_arg(record, &index, &value);
+        }
+        int written = -1;
+        bool is_int = arg.type == BINARY_LOG_ARG_INT32 || arg.type == BINARY_LOG_ARG_INT64;
+        if (strchr("di", conversion) != NULL && is_int) {
+            long long number = arg.type == BINARY_LOG_ARG_INT32 ? (int32_t)arg.i : arg.i;
+            number = shorten == 2 ? (signed char)number : shorten == 1 ? (short)number : number;
+            memcpy(spec + spec_length, "lld", 4);
+            written = stars == 2   ? snprintf(piece, sizeof(piece), spec, star_values[0],
+                                              star_values[1], number)
+                      : stars == 1 ? snprintf(piece, sizeof(piece), spec, star_values[0], number)
+                                   : snprintf(piece, sizeof(piece), spec, number);
+        } else if (strchr("uoxX", conversion) != NULL && is_int) {
+            unsigned long long number =
+                arg.type == BINARY_LOG_ARG_INT32 ? (uint32_t)arg.i : (uint64_t)arg.i;
+            number = shorten == 2   ? (unsigned char)number
+                     : shorten == 1 ? (unsigned short)number
+                                    : number;
+            spec[spec_length] = 'l';
+            spec[spec_length + 1] = 'l';
+            spec[spec_length + 2] = conversion;
+            spec[spec_length + 3] = '\0';
+            written = stars == 2   ? snprintf(piece, sizeof(piece), spec, star_values[0],
+                                              star_values[1], number)
+                      : stars == 1 ? snprintf(piece, sizeof(piece), spec, star_values[0], number)
+                                   : snprintf(piece, sizeof(piece), spec, number);
+        } else if (conversion == 'c' && is_int) {
+            memcpy(spec + spec_length, "c", 2);
+            written = stars == 1 ? snprintf(piece, sizeof(piece), spec, star_values[0], (int)arg.i)
+                                 : snprintf(piece, sizeof(piece), spec, (int)arg.i);
+        } else if (strchr("fFeEgGaA", conversion) != NULL && arg.type == BINARY_LOG_ARG_DOUBLE) {
+            spec[spec_length] = conversion;
+            spec[spec_length + 1] = '\0';
+            written = stars == 2   ? snprintf(piece, sizeof(piece), spec, star_values[0],
+                                              star_values[1], arg.d)
+                      : stars == 1 ? snprintf(piece, sizeof(piece), spec, star_values[0], arg.d)
+                                   : snprintf(piece, sizeof(piece), spec, arg.d);
+        } else if (conversion == 's' && arg.type == BINARY_LOG_ARG_STRING) {
+            memcpy(spec + spec_length, "s", 2);
+            written = stars == 2   ? snprintf(piece, sizeof(piece), spec, star_values[0],
+                                              star_values[1], arg.s)
+                      : stars == 1 ? snprintf(piece, sizeof(piece), spec, star_values[0], arg.s)
+                                   : snprintf(piece, sizeof(piece), spec, arg.s);
+        } else if (conversion == 'p' && arg.type != BINARY_LOG_ARG_NONE) {
+            memcpy(spec + spec_length, "p", 2);
+            written = snprintf(piece, sizeof(piece), spec, (void *)(uintptr_t)arg.i);
+        } else if (conversion == 'n') {
+            continue;
+        } else {
+            // the argument does not match its conversion
+            written = snprintf(piece, sizeof(piece), "<?>");
+        }
+        for (int i = 0; i < written && i < (int)sizeof(piece) - 1 && length < size - 1; i++) {
+            message[length++] = piece[i];
+        }
+    }
+    message[length] = '\0';
+    return (int)length;
+}
+
+}  // namespace qcamx
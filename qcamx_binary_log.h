@@ -0,0 +1,176 @@
+/**
+ * @file  qcamx_binary_log.h
+ * @brief asynchronous binary log backend of QCamxLog
+ *        a log call copies its format id, a timestamp and its raw arguments into a lock free ring
+ *        of the calling thread, a background thread formats the records of all rings in batches
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <type_traits>
+
+namespace qcamx {
+
+#define BINARY_LOG_RING_SIZE (64 * 1024)   // bytes of the ring of a thread, a power of 2
+#define BINARY_LOG_FORMAT_MAX (1024)       // distinct format strings
+#define BINARY_LOG_SINK_MAX (32)
+#define BINARY_LOG_ARG_MAX (16)
+#define BINARY_LOG_STRING_MAX (255)        // longer string arguments are truncated
+#define BINARY_LOG_MESSAGE_LENGTH (256)    // formatted message, longer ones are truncated
+#define BINARY_LOG_WRITER_PERIOD_MS (5)    // the writer thread polls, a log call never wakes it
+#define BINARY_LOG_BATCH_SIZE (16 * 1024)  // text a sink buffers before writing it
+#define BINARY_LOG_FILE_MAGIC "QCXLOG1"    // first 8 bytes of a .qlog file
+
+typedef enum {
+    BINARY_LOG_MESSAGE = 0,  ///< a log call, the argument types then the argument values
+    BINARY_LOG_FORMAT,       ///< .qlog file only, the format string of format_id
+    BINARY_LOG_TAG,          ///< .qlog file only, the tag of the messages after it
+    BINARY_LOG_PADDING,      ///< ring only, skip to the start of the ring
+} BinaryLogRecordKind;
+
+typedef enum {
+    BINARY_LOG_ARG_NONE = 0,
+    BINARY_LOG_ARG_INT32,   ///< integer of 4 bytes or less, 8 bytes value
+    BINARY_LOG_ARG_INT64,   ///< 8 bytes value
+    BINARY_LOG_ARG_DOUBLE,  ///< 8 bytes value
+    BINARY_LOG_ARG_STRING,  ///< 8 bytes length, then the bytes and a NUL padded to 8 bytes
+    BINARY_LOG_ARG_POINTER, ///< 8 bytes value
+} BinaryLogArgType;
+
+// header of a record in a ring and in a .qlog file, the size of the header is a multiple of 8
+typedef struct _binary_log_record {
+    uint16_t size;       ///< bytes of the record with its payload, a multiple of 8
+    uint8_t kind;        ///< BinaryLogRecordKind
+    uint8_t arg_count;
+    uint16_t sink;       ///< QCamxLog the message goes to
+    uint16_t format_id;  ///< index of the format string
+    int64_t timestamp;   ///< CLOCK_MONOTONIC in ns
+} BinaryLogRecord;
+
+// an argument of a log call, built inline at the call site
+struct BinaryLogArg {
+    BinaryLogArg() : type(BINARY_LOG_ARG_NONE), i(0) {}
+    template <typename T, typename std::enable_if<std::is_integral<T>::value ||
+                                                      std::is_enum<T>::value,
+                                                  int>::type = 0>
+    BinaryLogArg(T value)
+        : type(sizeof(T) > 4 ? BINARY_LOG_ARG_INT64 : BINARY_LOG_ARG_INT32), i((int64_t)value) {}
+    template <typename T,
+              typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+    BinaryLogArg(T value) : type(BINARY_LOG_ARG_DOUBLE), d((double)value) {}
+    BinaryLogArg(const char *value) : type(BINARY_LOG_ARG_STRING), s(value) {}
+    BinaryLogArg(char *value) : type(BINARY_LOG_ARG_STRING), s(value) {}
+    template <typename T>
+    BinaryLogArg(T *value) : type(BINARY_LOG_ARG_POINTER), p((const void *)value) {}
+
+    uint8_t type;  ///< BinaryLogArgType
+    union {
+        int64_t i;
+        double d;
+        const char *s;
+        const void *p;
+    };
+};
+
+// where the writer thread hands the records of a sink
+class QCamxBinaryLogSink {
+public:
+    virtual ~QCamxBinaryLogSink() {}
+    /**
+     * @brief a message of the sink, called on the writer thread
+     * @param format the format string of the record
+    */
+    virtual void write_record(const BinaryLogRecord *record, const char *format) = 0;
+    /**
+     * @brief end of a batch, the sink writes out what it buffered
+    */
+    virtual void flush_batch() = 0;
+};
+
+class QCamxBinaryLog {
+public:
+    static QCamxBinaryLog *get_instance();
+    /**
+     * @return the sink id of the records, -1 if all the sinks are used
+    */
+    int register_sink(QCamxBinaryLogSink *sink);
+    /**
+     * @brief hand the pending records to the sink, then forget it
+    */
+    void unregister_sink(int sink);
+    /**
+     * @brief copy a message into the ring of the calling thread, never blocks
+     * @param format must stay valid as long as the process, a string literal
+     * @return 0, -1 if the message is dropped on a full ring or format table
+    */
+    int write(int sink, const char *format, const BinaryLogArg *args, int arg_count);
+    /**
+     * @brief wait until the messages written before are handed to their sinks
+    */
+    void flush();
+    /**
+     * @brief messages dropped on a full ring or format table
+    */
+    uint64_t get_dropped() { return _dropped.load(std::memory_order_relaxed); }
+private:
+    // single producer single consumer ring of one thread
+    struct ThreadRing {
+        uint8_t *buffer;
+        std::atomic<uint64_t> head;  ///< written by the thread
+        std::atomic<uint64_t> tail;  ///< written by the writer thread
+        std::atomic<bool> closed;    ///< the thread exited, freed once drained
+        ThreadRing *next;
+    };
+    // gives the ring of the thread back when the thread exits
+    struct ThreadRingHolder {
+        ThreadRing *ring = nullptr;
+        ~ThreadRingHolder();
+    };
+    QCamxBinaryLog();
+    ~QCamxBinaryLog();
+    ThreadRing *get_thread_ring();
+    /**
+     * @return the format id, registered on its first use, -1 if the table is full
+    */
+    int get_format_id(const char *format);
+    /**
+     * @brief hand the records of all rings to their sinks in timestamp order
+    */
+    void drain();
+    static void *writer_thread(void *data);
+    // Do not support the copy constructor or assignment operator
+    QCamxBinaryLog(const QCamxBinaryLog &) = delete;
+    QCamxBinaryLog &operator=(const QCamxBinaryLog &) = delete;
+private:
+    std::atomic<const char *> _formats[BINARY_LOG_FORMAT_MAX];
+    std::atomic<uint64_t> _dropped;
+
+    pthread_mutex_t _ring_lock;  ///< guards the ring list
+    ThreadRing *_rings;
+
+    pthread_mutex_t _sink_lock;  ///< held while the records go to the sinks
+    QCamxBinaryLogSink *_sinks[BINARY_LOG_SINK_MAX];
+
+    pthread_mutex_t _lock;       ///< guards the writer state below
+    pthread_cond_t _cond;        ///< wakes the writer on a flush or a stop
+    pthread_cond_t _flush_cond;  ///< signaled at the end of a drain
+    uint64_t _flush_requests;
+    uint64_t _flush_done;
+    bool _stop;
+    bool _running;
+    pthread_t _thread;
+};
+
+/**
+ * @brief format a message record as vsnprintf would have with its arguments
+ * @return the length of the message, truncated to size - 1
+*/
+int format_binary_log_message(const BinaryLogRecord *record, const char *format, char *message,
+                              size_t size);
+
+}  // namespace qcamx
@@ -11,6 +11,11 @@
 
 #include "qcamx_buffer_manager.h"
 
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include "qcamx_define.h"
 
 #ifdef LOG_TAG
@@ -30,6 +35,23 @@ static const uint32_t CameraTitanSocQRB3165N = 599;  ///< QRB3165N SOC Id
 QCamxBufferManager::QCamxBufferManager() {
     _num_of_buffers = 0;
     _buffer_stride = 0;
+    _max_buffers = 0;
+    _allocated_bytes = 0;
+    pthread_mutex_init(&_grow_lock, NULL);
+    memset(&_allocate_params, 0, sizeof(_allocate_params));
+    _free_sequence = 0;
+    _free_waiters = 0;
+    _empty_wait_count = 0;
+    _timeline = NULL;
+    _stream_index = -1;
+    memset(_buffer_frame, 0, sizeof(_buffer_frame));
+    for (int i = 0; i < BUFFER_QUEUE_DEPTH; i++) {
+        _buffer_refs[i] = 0;
+    }
+    for (int i = 0; i < BUFFER_HANDLE_TABLE_SIZE; i++) {
+        _handle_slots[i].handle = NULL;
+        _handle_slots[i].slot = 0;
+    }
     initialize();
 #ifdef USE_ION
     _ion_fd = -1;
@@ -38,6 +60,7 @@ QCamxBufferManager::QCamxBufferManager() {
 
 QCamxBufferManager::~QCamxBufferManager() {
     destroy();
+    pthread_mutex_destroy(&_grow_lock);
 }
 
 /***************************** public method ***************************************/
@@ -67,16 +90,26 @@ int QCamxBufferManager::allocate_buffers(uint32_t num_of_buffers, uint32_t width
                                          Implsubformat subformat, uint32_t is_meta_buf,
                                          uint32_t is_UBWC) {
     QCAMX_DBG("allocate_buffers, Enter subformat=%d, type=%d\n", subformat, type);
+    _is_meta_buf = is_meta_buf;
+    _is_UWBC = is_UBWC;
+    _allocate_params.width = width;
+    _allocate_params.height = height;
+    _allocate_params.format = format;
+    _allocate_params.producer_flags = producer_flags;
+    _allocate_params.consumer_flags = consumer_flags;
+    _allocate_params.type = type;
+    _allocate_params.subformat = subformat;
 
     for (uint32_t i = 0; i < num_of_buffers; i++) {
         allocate_one_buffer(width, height, format, producer_flags, consumer_flags, &_buffers[i],
                             &_buffer_stride, i, type, subformat);
+        _allocated_bytes += _buffer_info[i].size;
+        insert_buffer_handle(i);
         _num_of_buffers++;
-        _buffers_free.push_back(&_buffers[i]);
+        _free_slots.push(i);
     }
+    _max_buffers = _num_of_buffers;
 
-    _is_meta_buf = is_meta_buf;
-    _is_UWBC = is_UBWC;
     QCAMX_DBG("allocate_buffers end\n");
     return 0;
 }
@@ -93,6 +126,9 @@ void QCamxBufferManager::free_all_buffers() {
 #endif
             native_handle_close((native_handle_t *)_buffers[i]);
             native_handle_delete((native_handle_t *)_buffers[i]);
+#elif defined USE_MEMFD
+            native_handle_close((native_handle_t *)_buffers[i]);
+            native_handle_delete((native_handle_t *)_buffers[i]);
 #elif defined USE_GBM
             native_handle_t *pHandle =
                 const_cast<native_handle_t *>(static_cast<const native_handle_t *>(_buffers[i]));
@@ -110,6 +146,113 @@ void QCamxBufferManager::free_all_buffers() {
             _buffers[i] = NULL;
         }
     }
+    for (int i = 0; i < BUFFER_HANDLE_TABLE_SIZE; i++) {
+        _handle_slots[i].handle.store(NULL, std::memory_order_relaxed);
+    }
+    _free_slots.reset();
+    _num_of_buffers = 0;
+    _allocated_bytes = 0;
+}
+
+void QCamxBufferManager::set_max_buffers(uint32_t max_buffers) {
+    if (max_buffers > BUFFER_QUEUE_DEPTH) {
+        QCAMX_ERR("max buffers %u over %d\n", max_buffers, BUFFER_QUEUE_DEPTH);
+        max_buffers = BUFFER_QUEUE_DEPTH;
+    }
+    pthread_mutex_lock(&_grow_lock);
+    _max_buffers = max_buffers > _num_of_buffers ? max_buffers : _num_of_buffers.load();
+    pthread_mutex_unlock(&_grow_lock);
+}
+
+int32_t QCamxBufferManager::wait_free_slot(int timeout_ms) {
+    uint32_t slot;
+    int32_t new_slot = grow_pool();
+    if (new_slot >= 0) {
+        return new_slot;
+    }
+    _empty_wait_count.fetch_add(1, std::memory_order_relaxed);
+    struct timespec deadline;
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    for (;;) {
+        // read the sequence before the last pop attempt, so a return_buffer that lands in
+        // between changes the futex word and FUTEX_WAIT returns immediately
+        uint32_t sequence = _free_sequence.load();
+        _free_waiters.fetch_add(1);
+        if (_free_slots.pop(slot)) {
+            _free_waiters.fetch_sub(1);
+            return slot;
+        }
+        struct timespec remaining;
+        struct timespec *timeout = NULL;
+        if (timeout_ms >= 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t remaining_ns = (int64_t)(deadline.tv_sec - now.tv_sec) * 1000000000LL +
+                                   (deadline.tv_nsec - now.tv_nsec);
+            if (remaining_ns <= 0) {
+                _free_waiters.fetch_sub(1);
+                return -1;
+            }
+            remaining.tv_sec = remaining_ns / 1000000000LL;
+            remaining.tv_nsec = remaining_ns % 1000000000LL;
+            timeout = &remaining;
+        }
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&_free_sequence), FUTEX_WAIT_PRIVATE,
+                sequence, timeout, NULL, 0);
+        _free_waiters.fetch_sub(1);
+        if (_free_slots.pop(slot)) {
+            return slot;
+        }
+    }
+}
+
+int32_t QCamxBufferManager::grow_pool() {
+    if (_num_of_buffers.load() >= _max_buffers) {
+        return -1;
+    }
+    int32_t slot = -1;
+    pthread_mutex_lock(&_grow_lock);
+    uint32_t index = _num_of_buffers.load();
+    if (index < _max_buffers &&
+        allocate_one_buffer(_allocate_params.width, _allocate_params.height,
+                            _allocate_params.format, _allocate_params.producer_flags,
+                            _allocate_params.consumer_flags, &_buffers[index], &_buffer_stride,
+                            index, _allocate_params.type, _allocate_params.subformat) == 0) {
+        _allocated_bytes += _buffer_info[index].size;
+        insert_buffer_handle(index);
+        // publish the slot after its buffer info, get_buffer_slot checks against the count
+        _num_of_buffers.store(index + 1);
+        slot = (int32_t)index;
+    }
+    pthread_mutex_unlock(&_grow_lock);
+    return slot;
+}
+
+void QCamxBufferManager::insert_buffer_handle(uint32_t slot) {
+    buffer_handle_t handle = _buffers[slot];
+    if (handle == NULL) {
+        return;
+    }
+    // the table holds at most BUFFER_QUEUE_DEPTH handles, a free entry is always found
+    uint32_t i = hash_buffer_handle(handle);
+    while (_handle_slots[i].handle.load(std::memory_order_relaxed) != NULL) {
+        i = (i + 1) % BUFFER_HANDLE_TABLE_SIZE;
+    }
+    _handle_slots[i].slot = slot;
+    _handle_slots[i].handle.store(handle, std::memory_order_release);
+}
+
+void QCamxBufferManager::wake_free_slot_waiter() {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&_free_sequence), FUTEX_WAKE_PRIVATE, 1, NULL,
+            NULL, 0);
 }
 
 uint32_t QCamxBufferManager::get_soc_id() {
@@ -143,6 +286,9 @@ int QCamxBufferManager::allocate_one_buffer(uint32_t width, uint32_t height, uin
 #elif defined USE_ION
     result = allocate_one_ion_buffer(width, height, format, producer_flags, consumer_flags,
                                      allocated_buffer, index, type, subformat);
+#elif defined USE_MEMFD
+    result = allocate_one_memfd_buffer(width, height, format, producer_flags, consumer_flags,
+                                       allocated_buffer, index, type, subformat);
 #elif defined USE_GBM
     result = allocate_one_gbm_buffer(width, height, format, producer_flags, consumer_flags,
                                      allocated_buffer, index, type, subformat);
@@ -150,6 +296,84 @@ int QCamxBufferManager::allocate_one_buffer(uint32_t width, uint32_t height, uin
     return result;
 }
 
+int QCamxBufferManager::get_buffer_layout(uint32_t width, uint32_t height, uint32_t format,
+                                          uint64_t consumer_flags, uint32_t *stride,
+                                          uint32_t *slice, size_t *size) {
+    *stride = 0;
+    *slice = 0;
+    *size = 0;
+    switch (format) {
+        case HAL_PIXEL_FORMAT_Y16:
+        case HAL_PIXEL_FORMAT_RAW16: {
+            *stride = width * 2;
+            *slice = height;
+            *size = (size_t)(*stride * *slice);
+            break;
+        }
+        case HAL_PIXEL_FORMAT_RAW10: {
+            *stride = ALIGN((width * 5 / 4), 16);
+            *slice = height;
+            *size = (size_t)(*stride * *slice);
+            break;
+        }
+        case HAL_PIXEL_FORMAT_RAW12: {
+            *stride = ALIGN((width * 3 / 2), 16);
+            *slice = height;
+            *size = (size_t)(*stride * *slice);
+            break;
+        }
+        case HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED: {
+            /// check with GetRigidYUVFormat & CamxFormatUtil_GetFlexibleYUVFormats
+            if ((CameraTitanSocSDM865 == _soc_id) || (CameraTitanSocSM7250 == _soc_id) ||
+                (CameraTitanSocQSM7250 == _soc_id) || (CameraTitanSocQRB5165 == _soc_id) ||
+                (CameraTitanSocQRB5165N == _soc_id) || (CameraTitanSocQCS7230 == _soc_id) ||
+                (CameraTitanSocQRB3165 == _soc_id) || (CameraTitanSocQRB3165N == _soc_id)) {
+                *stride = ALIGN(width, 512);
+                *slice = ALIGN(height, 512);
+            } else {
+                *stride = ALIGN(width, 128);
+                *slice = ALIGN(height, 32);
+            }
+            *size = (size_t)(*stride * *slice * 3 / 2);
+
+            break;
+        }
+
+        case HAL_PIXEL_FORMAT_YCBCR_420_888: {
+            if (consumer_flags & GRALLOC_USAGE_HW_VIDEO_ENCODER) {
+                if ((CameraTitanSocSDM865 == _soc_id) || (CameraTitanSocSM7250 == _soc_id) ||
+                    (CameraTitanSocQSM7250 == _soc_id) || (CameraTitanSocQRB5165 == _soc_id) ||
+                    (CameraTitanSocQRB5165N == _soc_id) || (CameraTitanSocQCS7230 == _soc_id) ||
+                    (CameraTitanSocQRB3165 == _soc_id) || (CameraTitanSocQRB3165N == _soc_id)) {
+                    *stride = ALIGN(width, 512);
+                    *slice = ALIGN(height, 512);
+                } else {
+                    *stride = ALIGN(width, 128);
+                    *slice = ALIGN(height, 32);
+                }
+            } else if ((consumer_flags & GRALLOC_USAGE_HW_COMPOSER) ||
+                       (consumer_flags & GRALLOC_USAGE_HW_TEXTURE)) {
+                // ZSL or non-ZSL Preview
+                *stride = ALIGN(width, 64);
+                *slice = ALIGN(height, 64);
+            }
+            *size = (size_t)(*stride * *slice * 3 / 2);
+
+            break;
+        }
+        case HAL_PIXEL_FORMAT_BLOB: {
+            // Blob
+            *size = (size_t)(width);
+
+            break;
+        }
+        default: {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 #ifdef USE_GRALLOC1
 
 int QCamxBufferManager::setup_gralloc1_interface() {
@@ -305,74 +529,9 @@ int QCamxBufferManager::allocate_one_ion_buffer(uint32_t width, uint32_t height,
     }
     memset(&alloc, 0, sizeof(alloc));
 
-    switch (format) {
-        case HAL_PIXEL_FORMAT_Y16:
-        case HAL_PIXEL_FORMAT_RAW16: {
-            stride = width * 2;
-            slice = height;
-            buf_size = (size_t)(stride * slice);
-            break;
-        }
-        case HAL_PIXEL_FORMAT_RAW10: {
-            stride = ALIGN((width * 5 / 4), 16);
-            slice = height;
-            buf_size = (size_t)(stride * slice);
-            break;
-        }
-        case HAL_PIXEL_FORMAT_RAW12: {
-            stride = ALIGN((width * 3 / 2), 16);
-            slice = height;
-            buf_size = (size_t)(stride * slice);
-            break;
-        }
-        case HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED: {
-            /// check with GetRigidYUVFormat & CamxFormatUtil_GetFlexibleYUVFormats
-            if ((CameraTitanSocSDM865 == _soc_id) || (CameraTitanSocSM7250 == _soc_id) ||
-                (CameraTitanSocQSM7250 == _soc_id) || (CameraTitanSocQRB5165 == _soc_id) ||
-                (CameraTitanSocQRB5165N == _soc_id) || (CameraTitanSocQCS7230 == _soc_id) ||
-                (CameraTitanSocQRB3165 == _soc_id) || (CameraTitanSocQRB3165N == _soc_id)) {
-                stride = ALIGN(width, 512);
-                slice = ALIGN(height, 512);
-            } else {
-                stride = ALIGN(width, 128);
-                slice = ALIGN(height, 32);
-            }
-            buf_size = (size_t)(stride * slice * 3 / 2);
-
-            break;
-        }
-
-        case HAL_PIXEL_FORMAT_YCBCR_420_888: {
-            if (consumerUsageFlags & GRALLOC_USAGE_HW_VIDEO_ENCODER) {
-                if ((CameraTitanSocSDM865 == _soc_id) || (CameraTitanSocSM7250 == _soc_id) ||
-                    (CameraTitanSocQSM7250 == _soc_id) || (CameraTitanSocQRB5165 == _soc_id) ||
-                    (CameraTitanSocQRB5165N == _soc_id) || (CameraTitanSocQCS7230 == _soc_id) ||
-                    (CameraTitanSocQRB3165 == _soc_id) || (CameraTitanSocQRB3165N == _soc_id)) {
-                    stride = ALIGN(width, 512);
-                    slice = ALIGN(height, 512);
-                } else {
-                    stride = ALIGN(width, 128);
-                    slice = ALIGN(height, 32);
-                }
-            } else if ((consumerUsageFlags & GRALLOC_USAGE_HW_COMPOSER) ||
-                       (consumerUsageFlags & GRALLOC_USAGE_HW_TEXTURE)) {
-                // ZSL or non-ZSL Preview
-                stride = ALIGN(width, 64);
-                slice = ALIGN(height, 64);
-            }
-            buf_size = (size_t)(stride * slice * 3 / 2);
-
-            break;
-        }
-        case HAL_PIXEL_FORMAT_BLOB: {
-            // Blob
-            buf_size = (size_t)(width);
-
-            break;
-        }
-        default: {
-            return -1;
-        }
+    rc = get_buffer_layout(width, height, format, consumerUsageFlags, &stride, &slice, &buf_size);
+    if (rc != 0) {
+        return rc;
     }
 
     alloc.len = (size_t)(buf_size);
@@ -449,6 +608,83 @@ int QCamxBufferManager::allocate_one_ion_buffer(uint32_t width, uint32_t height,
 
     return rc;
 }
+#elif defined USE_MEMFD
+
+int QCamxBufferManager::allocate_one_memfd_buffer(uint32_t width, uint32_t height,
+                                                  uint32_t format, uint64_t producer_flags,
+                                                  uint64_t consumer_flags,
+                                                  buffer_handle_t *buffer_handle, uint32_t index,
+                                                  StreamType type, Implsubformat subformat) {
+    uint32_t stride = 0;
+    uint32_t slice = 0;
+    size_t buf_size = 0;
+    int rc = get_buffer_layout(width, height, format, consumer_flags, &stride, &slice, &buf_size);
+    if (rc != 0) {
+        QCAMX_ERR("memfd not support format 0x%x\n", format);
+        return rc;
+    }
+    if (buf_size == 0) {
+        // YUV buffer only read by cpu, use the preview alignment of the ion rules
+        stride = ALIGN(width, 64);
+        slice = ALIGN(height, 64);
+        buf_size = (size_t)(stride * slice * 3 / 2);
+    }
+    size_t len = (buf_size + 4095U) & (~4095U);
+
+    char name[32];
+    snprintf(name, sizeof(name), "qcamx-buf-%d-%u", type, index);
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd < 0) {
+        QCAMX_ERR("memfd_create failed %s\n", strerror(errno));
+        return -errno;
+    }
+    if (ftruncate(fd, len) != 0) {
+        rc = -errno;
+        QCAMX_ERR("memfd resize to %zu failed %s\n", len, strerror(errno));
+        close(fd);
+        return rc;
+    }
+    void *vaddr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (vaddr == MAP_FAILED) {
+        rc = -errno;
+        QCAMX_ERR("memfd map failed %s\n", strerror(errno));
+        close(fd);
+        return rc;
+    }
+
+    _buffer_info[index].vaddr = vaddr;
+    _buffer_info[index].fd = fd;
+    _buffer_info[index].size = len;
+    _buffer_info[index].width = width;
+    _buffer_info[index].height = height;
+    _buffer_info[index].stride = stride;
+    _buffer_info[index].slice = slice;
+    _buffer_info[index].format = format;
+
+    // same handle layout as the ion backend
+    native_handle_t *nh = nullptr;
+    if (!_is_meta_buf) {
+        nh = native_handle_create(1, 4);
+        nh->data[0] = fd;
+        nh->data[1] = 0;
+        nh->data[2] = 0;
+        nh->data[3] = 0;
+        nh->data[4] = len;
+    } else {
+        nh = native_handle_create(1, 2);
+        nh->data[0] = fd;
+        nh->data[1] = 0;
+        nh->data[2] = len;
+    }
+    *buffer_handle = nh;
+
+    QCAMX_INFO(
+        "Alloc buffer fd:%d vaddr:%p len:%d width:%d height:%d stride:%d slice:%d format 0x%x\n",
+        _buffer_info[index].fd, _buffer_info[index].vaddr, _buffer_info[index].size,
+        _buffer_info[index].width, _buffer_info[index].height, _buffer_info[index].stride,
+        _buffer_info[index].slice, _buffer_info[index].format);
+    return 0;
+}
 #elif defined USE_GBM
 
 int QCamxBufferManager::allocate_one_gbm_buffer(uint32_t width, uint32_t height, uint32_t format,
@@ -4,9 +4,13 @@
  * @brief buffer manager
 */
 
+#pragma once
+
 #if defined USE_GRALLOC1
 #include <gralloc_priv.h>
 #include <hardware/gralloc1.h>
+#elif defined USE_MEMFD
+#include <cutils/native_handle.h>
 #elif defined USE_GBM
 #include <cutils/native_handle.h>
 #include <gbm_priv.h>
@@ -20,9 +24,13 @@ typedef struct gbm_device GBM_DEVICE;
 #include <errno.h>
 #include <fcntl.h>
 #include <hardware/gralloc.h>
+#ifndef USE_MEMFD
 #include <linux/ion.h>
 #include <linux/msm_ion.h>
+#endif
 #include <log/log.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,15 +39,16 @@ typedef struct gbm_device GBM_DEVICE;
 #include <sys/stat.h>
 #include <sys/types.h>
 
-#include <condition_variable>
-#include <deque>
-#include <mutex>
+#include <atomic>
 #include <unordered_map>
 
 #include "qcamx_define.h"
+#include "qcamx_frame_timeline.h"
+#include "qcamx_lockfree_queue.h"
 #include "qcamx_log.h"
 
 #define BUFFER_QUEUE_DEPTH 256
+#define BUFFER_HANDLE_TABLE_SIZE (2 * BUFFER_QUEUE_DEPTH)  // a power of 2, at most half full
 
 typedef const native_handle_t *buffer_handle_t;
 
@@ -114,6 +123,12 @@ public:
     int allocate_buffers(uint32_t num_of_buffers, uint32_t width, uint32_t height, uint32_t format,
                          uint64_t producer_flags, uint64_t consumer_lags, StreamType type,
                          Implsubformat subformat, uint32_t is_meta_buf = 0, uint32_t is_UBWC = 0);
+    /**
+     * @brief let the pool grow on demand, called after allocate_buffers
+     * @detail while the pool has less than max_buffers buffers an empty pool allocates one more
+     *         buffer like the ones of allocate_buffers instead of waiting for a returned one
+     */
+    void set_max_buffers(uint32_t max_buffers);
 
     /**
      * @brief Free all buffers
@@ -122,47 +137,169 @@ public:
 public:
     /**
      * @brief Get one buffer
+     * @detail lock-free pop from the free list, sleeps on a futex only when the pool is empty
+     */
+    buffer_handle_t *get_buffer() { return get_buffer(-1); }
+    /**
+     * @brief Get one buffer, wait at most timeout_ms for it
+     * @param timeout_ms -1 waits until a buffer is returned
+     * @return NULL if the pool stayed empty
      */
-    buffer_handle_t *get_buffer() {
-        std::unique_lock<std::mutex> lock(_buffer_mutex);
-        if (_buffers_free.size() == 0) {
-            //wait for usable buf
-            _buffer_conditiaon_variable.wait(lock);
+    buffer_handle_t *get_buffer(int timeout_ms) {
+        uint32_t slot;
+        if (!_free_slots.pop(slot)) {
+            int32_t free_slot = wait_free_slot(timeout_ms);
+            if (free_slot < 0) {
+                return NULL;
+            }
+            slot = (uint32_t)free_slot;
         }
-        buffer_handle_t *buffer = _buffers_free.front();
-        _buffers_free.pop_front();
-        return buffer;
+        _buffer_refs[slot].store(1, std::memory_order_relaxed);
+        return &_buffers[slot];
     }
     /**
-     * @brief recycle buffer to buffer pool
+     * @brief take one more reference on a buffer handed out by get_buffer, no copy
+     * @detail every reference is dropped by return_buffer, the last one recycles the buffer
+    */
+    void acquire_buffer(buffer_handle_t *buffer) {
+        int slot = get_buffer_slot(buffer);
+        if (slot < 0) {
+            QCAMX_ERR("buffer %p not belong to this pool\n", buffer);
+            return;
+        }
+        _buffer_refs[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+    /**
+     * @brief drop one reference, recycle buffer to buffer pool with the last one
     */
     void return_buffer(buffer_handle_t *buffer) {
-        std::unique_lock<std::mutex> lock(_buffer_mutex);
-        _buffers_free.push_back(buffer);
-        _buffer_conditiaon_variable.notify_all();
+        int slot = get_buffer_slot(buffer);
+        if (slot < 0) {
+            QCAMX_ERR("buffer %p not belong to this pool\n", buffer);
+            return;
+        }
+        // the holder of the last reference sees all writes of the other holders
+        int32_t refs = _buffer_refs[slot].fetch_sub(1, std::memory_order_acq_rel);
+        if (refs > 1) {
+            return;
+        }
+        if (refs < 1) {
+            QCAMX_ERR("buffer %p slot:%d returned twice\n", buffer, slot);
+            _buffer_refs[slot].store(0, std::memory_order_relaxed);
+            return;
+        }
+        if (_timeline != NULL) {
+            _timeline->stamp_pool_return(_buffer_frame[slot], _stream_index);
+        }
+        // the pool never holds more than BUFFER_QUEUE_DEPTH slots, a failed push is transient
+        while (!_free_slots.push((uint32_t)slot)) {
+            sched_yield();
+        }
+        _free_sequence.fetch_add(1);
+        if (_free_waiters.load() > 0) {
+            wake_free_slot_waiter();
+        }
     }
     /**
      * @brief get free buffer size
     */
-    size_t get_free_buffer_size() {
-        std::unique_lock<std::mutex> lock(_buffer_mutex);
-        return _buffers_free.size();
+    size_t get_free_buffer_size() { return _free_slots.size(); }
+    /**
+     * @brief how many times get_buffer had to sleep because the pool was empty
+    */
+    uint64_t get_empty_wait_count() { return _empty_wait_count.load(std::memory_order_relaxed); }
+    /**
+     * @brief buffers allocated so far, grows up to get_max_buffers when allocated on demand
+    */
+    uint32_t get_buffer_count() { return _num_of_buffers.load(); }
+    uint32_t get_max_buffers() { return _max_buffers; }
+    /**
+     * @brief memory of the buffers allocated so far
+    */
+    size_t get_allocated_bytes() { return _allocated_bytes.load(); }
+    /**
+     * @brief stamp every buffer returned to this pool on the frame timeline
+     * @param stream_index stream index of the pool in the timeline, NULL timeline disables it
+    */
+    void set_frame_timeline(QCamxFrameTimeline *timeline, int stream_index) {
+        _timeline = timeline;
+        _stream_index = stream_index;
+    }
+    /**
+     * @return index of the stream of this pool in the device configuration, -1 if not configured
+    */
+    int get_stream_index() { return _stream_index; }
+    /**
+     * @brief remember the frame a buffer is requested for, reported when it is returned
+    */
+    void set_buffer_frame(buffer_handle_t *buffer, uint32_t frame_number) {
+        int slot = get_buffer_slot(buffer);
+        if (slot >= 0) {
+            _buffer_frame[slot] = frame_number;
+        }
     }
 
-    BufferInfo *get_buffer_info(buffer_handle_t *buffer) {
-        std::unique_lock<std::mutex> lock(_buffer_mutex);
-        for (uint32_t i = 0; i < _num_of_buffers; i++) {
-            if (*buffer == _buffers[i]) {
-                return &(_buffer_info[i]);
+    /**
+     * @brief get the pool slot of a buffer handed out by get_buffer
+     * @return slot index in [0, num_of_buffers), -1 if the buffer not belong to this pool
+    */
+    int get_buffer_slot(buffer_handle_t *buffer) {
+        if (buffer >= _buffers && buffer < _buffers + _num_of_buffers) {
+            return (int)(buffer - _buffers);
+        }
+        if (buffer == NULL || *buffer == NULL) {
+            return -1;
+        }
+        // handle copied out of the pool, handles never change after allocation
+        for (uint32_t i = hash_buffer_handle(*buffer);; i = (i + 1) % BUFFER_HANDLE_TABLE_SIZE) {
+            buffer_handle_t handle = _handle_slots[i].handle.load(std::memory_order_acquire);
+            if (handle == *buffer) {
+                return (int)_handle_slots[i].slot;
+            }
+            if (handle == NULL) {
+                return -1;
             }
         }
-        return NULL;
+    }
+    /**
+     * @brief get buffer info of a buffer, constant time and lock-free
+    */
+    BufferInfo *get_buffer_info(buffer_handle_t *buffer) {
+        int slot = get_buffer_slot(buffer);
+        return (slot < 0) ? NULL : &(_buffer_info[slot]);
     }
 private:
     /**
      * @brief get the soc identify
     */
     uint32_t get_soc_id();
+    /**
+     * @brief slow path of get_buffer, grow the pool or block until a buffer is returned
+     * @return free slot index, -1 on timeout
+    */
+    int32_t wait_free_slot(int timeout_ms);
+    /**
+     * @brief allocate one more buffer if the pool is below _max_buffers
+     * @return slot of the new buffer, -1 if the pool can not grow
+    */
+    int32_t grow_pool();
+    /**
+     * @brief wake up one thread blocked in wait_free_slot
+    */
+    void wake_free_slot_waiter();
+    /**
+     * @brief stride/slice/size rules of ion and memfd buffers
+     * @return 0 on success, -1 for unsupported format
+    */
+    int get_buffer_layout(uint32_t width, uint32_t height, uint32_t format, uint64_t consumer_flags,
+                          uint32_t *stride, uint32_t *slice, size_t *size);
+    /**
+     * @brief index the handle to slot table, called after the buffer of the slot is allocated
+    */
+    void insert_buffer_handle(uint32_t slot);
+    static inline uint32_t hash_buffer_handle(buffer_handle_t handle) {
+        return (uint32_t)(((uintptr_t)handle >> 4) * 2654435761u) % BUFFER_HANDLE_TABLE_SIZE;
+    }
     static inline uint32_t ALIGN(uint32_t operand, uint32_t alignment) {
         uint32_t remainder = (operand % alignment);
 
@@ -198,6 +335,14 @@ private:
                                 uint64_t producer_flags, uint64_t consumer_flags,
                                 buffer_handle_t *pAllocatedBuffer, uint32_t index, StreamType type,
                                 Implsubformat subformat);
+#elif defined USE_MEMFD
+    /**
+     * @brief allocate one buffer from memfd, follow the ion stride rules
+    */
+    int allocate_one_memfd_buffer(uint32_t width, uint32_t height, uint32_t format,
+                                  uint64_t producer_flags, uint64_t consumer_flags,
+                                  buffer_handle_t *buffer_handle, uint32_t index, StreamType type,
+                                  Implsubformat subformat);
 #elif defined USE_GBM
     /**
      * @brief allocate one buffer from Gbm interface
@@ -212,15 +357,37 @@ private:
     QCamxBufferManager &operator=(const QCamxBufferManager &) = delete;
 private:
     uint32_t _soc_id;          ///< soc id
-    uint32_t _num_of_buffers;  ///< num of Buffers
-    uint32_t _buffer_stride;   ///< buffer stride default is 0
+    std::atomic<uint32_t> _num_of_buffers;  ///< num of Buffers
+    uint32_t _buffer_stride;                ///< buffer stride default is 0
+    uint32_t _max_buffers;                  ///< the pool grows on demand up to it
+    std::atomic<size_t> _allocated_bytes;
+    pthread_mutex_t _grow_lock;  ///< serializes the buffers allocated on demand
+    // parameters of allocate_buffers, reused by the buffers allocated on demand
+    struct {
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;
+        uint64_t producer_flags;
+        uint64_t consumer_flags;
+        StreamType type;
+        Implsubformat subformat;
+    } _allocate_params;
 private:
     buffer_handle_t _buffers[BUFFER_QUEUE_DEPTH];  ///< buffer pool handle
     BufferInfo _buffer_info[BUFFER_QUEUE_DEPTH];
-    std::deque<buffer_handle_t *> _buffers_free;
-
-    std::mutex _buffer_mutex;
-    std::condition_variable _buffer_conditiaon_variable;
+    QCamxLockFreeQueue<uint32_t, BUFFER_QUEUE_DEPTH> _free_slots;  ///< free slot index of _buffers
+    std::atomic<uint32_t> _free_sequence;    ///< futex word, bumped on every return_buffer
+    std::atomic<int32_t> _free_waiters;      ///< threads sleeping in wait_free_slot
+    std::atomic<uint64_t> _empty_wait_count;
+    std::atomic<int32_t> _buffer_refs[BUFFER_QUEUE_DEPTH];  ///< 0 while the slot is in the pool
+    QCamxFrameTimeline *_timeline;
+    int _stream_index;
+    uint32_t _buffer_frame[BUFFER_QUEUE_DEPTH];  ///< frame number the slot was last requested for
+    // open addressing table of the handles copied out of the pool, written only on allocation
+    struct {
+        std::atomic<buffer_handle_t> handle;
+        uint32_t slot;
+    } _handle_slots[BUFFER_HANDLE_TABLE_SIZE];
 
     uint32_t _is_meta_buf;
     uint32_t _is_UWBC;  // not support for now
@@ -234,7 +401,7 @@ private:
 #endif
 };
 
-#ifdef USE_GBM
+#if defined USE_GBM && !defined USE_MEMFD
 class QCamxGBM {
 public:
     /**
@@ -11,8 +11,6 @@
 
 #include "qcamx_case.h"
 
-#include <math.h>  // ceil
-
 #include "qcamx_log.h"
 
 #ifdef LOG_TAG
@@ -20,27 +18,6 @@
 #endif
 #define LOG_TAG "QCamxHAL3Test"
 
-/* Tile info for supported UBWC formats */
-static const UBWCYUVTileInfo SupportedUBWCYUVTileInfo[] = {
-    {48, 64, 4, 256, 16, 4, 3},  // UBWC_TP10-Y
-
-    {64, 64, 4, 256, 16, 1, 1},  // UBWC_NV12-4R-Y
-
-    {32, 32, 8, 128, 32, 1, 1},  // UBWC_NV12-Y/UBWCNV12
-
-    {32, 64, 4, 256, 16, 2, 1},  // UBWC_P010
-};
-
-/**
-* @brief get stream type string
-*/
-static inline const char *get_stream_type_string(StreamType type);
-
-/**
-* @brief get string of file type
-*/
-static inline const char *get_file_type_string(uint32_t format);
-
 /******************************** DeviceCallback function *****************************/
 
 void QCamxCase::capture_post_process(DeviceCallback *cb, camera3_capture_result *result) {}
@@ -50,19 +27,11 @@ void QCamxCase::capture_post_process(DeviceCallback *cb, camera3_capture_result
 * function: analysis meta info from capture result.
 ************************************************************************/
 void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *result) {
-    int res = 0;
-    android::sp<android::VendorTagDescriptor> vTags =
-        android::VendorTagDescriptor::getGlobalVendorTagDescriptor();
-
     if (result->partial_result >= 1) {
+        scan_metadata(result);
         if (_config->_meta_dump.exposureValue) {
-            camera_metadata_ro_entry entry;
-            uint64_t exposure_time = 0;
-            res =
-                find_camera_metadata_ro_entry(result->result, ANDROID_SENSOR_EXPOSURE_TIME, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                exposure_time = entry.data.i64[0];
-            }
+            uint64_t exposure_time =
+                _metadata_watch.get<int64_t>(_watch_ids[META_WATCH_EXPOSURE_TIME], 0, 0);
             if (exposure_time != _config->_meta_stat.exposure_time) {
                 _config->_meta_stat.exposure_time = exposure_time;
                 _config->_dump_log->print("frame:%d exposure value = %llu\n", result->frame_number,
@@ -70,24 +39,14 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.isoValue) {
-            camera_metadata_ro_entry entry;
-            int iso = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_SENSOR_SENSITIVITY, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                iso = entry.data.i32[0];
-            }
+            int iso = _metadata_watch.get<int32_t>(_watch_ids[META_WATCH_ISO], 0, 0);
             if (iso != _config->_meta_stat.isoValue) {
                 _config->_dump_log->print("frame:%d iso value = %d\n", result->frame_number, iso);
                 _config->_meta_stat.isoValue = iso;
             }
         }
         if (_config->_meta_dump.aeMode) {
-            camera_metadata_ro_entry entry;
-            int aemode = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_CONTROL_AE_MODE, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                aemode = entry.data.u8[0];
-            }
+            int aemode = _metadata_watch.get<uint8_t>(_watch_ids[META_WATCH_AE_MODE], 0, 0);
 
             if (aemode != _config->_meta_stat.aeMode) {
                 switch (aemode) {
@@ -106,12 +65,7 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.awbMode) {
-            camera_metadata_ro_entry entry;
-            int awbmode = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_CONTROL_AWB_MODE, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                awbmode = entry.data.u8[0];
-            }
+            int awbmode = _metadata_watch.get<uint8_t>(_watch_ids[META_WATCH_AWB_MODE], 0, 0);
             if (awbmode != _config->_meta_stat.awbMode) {
                 switch (awbmode) {
                     case ANDROID_CONTROL_AWB_MODE_OFF:
@@ -129,12 +83,7 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.afMode) {
-            camera_metadata_ro_entry entry;
-            int afmode = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_CONTROL_AF_MODE, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                afmode = entry.data.u8[0];
-            }
+            int afmode = _metadata_watch.get<uint8_t>(_watch_ids[META_WATCH_AF_MODE], 0, 0);
             if (afmode != _config->_meta_stat.afMode) {
                 switch (afmode) {
                     case ANDROID_CONTROL_AF_MODE_OFF:
@@ -163,13 +112,8 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.afValue) {
-            camera_metadata_ro_entry entry;
-            float afvalue = 0;
-            res =
-                find_camera_metadata_ro_entry(result->result, ANDROID_LENS_FOCUS_DISTANCE, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                afvalue = entry.data.f[0];
-            }
+            float afvalue =
+                _metadata_watch.get<float>(_watch_ids[META_WATCH_FOCUS_DISTANCE], 0, 0);
             if (afvalue != _config->_meta_stat.afValue) {
                 _config->_dump_log->print("frame:%d af focus distance = %f\n", result->frame_number,
                                           afvalue);
@@ -177,13 +121,8 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.aeAntiMode) {
-            camera_metadata_ro_entry entry;
-            int antimode = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_CONTROL_AE_ANTIBANDING_MODE,
-                                                &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                antimode = entry.data.u8[0];
-            }
+            int antimode =
+                _metadata_watch.get<uint8_t>(_watch_ids[META_WATCH_AE_ANTIBANDING], 0, 0);
             if (antimode != _config->_meta_stat.aeAntiMode) {
                 switch (antimode) {
                     case ANDROID_CONTROL_AE_ANTIBANDING_MODE_OFF:
@@ -209,13 +148,8 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.colorCorrectMode) {
-            camera_metadata_ro_entry entry;
-            int colormode = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_COLOR_CORRECTION_MODE,
-                                                &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                colormode = entry.data.u8[0];
-            }
+            int colormode =
+                _metadata_watch.get<uint8_t>(_watch_ids[META_WATCH_COLOR_CORRECTION_MODE], 0, 0);
             if (colormode != _config->_meta_stat.colorCorrectMode) {
                 switch (colormode) {
                     case ANDROID_COLOR_CORRECTION_MODE_TRANSFORM_MATRIX:
@@ -238,13 +172,8 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.colorCorrectValue) {
-            camera_metadata_ro_entry entry;
-            float colorvalue = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_COLOR_CORRECTION_GAINS,
-                                                &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                colorvalue = entry.data.f[0];
-            }
+            float colorvalue =
+                _metadata_watch.get<float>(_watch_ids[META_WATCH_COLOR_CORRECTION_GAINS], 0, 0);
             if (colorvalue != _config->_meta_stat.colorCorrectValue) {
                 _config->_dump_log->print("frame:%d color correction gain = %f\n",
                                           result->frame_number, colorvalue);
@@ -252,12 +181,8 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.controlMode) {
-            camera_metadata_ro_entry entry;
-            int ctrlvalue = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_CONTROL_MODE, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                ctrlvalue = entry.data.u8[0];
-            }
+            int ctrlvalue =
+                _metadata_watch.get<uint8_t>(_watch_ids[META_WATCH_CONTROL_MODE], 0, 0);
             if (ctrlvalue != _config->_meta_stat.controlMode) {
                 switch (ctrlvalue) {
                     case ANDROID_CONTROL_MODE_OFF:
@@ -279,15 +204,13 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.sceneMode) {
-            camera_metadata_ro_entry entry;
             int32_t asdresults[10] = {0};
-            uint32_t tag = 0;
             int i = 0;
-            android::CameraMetadata::getTagFromName("org.quic.camera2.asdresults.ASDResults",
-                                                    vTags.get(), &tag);
-            res = find_camera_metadata_ro_entry(result->result, tag, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                memcpy(asdresults, &(entry.data.i32[0]), sizeof(asdresults));
+            int id = _watch_ids[META_WATCH_ASD_RESULTS];
+            if (_metadata_watch.found(id)) {
+                for (i = 0; i < 10; i++) {
+                    asdresults[i] = _metadata_watch.get<int32_t>(id, i, 0);
+                }
                 for (i = 6; i < 10; i++) {
                     if (asdresults[i] != _config->_meta_stat.asdresults[i]) {
                         break;
@@ -303,15 +226,7 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.hdrMode) {
-            camera_metadata_ro_entry entry;
-            int hdrmode = 0;
-            uint32_t tag = 0;
-            android::CameraMetadata::getTagFromName("org.codeaurora.qcamera3.stats.is_hdr_scene",
-                                                    vTags.get(), &tag);
-            res = find_camera_metadata_ro_entry(result->result, tag, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                hdrmode = entry.data.u8[0];
-            }
+            int hdrmode = _metadata_watch.get<uint8_t>(_watch_ids[META_WATCH_HDR_SCENE], 0, 0);
             if (hdrmode != _config->_meta_stat.hdrMode) {
                 _config->_dump_log->print("frame:%d is hdr scene = %d\n", result->frame_number,
                                           hdrmode);
@@ -319,12 +234,11 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.zoomValue) {
-            camera_metadata_ro_entry entry;
             int32_t cropregion[4] = {0};
             int i = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_SCALER_CROP_REGION, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                memcpy(cropregion, &(entry.data.i32[0]), sizeof(cropregion));
+            for (i = 0; i < 4; i++) {
+                cropregion[i] =
+                    _metadata_watch.get<int32_t>(_watch_ids[META_WATCH_CROP_REGION], i, 0);
             }
             for (i = 0; i < 4; i++) {
                 if (cropregion[i] != _config->_meta_stat.cropregion[i]) {
@@ -340,11 +254,8 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
         }
 
         if (_config->_meta_dump.zslMode) {
-            camera_metadata_ro_entry entry;
-            uint8_t zsl = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_CONTROL_ENABLE_ZSL, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                zsl = entry.data.u8[0];
+            if (_metadata_watch.found(_watch_ids[META_WATCH_ZSL])) {
+                uint8_t zsl = _metadata_watch.get<uint8_t>(_watch_ids[META_WATCH_ZSL], 0, 0);
                 if (zsl != _config->_meta_stat.zslMode) {
                     _config->_dump_log->print("frame:%d ZSL mode:%d\n", result->frame_number, zsl);
                     _config->_meta_stat.zslMode = zsl;
@@ -353,14 +264,9 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
         }
 
         if (_config->_meta_dump.numFrames) {
-            camera_metadata_ro_entry entry;
-            uint32_t tag = 0;
-            int32_t numFrames = -1;
-            android::CameraMetadata::getTagFromName(
-                "org.quic.camera2.mfnrconfigs.MFNRTotalNumFrames", vTags.get(), &tag);
-            res = find_camera_metadata_ro_entry(result->result, tag, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                numFrames = entry.data.i32[0];
+            if (_metadata_watch.found(_watch_ids[META_WATCH_MFNR_FRAMES])) {
+                int32_t numFrames =
+                    _metadata_watch.get<int32_t>(_watch_ids[META_WATCH_MFNR_FRAMES], 0, -1);
                 if (numFrames != _config->_meta_stat.numFrames) {
                     _config->_dump_log->print("frame:%d num Frames:%d\n", result->frame_number,
                                               numFrames);
@@ -370,15 +276,9 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
         }
 
         if (_config->_meta_dump.expMetering) {
-            camera_metadata_ro_entry entry;
-            uint32_t tag = 0;
-            int32_t metering = -1;
-            android::CameraMetadata::getTagFromName(
-                "org.codeaurora.qcamera3.exposure_metering.exposure_metering_mode", vTags.get(),
-                &tag);
-            res = find_camera_metadata_ro_entry(result->result, tag, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                metering = entry.data.i32[0];
+            if (_metadata_watch.found(_watch_ids[META_WATCH_EXPOSURE_METERING])) {
+                int32_t metering =
+                    _metadata_watch.get<int32_t>(_watch_ids[META_WATCH_EXPOSURE_METERING], 0, -1);
                 if (metering != _config->_meta_stat.expMetering) {
                     _config->_dump_log->print("frame:%d expMetering:%d\n", result->frame_number,
                                               metering);
@@ -388,14 +288,9 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
         }
 
         if (_config->_meta_dump.selPriority) {
-            camera_metadata_ro_entry entry;
-            uint32_t tag = 0;
-            int32_t priority = -1;
-            android::CameraMetadata::getTagFromName(
-                "org.codeaurora.qcamera3.iso_exp_priority.select_priority", vTags.get(), &tag);
-            res = find_camera_metadata_ro_entry(result->result, tag, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                priority = entry.data.i32[0];
+            if (_metadata_watch.found(_watch_ids[META_WATCH_SELECT_PRIORITY])) {
+                int32_t priority =
+                    _metadata_watch.get<int32_t>(_watch_ids[META_WATCH_SELECT_PRIORITY], 0, -1);
                 if (priority != _config->_meta_stat.selPriority) {
                     _config->_dump_log->print("frame:%d select priority:%d\n", result->frame_number,
                                               priority);
@@ -405,14 +300,9 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
         }
 
         if (_config->_meta_dump.expPriority) {
-            camera_metadata_ro_entry entry;
-            uint32_t tag = 0;
-            int64_t priority = -1;
-            android::CameraMetadata::getTagFromName(
-                "org.codeaurora.qcamera3.iso_exp_priority.use_iso_exp_priority", vTags.get(), &tag);
-            res = find_camera_metadata_ro_entry(result->result, tag, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                priority = entry.data.i64[0];
+            if (_metadata_watch.found(_watch_ids[META_WATCH_ISO_EXP_PRIORITY])) {
+                int64_t priority =
+                    _metadata_watch.get<int64_t>(_watch_ids[META_WATCH_ISO_EXP_PRIORITY], 0, -1);
                 if (priority != _config->_meta_stat.expPriority) {
                     _config->_dump_log->print("frame:%d ios exp priority:%lld\n",
                                               result->frame_number, priority);
@@ -421,12 +311,8 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.jpegquality) {
-            camera_metadata_ro_entry entry;
-            int jpeg_quality = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_JPEG_QUALITY, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                jpeg_quality = entry.data.u8[0];
-            }
+            int jpeg_quality =
+                _metadata_watch.get<uint8_t>(_watch_ids[META_WATCH_JPEG_QUALITY], 0, 0);
             if (jpeg_quality != _config->_meta_stat.jpegquality) {
                 _config->_dump_log->print("frame:%d jpegquality value = %d mMetaStat %d\n",
                                           result->frame_number, jpeg_quality,
@@ -435,12 +321,11 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.showCropRegion) {
-            camera_metadata_ro_entry entry;
             int32_t cropregion[4] = {0};
             int i = 0;
-            res = find_camera_metadata_ro_entry(result->result, ANDROID_SCALER_CROP_REGION, &entry);
-            if ((res == 0) && (entry.count > 0)) {
-                memcpy(cropregion, &(entry.data.i32[0]), sizeof(cropregion));
+            for (i = 0; i < 4; i++) {
+                cropregion[i] =
+                    _metadata_watch.get<int32_t>(_watch_ids[META_WATCH_CROP_REGION], i, 0);
             }
             for (i = 0; i < 4; i++) {
                 if (cropregion[i] != _config->_meta_stat.cropregion[i]) {
@@ -455,19 +340,12 @@ void QCamxCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *resu
             }
         }
         if (_config->_meta_dump.temperature) {
-            camera_metadata_ro_entry entry;
-            int temperature = 0;
-
-            if (_tag_id_temperature != 0) {
-                res = find_camera_metadata_ro_entry(result->result, _tag_id_temperature, &entry);
-
-                if ((res == 0) && (entry.count > 0)) {
-                    temperature = entry.data.i64[0];
-
-                    if (temperature != _config->_meta_stat.temperature) {
-                        _config->_dump_log->print("Temperature:%.2f\n", ((float)temperature) / 100);
-                        _config->_meta_stat.temperature = temperature;
-                    }
+            if (_metadata_watch.found(_watch_ids[META_WATCH_TEMPERATURE])) {
+                int temperature =
+                    _metadata_watch.get<int64_t>(_watch_ids[META_WATCH_TEMPERATURE], 0, 0);
+                if (temperature != _config->_meta_stat.temperature) {
+                    _config->_dump_log->print("Temperature:%.2f\n", ((float)temperature) / 100);
+                    _config->_meta_stat.temperature = temperature;
                 }
             }
         }
@@ -484,7 +362,53 @@ void QCamxCase::close_camera() {
 }
 
 void QCamxCase::set_callbacks(qcamx_hal3_test_cbs_t *callbacks) {
+    for (size_t i = 0; i < _callback_subscriptions.size(); i++) {
+        _device->_frame_hub.unsubscribe(_callback_subscriptions[i]);
+    }
+    _callback_subscriptions.clear();
     _callbacks = callbacks;
+    if (_callbacks == NULL) {
+        return;
+    }
+    const struct {
+        StreamType type;
+        bool enabled;
+    } subscriptions[] = {
+        {PREVIEW_TYPE, _callbacks->preview_cb != NULL},
+        {IRBG_TYPE, _callbacks->preview_cb != NULL},
+        {VIDEO_TYPE, _callbacks->video_cb != NULL},
+        {DEPTH_TYPE, _callbacks->video_cb != NULL},
+        {SNAPSHOT_TYPE, _callbacks->snapshot_cb != NULL},
+        {RAW_SNAPSHOT_TYPE, _callbacks->snapshot_cb != NULL},
+    };
+    for (size_t i = 0; i < sizeof(subscriptions) / sizeof(subscriptions[0]); i++) {
+        if (!subscriptions[i].enabled) {
+            continue;
+        }
+        // inline like the callbacks always were, the packed copy is shared by them
+        int id = _device->_frame_hub.subscribe(subscriptions[i].type, &QCamxCase::legacy_callback,
+                                               this, 0, FRAME_POLICY_DROP_OLDEST);
+        if (id >= 0) {
+            _callback_subscriptions.push_back(id);
+        }
+    }
+}
+
+int QCamxCase::subscribe_frames(StreamType stream_type, FrameSubscriberFunc func, void *user_data,
+                                int queue_depth, int policy) {
+    return _device->_frame_hub.subscribe(stream_type, func, user_data, queue_depth, policy);
+}
+
+void QCamxCase::unsubscribe_frames(int id) {
+    _device->_frame_hub.unsubscribe(id);
+}
+
+bool QCamxCase::get_stream_metrics(StreamType stream_type, StreamMetricsSnapshot *snapshot) {
+    return _device->_stream_metrics.get_snapshot(stream_type, snapshot);
+}
+
+void QCamxCase::report_stream_metrics() {
+    _device->_stream_metrics.report("command");
 }
 
 void QCamxCase::trigger_dump(int count, int interval) {
@@ -507,134 +431,156 @@ void QCamxCase::updata_metadata(android::CameraMetadata *meta) {
     _device->update_metadata_for_next_request(meta);
 }
 
-static inline uint32_t ALIGN(uint32_t operand, uint32_t alignment) {
-    uint32_t remainder = (operand % alignment);
-    return (0 == remainder) ? operand : operand - remainder + alignment;
+size_t QCamxCase::dump_frame(BufferInfo *info, unsigned int frame_num, StreamType dump_type,
+                             Implsubformat subformat) {
+    return QCamxFrameDump::write_file(DUMP_FILE_DIR, info, frame_num, dump_type, subformat,
+                                      time(NULL));
 }
 
-void QCamxCase::dump_frame(BufferInfo *info, unsigned int frame_num, StreamType dump_type,
-                           Implsubformat subformat) {
-    uint8_t *data = (uint8_t *)info->vaddr;
-    int size = info->size;
-    int width = info->width;
-    int height = info->height;
-    int stride = info->stride;
-    int slice = info->slice;
-    uint32_t format = info->format;
-    int plane_cnt = 1;
-    int pixel_byte = 1;
-
-    if ((static_cast<uint32_t>(HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED) == format) &&
-        ((YUV420NV12 == subformat) || (YUV420NV21 == subformat))) {
-        format = HAL_PIXEL_FORMAT_YCBCR_420_888;
+void QCamxCase::dump_frame_async(CameraStream *stream, buffer_handle_t *buffer,
+                                 unsigned int frame_num, StreamType dump_type,
+                                 Implsubformat subformat) {
+    if (_device->_dump_writer.is_running()) {
+        _device->_dump_writer.enqueue(stream->buffer_manager, buffer, frame_num, dump_type,
+                                      subformat, &QCamxCase::dump_frame);
+        return;
+    }
+    BufferInfo *info = stream->buffer_manager->get_buffer_info(buffer);
+    if (info != NULL && _device->_dump_container.is_open()) {
+        _device->_dump_container.append(info, frame_num, dump_type, subformat, systemTime());
+    } else if (info != NULL) {
+        dump_frame(info, frame_num, dump_type, subformat);
     }
+}
+
+/**************************** protected method *************************************/
+void QCamxCase::publish_frame(CameraStream *stream, buffer_handle_t *buffer, unsigned int frame_num,
+                              StreamType stream_type) {
+    publish_frame(stream, buffer, frame_num, stream_type, get_subformat(stream_type));
+}
 
-    char fname[256];
-    time_t timer;
-    time(&timer);
-    struct tm *t = localtime(&timer);
-    snprintf(fname, sizeof(fname), "%s/%s_w[%d]_h[%d]_id[%d]_%4d%02d%02d_%02d%02d%02d.%s",
-             "/data/misc/camera/", get_stream_type_string(dump_type), width, height, frame_num,
-             t->tm_year + 1900, t->tm_mon + 1, t->tm_mday, t->tm_hour, t->tm_min, t->tm_sec,
-             get_file_type_string(format));
+void QCamxCase::publish_frame(CameraStream *stream, buffer_handle_t *buffer, unsigned int frame_num,
+                              StreamType stream_type, Implsubformat subformat) {
+    _device->_frame_hub.publish(stream->buffer_manager, buffer, frame_num, stream_type, subformat);
+}
 
-    FILE *fd = fopen(fname, "wb");
+BufferInfo *QCamxCase::get_callback_buffer(BufferInfo *info, StreamType type) {
+    if (info == NULL || (!_config->_callback_packed && _config->_raw_unpack_threads <= 0)) {
+        return info;
+    }
+    Implsubformat subformat = get_subformat(type);
+    uint32_t format = info->format;
+    if (format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED &&
+        (subformat == YUV420NV12 || subformat == YUV420NV21)) {
+        format = HAL_PIXEL_FORMAT_YCBCR_420_888;
+    }
 
+    uint8_t *src = (uint8_t *)info->vaddr;
+    int width = info->width;
+    int height = info->height;
+    size_t stride = info->stride;
+    size_t packed_size = 0;
+    uint32_t packed_format = info->format;
     switch (format) {
         case HAL_PIXEL_FORMAT_RAW10:
         case HAL_PIXEL_FORMAT_RAW12: {
-            fwrite(data, size, 1, fd);
+            if (_config->_raw_unpack_threads <= 0) {
+                return info;
+            }
+            packed_size = (size_t)width * height * sizeof(uint16_t);
+            _callback_pack_buffer.resize(packed_size);
+            int bits = format == HAL_PIXEL_FORMAT_RAW10 ? 10 : 12;
+            QCamxImageKernels::unpack_mipi_raw((uint16_t *)_callback_pack_buffer.data(), src, bits,
+                                               width, height, stride);
+            // handed on as RAW16, the stride is in pixels then
+            format = HAL_PIXEL_FORMAT_RAW16;
+            packed_format = HAL_PIXEL_FORMAT_RAW16;
             break;
         }
-        case HAL_PIXEL_FORMAT_BLOB: {
-            struct Camera3JPEGBlob jpegBlob;
-            size_t jpeg_eof_offset = (size_t)(size - (size_t)sizeof(jpegBlob));
-            uint8_t *jpeg_eof = &data[jpeg_eof_offset];
-            memcpy(&jpegBlob, jpeg_eof, sizeof(Camera3JPEGBlob));
-
-            if (jpegBlob.JPEGBlobId == JPEG_BLOB_ID) {
-                fwrite(data, jpegBlob.JPEGBlobSize, 1, fd);
-            } else {
-                QCAMX_ERR("Failed to Get Picture size:%d\n", size);
-                fwrite(data, size, 1, fd);
-            }
-            break;
-        }
-        case HAL_PIXEL_FORMAT_YCBCR_420_888:
-        case HAL_PIXEL_FORMAT_Y16: {
-            if (format == HAL_PIXEL_FORMAT_Y16) {
-                plane_cnt = 1;
-                pixel_byte = 2;
-            } else {
-                plane_cnt = 2;
-                pixel_byte = 1;
-            }
-
-            for (int idx = 1; idx <= plane_cnt; idx++) {
-                for (int h = 0; h < height / idx; h++) {
-                    fwrite(data, (width * pixel_byte), 1, fd);
-                    data += stride;
-                }
-                data += stride * (slice - height);
-            }
+        case HAL_PIXEL_FORMAT_YCBCR_420_888: {
+            if (!_config->_callback_packed) {
+                return info;
+            }
+            if (stride == (size_t)width && info->slice == height) {
+                return info;
+            }
+            packed_size = QCamxImageKernels::get_yuv420_size(width, height);
+            _callback_pack_buffer.resize(packed_size);
+            Yuv420Layout layout = subformat == YUV420NV21 ? YUV420_NV21 : YUV420_NV12;
+            QCamxImageKernels::convert_yuv420(_callback_pack_buffer.data(), layout, src, layout,
+                                              width, height, stride, info->slice);
             break;
         }
+        case HAL_PIXEL_FORMAT_Y16:
         case HAL_PIXEL_FORMAT_RAW16: {
-            // RAW16, 2 Bytes hold 1 pixel data
-            plane_cnt = 1;
-            pixel_byte = 2;
-            for (int idx = 1; idx <= plane_cnt; idx++) {
-                for (int h = 0; h < height / idx; h++) {
-                    fwrite(data, (width * pixel_byte), 1, fd);
-                    data += stride * pixel_byte;
-                }
+            if (!_config->_callback_packed) {
+                return info;
             }
-            break;
-        }
-        case HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED: {
-            const UBWCYUVTileInfo *pTileInfo = &SupportedUBWCYUVTileInfo[0];
-            YUVFormat Plane[2];
-            plane_cnt = 2;
-            memset(Plane, 0, sizeof(Plane));
-
-            for (int idx = 0; idx < plane_cnt; idx++) {
-                // calculate plane size
-                Plane[idx].width = width;
-                Plane[idx].height = height >> idx;
-                unsigned int localWidth = ALIGN(Plane[idx].width, pTileInfo->widthPixels);
-                Plane[idx].width =
-                    (localWidth / pTileInfo->BPPDenominator) * pTileInfo->BPPNumerator;
-                float local1 = static_cast<float>(static_cast<float>(Plane[idx].width) /
-                                                  pTileInfo->widthBytes) /
-                               64;
-                Plane[idx].metadataStride = static_cast<uint32_t>(ceil(local1)) * 1024;
-                float local2 =
-                    static_cast<float>(static_cast<float>(Plane[idx].height) / pTileInfo->height) /
-                    16;
-                unsigned int localMetaSize =
-                    static_cast<uint32_t>(ceil(local2)) * Plane[idx].metadataStride;
-                Plane[idx].metadataSize = ALIGN(localMetaSize, 4096);
-                Plane[idx].metadataHeight = Plane[idx].metadataSize / Plane[idx].metadataStride;
-                Plane[idx].planeStride = ALIGN(Plane[idx].width, pTileInfo->widthMacroTile);
-                Plane[idx].sliceHeight = ALIGN(Plane[idx].height, pTileInfo->heightMacroTile);
-                Plane[idx].pixelPlaneSize =
-                    ALIGN((Plane[idx].planeStride * Plane[idx].sliceHeight), 4096);
-                Plane[idx].planeSize = Plane[idx].metadataSize + Plane[idx].pixelPlaneSize;
-                // write data
-                fwrite(data, Plane[idx].planeSize, 1, fd);
-                data += Plane[idx].planeSize;
+            // the RAW16 stride is in pixels, the Y16 stride in bytes
+            if (format == HAL_PIXEL_FORMAT_RAW16) {
+                stride *= sizeof(uint16_t);
             }
+            if (stride == width * sizeof(uint16_t)) {
+                return info;
+            }
+            packed_size = (size_t)width * height * sizeof(uint16_t);
+            _callback_pack_buffer.resize(packed_size);
+            QCamxImageKernels::pack_16bit((uint16_t *)_callback_pack_buffer.data(), src, width,
+                                          height, stride);
             break;
         }
-        default: {
-            QCAMX_ERR("No matched formats!");
-            break;
-        }
+        default:
+            // compressed or tiled, nothing to pack
+            return info;
     }
-    fclose(fd);
+    _callback_info = *info;
+    _callback_info.format = packed_format;
+    _callback_info.vaddr = _callback_pack_buffer.data();
+    _callback_info.size = (int)packed_size;
+    // keep the stride unit of the format
+    _callback_info.stride = format == HAL_PIXEL_FORMAT_Y16 ? width * 2 : width;
+    _callback_info.slice = height;
+    _callback_info.fd = -1;
+    return &_callback_info;
+}
+
+void QCamxCase::update_frame_stats(BufferInfo *info, StreamType type, unsigned int frame_num) {
+    int stream_bit = 0;
+    Implsubformat subformat = get_subformat(type);
+    frame_stats_t *stats = NULL;
+    if (type == PREVIEW_TYPE) {
+        stream_bit = FRAME_STATS_PREVIEW;
+        stats = &_config->_meta_stat.previewStats;
+    } else if (type == VIDEO_TYPE) {
+        stream_bit = FRAME_STATS_VIDEO;
+        stats = &_config->_meta_stat.videoStats;
+    }
+    if (!(_config->_frame_stats & stream_bit)) {
+        return;
+    }
+    compute_frame_stats(info, type, subformat, frame_num, stats);
+}
+
+void QCamxCase::compute_frame_stats(BufferInfo *info, StreamType type, Implsubformat subformat,
+                                    unsigned int frame_num, frame_stats_t *stats) {
+    if (info == NULL || !_frame_stats.is_running()) {
+        return;
+    }
+    uint32_t format = info->format;
+    if (format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED &&
+        (subformat == YUV420NV12 || subformat == YUV420NV21)) {
+        format = HAL_PIXEL_FORMAT_YCBCR_420_888;
+    }
+    if (_frame_stats.compute(info, format, frame_num, stats) != 0) {
+        return;
+    }
+    _config->_dump_log->print(
+        "frame:%d %s luma mean = %.1f clip = %.4f sharpness = %.1f tiles %d/%d step %d %dus\n",
+        frame_num, QCamxFrameDump::get_stream_type_string(type), stats->lumaMean,
+        stats->clipRatio, stats->sharpness, stats->tilesDone, stats->tilesTotal, stats->rowStep,
+        stats->costUs);
 }
 
-/**************************** protected method *************************************/
 bool QCamxCase::init(camera_module_t *module, QCamxConfig *config) {
     _metadata_ext = NULL;
 
@@ -642,14 +588,6 @@ bool QCamxCase::init(camera_module_t *module, QCamxConfig *config) {
     _dump_video_num = 0;
     _dump_interval = 0;
 
-    _preview_frame_count = 0;
-    _preview_last_frame_count = 0;
-    _preview_last_fps_time = 0;
-
-    _video_frame_count = 0;
-    _video_last_frame_count = 0;
-    _video_last_fps_time = 0;
-
     _callbacks = NULL;
 
     if (module != NULL && config != NULL) {
@@ -663,11 +601,19 @@ bool QCamxCase::init(camera_module_t *module, QCamxConfig *config) {
         return false;
     }
 
+    QCamxImageKernels::set_worker_threads(_config->_raw_unpack_threads);
+    QCamxFrameDump::set_unpack_raw(_config->_raw_unpack_threads > 0);
+    if (_config->_frame_stats != 0) {
+        _frame_stats.start(_config->_frame_stats_threads, _config->_frame_stats_budget);
+    }
+
     _tag_id_temperature = 0;
     android::sp<android::VendorTagDescriptor> vendor_tag =
         android::VendorTagDescriptor::getGlobalVendorTagDescriptor();
     android::CameraMetadata::getTagFromName("com.qti.chi.temperature.temperature", vendor_tag.get(),
                                             &_tag_id_temperature);
+    _metadata_watch_ready = false;
+    update_metadata_watch();
 
     camera_metadata_ro_entry active_array_size =
         ((const android::CameraMetadata)_config->_static_meta)
@@ -690,84 +636,134 @@ bool QCamxCase::init(camera_module_t *module, QCamxConfig *config) {
 }
 
 void QCamxCase::deinit() {
+    // the subscriptions go with the frame hub of the device
+    _callback_subscriptions.clear();
     if (_device) {
         delete _device;
         _device = NULL;
     }
 }
 
-void QCamxCase::show_fps(StreamType stream_type) {
-    volatile unsigned int *frame_count = NULL;
-    volatile unsigned int *last_frame_count = NULL;
-    volatile nsecs_t *last_fps_time = NULL;
-    const char *tag = NULL;
-
-    if (stream_type == PREVIEW_TYPE) {
-        frame_count = &_preview_frame_count;
-        last_fps_time = &_preview_last_fps_time;
-        last_frame_count = &_preview_last_frame_count;
-        tag = "PROFILE_PREVIEW_FRAMES_PER_SECOND";
-    } else if (stream_type == VIDEO_TYPE) {
-        frame_count = &_video_frame_count;
-        last_fps_time = &_video_last_fps_time;
-        last_frame_count = &_video_last_frame_count;
-        tag = "PROFILE_VIDEO_FRAMES_PER_SECOND";
-    } else {
-        QCAMX_ERR("invalid stream!");
-        return;
+void QCamxCase::scan_metadata(camera3_capture_result *result) {
+    // the meta dump selection may be changed by a command while streaming
+    if (!_metadata_watch_ready ||
+        memcmp(&_watched_dump, &_config->_meta_dump, sizeof(meta_dump_t)) != 0) {
+        update_metadata_watch();
     }
-
-    nsecs_t now = systemTime();
-    volatile nsecs_t diff = now - (*last_fps_time);
-
-    if (diff > s2ns(1)) {
-        double fps =
-            (((double)((*frame_count) - (*last_frame_count))) * (double)(s2ns(1))) / (double)diff;
-        QCAMX_DBG("CAMERA %d, %s: %.4f, frameCount %d\n", _config->_camera_id, tag, fps,
-                  (*frame_count));
-        (*last_fps_time) = now;
-        (*last_frame_count) = (*frame_count);
+    _metadata_watch.scan(result->result);
+    // the frames published from now on carry these, see QCamxFrame::metadata
+    int exposure_id = _watch_ids[META_WATCH_EXPOSURE_TIME];
+    int iso_id = _watch_ids[META_WATCH_ISO];
+    int ae_state_id = _watch_ids[META_WATCH_AE_STATE];
+    if (_metadata_watch.found(exposure_id) || _metadata_watch.found(iso_id) ||
+        _metadata_watch.found(ae_state_id)) {
+        _device->_frame_hub.set_frame_result(
+            result->frame_number, _metadata_watch.get<int64_t>(exposure_id, 0, -1),
+            _metadata_watch.get<int32_t>(iso_id, 0, -1),
+            _metadata_watch.found(ae_state_id) ? _metadata_watch.get<uint8_t>(ae_state_id, 0, 0)
+                                               : -1);
     }
+}
 
-    // increate current frame count
-    *frame_count = (*frame_count) + 1;
+Implsubformat QCamxCase::get_subformat(StreamType type) {
+    if (type == PREVIEW_TYPE || type == IRBG_TYPE) {
+        return _config->_preview_stream.subformat;
+    } else if (type == VIDEO_TYPE || type == DEPTH_TYPE) {
+        return _config->_video_stream.subformat;
+    } else if (type == SNAPSHOT_TYPE) {
+        return _config->_snapshot_stream.subformat;
+    }
+    return None;
 }
 
-static inline const char *get_stream_type_string(StreamType type) {
-    switch (type) {
+void QCamxCase::legacy_callback(QCamxFrame *frame, void *user_data) {
+    QCamxCase *test_case = (QCamxCase *)user_data;
+    qcamx_hal3_test_cbs_t *callbacks = test_case->_callbacks;
+    pthread_mutex_lock(&test_case->_callback_lock);
+    BufferInfo *info = test_case->get_callback_buffer(frame->info, frame->type);
+    switch (frame->type) {
         case PREVIEW_TYPE:
-            return "preview";
+        case IRBG_TYPE:
+            callbacks->preview_cb(info, frame->frame_number);
             break;
         case VIDEO_TYPE:
-            return "video";
-            break;
-        case SNAPSHOT_TYPE:
-            return "snapshot";
-            break;
-        case RAW_SNAPSHOT_TYPE:
-            return "raw";
-            break;
         case DEPTH_TYPE:
-            return "depth";
+            callbacks->video_cb(info, frame->frame_number);
             break;
-        case IRBG_TYPE:
-            return "irbg";
+        default:
+            callbacks->snapshot_cb(info, frame->frame_number);
             break;
     }
-    return "";
+    pthread_mutex_unlock(&test_case->_callback_lock);
 }
 
-static inline const char *get_file_type_string(uint32_t format) {
-    if (format == HAL_PIXEL_FORMAT_Y16) {
-        return "y16";
-    } else if (format == HAL_PIXEL_FORMAT_RAW10 || format == HAL_PIXEL_FORMAT_RAW16 ||
-               format == HAL_PIXEL_FORMAT_RAW12) {
-        return "raw";
-    } else if (format == HAL_PIXEL_FORMAT_BLOB) {
-        return "jpg";
-    } else if (format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED) {
-        return "ubwc";
-    } else {
-        return "yuv";
+void QCamxCase::update_metadata_watch() {
+    const meta_dump_t &dump = _config->_meta_dump;
+    const struct {
+        MetadataWatchId id;
+        bool enabled;
+        uint32_t tag;
+        const char *tag_name;  ///< vendor tag resolved by name when not NULL
+    } watches[] = {
+        // always watched, every frame carries them
+        {META_WATCH_EXPOSURE_TIME, true, ANDROID_SENSOR_EXPOSURE_TIME, NULL},
+        {META_WATCH_ISO, true, ANDROID_SENSOR_SENSITIVITY, NULL},
+        {META_WATCH_AE_MODE, dump.aeMode != 0, ANDROID_CONTROL_AE_MODE, NULL},
+        {META_WATCH_AWB_MODE, dump.awbMode != 0, ANDROID_CONTROL_AWB_MODE, NULL},
+        {META_WATCH_AF_MODE, dump.afMode != 0, ANDROID_CONTROL_AF_MODE, NULL},
+        {META_WATCH_FOCUS_DISTANCE, dump.afValue != 0, ANDROID_LENS_FOCUS_DISTANCE, NULL},
+        {META_WATCH_AE_ANTIBANDING, dump.aeAntiMode != 0, ANDROID_CONTROL_AE_ANTIBANDING_MODE,
+         NULL},
+        {META_WATCH_COLOR_CORRECTION_MODE, dump.colorCorrectMode != 0,
+         ANDROID_COLOR_CORRECTION_MODE, NULL},
+        {META_WATCH_COLOR_CORRECTION_GAINS, dump.colorCorrectValue != 0,
+         ANDROID_COLOR_CORRECTION_GAINS, NULL},
+        {META_WATCH_CONTROL_MODE, dump.controlMode != 0, ANDROID_CONTROL_MODE, NULL},
+        {META_WATCH_ASD_RESULTS, dump.sceneMode != 0, 0, "org.quic.camera2.asdresults.ASDResults"},
+        {META_WATCH_HDR_SCENE, dump.hdrMode != 0, 0, "org.codeaurora.qcamera3.stats.is_hdr_scene"},
+        {META_WATCH_CROP_REGION, dump.zoomValue != 0 || dump.showCropRegion != 0,
+         ANDROID_SCALER_CROP_REGION, NULL},
+        {META_WATCH_ZSL, dump.zslMode != 0, ANDROID_CONTROL_ENABLE_ZSL, NULL},
+        {META_WATCH_MFNR_FRAMES, dump.numFrames != 0, 0,
+         "org.quic.camera2.mfnrconfigs.MFNRTotalNumFrames"},
+        {META_WATCH_EXPOSURE_METERING, dump.expMetering != 0, 0,
+         "org.codeaurora.qcamera3.exposure_metering.exposure_metering_mode"},
+        {META_WATCH_SELECT_PRIORITY, dump.selPriority != 0, 0,
+         "org.codeaurora.qcamera3.iso_exp_priority.select_priority"},
+        {META_WATCH_ISO_EXP_PRIORITY, dump.expPriority != 0, 0,
+         "org.codeaurora.qcamera3.iso_exp_priority.use_iso_exp_priority"},
+        {META_WATCH_JPEG_QUALITY, dump.jpegquality != 0, ANDROID_JPEG_QUALITY, NULL},
+        {META_WATCH_TEMPERATURE, dump.temperature != 0 && _tag_id_temperature != 0,
+         _tag_id_temperature, NULL},
+        // the SAT info is always shown by the video cases
+        {META_WATCH_SAT_CAMERA_ID, dump.SatCamId >= 0, 0,
+         "org.quic.camera2.sensormode.info.SATCameraId"},
+        {META_WATCH_SAT_ACTIVE_ARRAY, true, 0,
+         "org.quic.camera2.sensormode.info.SATActiveSensorArray"},
+        {META_WATCH_SAT_CROP_REGION, true, 0,
+         "org.quic.camera2.sensormode.info.SATScalerCropRegion"},
+        {META_WATCH_RAW_SIZE, dump.rawsize != 0, 0, "com.qti.chi.multicamerainfo.MasterRawSize"},
+        // always watched, every frame carries it and the zsl ring picks its snapshot by it
+        {META_WATCH_AE_STATE, true, ANDROID_CONTROL_AE_STATE, NULL},
+    };
+    static_assert(sizeof(watches) / sizeof(watches[0]) == META_WATCH_MAX,
+                  "every MetadataWatchId needs a watch entry");
+
+    _metadata_watch.clear();
+    for (uint32_t i = 0; i < sizeof(watches) / sizeof(watches[0]); i++) {
+        int id = -1;
+        if (watches[i].enabled) {
+            id = watches[i].tag_name != NULL ? _metadata_watch.add(watches[i].tag_name)
+                                             : _metadata_watch.add(watches[i].tag);
+        }
+        _watch_ids[watches[i].id] = id;
     }
-}
\ No newline at end of file
+    _watched_dump = dump;
+    _metadata_watch_ready = true;
+}
+
+void QCamxCase::update_stream_metrics(StreamType stream_type, unsigned int frame_num) {
+    FrameMetadata metadata;
+    _device->_frame_hub.get_frame_metadata(frame_num, &metadata);
+    _device->_stream_metrics.record_frame(stream_type, metadata.timestamp);
+}
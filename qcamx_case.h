@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <pthread.h>
 #include <stdint.h>
 
 #include <vector>
@@ -13,6 +14,11 @@
 #include "qcamx_config.h"
 #include "qcamx_define.h"
 #include "qcamx_device.h"
+#include "qcamx_frame_dump.h"
+#include "qcamx_frame_hub.h"
+#include "qcamx_frame_stats.h"
+#include "qcamx_image_kernels.h"
+#include "qcamx_metadata_watch.h"
 
 #define JPEG_QUALITY_DEFAULT (85)
 #define PREVIEW_STREAM_BUFFER_MAX (12)
@@ -21,54 +27,49 @@
 #define RAW_STREAM_BUFFER_MAX (8)
 #define VIDEO_STREAM_BUFFER_MAX (18)
 #define HFR_VIDEO_STREAM_BUFFER_MAX (40)
-#define JPEG_BLOB_ID (0xFF)
 
 typedef struct _StreamCapture {
     StreamType type;
     int count;
 } StreamCapture;
 
-struct Camera3JPEGBlob {
-    uint16_t JPEGBlobId;
-    uint32_t JPEGBlobSize;
-};
-
+// legacy callbacks, called inline by frame hub subscribers, the buffer is valid during the call
 typedef struct qcamx_hal3_test_cbs {
     void (*preview_cb)(BufferInfo *info, int frameNum);
     void (*snapshot_cb)(BufferInfo *info, int frameNum);
     void (*video_cb)(BufferInfo *info, int frameNum);
 } qcamx_hal3_test_cbs_t;
 
-struct UBWCYUVTileInfo {
-    unsigned int widthPixels;      ///< Tile width in pixels
-    unsigned int widthBytes;       ///< Tile width in pixels
-    unsigned int height;           ///< Tile height
-    unsigned int widthMacroTile;   ///< Macro tile width
-    unsigned int heightMacroTile;  ///< Macro tile height
-    unsigned int BPPNumerator;     ///< Bytes per pixel (numerator)
-    unsigned int BPPDenominator;   ///< Bytes per pixel (denominator)
-};
-
-struct YUVFormat {
-    uint32_t width;   ///< Width of the YUV plane in pixels.
-                      ///  Tile aligned width in bytes for UBWC
-    uint32_t height;  ///< Height of the YUV plane in pixels.
-    uint32_t
-        planeStride;  ///< The number of bytes between the first byte of two sequential lines on plane 1. It may be
-    ///  greater than nWidth * nDepth / 8 if the line includes padding.
-    ///  Macro-tile width aligned for UBWC
-    uint32_t
-        sliceHeight;  ///< The number of lines in the plane which can be equal to or larger than actual frame height.
-    ///  Tile height aligned for UBWC
-
-    uint32_t metadataStride;  ///< Aligned meta data plane stride in bytes, used for UBWC formats
-    uint32_t metadataHeight;  ///< Aligned meta data plane height in bytes, used for UBWC formats
-    uint32_t metadataSize;    ///< Aligned metadata plane size in bytes, used for UBWC formats
-    uint32_t
-        pixelPlaneSize;  ///< Aligned pixel plane size in bytes, calculated once for UBWC formats
-                         ///< and stored thereafter, since the calculations are expensive
-    size_t planeSize;    ///< Size in pixels for this plane.
-};
+// result metadata watched for the meta dump and the frame metadata, index of
+// QCamxCase::_watch_ids
+typedef enum {
+    META_WATCH_EXPOSURE_TIME = 0,
+    META_WATCH_ISO,
+    META_WATCH_AE_MODE,
+    META_WATCH_AWB_MODE,
+    META_WATCH_AF_MODE,
+    META_WATCH_FOCUS_DISTANCE,
+    META_WATCH_AE_ANTIBANDING,
+    META_WATCH_COLOR_CORRECTION_MODE,
+    META_WATCH_COLOR_CORRECTION_GAINS,
+    META_WATCH_CONTROL_MODE,
+    META_WATCH_ASD_RESULTS,
+    META_WATCH_HDR_SCENE,
+    META_WATCH_CROP_REGION,
+    META_WATCH_ZSL,
+    META_WATCH_MFNR_FRAMES,
+    META_WATCH_EXPOSURE_METERING,
+    META_WATCH_SELECT_PRIORITY,
+    META_WATCH_ISO_EXP_PRIORITY,
+    META_WATCH_JPEG_QUALITY,
+    META_WATCH_TEMPERATURE,
+    META_WATCH_SAT_CAMERA_ID,
+    META_WATCH_SAT_ACTIVE_ARRAY,
+    META_WATCH_SAT_CROP_REGION,
+    META_WATCH_RAW_SIZE,
+    META_WATCH_AE_STATE,
+    META_WATCH_MAX,
+} MetadataWatchId;
 
 class QCamxCase : public DeviceCallback {
 public:  // DeviceCallback function
@@ -96,14 +97,32 @@ public:
     */
     void close_camera();
     /**
-     * @brief callback function for case
+     * @brief callback function for case, replaces the callbacks set before
     */
     void set_callbacks(qcamx_hal3_test_cbs_t *callbacks);
+    /**
+     * @brief hand the frames of a stream type to func without copying them
+     * @param queue_depth frames waiting for func, 0 calls it on the post process thread
+     * @param policy FrameQueuePolicy when the queue is full
+     * @return subscription id, -1 on failure
+    */
+    int subscribe_frames(StreamType stream_type, FrameSubscriberFunc func, void *user_data,
+                         int queue_depth = 4, int policy = FRAME_POLICY_DROP_OLDEST);
+    void unsubscribe_frames(int id);
     /**
      * @brief trigger dump image
      * @param count image count 
     */
-    void trigger_dump(int count, int interval = 0);
+    virtual void trigger_dump(int count, int interval = 0);
+    /**
+     * @brief fps, interval percentiles and drops of a stream type
+     * @return false if no buffer of the stream type arrived yet
+    */
+    bool get_stream_metrics(StreamType stream_type, StreamMetricsSnapshot *snapshot);
+    /**
+     * @brief print the stream metrics of every stream type seen, one key=value line each
+    */
+    void report_stream_metrics();
 public:  //metadata operation
     void set_current_metadata(android::CameraMetadata *metadata);
     android::CameraMetadata *get_current_meta();
@@ -113,12 +132,19 @@ public:
      * @brief dump one frame to file
      * @param frame_num current frame num
      * @param dump_type dump frame type
+     * @return bytes written
     */
-    static void dump_frame(BufferInfo *info, unsigned int frame_num, StreamType dump_type,
-                           Implsubformat subformat);
+    static size_t dump_frame(BufferInfo *info, unsigned int frame_num, StreamType dump_type,
+                             Implsubformat subformat);
+    /**
+     * @brief hand one frame to the dump writer, written inline if the writer is not running
+     *        goes to the dump container instead of its own file when the container is open
+    */
+    void dump_frame_async(CameraStream *stream, buffer_handle_t *buffer, unsigned int frame_num,
+                          StreamType dump_type, Implsubformat subformat);
 public:
-    QCamxCase() {}
-    virtual ~QCamxCase() {}
+    QCamxCase() { pthread_mutex_init(&_callback_lock, NULL); }
+    virtual ~QCamxCase() { pthread_mutex_destroy(&_callback_lock); }
 protected:
     /**
      * @brief initialization of variables
@@ -129,9 +155,53 @@ protected:
     */
     void deinit();
     /**
-     * @brief show preview stream / video stream frame fps
+     * @brief count one buffer of a stream in the stream metrics of the device
+    */
+    void update_stream_metrics(StreamType stream_type, unsigned int frame_num);
+    /**
+     * @brief hand one buffer to the frame subscribers of its stream type
     */
-    void show_fps(StreamType stream_type);
+    void publish_frame(CameraStream *stream, buffer_handle_t *buffer, unsigned int frame_num,
+                       StreamType stream_type);
+    void publish_frame(CameraStream *stream, buffer_handle_t *buffer, unsigned int frame_num,
+                       StreamType stream_type, Implsubformat subformat);
+    /**
+     * @brief read all watched tags of a result into _metadata_watch
+     * @detail the watch table is rebuilt only when the meta dump selection changed, the
+     *         exposure, sensitivity and AE state of the result go to the frame hub
+    */
+    void scan_metadata(camera3_capture_result *result);
+    /**
+     * @brief buffer handed to the public callbacks
+     * @return info itself, or a packed copy without stride padding when enabled by the config,
+     *         RAW10/RAW12 are unpacked to RAW16 with rawunpack, the copy is valid until the next
+     *         call
+    */
+    BufferInfo *get_callback_buffer(BufferInfo *info, StreamType type);
+    /**
+     * @brief compute the luma statistics of a frame into _meta_stat when the config enables them
+     *        for its stream, and print them to the meta dump log
+    */
+    void update_frame_stats(BufferInfo *info, StreamType type, unsigned int frame_num);
+    /**
+     * @brief compute the luma statistics of a frame into stats and print them to the meta dump
+     *        log, whatever the config selects
+    */
+    void compute_frame_stats(BufferInfo *info, StreamType type, Implsubformat subformat,
+                             unsigned int frame_num, frame_stats_t *stats);
+private:
+    /**
+     * @brief resolve the tags selected by the meta dump config into the watch table
+    */
+    void update_metadata_watch();
+    /**
+     * @brief subformat of the configured stream a stream type belongs to
+    */
+    Implsubformat get_subformat(StreamType type);
+    /**
+     * @brief frame subscriber calling the legacy callback of the frame stream type
+    */
+    static void legacy_callback(QCamxFrame *frame, void *user_data);
 public:
     camera_module_t *_module;
     QCamxConfig *_config;
@@ -144,17 +214,20 @@ protected:
     unsigned int _dump_preview_num;
     unsigned int _dump_video_num;
     unsigned int _dump_interval;
-    // calc preview stream fps value
-    volatile unsigned int _preview_frame_count;       // current preview frame count
-    volatile unsigned int _preview_last_frame_count;  // before calc fps preview frame count
-    volatile nsecs_t _preview_last_fps_time;          // before calc fps preivew current time
-    // calc video frame fps value
-    volatile unsigned int _video_frame_count;
-    volatile unsigned int _video_last_frame_count;
-    volatile nsecs_t _video_last_fps_time;
 
     std::vector<Stream *> _streams;
 
     qcamx_hal3_test_cbs_t *_callbacks;
+    std::vector<int> _callback_subscriptions;  ///< frame hub ids of the legacy callbacks
+    // frames are published from the result and the command thread, the packed copy is shared
+    pthread_mutex_t _callback_lock;
+    std::vector<uint8_t> _callback_pack_buffer;
+    BufferInfo _callback_info;
+    QCamxFrameStats _frame_stats;
     uint32_t _tag_id_temperature;
+
+    QCamxMetadataWatch _metadata_watch;
+    int _watch_ids[META_WATCH_MAX];  ///< watch id of each MetadataWatchId, -1 if not watched
+    meta_dump_t _watched_dump;       ///< meta dump selection _metadata_watch was built for
+    bool _metadata_watch_ready;
 };
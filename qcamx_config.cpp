@@ -11,6 +11,7 @@
 
 #include "qcamx_config.h"
 
+#include <hardware/gralloc.h>
 #include <log/log.h>
 #include <string.h>
 #include <unistd.h>
@@ -41,11 +42,28 @@ QCamxConfig::QCamxConfig() {
 
     // Enable ZSL by default
     _zsl_enabled = true;
+    _zsl_depth = 0;
 
     //disable IRBG
     _depth_IRBG_enabled = false;
 
     _show_fps = 0;
+    _timeline_period = 0;
+    _inflight_control = 0;
+    _dump_threads = 1;
+    _dump_queue_depth = 4;
+    _dump_policy = 0;
+    _dump_container_size = 0;
+    _callback_packed = 0;
+    _raw_unpack_threads = 0;
+    _frame_stats = 0;
+    _frame_stats_threads = 2;
+    _frame_stats_budget = 2000;
+    _frame_export = 0;
+    _hal_buffer_manage = 0;
+    _hfr_batch = 1;
+    memset(_pipeline_streams, 0, sizeof(_pipeline_streams));
+    _pipeline_stream_num = 0;
 
     memset(&_meta_dump, 0, sizeof(meta_dump_t));
     _dump_log = new QCamxLog("/data/misc/camera/test1.log");
@@ -653,6 +671,22 @@ int QCamxConfig::parse_commandline_add(int ordersize, char *order) {
         LOG_FILE,
         FORCE_OPMODE,
         SHOW_FPS,
+        TIMELINE_PERIOD,
+        INFLIGHT_CONTROL,
+        DUMP_THREADS,
+        DUMP_QUEUE_DEPTH,
+        DUMP_POLICY,
+        DUMP_CONTAINER,
+        CALLBACK_PACKED,
+        RAW_UNPACK,
+        FRAME_STATS,
+        FRAME_STATS_THREADS,
+        FRAME_STATS_BUDGET,
+        FRAME_EXPORT,
+        PIPELINE,
+        ZSL_DEPTH,
+        HAL_BUFFER_MANAGE,
+        HFR_BATCH,
     };
     char *const token[] = {[ID_OPT] = (char *const)"id",
                            [PREVIEW_SIZE_OPT] = (char *const)"psize",
@@ -678,6 +712,22 @@ int QCamxConfig::parse_commandline_add(int ordersize, char *order) {
                            [LOG_FILE] = (char *const)"logfile",
                            [FORCE_OPMODE] = (char *const)"forceopmode",
                            [SHOW_FPS] = (char *const)"showfps",
+                           [TIMELINE_PERIOD] = (char *const)"timeline",
+                           [INFLIGHT_CONTROL] = (char *const)"inflight",
+                           [DUMP_THREADS] = (char *const)"dumpthreads",
+                           [DUMP_QUEUE_DEPTH] = (char *const)"dumpqueue",
+                           [DUMP_POLICY] = (char *const)"dumppolicy",
+                           [DUMP_CONTAINER] = (char *const)"dumpcontainer",
+                           [CALLBACK_PACKED] = (char *const)"cbpacked",
+                           [RAW_UNPACK] = (char *const)"rawunpack",
+                           [FRAME_STATS] = (char *const)"framestats",
+                           [FRAME_STATS_THREADS] = (char *const)"statsthreads",
+                           [FRAME_STATS_BUDGET] = (char *const)"statsbudget",
+                           [FRAME_EXPORT] = (char *const)"export",
+                           [PIPELINE] = (char *const)"pipeline",
+                           [ZSL_DEPTH] = (char *const)"zsldepth",
+                           [HAL_BUFFER_MANAGE] = (char *const)"halbuf",
+                           [HFR_BATCH] = (char *const)"hfrbatch",
                            NULL};
     enum {
         CONTROL_RATE_CONSTANT = 1,
@@ -954,6 +1004,119 @@ int QCamxConfig::parse_commandline_add(int ordersize, char *order) {
                 _show_fps = show_fps;
                 break;
             }
+            case TIMELINE_PERIOD: {
+                int timeline_period = 0;
+                sscanf(value, "%d", &timeline_period);
+                QCAMX_PRINT("timeline period:%d\n", timeline_period);
+                _timeline_period = timeline_period;
+                break;
+            }
+            case INFLIGHT_CONTROL: {
+                int inflight_control = 0;
+                sscanf(value, "%d", &inflight_control);
+                QCAMX_PRINT("inflight control:%d\n", inflight_control);
+                _inflight_control = inflight_control;
+                break;
+            }
+            case DUMP_THREADS: {
+                int dump_threads = 0;
+                sscanf(value, "%d", &dump_threads);
+                QCAMX_PRINT("dump threads:%d\n", dump_threads);
+                _dump_threads = dump_threads;
+                break;
+            }
+            case DUMP_QUEUE_DEPTH: {
+                int dump_queue_depth = 0;
+                sscanf(value, "%d", &dump_queue_depth);
+                QCAMX_PRINT("dump queue depth:%d\n", dump_queue_depth);
+                _dump_queue_depth = dump_queue_depth;
+                break;
+            }
+            case DUMP_POLICY: {
+                int dump_policy = 0;
+                sscanf(value, "%d", &dump_policy);
+                QCAMX_PRINT("dump policy:%d\n", dump_policy);
+                _dump_policy = dump_policy;
+                break;
+            }
+            case DUMP_CONTAINER: {
+                int dump_container_size = 0;
+                sscanf(value, "%d", &dump_container_size);
+                QCAMX_PRINT("dump container size:%dMB\n", dump_container_size);
+                _dump_container_size = dump_container_size;
+                break;
+            }
+            case CALLBACK_PACKED: {
+                int callback_packed = 0;
+                sscanf(value, "%d", &callback_packed);
+                QCAMX_PRINT("callback packed:%d\n", callback_packed);
+                _callback_packed = callback_packed;
+                break;
+            }
+            case RAW_UNPACK: {
+                int raw_unpack_threads = 0;
+                sscanf(value, "%d", &raw_unpack_threads);
+                QCAMX_PRINT("raw unpack threads:%d\n", raw_unpack_threads);
+                _raw_unpack_threads = raw_unpack_threads;
+                break;
+            }
+            case FRAME_STATS: {
+                int frame_stats = 0;
+                sscanf(value, "%d", &frame_stats);
+                QCAMX_PRINT("frame stats:%d\n", frame_stats);
+                _frame_stats = frame_stats;
+                break;
+            }
+            case FRAME_STATS_THREADS: {
+                int frame_stats_threads = 0;
+                sscanf(value, "%d", &frame_stats_threads);
+                QCAMX_PRINT("frame stats threads:%d\n", frame_stats_threads);
+                _frame_stats_threads = frame_stats_threads;
+                break;
+            }
+            case FRAME_STATS_BUDGET: {
+                int frame_stats_budget = 0;
+                sscanf(value, "%d", &frame_stats_budget);
+                QCAMX_PRINT("frame stats budget:%dus\n", frame_stats_budget);
+                _frame_stats_budget = frame_stats_budget;
+                break;
+            }
+            case FRAME_EXPORT: {
+                int frame_export = 0;
+                sscanf(value, "%d", &frame_export);
+                QCAMX_PRINT("frame export max held frames per stream:%d\n", frame_export);
+                _frame_export = frame_export;
+                break;
+            }
+            case PIPELINE: {
+                QCAMX_PRINT("pipeline streams:%s\n", value);
+                if (value == NULL || parse_pipeline_streams(value) != 0) {
+                    err_found = 1;
+                }
+                mode_config |= (1 << TESTMODE_PIPELINE);
+                break;
+            }
+            case ZSL_DEPTH: {
+                int zsl_depth = 0;
+                sscanf(value, "%d", &zsl_depth);
+                QCAMX_PRINT("zsl depth:%d\n", zsl_depth);
+                _zsl_depth = zsl_depth;
+                break;
+            }
+            case HAL_BUFFER_MANAGE: {
+                int hal_buffer_manage = 0;
+                sscanf(value, "%d", &hal_buffer_manage);
+                QCAMX_PRINT("hal buffer manage:%d\n", hal_buffer_manage);
+                _hal_buffer_manage = hal_buffer_manage;
+                break;
+            }
+            case HFR_BATCH: {
+                int hfr_batch = 0;
+                sscanf(value, "%d", &hfr_batch);
+                QCAMX_PRINT("hfr batch:%d\n", hfr_batch);
+                _hfr_batch = hfr_batch;
+                break;
+            }
             default:
                 QCAMX_PRINT("WARNING Command Add unsupport order param: %s \n", value);
                 break;
@@ -978,6 +1141,9 @@ int QCamxConfig::parse_commandline_add(int ordersize, char *order) {
         case (1 << TESTMODE_DEPTH):
             _test_mode = TESTMODE_DEPTH;
             break;
+        case (1 << TESTMODE_PIPELINE):
+            _test_mode = TESTMODE_PIPELINE;
+            break;
         default:
             res = -1;
             break;
@@ -985,5 +1151,206 @@ int QCamxConfig::parse_commandline_add(int ordersize, char *order) {
     if (err_found) {
         res = -1;
     }
+    if (res == 0) {
+        build_pipeline_preset();
+    }
     return res;
 }
+
+// a stream of a preset, its size and format come from the preview or video option
+typedef struct _pipeline_preset_stream {
+    StreamType type;
+    uint32_t consumers;
+    uint32_t usage;  // 0 uses the default of the stream type
+} pipeline_preset_stream_t;
+
+// the test modes run by the pipeline case, the streams in the order they are configured
+static const struct {
+    int test_mode;
+    int stream_num;
+    pipeline_preset_stream_t streams[2];
+} s_pipeline_presets[] = {
+    {TESTMODE_PREVIEW, 1,
+     {{PREVIEW_TYPE, PIPELINE_CONSUMER_DUMP | PIPELINE_CONSUMER_STATS | PIPELINE_CONSUMER_EXPORT,
+       GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN |
+           GRALLOC_USAGE_HW_CAMERA_READ | GRALLOC_USAGE_HW_CAMERA_WRITE}}},
+    {TESTMODE_VIDEO_ONLY, 1,
+     {{VIDEO_TYPE, PIPELINE_CONSUMER_DUMP | PIPELINE_CONSUMER_ENCODER | PIPELINE_CONSUMER_EXPORT,
+       0}}},
+    {TESTMODE_PREVIEW_VIDEO_ONLY, 2,
+     {{PREVIEW_TYPE, PIPELINE_CONSUMER_DUMP | PIPELINE_CONSUMER_STATS | PIPELINE_CONSUMER_EXPORT,
+       0},
+      {VIDEO_TYPE,
+       PIPELINE_CONSUMER_DUMP | PIPELINE_CONSUMER_STATS | PIPELINE_CONSUMER_ENCODER |
+           PIPELINE_CONSUMER_EXPORT,
+       0}}},
+};
+
+/************************************************************************
+* name : build_pipeline_preset
+* function: get the pipeline streams of a preset test mode from the stream options.
+************************************************************************/
+int QCamxConfig::build_pipeline_preset() {
+    int preset = -1;
+    for (size_t i = 0; i < sizeof(s_pipeline_presets) / sizeof(s_pipeline_presets[0]); i++) {
+        if (s_pipeline_presets[i].test_mode == _test_mode) {
+            preset = i;
+            break;
+        }
+    }
+    if (preset < 0) {
+        return -1;
+    }
+    VideoMode video_mode = get_video_mode(_fps_range[1]);
+    _pipeline_stream_num = s_pipeline_presets[preset].stream_num;
+    for (int i = 0; i < _pipeline_stream_num; i++) {
+        const pipeline_preset_stream_t *preset_stream = &s_pipeline_presets[preset].streams[i];
+        const stream_info_t *info =
+            preset_stream->type == VIDEO_TYPE ? &_video_stream : &_preview_stream;
+        pipeline_stream_t *stream = &_pipeline_streams[i];
+        memset(stream, 0, sizeof(pipeline_stream_t));
+        stream->type = preset_stream->type;
+        stream->width = info->width;
+        stream->height = info->height;
+        stream->format = info->format;
+        stream->subformat = info->subformat;
+        stream->divider = 1;
+        stream->consumers = preset_stream->consumers;
+        stream->usage = preset_stream->usage;
+
+        // the statistics of a stream type are still turned on by their own option
+        int stats_bit = stream->type == VIDEO_TYPE ? FRAME_STATS_VIDEO : FRAME_STATS_PREVIEW;
+        if (!(_frame_stats & stats_bit)) {
+            stream->consumers &= ~PIPELINE_CONSUMER_STATS;
+        }
+        if (stream->type == PREVIEW_TYPE && _pipeline_stream_num > 1) {
+            // a preview next to a high frame rate video runs at most at 60fps
+            if (video_mode > VIDEO_MODE_HFR60) {
+                stream->divider = (video_mode + VIDEO_MODE_HFR60 - 1) / VIDEO_MODE_HFR60;
+            }
+            // the yuv_ubwc_enc preview format is allocated like a video stream
+            if (_preview_stream.type == CAMERA3_TEMPLATE_VIDEO_RECORD) {
+                stream->usage = GRALLOC_USAGE_PRIVATE_0 | GRALLOC_USAGE_HW_VIDEO_ENCODER |
+                                GRALLOC_USAGE_HW_CAMERA_WRITE;
+            }
+        }
+    }
+    return 0;
+}
+
+/************************************************************************
+* name : parse_pipeline_streams
+* function: get the streams of the pipeline test mode from cmd.
+************************************************************************/
+int QCamxConfig::parse_pipeline_streams(char *value) {
+    /*
+     e.g. preview:1920x1080:yuv420:1:dump+stats/video:3840x2160:yuv_ubwc:1:encoder/
+          video:1280x720:yuv420:2:export/raw:4056x3040:raw10:0:dump
+     type      preview video snapshot raw
+     format    yuv420 yuv_ubwc ubwctp10 p010 jpeg raw10 raw12 raw16 y16
+     divider   1 by default, 0 only captures on the 's' command
+     consumers dump encoder stats export, separated by '+'
+     buffers   0 by default, the buffer count of the stream type
+    */
+    _pipeline_stream_num = 0;
+    char *stream_save = NULL;
+    for (char *spec = strtok_r(value, "/", &stream_save); spec != NULL;
+         spec = strtok_r(NULL, "/", &stream_save)) {
+        if (_pipeline_stream_num >= PIPELINE_STREAM_MAX) {
+            QCAMX_PRINT("pipeline supports %d streams at most\n", PIPELINE_STREAM_MAX);
+            return -1;
+        }
+        pipeline_stream_t *stream = &_pipeline_streams[_pipeline_stream_num];
+        memset(stream, 0, sizeof(pipeline_stream_t));
+        stream->divider = 1;
+
+        char *field_save = NULL;
+        char *type = strtok_r(spec, ":", &field_save);
+        char *size = strtok_r(NULL, ":", &field_save);
+        char *format = strtok_r(NULL, ":", &field_save);
+        char *divider = strtok_r(NULL, ":", &field_save);
+        char *consumers = strtok_r(NULL, ":", &field_save);
+        char *buffers = strtok_r(NULL, ":", &field_save);
+        if (type == NULL || size == NULL || format == NULL ||
+            sscanf(size, "%dx%d", &stream->width, &stream->height) != 2) {
+            QCAMX_PRINT("wrong pipeline stream %d, type:WxH:format is needed\n",
+                        _pipeline_stream_num);
+            return -1;
+        }
+
+        if (!strcmp("preview", type)) {
+            stream->type = PREVIEW_TYPE;
+        } else if (!strcmp("video", type)) {
+            stream->type = VIDEO_TYPE;
+        } else if (!strcmp("snapshot", type)) {
+            stream->type = SNAPSHOT_TYPE;
+        } else if (!strcmp("raw", type)) {
+            stream->type = RAW_SNAPSHOT_TYPE;
+        } else {
+            QCAMX_PRINT("unsupported pipeline stream type:%s\n", type);
+            return -1;
+        }
+
+        if (!strcmp("yuv420", format)) {
+            stream->format = HAL_PIXEL_FORMAT_YCBCR_420_888;
+        } else if (!strcmp("yuv_ubwc", format)) {
+            stream->format = HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED;
+            stream->subformat = UBWCNV12;
+        } else if (!strcmp("ubwctp10", format)) {
+            stream->format = HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED;
+            stream->subformat = UBWCTP10;
+        } else if (!strcmp("p010", format)) {
+            stream->format = HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED;
+            stream->subformat = P010;
+        } else if (!strcmp("jpeg", format)) {
+            stream->format = HAL_PIXEL_FORMAT_BLOB;
+        } else if (!strcmp("raw10", format)) {
+            stream->format = HAL_PIXEL_FORMAT_RAW10;
+        } else if (!strcmp("raw12", format)) {
+            stream->format = HAL_PIXEL_FORMAT_RAW12;
+        } else if (!strcmp("raw16", format)) {
+            stream->format = HAL_PIXEL_FORMAT_RAW16;
+        } else if (!strcmp("y16", format)) {
+            stream->format = HAL_PIXEL_FORMAT_Y16;
+        } else {
+            QCAMX_PRINT("unsupported pipeline stream format:%s\n", format);
+            return -1;
+        }
+
+        if (divider != NULL) {
+            stream->divider = atoi(divider);
+        }
+        if (stream->divider < 0) {
+            QCAMX_PRINT("wrong pipeline stream divider:%s\n", divider);
+            return -1;
+        }
+
+        char *consumer_save = NULL;
+        for (char *consumer = consumers ? strtok_r(consumers, "+", &consumer_save) : NULL;
+             consumer != NULL; consumer = strtok_r(NULL, "+", &consumer_save)) {
+            if (!strcmp("dump", consumer)) {
+                stream->consumers |= PIPELINE_CONSUMER_DUMP;
+            } else if (!strcmp("encoder", consumer)) {
+                stream->consumers |= PIPELINE_CONSUMER_ENCODER;
+            } else if (!strcmp("stats", consumer)) {
+                stream->consumers |= PIPELINE_CONSUMER_STATS;
+            } else if (!strcmp("export", consumer)) {
+                stream->consumers |= PIPELINE_CONSUMER_EXPORT;
+            } else if (strcmp("none", consumer)) {
+                QCAMX_PRINT("unsupported pipeline stream consumer:%s\n", consumer);
+                return -1;
+            }
+        }
+
+        if (buffers != NULL) {
+            stream->buffers = atoi(buffers);
+        }
+        QCAMX_PRINT("pipeline stream %d: type:%d %dx%d format:%d subformat:%d divider:%d "
+                    "consumers:0x%x buffers:%d\n",
+                    _pipeline_stream_num, stream->type, stream->width, stream->height,
+                    stream->format, stream->subformat, stream->divider, stream->consumers,
+                    stream->buffers);
+        _pipeline_stream_num++;
+    }
+    return _pipeline_stream_num > 0 ? 0 : -1;
+}
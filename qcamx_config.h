@@ -7,6 +7,8 @@
  *             needed when snapshot requests in NonZSL or ZSL mode
  *  Video: There are preview, video and snapshot streams, it is needed
  *         when video/liveshot
+ *  pipeline : The streams listed by the pipeline option, any mix of up to
+ *             PIPELINE_STREAM_MAX preview, video, snapshot and raw streams
 */
 #pragma once
 
@@ -28,6 +30,7 @@ using namespace qcamx;
 #define TESTMODE_VIDEO_ONLY 3
 #define TESTMODE_PREVIEW_VIDEO_ONLY 4
 #define TESTMODE_DEPTH 5
+#define TESTMODE_PIPELINE 6
 
 // stream info struct for a stream
 typedef struct _stream_info {
@@ -39,6 +42,26 @@ typedef struct _stream_info {
     int request_number;
 } stream_info_t;
 
+#define PIPELINE_STREAM_MAX (4)
+// consumers of a pipeline stream, bits of pipeline_stream_t::consumers
+#define PIPELINE_CONSUMER_DUMP (1 << 0)
+#define PIPELINE_CONSUMER_ENCODER (1 << 1)
+#define PIPELINE_CONSUMER_STATS (1 << 2)
+#define PIPELINE_CONSUMER_EXPORT (1 << 3)
+
+// one stream of the pipeline test mode
+typedef struct _pipeline_stream {
+    StreamType type;  // preview, video, snapshot or raw
+    int width;
+    int height;
+    int format;
+    Implsubformat subformat;
+    int divider;  // requested on one of divider frames, 0 only on a capture command
+    uint32_t consumers;
+    int buffers;     // 0 uses the default of the stream type
+    uint32_t usage;  // gralloc usage, 0 uses the default of the stream type
+} pipeline_stream_t;
+
 // Settings for item selection which is needed to dump/show as user's order.
 typedef struct _meta_dump {
     int exposureValue;
@@ -68,6 +91,25 @@ typedef struct _meta_dump {
     int rawsize;
 } meta_dump_t;
 
+#define FRAME_STATS_HIST_BINS (64)
+// streams the luma statistics are computed on, bits of QCamxConfig::_frame_stats
+#define FRAME_STATS_PREVIEW (1 << 0)
+#define FRAME_STATS_VIDEO (1 << 1)
+
+// luma statistics of the last frame of a stream
+typedef struct _frame_stats {
+    unsigned int frameNum;
+    float lumaMean;
+    uint32_t lumaHist[FRAME_STATS_HIST_BINS];  // sampled pixels, 4 luma levels per bin
+    float clipRatio;                           // part of the sampled pixels which are clipped
+    float sharpness;                           // mean squared luma gradient
+    uint32_t samples;
+    int rowStep;     // rows sampled, one of rowStep
+    int tilesDone;   // tiles finished within the budget
+    int tilesTotal;
+    int costUs;
+} frame_stats_t;
+
 // Saving the Metadata Value status
 typedef struct _meta_stat {
     uint64_t exposure_time;
@@ -93,6 +135,8 @@ typedef struct _meta_stat {
     int camId;
     int activeArray[4];
     int cropRegion[4];
+    frame_stats_t previewStats;
+    frame_stats_t videoStats;
 } meta_stat_t;
 
 typedef struct _video_bitrate_config {
@@ -118,10 +162,43 @@ public:
     video_bitrate_config_t _video_rate_config;
     //zsl
     bool _zsl_enabled;
+    // snapshot stream frames kept for zero shutter lag, 0 captures a new frame per snapshot
+    int _zsl_depth;
     //
     bool _depth_IRBG_enabled;
-    // show fps statics
+    // stream metrics report interval in second, 0 only reports on stop
     int _show_fps;
+    // frame latency timeline summary interval in second, 0 only reports on stop
+    int _timeline_period;
+    // in-flight request limit control, 0: fixed 1: adaptive 2: adaptive and log every decision
+    int _inflight_control;
+    // dump writer threads, 0 writes dumps on the post process thread
+    int _dump_threads;
+    // dumps waiting for a writer thread, each holds one stream buffer
+    int _dump_queue_depth;
+    // dump queue full, 0: drop the oldest dump 1: skip the new dump
+    int _dump_policy;
+    // dump container preallocation in MB, 0 dumps every frame to its own file
+    int _dump_container_size;
+    // pack the buffers handed to the callbacks, without stride padding
+    int _callback_packed;
+    // threads unpacking MIPI RAW10/RAW12 to 16 bit for the dumps and callbacks, 0 keeps them packed
+    int _raw_unpack_threads;
+    // luma statistics of the streams, FRAME_STATS_PREVIEW | FRAME_STATS_VIDEO, 0 disables them
+    int _frame_stats;
+    // threads computing the luma statistics of a frame
+    int _frame_stats_threads;
+    // luma statistics time budget of a frame in us
+    int _frame_stats_budget;
+    // frames of a stream the frame export clients may hold together, 0 disables the export
+    int _frame_export;
+    // let the HAL request the stream buffers when it needs them, the pools grow on demand then
+    int _hal_buffer_manage;
+    // submit fps / 30 requests back to back in a constrained high speed session, 0 one by one
+    int _hfr_batch;
+    // streams of the pipeline test mode, in the order they are configured
+    pipeline_stream_t _pipeline_streams[PIPELINE_STREAM_MAX];
+    int _pipeline_stream_num;
 
     //dump
     /*
@@ -148,9 +225,22 @@ public:
     android::CameraMetadata _static_meta;
 public:
     int parse_commandline_add(int ordersize, char *order);
+    /**
+     * @brief fill _pipeline_streams with the preset of the test mode, from the stream options
+     * @return 0, -1 if the test mode has no preset and keeps a case of its own
+    */
+    int build_pipeline_preset();
     int parse_commandline_meta_dump(int ordersize, char *order);
     int parse_commandline_meta_update(char *order, android::CameraMetadata *meta_update);
 public:
     QCamxConfig();
     ~QCamxConfig();
+private:
+    /**
+     * @brief parse the stream list of the pipeline test mode into _pipeline_streams
+     * @param value streams separated by '/', each type:WxH:format[:divider[:consumers[:buffers]]]
+     *        with the consumers separated by '+', e.g. preview:1920x1080:yuv420:1:dump+stats
+     * @return 0 on success, -1 on a wrong stream
+    */
+    int parse_pipeline_streams(char *value);
 };
@@ -36,6 +36,23 @@ typedef enum {
     VIDEO_MODE_MAX,
 } VideoMode;
 
+/**
+ * @brief video mode of a max frame rate, VIDEO_MODE_NORMAL above the HFR modes as well
+*/
+static inline VideoMode get_video_mode(int fps) {
+    static const VideoMode modes[] = {VIDEO_MODE_HFR60, VIDEO_MODE_HFR90, VIDEO_MODE_HFR120,
+                                      VIDEO_MODE_HFR240, VIDEO_MODE_HFR480};
+    if (fps <= VIDEO_MODE_NORMAL) {
+        return VIDEO_MODE_NORMAL;
+    }
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        if (fps <= modes[i]) {
+            return modes[i];
+        }
+    }
+    return VIDEO_MODE_NORMAL;
+}
+
 // sensor max framerate
 #define MAX_SENSOR_FPS (480)
 #define LIVING_REQUEST_APPEND (7)
@@ -1,6 +1,11 @@
 
 #include "qcamx_device.h"
 
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "qcamx_define.h"
 
 #ifdef LOG_TAG
@@ -8,6 +13,11 @@
 #endif
 #define LOG_TAG "QCamxHAL3TestDevice"
 
+static_assert(CAMX_INFLIGHT_RING_SIZE >= CAMX_LIVING_REQUEST_MAX + HFR_LIVING_REQUEST_APPEND,
+              "in-flight ring can not hold the max living request");
+static_assert(TIMELINE_MAX_STREAMS >= MAXSTREAM, "frame timeline can not hold every stream");
+static_assert(QCAMX_EXPORT_MAX_STREAMS >= MAXSTREAM, "frame export can not tell every stream");
+
 QCamxDevice::QCamxDevice(camera_module_t *camera_module, int camera_id, QCamxConfig *Config,
                          int mode)
     : _camera_module(camera_module), _camera_id(camera_id), _config(Config) {
@@ -23,10 +33,30 @@ QCamxDevice::QCamxDevice(camera_module_t *camera_module, int camera_id, QCamxCon
     pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
     pthread_cond_init(&_pending_cond, &attr);
     pthread_condattr_destroy(&attr);
+    _pending_count = 0;
+    _pending_waiters = 0;
+    _inflight_waiting = 0;
+    _inflight_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_inflight_event_fd < 0) {
+        QCAMX_ERR("create in-flight eventfd failed:%s\n", strerror(errno));
+    }
+    _wake_to_submit_count = 0;
+    _wake_to_submit_total_ns = 0;
+    _wake_to_submit_max_ns = 0;
+    _request_batch_size = 1;
+    _submit_cpu_ns = 0;
+    _submit_frames = 0;
+    _submit_calls = 0;
+    _settings_sent = 0;
+    _settings_requests = 0;
 
     struct camera_info info;
     _camera_module->get_camera_info(_camera_id, &info);
     _camera_characteristics = (camera_metadata_t *)info.static_camera_characteristics;
+    _partial_result_count = 1;
+    _hal_buffer_managed = false;
+    _hal_buffer_requests = 0;
+    _hal_buffer_failures = 0;
 
     // NODE(anxs) : must init default value, otherwise will cause callback function not working
     _living_request_ext_append = 0;
@@ -36,6 +66,9 @@ QCamxDevice::~QCamxDevice() {
     pthread_mutex_destroy(&_setting_metadata_lock);
     pthread_mutex_destroy(&_pending_lock);
     pthread_cond_destroy(&_pending_cond);
+    if (_inflight_event_fd >= 0) {
+        close(_inflight_event_fd);
+    }
 }
 
 /*************************public method*****************************/
@@ -55,6 +88,15 @@ bool QCamxDevice::open_camera() {
     res = _camera3_device->ops->initialize(_camera3_device, _callback_ops);
     res = _camera_module->get_camera_info(_camera_id, &info);
     _camera_characteristics = (camera_metadata_t *)info.static_camera_characteristics;
+    {
+        camera_metadata_ro_entry entry;
+        res = find_camera_metadata_ro_entry(_camera_characteristics,
+                                            ANDROID_REQUEST_PARTIAL_RESULT_COUNT, &entry);
+        _partial_result_count = (res == 0 && entry.count > 0) ? entry.data.i32[0] : 1;
+    }
+    _hal_buffer_managed = _config->_hal_buffer_manage != 0 && hal_buffer_manage_supported(info);
+    QCAMX_PRINT("stream buffers %s\n",
+                _hal_buffer_managed ? "requested by the hal" : "preallocated per request");
 
     QCAMX_PRINT("open camera device id %d success\n", _camera_id);
     return true;
@@ -70,6 +112,12 @@ void QCamxDevice::pre_allocate_streams(std::vector<Stream *> streams) {
     for (uint32_t i = 0; i < streams.size(); i++) {
         QCamxBufferManager *buffer_manager = new QCamxBufferManager();
         int stream_buffer_max = streams[i]->pstream->max_buffers;
+        // frames held by the export clients are not available to the HAL
+        if (_config->_frame_export > 0 && streams[i]->type < QCAMX_EXPORT_STREAM_TYPES) {
+            stream_buffer_max += QCamxFrameExport::get_hold_budget(_config->_frame_export);
+        }
+        // a pool of HAL requested buffers starts empty and grows up to the max on demand
+        int initial_buffers = _hal_buffer_managed ? 0 : stream_buffer_max;
         Implsubformat subformat = streams[i]->subformat;
         QCAMX_PRINT("Subformat for stream %d: %d\n", i, subformat);
 
@@ -77,16 +125,17 @@ void QCamxDevice::pre_allocate_streams(std::vector<Stream *> streams) {
             int size =
                 get_jpeg_buffer_size(streams[i]->pstream->width, streams[i]->pstream->height);
 
-            buffer_manager->allocate_buffers(stream_buffer_max, size, 1,
+            buffer_manager->allocate_buffers(initial_buffers, size, 1,
                                              (int32_t)(streams[i]->pstream->format),
                                              streams[i]->pstream->usage, streams[i]->pstream->usage,
                                              streams[i]->type, subformat);
         } else {
             buffer_manager->allocate_buffers(
-                stream_buffer_max, streams[i]->pstream->width, streams[i]->pstream->height,
+                initial_buffers, streams[i]->pstream->width, streams[i]->pstream->height,
                 (int32_t)(streams[i]->pstream->format), streams[i]->pstream->usage,
                 streams[i]->pstream->usage, streams[i]->type, subformat);
         }
+        buffer_manager->set_max_buffers(stream_buffer_max);
         _buffer_manager[i] = buffer_manager;
     }
 }
@@ -113,6 +162,7 @@ bool QCamxDevice::config_streams(std::vector<Stream *> streams, int op_mode) {
         _camera_streams[i] = new_stream;
         new_stream->stream_id = i;
         _camera_streams[i]->buffer_manager = _buffer_manager[i];
+        _buffer_manager[i]->set_frame_timeline(&_timeline, i);
     }
 
     // update the operation_mode with mConfig->mRangeMode(0/1), mImageType(0/1/2/3/4)
@@ -127,6 +177,19 @@ bool QCamxDevice::config_streams(std::vector<Stream *> streams, int op_mode) {
         _camera3_stream_config.operation_mode = _config->_force_opmode;
     }
     _camera3_stream_config.streams = _camera3_streams.data();
+    _request_batch_size = 1;
+    if ((_camera3_stream_config.operation_mode & 0xFFFF) ==
+            CAMERA3_STREAM_CONFIGURATION_CONSTRAINED_HIGH_SPEED_MODE &&
+        _config->_hfr_batch != 0) {
+        // the HAL processes fps / 30 requests as one batch
+        _request_batch_size = _config->_fps_range[1] / 30;
+        if (_request_batch_size > CAMX_REQUEST_BATCH_MAX) {
+            _request_batch_size = CAMX_REQUEST_BATCH_MAX;
+        } else if (_request_batch_size < 1) {
+            _request_batch_size = 1;
+        }
+        QCAMX_PRINT("high speed session, request batch size:%d\n", _request_batch_size);
+    }
 
     /**
      * Assignment clones metadata buffer.
@@ -158,58 +221,93 @@ bool QCamxDevice::config_streams(std::vector<Stream *> streams, int op_mode) {
         result = false;
     }
     _init_metadata.unlock(_camera3_stream_config.session_parameters);
+
+    // a new session starts without settings in the HAL
+    _request_settings.resend();
     return result;
 }
 
 void QCamxDevice::stop_streams() {
     // stop the request thread
-    pthread_mutex_lock(&_request_thread->mutex);
     CameraRequestMsg *rqMsg = new CameraRequestMsg();
+    memset(rqMsg, 0, sizeof(CameraRequestMsg));
     rqMsg->message_type = START_STOP;
     rqMsg->stop = 1;
-    _request_thread->message_queue.push_back(rqMsg);
-    QCAMX_INFO("Msg for stop request queue size:%zu\n", _request_thread->message_queue.size());
-    pthread_cond_signal(&_request_thread->cond);
-    pthread_mutex_unlock(&_request_thread->mutex);
+    post_request_message(rqMsg);
     pthread_join(_request_thread->thread, NULL);
     pthread_mutex_destroy(&_request_thread->mutex);
-    pthread_cond_destroy(&_request_thread->cond);
+    deinit_thread_events(_request_thread);
     delete _request_thread;
     _request_thread = NULL;
+    uint64_t wake_count = _wake_to_submit_count.load();
+    if (wake_count > 0) {
+        QCAMX_PRINT("request thread wake to submit: count:%" PRIu64 " avg:%" PRIu64
+                    "us max:%" PRIu64 "us\n",
+                    wake_count, _wake_to_submit_total_ns.load() / wake_count / 1000,
+                    _wake_to_submit_max_ns.load() / 1000);
+    }
+    uint64_t submit_frames = _submit_frames.load();
+    if (submit_frames > 0) {
+        QCAMX_PRINT("request thread submit cpu: frames:%" PRIu64 " batch:%d avg:%.2fus/frame\n",
+                    submit_frames, _request_batch_size,
+                    _submit_cpu_ns.load() / 1000.0 / submit_frames);
+    }
+    QCAMX_PRINT("request settings: sent with %u of %u requests, %u updates queued\n",
+                _settings_sent, _settings_requests, _request_settings.get_update_count());
     // then flush all the request
     //flush();
     // then stop the result process thread
-    pthread_mutex_lock(&_result_thread->mutex);
-    CameraPostProcessMsg *msg = new CameraPostProcessMsg();
-    msg->stop = 1;
+    CameraPostProcessMsg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.stop = 1;
     _result_thread->stopped = 1;
-    _result_thread->message_queue.push_back(msg);
-    QCAMX_INFO("Msg for stop result queue size:%zu\n", _result_thread->message_queue.size());
-    pthread_cond_signal(&_result_thread->cond);
-    pthread_mutex_unlock(&_result_thread->mutex);
+    post_capture_result(msg);
+    QCAMX_INFO("Msg for stop result queue size:%zu\n", _result_ring.size());
     pthread_join(_result_thread->thread, NULL);
+    // no new dumps now, the queued ones still hold buffers of the managers deleted below
+    _dump_writer.stop();
+    _frame_export.stop();
+    // subscribers still holding frames hold buffers of the managers deleted below too
+    _frame_hub.flush();
+    _frame_hub.report();
+    // the zsl history holds buffers of the managers deleted below as well
+    _zsl_ring.stop();
+    _dump_container.close();
+    _timeline.report("stop");
+    _stream_metrics.report("stop");
+    _inflight_controller.report();
     // wait for all request back
-    pthread_mutex_lock(&_pending_lock);
     int tryCount = 5;
-    while (!_pending_vector.isEmpty() && tryCount > 0) {
-        QCAMX_INFO("wait for pending vector empty:%zu\n", _pending_vector.size());
-        struct timespec tv;
-        clock_gettime(CLOCK_MONOTONIC, &tv);
-        tv.tv_sec += 1;
-        if (pthread_cond_timedwait(&_pending_cond, &_pending_lock, &tv) != 0) {
+    while (_pending_count.load() > 0 && tryCount > 0) {
+        QCAMX_INFO("wait for pending request empty:%d\n", _pending_count.load());
+        if (wait_inflight_slot(0, 1, 1) != 0) {
             tryCount--;
         }
-        continue;
     }
-    if (!_pending_vector.isEmpty()) {
-        QCAMX_ERR("ERROR: request pending vector not empty after stop frame:%d !!\n",
-                  _pending_vector.keyAt(0));
-        _pending_vector.clear();
+    if (_pending_count.load() > 0) {
+        for (int i = 0; i < CAMX_INFLIGHT_RING_SIZE; i++) {
+            int64_t frame_number = _pending_ring[i]._frame_number.load();
+            if (frame_number != -1) {
+                QCAMX_ERR("ERROR: request pending not empty after stop frame:%" PRId64 " !!\n",
+                          frame_number);
+                _pending_ring[i]._frame_number = -1;
+            }
+        }
+        _pending_count = 0;
     }
-    pthread_mutex_unlock(&_pending_lock);
+    if (_hal_buffer_managed) {
+        // the HAL gives the buffers it still holds back with return_stream_buffers
+        if (_camera3_device->ops->signal_stream_flush != NULL) {
+            _camera3_device->ops->signal_stream_flush(
+                _camera3_device, _camera3_streams.size(),
+                (const camera3_stream_t *const *)_camera3_streams.data());
+        }
+        wait_hal_buffers_returned(1000);
+    }
+    report_buffer_memory();
 
     pthread_mutex_destroy(&_result_thread->mutex);
-    pthread_cond_destroy(&_result_thread->cond);
+    deinit_thread_events(_result_thread);
     delete _result_thread;
     _result_thread = NULL;
     int size = (int)_camera3_streams.size();
@@ -268,7 +366,7 @@ void QCamxDevice::construct_default_request_settings(int index, camera3_request_
         android::CameraMetadata::getTagFromName("org.quic.camera.EarlyPCRenable.EarlyPCRenable",
                                                 vendor_tag_descriptor.get(), &tag);
         _current_metadata.update(tag, &(pcr), 1);
-        _setting_metadata_list.push_back(_current_metadata);
+        _request_settings.queue(_current_metadata);
 
         pthread_mutex_unlock(&_setting_metadata_lock);
     }
@@ -280,14 +378,37 @@ void *do_process_capture_request(void *data);
 int QCamxDevice::process_capture_request_on(CameraThreadData *request_thread,
                                             CameraThreadData *result_thread) {
     // init result threads
-    pthread_condattr_t attr;
-    pthread_condattr_init(&attr);
-    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
     pthread_mutex_init(&result_thread->mutex, NULL);
     pthread_mutex_init(&request_thread->mutex, NULL);
-    pthread_cond_init(&request_thread->cond, &attr);
-    pthread_cond_init(&result_thread->cond, &attr);
-    pthread_condattr_destroy(&attr);
+    _result_ring.reset();
+    _timeline.reset(_config->_timeline_period);
+    _stream_metrics.reset(_camera_id, _config->_show_fps);
+    _inflight_controller.reset(_config->_inflight_control, _config->_fps_range[1],
+                               CAMX_LIVING_REQUEST_MAX + _living_request_ext_append);
+    if (_config->_dump_container_size > 0) {
+        open_dump_container();
+    }
+    _dump_writer.start(_config->_dump_threads, _config->_dump_queue_depth, _config->_dump_policy,
+                       &_dump_container);
+    if (_config->_frame_export > 0) {
+        char export_path[128];
+        snprintf(export_path, sizeof(export_path), QCAMX_EXPORT_SOCKET_FORMAT, _camera_id);
+        _frame_export.start(export_path, _camera_id, _config->_frame_export, &_frame_hub);
+    }
+    _wake_to_submit_count = 0;
+    _wake_to_submit_total_ns = 0;
+    _wake_to_submit_max_ns = 0;
+    _submit_cpu_ns = 0;
+    _submit_frames = 0;
+    _submit_calls = 0;
+    _settings_sent = 0;
+    _settings_requests = 0;
+    if (init_thread_events(result_thread, THREAD_EVENT_RESULT) != 0 ||
+        init_thread_events(request_thread, THREAD_EVENT_MESSAGE | THREAD_EVENT_SLOT) != 0) {
+        deinit_thread_events(result_thread);
+        deinit_thread_events(request_thread);
+        return -1;
+    }
 
     pthread_attr_t result_attr;
     pthread_attr_init(&result_attr);
@@ -311,92 +432,75 @@ int QCamxDevice::process_capture_request_on(CameraThreadData *request_thread,
 
 int QCamxDevice::process_one_capture_request(int *request_number_of_each_stream,
                                              int *frame_number) {
-    pthread_mutex_lock(&_pending_lock);
-    int pending_vector_size = _pending_vector.size();
-    int max_pending_size = (CAMX_LIVING_REQUEST_MAX + _living_request_ext_append);
-    if (pending_vector_size >= max_pending_size) {
-        // QCAMX_DBG("reach max pending request : %d, max : %d\n", pending_vector_size, max_pending_size);
-        struct timespec tv;
-        clock_gettime(CLOCK_MONOTONIC, &tv);
-        tv.tv_sec += 5;
-        if (pthread_cond_timedwait(&_pending_cond, &_pending_lock, &tv) != 0) {
+    int max_pending_size = get_max_inflight();
+    if (!inflight_slot_available(*frame_number, max_pending_size)) {
+        if (wait_inflight_slot(*frame_number, max_pending_size, 5) != 0) {
             QCAMX_INFO("timeout");
-            pthread_mutex_unlock(&_pending_lock);
             return -1;
         }
     }
-    pthread_mutex_unlock(&_pending_lock);
 
-    RequestPending *pend = new RequestPending();
-    // Try to get buffer from buffer_manager
-    std::vector<camera3_stream_buffer_t> stream_buffers;
-    for (int i = 0; i < (int)_camera3_streams.size(); i++) {
-        if (request_number_of_each_stream[i] == 0) {
-            continue;
-        }
-        CameraStream *stream = _camera_streams[i];
-        camera3_stream_buffer_t stream_buffer;
-        stream_buffer.buffer = (const native_handle_t **)(stream->buffer_manager->get_buffer());
-        // make a capture request and send to HAL
-        stream_buffer.stream = _camera3_streams[i];
-        stream_buffer.status = 0;
-        stream_buffer.release_fence = -1;
-        stream_buffer.acquire_fence = -1;
-        pend->_request.num_output_buffers++;
-        stream_buffers.push_back(stream_buffer);
-        QCAMX_INFO("ProcessOneCaptureRequest for format:%d frameNumber %d.\n",
-                   stream_buffer.stream->format, *frame_number);
-    }
-    pend->_request.frame_number = *frame_number;
     // using the new metadata if needed
-    pend->_request.settings = nullptr;
-    pthread_mutex_lock(&_setting_metadata_lock);
-    if (!_setting_metadata_list.empty()) {
-        setting = _setting_metadata_list.front();
-        _setting_metadata_list.pop_front();
-        pend->_request.settings = (camera_metadata *)setting.getAndLock();
-    } else {
-        pend->_request.settings = (camera_metadata *)setting.getAndLock();
-    }
-    pthread_mutex_unlock(&_setting_metadata_lock);
-    pend->_request.input_buffer = nullptr;
-    pend->_request.output_buffers = stream_buffers.data();
-
-    pthread_mutex_lock(&_pending_lock);
-    _pending_vector.add(*frame_number, pend);
-    pthread_mutex_unlock(&_pending_lock);
-    {  // Getting AE_EXPOSURE_COMPENSATION value
+    camera_metadata *settings = _request_settings.lock();
+    if (settings != NULL && QCAMX_LOG_ENABLED(INFO)) {  // Getting AE_EXPOSURE_COMPENSATION value
         camera_metadata_ro_entry entry;
-        int res = find_camera_metadata_ro_entry(pend->_request.settings,
-                                                ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION, &entry);
+        int res = find_camera_metadata_ro_entry(settings, ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION,
+                                                &entry);
         int ae_comp = 0;
         if (res == 0 && entry.count > 0) {
             ae_comp = entry.data.i32[0];
         }
         QCAMX_INFO("AECOMP frame:%d ae_comp value = %d\n", *frame_number, ae_comp);
     }
+    RequestPending *pend =
+        prepare_capture_request(request_number_of_each_stream, *frame_number, settings);
+    pend->_submit_time = systemTime();
     int res = _camera3_device->ops->process_capture_request(_camera3_device, &(pend->_request));
     if (res != 0) {
-        int index = 0;
         QCAMX_ERR("process_capture_quest failed, frame:%d", *frame_number);
-        for (uint32_t i = 0; i < pend->_request.num_output_buffers; i++) {
-            index = find_stream_index(stream_buffers[i].stream);
-            CameraStream *stream = _camera_streams[index];
-            stream->buffer_manager->return_buffer(stream_buffers[i].buffer);
-        }
-        pthread_mutex_lock(&_pending_lock);
-        index = _pending_vector.indexOfKey(*frame_number);
-        _pending_vector.removeItemsAt(index, 1);
-        delete pend;
-        pend = NULL;
-        pthread_mutex_unlock(&_pending_lock);
+        abort_capture_request(pend);
     } else {
         (*frame_number)++;
-        if (pend->_request.settings != NULL) {
-            setting.unlock(pend->_request.settings);
+    }
+    _request_settings.unlock(settings, res == 0);
+    return res;
+}
+
+int QCamxDevice::process_capture_request_batch(int (*request_numbers)[MAXSTREAM], int batch_size,
+                                               int *frame_number) {
+    int max_pending_size = get_max_inflight();
+    // every slot of the batch is free before the settings are taken
+    if (!inflight_slot_available(*frame_number, max_pending_size, batch_size) &&
+        wait_inflight_slot(*frame_number, max_pending_size, 5, batch_size) != 0) {
+        QCAMX_INFO("timeout");
+        return -1;
+    }
+    RequestPending *pends[CAMX_REQUEST_BATCH_MAX];
+    // the first request of a high speed batch carries the settings of the whole batch
+    camera_metadata *settings = _request_settings.lock();
+    for (int i = 0; i < batch_size; i++) {
+        pends[i] = prepare_capture_request(request_numbers[i], *frame_number + i,
+                                           i == 0 ? settings : NULL);
+    }
+
+    // nothing but the HAL calls between the requests of the batch
+    int submitted = 0;
+    int res = 0;
+    for (; submitted < batch_size; submitted++) {
+        pends[submitted]->_submit_time = systemTime();
+        res = _camera3_device->ops->process_capture_request(_camera3_device,
+                                                            &(pends[submitted]->_request));
+        if (res != 0) {
+            QCAMX_ERR("process_capture_quest failed, frame:%d",
+                      pends[submitted]->_request.frame_number);
+            break;
         }
     }
-    //FIXME(anxs) why not free pend
+    for (int i = submitted; i < batch_size; i++) {
+        abort_capture_request(pends[i]);
+    }
+    *frame_number += submitted;
+    _request_settings.unlock(settings, submitted > 0);
     return res;
 }
 
@@ -445,22 +549,46 @@ int QCamxDevice::get_valid_output_streams(std::vector<AvailableStream> &output_s
 void QCamxDevice::set_current_meta(android::CameraMetadata *metadata) {
     pthread_mutex_lock(&_setting_metadata_lock);
     _current_metadata = *metadata;
-    _setting_metadata_list.push_back(_current_metadata);
+    _request_settings.queue(_current_metadata);
     pthread_mutex_unlock(&_setting_metadata_lock);
 }
 
 int QCamxDevice::update_metadata_for_next_request(android::CameraMetadata *meta) {
-    pthread_mutex_lock(&_setting_metadata_lock);
-    android::CameraMetadata _meta(*meta);
-    _setting_metadata_list.push_back(_meta);
-    pthread_mutex_unlock(&_setting_metadata_lock);
+    _request_settings.queue(*meta);
     return 0;
 }
 
+void QCamxDevice::post_request_message(CameraRequestMsg *msg) {
+    pthread_mutex_lock(&_request_thread->mutex);
+    _request_thread->message_queue.push_back(msg);
+    _request_thread->message_pending.store(1, std::memory_order_release);
+    QCAMX_INFO("Msg type:%d for request queue size:%zu\n", msg->message_type,
+               _request_thread->message_queue.size());
+    pthread_mutex_unlock(&_request_thread->mutex);
+    uint64_t value = 1;
+    if (write(_request_thread->message_fd, &value, sizeof(value)) != sizeof(value)) {
+        QCAMX_ERR("wake up request thread failed:%s\n", strerror(errno));
+    }
+}
+
 void QCamxDevice::set_callback(DeviceCallback *callback) {
     _callback = callback;
 }
 
+void QCamxDevice::post_capture_result(const CameraPostProcessMsg &msg) {
+    // every record holds at least one buffer of an in-flight request, a failed push is transient
+    while (!_result_ring.push(msg)) {
+        sched_yield();
+    }
+    // pairs with the fence in do_capture_post_process before the consumer re-checks the ring
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_result_thread->sleeping.exchange(0) != 0) {
+        uint64_t value = 1;
+        ssize_t ret = write(_result_thread->event_fd, &value, sizeof(value));
+        (void)ret;
+    }
+}
+
 int QCamxDevice::find_stream_index(camera3_stream_t *camera3_stream) {
     int n = _camera3_streams.size();
     for (int i = 0; i < n; i++) {
@@ -477,6 +605,155 @@ void QCamxDevice::flush() {
     _camera3_device->ops->flush(_camera3_device);
 }
 
+RequestPending *QCamxDevice::prepare_capture_request(int *request_number_of_each_stream,
+                                                     int frame_number,
+                                                     camera_metadata *settings) {
+    RequestPending *pend = &_pending_ring[frame_number % CAMX_INFLIGHT_RING_SIZE];
+    pend->reset();
+    // Try to get buffer from buffer_manager
+    camera3_stream_buffer_t *stream_buffers = pend->_output_buffers;
+    uint32_t stream_mask = 0;
+    for (int i = 0; i < (int)_camera3_streams.size(); i++) {
+        if (request_number_of_each_stream[i] == 0) {
+            continue;
+        }
+        CameraStream *stream = _camera_streams[i];
+        camera3_stream_buffer_t &stream_buffer = stream_buffers[pend->_request.num_output_buffers];
+        if (_hal_buffer_managed) {
+            // the HAL requests the buffer with request_stream_buffers when it needs one
+            stream_buffer.buffer = NULL;
+        } else {
+            stream_buffer.buffer = (const native_handle_t **)(stream->buffer_manager->get_buffer());
+            stream->buffer_manager->set_buffer_frame(stream_buffer.buffer, frame_number);
+        }
+        stream_mask |= 1u << i;
+        // make a capture request and send to HAL
+        stream_buffer.stream = _camera3_streams[i];
+        stream_buffer.status = 0;
+        stream_buffer.release_fence = -1;
+        stream_buffer.acquire_fence = -1;
+        pend->_request.num_output_buffers++;
+        QCAMX_INFO_RATELIMIT("ProcessOneCaptureRequest for format:%d frameNumber %d.\n",
+                             stream_buffer.stream->format, frame_number);
+    }
+    pend->_request.frame_number = frame_number;
+    pend->_request.settings = settings;
+    _settings_requests++;
+    if (settings != NULL) {
+        _settings_sent++;
+    }
+    pend->_request.input_buffer = nullptr;
+
+    // publish the slot before HAL may call back
+    _pending_count.fetch_add(1);
+    pend->_frame_number.store(frame_number, std::memory_order_release);
+    _timeline.begin_frame(frame_number, stream_mask);
+    return pend;
+}
+
+void QCamxDevice::abort_capture_request(RequestPending *pend) {
+    // forget the rejected frame before its buffers go back to the pools
+    _timeline.abort_frame(pend->_request.frame_number);
+    _settings_requests--;
+    if (pend->_request.settings != NULL) {
+        _settings_sent--;
+    }
+    for (uint32_t i = 0; i < pend->_request.num_output_buffers; i++) {
+        const camera3_stream_buffer_t *stream_buffer = &pend->_output_buffers[i];
+        if (stream_buffer->buffer == NULL) {
+            continue;
+        }
+        int index = find_stream_index(stream_buffer->stream);
+        CameraStream *stream = _camera_streams[index];
+        stream->buffer_manager->return_buffer(stream_buffer->buffer);
+    }
+    if (pend->_completed.exchange(1) == 0) {
+        release_inflight_slot(pend);
+    }
+}
+
+bool QCamxDevice::hal_buffer_manage_supported(const struct camera_info &info) {
+    if (info.device_version < CAMERA_DEVICE_API_VERSION_3_5) {
+        QCAMX_ERR("hal buffer manage needs camera device 3.5, camera %d is 0x%x\n", _camera_id,
+                  info.device_version);
+        return false;
+    }
+    camera_metadata_ro_entry entry;
+    int res = find_camera_metadata_ro_entry(
+        _camera_characteristics, ANDROID_INFO_SUPPORTED_BUFFER_MANAGEMENT_VERSION, &entry);
+    if (res != 0 || entry.count == 0 ||
+        entry.data.u8[0] != ANDROID_INFO_SUPPORTED_BUFFER_MANAGEMENT_VERSION_HIDL_DEVICE_3_5) {
+        QCAMX_ERR("camera %d does not support hal buffer manage\n", _camera_id);
+        return false;
+    }
+    return true;
+}
+
+camera3_stream_buffer_req_status_t QCamxDevice::get_hal_stream_buffers(
+    const camera3_buffer_request_t *request, camera3_stream_buffer_ret_t *ret) {
+    ret->stream = request->stream;
+    ret->num_output_buffers = 0;
+    int index = find_stream_index(request->stream);
+    if (index < 0) {
+        return CAMERA3_PS_BUF_REQ_STREAM_DISCONNECTED;
+    }
+    QCamxBufferManager *buffer_manager = _camera_streams[index]->buffer_manager;
+    if (request->num_buffers_requested > buffer_manager->get_max_buffers()) {
+        return CAMERA3_PS_BUF_REQ_MAX_BUFFER_EXCEEDED;
+    }
+    for (uint32_t i = 0; i < request->num_buffers_requested; i++) {
+        buffer_handle_t *buffer = buffer_manager->get_buffer(HAL_BUFFER_REQUEST_TIMEOUT_MS);
+        if (buffer == NULL) {
+            QCAMX_ERR("stream %d has no buffer for the hal\n", index);
+            for (uint32_t j = 0; j < i; j++) {
+                buffer_manager->return_buffer(ret->output_buffers[j].buffer);
+            }
+            return CAMERA3_PS_BUF_REQ_NO_BUFFER_AVAILABLE;
+        }
+        camera3_stream_buffer_t *stream_buffer = &ret->output_buffers[i];
+        stream_buffer->stream = request->stream;
+        stream_buffer->buffer = buffer;
+        stream_buffer->status = CAMERA3_BUFFER_STATUS_OK;
+        stream_buffer->acquire_fence = -1;
+        stream_buffer->release_fence = -1;
+    }
+    ret->num_output_buffers = request->num_buffers_requested;
+    return CAMERA3_PS_BUF_REQ_OK;
+}
+
+void QCamxDevice::wait_hal_buffers_returned(int timeout_ms) {
+    for (int waited_ms = 0;; waited_ms += 10) {
+        size_t held = 0;
+        for (size_t i = 0; i < _camera3_streams.size(); i++) {
+            QCamxBufferManager *buffer_manager = _camera_streams[i]->buffer_manager;
+            held += buffer_manager->get_buffer_count() - buffer_manager->get_free_buffer_size();
+        }
+        if (held == 0) {
+            return;
+        }
+        if (waited_ms >= timeout_ms) {
+            QCAMX_ERR("%zu buffers not returned by the hal\n", held);
+            return;
+        }
+        usleep(10000);
+    }
+}
+
+void QCamxDevice::report_buffer_memory() {
+    size_t total_bytes = 0;
+    for (size_t i = 0; i < _camera3_streams.size(); i++) {
+        QCamxBufferManager *buffer_manager = _camera_streams[i]->buffer_manager;
+        size_t bytes = buffer_manager->get_allocated_bytes();
+        QCAMX_PRINT("  stream %zu buffers:%u/%u memory:%.2fMB\n", i,
+                    buffer_manager->get_buffer_count(), buffer_manager->get_max_buffers(),
+                    bytes / 1048576.0);
+        total_bytes += bytes;
+    }
+    QCAMX_PRINT("buffer memory [%s] peak:%.2fMB hal requests:%" PRIu64 " failed:%" PRIu64 "\n",
+                _hal_buffer_managed ? "hal managed" : "preallocated", total_bytes / 1048576.0,
+                _hal_buffer_requests.load(), _hal_buffer_failures.load());
+}
+
 int QCamxDevice::get_jpeg_buffer_size(uint32_t width, uint32_t height) {
     // get max jpeg buffer size
     camera_metadata_ro_entry jpeg_bufer_max_size;
@@ -498,12 +775,152 @@ int QCamxDevice::get_jpeg_buffer_size(uint32_t width, uint32_t height) {
     return jpeg_buffer_size;
 }
 
+int QCamxDevice::wait_inflight_slot(int frame_number, int max_pending_size, int timeout_sec,
+                                    int count) {
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    tv.tv_sec += timeout_sec;
+    int res = 0;
+    pthread_mutex_lock(&_pending_lock);
+    // the waiter count must be visible before the final check, see release_inflight_slot
+    _pending_waiters.fetch_add(1);
+    while (res == 0 && !inflight_slot_available(frame_number, max_pending_size, count)) {
+        res = pthread_cond_timedwait(&_pending_cond, &_pending_lock, &tv);
+    }
+    bool available = inflight_slot_available(frame_number, max_pending_size, count);
+    _pending_waiters.fetch_sub(1);
+    pthread_mutex_unlock(&_pending_lock);
+    return available ? 0 : -1;
+}
+
+void QCamxDevice::release_inflight_slot(RequestPending *pend) {
+    pend->_frame_number.store(-1, std::memory_order_release);
+    _pending_count.fetch_sub(1);
+    // pairs with the fence in prepare_wait_inflight_slot
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_inflight_waiting.exchange(0) != 0) {
+        uint64_t value = 1;
+        ssize_t ret = write(_inflight_event_fd, &value, sizeof(value));
+        (void)ret;
+    }
+    if (_pending_waiters.load() > 0) {
+        pthread_mutex_lock(&_pending_lock);
+        pthread_cond_broadcast(&_pending_cond);
+        pthread_mutex_unlock(&_pending_lock);
+    }
+}
+
+bool QCamxDevice::prepare_wait_inflight_slot(int frame_number, int max_pending_size, int count) {
+    _inflight_waiting = 1;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (inflight_slot_available(frame_number, max_pending_size, count)) {
+        _inflight_waiting = 0;
+        return false;
+    }
+    return true;
+}
+
+void QCamxDevice::update_inflight_limit() {
+    if (!_inflight_controller.is_enabled()) {
+        return;
+    }
+    uint64_t empty_wait_count = 0;
+    for (uint32_t i = 0; i < _camera3_streams.size(); i++) {
+        empty_wait_count += _camera_streams[i]->buffer_manager->get_empty_wait_count();
+    }
+    _inflight_controller.update(empty_wait_count);
+}
+
+void QCamxDevice::open_dump_container() {
+    char path[256];
+    time_t now = time(NULL);
+    struct tm tm_now;
+    localtime_r(&now, &tm_now);
+    snprintf(path, sizeof(path), "%s/camera%d_%4d%02d%02d_%02d%02d%02d.qcxdump", DUMP_FILE_DIR,
+             _camera_id, tm_now.tm_year + 1900, tm_now.tm_mon + 1, tm_now.tm_mday,
+             tm_now.tm_hour, tm_now.tm_min, tm_now.tm_sec);
+    _dump_container.open(path, (uint64_t)_config->_dump_container_size << 20);
+}
+
+void QCamxDevice::record_submit_cpu(int64_t cpu_ns, int frame_count) {
+    if (frame_count <= 0) {
+        return;
+    }
+    _submit_cpu_ns.fetch_add((uint64_t)cpu_ns, std::memory_order_relaxed);
+    _submit_frames.fetch_add(frame_count, std::memory_order_relaxed);
+    _submit_calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+void QCamxDevice::record_wake_to_submit(nsecs_t latency) {
+    uint64_t latency_ns = (uint64_t)latency;
+    _wake_to_submit_count.fetch_add(1, std::memory_order_relaxed);
+    _wake_to_submit_total_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+    uint64_t max_ns = _wake_to_submit_max_ns.load(std::memory_order_relaxed);
+    while (latency_ns > max_ns &&
+           !_wake_to_submit_max_ns.compare_exchange_weak(max_ns, latency_ns,
+                                                         std::memory_order_relaxed)) {
+    }
+}
+
+int QCamxDevice::init_thread_events(CameraThreadData *thread_data, uint32_t events) {
+    thread_data->sleeping = 0;
+    thread_data->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    thread_data->message_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    thread_data->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (thread_data->epoll_fd < 0 || thread_data->message_fd < 0 || thread_data->event_fd < 0) {
+        QCAMX_ERR("create thread events failed:%s\n", strerror(errno));
+        return -1;
+    }
+    const struct {
+        uint32_t type;
+        int fd;
+    } sources[] = {
+        {THREAD_EVENT_MESSAGE, thread_data->message_fd},
+        {THREAD_EVENT_SLOT, _inflight_event_fd},
+        {THREAD_EVENT_RESULT, thread_data->event_fd},
+    };
+    for (uint32_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        if ((events & sources[i].type) == 0) {
+            continue;
+        }
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        // event type in the low word, the eventfd to consume in the high word
+        event.data.u64 = ((uint64_t)sources[i].fd << 32) | sources[i].type;
+        if (epoll_ctl(thread_data->epoll_fd, EPOLL_CTL_ADD, sources[i].fd, &event) != 0) {
+            QCAMX_ERR("add event:%d to epoll failed:%s\n", sources[i].type, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void QCamxDevice::deinit_thread_events(CameraThreadData *thread_data) {
+    int *fds[] = {&thread_data->epoll_fd, &thread_data->message_fd, &thread_data->event_fd};
+    for (uint32_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
+
 /***************************** QCamxDevice::CallbackOps ****************************/
 
 void QCamxDevice::CallbackOps::ProcessCaptureResult(const camera3_callback_ops *cb,
                                                     const camera3_capture_result *result) {
     CallbackOps *cbOps = (CallbackOps *)cb;
-    int index = -1;
+    QCamxFrameTimeline *timeline = &cbOps->mParent->_timeline;
+    if (result->result != NULL && result->partial_result > 0) {
+        bool final_partial =
+            (int)result->partial_result == cbOps->mParent->_partial_result_count;
+        timeline->stamp_partial(result->frame_number, result->partial_result, final_partial);
+    }
+    for (uint32_t i = 0; i < result->num_output_buffers; i++) {
+        timeline->stamp_buffer(result->frame_number,
+                               cbOps->mParent->find_stream_index(result->output_buffers[i].stream));
+    }
 
     if (result->partial_result >= 1) {
         // handle the metadata callback
@@ -511,7 +928,8 @@ void QCamxDevice::CallbackOps::ProcessCaptureResult(const camera3_callback_ops *
                                                    (camera3_capture_result *)result);
     }
 
-    {  // Getting AE_EXPOSURE_COMPENSATION value
+    // Getting AE_EXPOSURE_COMPENSATION value, per result so only when it is logged
+    if (result->result != NULL && QCAMX_LOG_RATELIMIT_ENABLED(INFO)) {
         camera_metadata_ro_entry entry;
         int res = 0;
         int ae_comp = 0;
@@ -520,59 +938,209 @@ void QCamxDevice::CallbackOps::ProcessCaptureResult(const camera3_callback_ops *
         if ((0 == res) && (entry.count > 0)) {
             ae_comp = entry.data.i32[0];
         }
-        QCAMX_ERR("AECOMP frame:%d ae_comp value = %d\n", result->frame_number, ae_comp);
+        QCAMX_INFO("AECOMP frame:%d ae_comp value = %d\n", result->frame_number, ae_comp);
     }
 
+    QCamxDevice *device = cbOps->mParent;
     if (result->num_output_buffers > 0) {
-        pthread_mutex_lock(&cbOps->mParent->_result_thread->mutex);
-        if (!cbOps->mParent->_result_thread->stopped) {
-            CameraPostProcessMsg *msg = new CameraPostProcessMsg();
-            msg->result = *(result);
-            for (uint32_t i = 0; i < result->num_output_buffers; i++) {
-                msg->streamBuffers.push_back(result->output_buffers[i]);
+        CameraPostProcessMsg msg;
+        msg.result = *(result);
+        msg.stop = 0;
+        uint32_t num_output_buffers = 0;
+        for (uint32_t i = 0; i < result->num_output_buffers; i++) {
+            const camera3_stream_buffer_t *buffer = &result->output_buffers[i];
+            if (buffer->buffer == NULL) {
+                // the HAL could not get a buffer for it, nothing to process or return
+                continue;
+            }
+            int index = device->find_stream_index(buffer->stream);
+            if (index < 0) {
+                QCAMX_ERR("frame:%d buffer of unknown stream %p\n", result->frame_number,
+                          buffer->stream);
+                continue;
+            }
+            QCamxBufferManager *buffer_manager = device->_camera_streams[index]->buffer_manager;
+            if (device->_result_thread->stopped) {
+                // nobody processes it anymore, its pool still counts it
+                buffer_manager->return_buffer(buffer->buffer);
+                continue;
             }
-            cbOps->mParent->_result_thread->message_queue.push_back(msg);
-            pthread_cond_signal(&cbOps->mParent->_result_thread->cond);
+            if (num_output_buffers == MAXSTREAM) {
+                QCAMX_ERR("frame:%d too many output buffers:%d\n", result->frame_number,
+                          result->num_output_buffers);
+                break;
+            }
+            if (device->_hal_buffer_managed) {
+                buffer_manager->set_buffer_frame(buffer->buffer, result->frame_number);
+            }
+            msg.stream_buffers[num_output_buffers++] = *buffer;
+        }
+        msg.result.num_output_buffers = num_output_buffers;
+        if (num_output_buffers > 0) {
+            device->post_capture_result(msg);
         }
-        pthread_mutex_unlock(&cbOps->mParent->_result_thread->mutex);
     }
-    pthread_mutex_lock(&cbOps->mParent->_pending_lock);
-    index = cbOps->mParent->_pending_vector.indexOfKey(result->frame_number);
-    if (index < 0) {
-        pthread_mutex_unlock(&cbOps->mParent->_pending_lock);
-        QCAMX_ERR("%s: Get indexOfKey failed. Get index value:%d.\n", __func__, index);
+    RequestPending *pend = &device->_pending_ring[result->frame_number % CAMX_INFLIGHT_RING_SIZE];
+    if (pend->_frame_number.load(std::memory_order_acquire) != (int64_t)result->frame_number) {
+        QCAMX_ERR("%s: frame:%d is not in flight.\n", __func__, result->frame_number);
         return;
     }
-    RequestPending *pend = cbOps->mParent->_pending_vector.editValueAt(index);
-    pend->_num_output_buffer += result->num_output_buffers;
-    pend->_num_metadata += result->partial_result;
-    if (pend->_num_output_buffer >= pend->_request.num_output_buffers && pend->_num_metadata) {
-        cbOps->mParent->_pending_vector.removeItemsAt(index, 1);
-        pthread_cond_signal(&cbOps->mParent->_pending_cond);
-        delete pend;
-        pend = NULL;
+    pend->_num_output_buffer.fetch_add(result->num_output_buffers);
+    pend->_num_metadata.fetch_add(result->partial_result);
+    if (pend->_num_output_buffer.load() >= pend->_request.num_output_buffers &&
+        pend->_num_metadata.load() && pend->_completed.exchange(1) == 0) {
+        device->_inflight_controller.record_complete(systemTime() - pend->_submit_time);
+        device->release_inflight_slot(pend);
     }
-    pthread_mutex_unlock(&cbOps->mParent->_pending_lock);
 }
 
 void QCamxDevice::CallbackOps::Notify(const struct camera3_callback_ops *cb,
-                                      const camera3_notify_msg_t *msg) {}
+                                      const camera3_notify_msg_t *msg) {
+    CallbackOps *cbOps = (CallbackOps *)cb;
+    if (msg->type == CAMERA3_MSG_SHUTTER) {
+        cbOps->mParent->_timeline.stamp_shutter(msg->message.shutter.frame_number,
+                                                (int64_t)msg->message.shutter.timestamp);
+        // the shutter timestamp is the ANDROID_SENSOR_TIMESTAMP of the frame and comes before
+        // its buffers
+        cbOps->mParent->_frame_hub.set_frame_timestamp(msg->message.shutter.frame_number,
+                                                       (int64_t)msg->message.shutter.timestamp);
+    } else if (msg->type == CAMERA3_MSG_ERROR) {
+        QCAMX_ERR("frame:%d error code:%d\n", msg->message.error.frame_number,
+                  msg->message.error.error_code);
+    }
+}
+
+camera3_buffer_request_status_t QCamxDevice::CallbackOps::RequestStreamBuffers(
+    const struct camera3_callback_ops *cb, uint32_t num_buffer_reqs,
+    const camera3_buffer_request_t *buffer_reqs, uint32_t *num_returned_buf_reqs,
+    camera3_stream_buffer_ret_t *returned_buf_reqs) {
+    QCamxDevice *device = ((CallbackOps *)cb)->mParent;
+    *num_returned_buf_reqs = 0;
+    if (!device->_hal_buffer_managed) {
+        QCAMX_ERR("stream buffer request while the buffers are not managed by the hal\n");
+        return CAMERA3_BUF_REQ_FAILED_ILLEGAL_ARGUMENTS;
+    }
+    if (device->_result_thread == NULL || device->_result_thread->stopped) {
+        return CAMERA3_BUF_REQ_FAILED_CONFIGURING;
+    }
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < num_buffer_reqs; i++) {
+        returned_buf_reqs[i].status =
+            device->get_hal_stream_buffers(&buffer_reqs[i], &returned_buf_reqs[i]);
+        if (returned_buf_reqs[i].status != CAMERA3_PS_BUF_REQ_OK) {
+            failed++;
+        }
+    }
+    *num_returned_buf_reqs = num_buffer_reqs;
+    device->_hal_buffer_requests.fetch_add(num_buffer_reqs);
+    device->_hal_buffer_failures.fetch_add(failed);
+    if (failed == 0) {
+        return CAMERA3_BUF_REQ_OK;
+    }
+    return failed == num_buffer_reqs ? CAMERA3_BUF_REQ_FAILED_UNKNOWN
+                                     : CAMERA3_BUF_REQ_FAILED_PARTIAL;
+}
+
+void QCamxDevice::CallbackOps::ReturnStreamBuffers(const struct camera3_callback_ops *cb,
+                                                   uint32_t num_buffers,
+                                                   const camera3_stream_buffer_t *const *buffers) {
+    QCamxDevice *device = ((CallbackOps *)cb)->mParent;
+    for (uint32_t i = 0; i < num_buffers; i++) {
+        int index = device->find_stream_index(buffers[i]->stream);
+        if (index < 0 || buffers[i]->buffer == NULL) {
+            QCAMX_ERR("hal returned buffer %p of unknown stream %p\n", buffers[i]->buffer,
+                      buffers[i]->stream);
+            continue;
+        }
+        device->_camera_streams[index]->buffer_manager->return_buffer(buffers[i]->buffer);
+    }
+}
 
 /****************************global function********************************/
 
+/**
+* @brief wait on the thread epoll and consume the signaled eventfds
+* @return bit mask of ThreadEventType, 0 on timeout
+*/
+static uint32_t wait_thread_events(CameraThreadData *thread_data, int timeout_ms) {
+    struct epoll_event events[3];
+    int count = epoll_wait(thread_data->epoll_fd, events, 3, timeout_ms);
+    uint32_t event_mask = 0;
+    for (int i = 0; i < count; i++) {
+        uint64_t value;
+        int fd = (int)(events[i].data.u64 >> 32);
+        event_mask |= (uint32_t)(events[i].data.u64 & 0xFFFFFFFF);
+        ssize_t ret = read(fd, &value, sizeof(value));
+        (void)ret;
+    }
+    return event_mask;
+}
+
+/**
+* @brief apply all queued control messages of request thread
+*/
+static void handle_request_messages(CameraThreadData *thread_data, QCamxDevice *device) {
+    std::list<void *> messages;
+    pthread_mutex_lock(&thread_data->mutex);
+    thread_data->message_pending.store(0, std::memory_order_relaxed);
+    messages.swap(thread_data->message_queue);
+    pthread_mutex_unlock(&thread_data->mutex);
+
+    for (void *data : messages) {
+        CameraRequestMsg *msg = (CameraRequestMsg *)data;
+        switch (msg->message_type) {
+            case START_STOP: {
+                // stop command
+                QCAMX_INFO("Get message for stop request\n");
+                if (msg->stop == 1) {
+                    thread_data->stopped = 1;
+                }
+                break;
+            }
+            case REQUEST_CHANGE: {
+                QCAMX_INFO("Get message for change request\n");
+                for (uint32_t i = 0; i < device->_camera3_streams.size(); i++) {
+                    if (msg->mask & (1 << i)) {
+                        (thread_data->request_number[i] == REQUEST_NUMBER_UMLIMIT)
+                            ? thread_data->request_number[i] = msg->request_number[i]
+                            : thread_data->request_number[i] += msg->request_number[i];
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        delete msg;
+    }
+}
+
+/**
+* @brief cpu time of the calling thread in ns
+*/
+static int64_t thread_cpu_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 /**
 * @brief Thread for CaptureRequest ,handle the capture request from upper layer
+* @detail event driven, sleeps only on control message or in-flight slot release
 */
 void *do_process_capture_request(void *data) {
     CameraThreadData *thread_data = (CameraThreadData *)data;
     QCamxDevice *device = (QCamxDevice *)thread_data->device;
+    nsecs_t wake_time = 0;
 
     while (!thread_data->stopped) {  //need repeat and has not trigger out until stopped
-        pthread_mutex_lock(&thread_data->mutex);
-        bool empty = thread_data->message_queue.empty();
+        // the thread may never block while slots are free, look at the messages on every pass
+        if (thread_data->message_pending.load(std::memory_order_acquire)) {
+            handle_request_messages(thread_data, device);
+            continue;
+        }
         /* Send request till the request_number is 0;
-        ** Check the msgQueue for Message from other thread to
-        ** change setting or stop Capture Request
+        ** request_number is only changed by this thread, no lock needed
         */
         bool has_request = false;
         for (int i = 0; i < (int)device->_camera3_streams.size(); i++) {
@@ -580,84 +1148,89 @@ void *do_process_capture_request(void *data) {
                 has_request = true;
                 break;
             }
-            QCAMX_INFO("has no request :%d\n", i);
         }
 
-        if (empty && !has_request) {
-            QCAMX_INFO("Waiting message :%lu or buffer return at thread:%p\n",
-                       thread_data->message_queue.size(), thread_data);
-            struct timespec tv;
-            clock_gettime(CLOCK_MONOTONIC, &tv);
-            tv.tv_sec += 5;
-            if (pthread_cond_timedwait(&thread_data->cond, &thread_data->mutex, &tv) != 0) {
-                QCAMX_INFO("No message got!\n");
-            }
-            pthread_mutex_unlock(&thread_data->mutex);
-            continue;
-        } else if (!empty) {
-            CameraRequestMsg *msg = (CameraRequestMsg *)thread_data->message_queue.front();
-            thread_data->message_queue.pop_front();
-            switch (msg->message_type) {
-                case START_STOP: {
-                    // stop command
-                    QCAMX_INFO("Get message for stop request\n");
-                    if (msg->stop == 1) {
-                        thread_data->stopped = 1;
-                        pthread_mutex_unlock(&thread_data->mutex);
-                        delete msg;
-                        msg = NULL;
-                        continue;
-                    }
-                    break;
-                }
-                case REQUEST_CHANGE: {
-                    QCAMX_INFO("Get message for change request\n");
-                    for (uint32_t i = 0; i < device->_camera3_streams.size(); i++) {
-                        if (msg->mask & (1 << i)) {
-                            (thread_data->request_number[i] == REQUEST_NUMBER_UMLIMIT)
-                                ? thread_data->request_number[i] = msg->request_number[i]
-                                : thread_data->request_number[i] += msg->request_number[i];
-                        }
-                    }
-                    pthread_mutex_unlock(&thread_data->mutex);
-                    delete msg;
-                    msg = NULL;
+        int max_pending_size = device->get_max_inflight();
+        // a high speed batch goes when the slots of all its requests are free
+        int batch_size = device->get_request_batch_size();
+        if (batch_size > max_pending_size) {
+            batch_size = max_pending_size > 0 ? max_pending_size : 1;
+        }
+        int frame_number = thread_data->frame_number;
+        if (!has_request ||
+            !device->inflight_slot_available(frame_number, max_pending_size, batch_size)) {
+            int timeout_ms = -1;
+            if (has_request) {
+                device->_inflight_controller.record_limit_hit();
+                if (!device->prepare_wait_inflight_slot(frame_number, max_pending_size,
+                                                        batch_size)) {
                     continue;
-                    break;
                 }
-                default:
-                    break;
+                timeout_ms = 5000;
+            } else {
+                QCAMX_INFO_RATELIMIT("Waiting message at thread:%p\n", thread_data);
+            }
+            uint32_t events = wait_thread_events(thread_data, timeout_ms);
+            wake_time = systemTime();
+            if (events & THREAD_EVENT_MESSAGE) {
+                handle_request_messages(thread_data, device);
+            } else if (events == 0 && has_request &&
+                       !device->inflight_slot_available(frame_number, max_pending_size,
+                                                        batch_size)) {
+                QCAMX_ERR("ProcessOneCaptureRequest wait in-flight slot timeout\n");
+                return nullptr;
             }
-            delete msg;
-            msg = NULL;
+            continue;
         }
-        pthread_mutex_unlock(&thread_data->mutex);
 
-        // request one each time
-        int request_number_of_each_stream[MAXSTREAM] = {0};
-        for (int i = 0; i < MAXSTREAM; i++) {
-            if (thread_data->request_number[i] != 0) {
-                int skip = thread_data->skip_pattern[i];  // default skip pattern is 1
-                if ((thread_data->frame_number % skip) == 0) {
-                    request_number_of_each_stream[i] = 1;
+        // request one frame of each stream per request, batch_size requests each time
+        int request_numbers[CAMX_REQUEST_BATCH_MAX][MAXSTREAM] = {{0}};
+        int remaining[MAXSTREAM];
+        memcpy(remaining, thread_data->request_number, sizeof(remaining));
+        int batch_count = 0;
+        for (; batch_count < batch_size; batch_count++) {
+            int frame_number = thread_data->frame_number + batch_count;
+            bool any_stream = false;
+            for (int i = 0; i < MAXSTREAM; i++) {
+                if (remaining[i] != 0) {
+                    int skip = thread_data->skip_pattern[i];  // default skip pattern is 1
+                    if ((frame_number % skip) == 0) {
+                        request_numbers[batch_count][i] = 1;
+                        any_stream = true;
+                    }
+                }
+            }
+            if (!any_stream && batch_count > 0) {
+                break;
+            }
+            // reduce request number -1 each time
+            for (int i = 0; i < (int)device->_camera3_streams.size(); i++) {
+                if (remaining[i] > 0) {
+                    remaining[i] = remaining[i] - request_numbers[batch_count][i];
                 }
             }
         }
-        int res = device->process_one_capture_request(request_number_of_each_stream,
+        int start_frame_number = thread_data->frame_number;
+        int64_t cpu_start = thread_cpu_time_ns();
+        int res = 0;
+        if (batch_count > 1) {
+            res = device->process_capture_request_batch(request_numbers, batch_count,
+                                                        &(thread_data->frame_number));
+        } else {
+            res = device->process_one_capture_request(request_numbers[0],
                                                       &(thread_data->frame_number));
+        }
+        device->record_submit_cpu(thread_cpu_time_ns() - cpu_start,
+                                  thread_data->frame_number - start_frame_number);
         if (res != 0) {
             QCAMX_ERR("ProcessOneCaptureRequest error res:%d\n", res);
             return nullptr;
         }
-
-        // reduce request number -1 each time
-        pthread_mutex_lock(&thread_data->mutex);
-        for (int i = 0; i < (int)device->_camera3_streams.size(); i++) {
-            if (thread_data->request_number[i] > 0)
-                thread_data->request_number[i] =
-                    thread_data->request_number[i] - request_number_of_each_stream[i];
+        if (wake_time != 0) {
+            device->record_wake_to_submit(systemTime() - wake_time);
+            wake_time = 0;
         }
-        pthread_mutex_unlock(&thread_data->mutex);
+        memcpy(thread_data->request_number, remaining, sizeof(remaining));
     }
     return nullptr;
 }
@@ -668,45 +1241,47 @@ void *do_process_capture_request(void *data) {
 void *do_capture_post_process(void *data) {
     CameraThreadData *thread_data = (CameraThreadData *)data;
     QCamxDevice *device = (QCamxDevice *)thread_data->device;
+    CameraPostProcessMsg msg;
     // QCAMX_PRINT("%s capture result handle thread start\n", __func__);
     while (true) {
-        pthread_mutex_lock(&thread_data->mutex);
-        if (thread_data->message_queue.empty()) {
-            struct timespec tv;
-            clock_gettime(CLOCK_MONOTONIC, &tv);
-            tv.tv_sec += 5;
-            if (pthread_cond_timedwait(&thread_data->cond, &thread_data->mutex, &tv) != 0) {
-                QCAMX_ERR("%s No Msg got in 5 sec in Result Process thread", __func__);
-                pthread_mutex_unlock(&thread_data->mutex);
+        if (!device->_result_ring.pop(msg)) {
+            thread_data->sleeping = 1;
+            // pairs with the fence in QCamxDevice::post_capture_result
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!device->_result_ring.pop(msg)) {
+                // every result and the stop record signal the eventfd, an idle thread just sleeps
+                wait_thread_events(thread_data, -1);
+                thread_data->sleeping = 0;
                 continue;
             }
+            thread_data->sleeping = 0;
         }
-        CameraPostProcessMsg *msg = (CameraPostProcessMsg *)thread_data->message_queue.front();
-        thread_data->message_queue.pop_front();
         // stop command
-        if (msg->stop == 1) {
-            delete msg;
-            msg = NULL;
-            pthread_mutex_unlock(&thread_data->mutex);
+        if (msg.stop == 1) {
             return nullptr;
         }
-        pthread_mutex_unlock(&thread_data->mutex);
-        camera3_capture_result result = msg->result;
-        const camera3_stream_buffer_t *buffers = result.output_buffers = msg->streamBuffers.data();
+        camera3_capture_result result = msg.result;
+        const camera3_stream_buffer_t *buffers = result.output_buffers = msg.stream_buffers;
         // QCAMX_PRINT("%s callback capture_post_process\n", __func__);
+        int stream_index[MAXSTREAM];
+        for (uint32_t i = 0; i < result.num_output_buffers; i++) {
+            stream_index[i] = device->find_stream_index(buffers[i].stream);
+            device->_timeline.stamp_process_enter(result.frame_number, stream_index[i]);
+        }
         device->_callback->capture_post_process(device->_callback, &result);
+        for (uint32_t i = 0; i < result.num_output_buffers; i++) {
+            device->_timeline.stamp_process_exit(result.frame_number, stream_index[i]);
+        }
+        device->_timeline.report_if_due();
+        device->_stream_metrics.report_if_due();
+        device->update_inflight_limit();
         // return the buffer back
         if (device->get_sync_buffer_mode() != SYNC_BUFFER_EXTERNAL) {
             for (uint32_t i = 0; i < result.num_output_buffers; i++) {
-                int index = device->find_stream_index(buffers[i].stream);
-                CameraStream *stream = device->_camera_streams[index];
+                CameraStream *stream = device->_camera_streams[stream_index[i]];
                 stream->buffer_manager->return_buffer(buffers[i].buffer);
             }
         }
-        msg->streamBuffers.erase(msg->streamBuffers.begin(),
-                                 msg->streamBuffers.begin() + msg->streamBuffers.size());
-        delete msg;
-        msg = NULL;
     }
     return nullptr;
 }
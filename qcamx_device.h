@@ -11,20 +11,39 @@
 #include <hardware/camera_common.h>
 #include <inttypes.h>
 #include <pthread.h>
-#include <utils/KeyedVector.h>
 #include <utils/Timers.h>
 
+#include <atomic>
 #include <list>
 #include <string>
 #include <vector>
 
 #include "qcamx_buffer_manager.h"
 #include "qcamx_config.h"
+#include "qcamx_dump_container.h"
+#include "qcamx_dump_writer.h"
+#include "qcamx_frame_dump.h"
+#include "qcamx_frame_export.h"
+#include "qcamx_frame_hub.h"
+#include "qcamx_frame_timeline.h"
+#include "qcamx_inflight_controller.h"
+#include "qcamx_lockfree_queue.h"
 #include "qcamx_log.h"
+#include "qcamx_request_settings.h"
+#include "qcamx_stream_metrics.h"
+#include "qcamx_zsl_ring.h"
 
 #define REQUEST_NUMBER_UMLIMIT (-1)  // useless for now default request_number is 0
 #define MAXSTREAM (4)
-#define CAMX_LIVING_REQUEST_MAX (5)  // _pending_vector support living request max value
+#define CAMX_LIVING_REQUEST_MAX (5)  // in-flight request max value without ext append
+// in-flight ring capacity, must cover CAMX_LIVING_REQUEST_MAX + HFR_LIVING_REQUEST_APPEND
+#define CAMX_INFLIGHT_RING_SIZE (64)
+// capture result ring capacity, must cover one result per buffer of every in-flight request
+#define CAMX_RESULT_RING_SIZE (256)
+// largest request batch of a constrained high speed session, 480 fps / 30
+#define CAMX_REQUEST_BATCH_MAX (16)
+// wait for a returned buffer on a buffer request of the HAL
+#define HAL_BUFFER_REQUEST_TIMEOUT_MS (100)
 
 class QCamxDevice;
 
@@ -39,18 +58,36 @@ struct AvailableStream {
     int32_t format;
 };
 
-// Request and Result Pending
+// Request and Result Pending, one preallocated slot of the in-flight ring
 class RequestPending {
 public:
     RequestPending() {
+        _frame_number = -1;
         _num_output_buffer = 0;
         _num_metadata = 0;
+        _completed = 0;
+        _submit_time = 0;
         memset(&_request, 0, sizeof(camera3_capture_request_t));
+        memset(_output_buffers, 0, sizeof(_output_buffers));
+    }
+    /**
+     * @brief clear the slot before reuse it for a new frame
+    */
+    void reset() {
+        _num_output_buffer = 0;
+        _num_metadata = 0;
+        _completed = 0;
+        memset(&_request, 0, sizeof(camera3_capture_request_t));
+        _request.output_buffers = _output_buffers;
     }
 public:
     camera3_capture_request_t _request;
-    uint32_t _num_output_buffer;
-    int _num_metadata;
+    camera3_stream_buffer_t _output_buffers[MAXSTREAM];  ///< storage of _request.output_buffers
+    std::atomic<int64_t> _frame_number;                  ///< -1 means the slot is free
+    std::atomic<uint32_t> _num_output_buffer;
+    std::atomic<int> _num_metadata;
+    std::atomic<int> _completed;
+    nsecs_t _submit_time;  ///< when the request was handed to the HAL
 };
 
 // Callback for QCamxDevice to upper layer
@@ -70,10 +107,10 @@ public:
     virtual void handle_metadata(DeviceCallback *callback, camera3_capture_result *result) = 0;
 };
 
-// Message data for PostProcess thread
+// Message data for PostProcess thread, fixed size record of the result ring
 typedef struct _CameraPostProcessMsg {
     camera3_capture_result result;
-    std::vector<camera3_stream_buffer_t> streamBuffers;
+    camera3_stream_buffer_t stream_buffers[MAXSTREAM];
     int stop;
 } CameraPostProcessMsg;
 
@@ -90,23 +127,38 @@ typedef struct _CameraRequestMsg {
     int stop;
 } CameraRequestMsg;
 
+typedef enum {
+    THREAD_EVENT_MESSAGE = 0x1,  ///< control message queued (START_STOP, REQUEST_CHANGE)
+    THREAD_EVENT_SLOT = 0x2,     ///< in-flight slot released
+    THREAD_EVENT_RESULT = 0x4,   ///< capture result queued
+} ThreadEventType;
+
 // Thread Data for camera Request and Result thread
 struct CameraThreadData {
     pthread_t thread;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
+    pthread_mutex_t mutex;  ///< only protect message_queue
     std::list<void *> message_queue;
     int request_number[MAXSTREAM];
     //skip requeast for frame_number % skip_pattern != 0
     int skip_pattern[MAXSTREAM];
     int frame_number;
-    int stopped;
+    std::atomic<int> stopped;
+    std::atomic<int> message_pending;  ///< message_queue is not empty, checked on every pass
+    int epoll_fd;               ///< waits on message_fd and event_fd
+    int message_fd;             ///< eventfd, signaled by post_request_message
+    int event_fd;               ///< eventfd, signaled when new work arrives while sleeping
+    std::atomic<int> sleeping;  ///< thread is (about to be) blocked in epoll_wait
     QCamxDevice *device;
     void *priv;
 public:
     CameraThreadData() {
         priv = NULL;
         stopped = 0;
+        message_pending = 0;
+        epoll_fd = -1;
+        message_fd = -1;
+        event_fd = -1;
+        sleeping = 0;
         frame_number = 0;
         for (int i = 0; i < MAXSTREAM; i++) {
             request_number[i] = 0;
@@ -175,6 +227,22 @@ public:
      * @param request_number_of_each_stream each stream request capture number
     */
     int process_one_capture_request(int *request_number_of_each_stream, int *frame_number);
+    /**
+     * @brief process batch_size capture requests back to back, sharing one settings buffer
+     * @param request_numbers capture number of each stream for every request of the batch
+     * @return 0 when the whole batch is submitted, frame_number is advanced by the submitted ones
+    */
+    int process_capture_request_batch(int (*request_numbers)[MAXSTREAM], int batch_size,
+                                      int *frame_number);
+    /**
+     * @brief requests submitted together, fps / 30 in a constrained high speed session, else 1
+    */
+    int get_request_batch_size() { return _request_batch_size; }
+    /**
+     * @brief queue a control message to the request thread and wake it up
+     * @param msg allocated by new, freed by the request thread
+    */
+    void post_request_message(CameraRequestMsg *msg);
 public:
     /**
      * @brief Get all valid output streams
@@ -205,6 +273,10 @@ public:
      * @return index of _camera3_streams -1 means not found
     */
     int find_stream_index(camera3_stream_t *stream);
+    /**
+     * @brief queue one record to the result thread, never allocates or takes a lock
+    */
+    void post_capture_result(const CameraPostProcessMsg &msg);
 private:
     /**
      * @brief flush when stop the stream
@@ -216,6 +288,97 @@ private:
      * @return return 0 on failed
     */
     int get_jpeg_buffer_size(uint32_t width, uint32_t height);
+    /**
+     * @brief create eventfd and epoll for a request/result thread
+    */
+    int init_thread_events(CameraThreadData *thread_data, uint32_t events);
+    /**
+     * @brief close eventfd and epoll of a request/result thread
+    */
+    void deinit_thread_events(CameraThreadData *thread_data);
+    /**
+     * @brief take the buffers of a request and publish its in-flight slot, the slot must be free
+    */
+    RequestPending *prepare_capture_request(int *request_number_of_each_stream, int frame_number,
+                                            camera_metadata *settings);
+    /**
+     * @brief give back the buffers and the slot of a request the HAL rejected or never got
+    */
+    void abort_capture_request(RequestPending *pend);
+    /**
+     * @brief whether the HAL can request the stream buffers itself, camera device 3.5 and
+     *        ANDROID_INFO_SUPPORTED_BUFFER_MANAGEMENT_VERSION
+    */
+    bool hal_buffer_manage_supported(const struct camera_info &info);
+    /**
+     * @brief hand num_buffers_requested buffers of a stream to the HAL, all or none
+    */
+    camera3_stream_buffer_req_status_t get_hal_stream_buffers(
+        const camera3_buffer_request_t *request, camera3_stream_buffer_ret_t *ret);
+    /**
+     * @brief wait until the buffers held by the HAL are back in their pools
+    */
+    void wait_hal_buffers_returned(int timeout_ms);
+    /**
+     * @brief print the buffers and the memory allocated by every stream pool
+    */
+    void report_buffer_memory();
+public:
+    /**
+     * @brief the current in-flight request limit
+    */
+    int get_max_inflight() {
+        return _inflight_controller.is_enabled()
+                   ? _inflight_controller.get_limit()
+                   : CAMX_LIVING_REQUEST_MAX + _living_request_ext_append;
+    }
+    /**
+     * @brief feed the pool starvation to the in-flight controller, called by the result thread
+    */
+    void update_inflight_limit();
+    /**
+     * @brief open a dump container named after the camera and the start time
+    */
+    void open_dump_container();
+    /**
+     * @brief whether the in-flight ring can take the count requests from frame_number on
+    */
+    bool inflight_slot_available(int frame_number, int max_pending_size, int count = 1) {
+        if (_pending_count.load() > max_pending_size - count) {
+            return false;
+        }
+        // requests complete out of order, a free slot for the last frame says nothing of the others
+        for (int i = 0; i < count; i++) {
+            RequestPending *pend = &_pending_ring[(frame_number + i) % CAMX_INFLIGHT_RING_SIZE];
+            if (pend->_frame_number.load() != -1) {
+                return false;
+            }
+        }
+        return true;
+    }
+    /**
+     * @brief slow path, block until the in-flight ring can take the count requests
+     * @return 0 on success, -1 on timeout
+    */
+    int wait_inflight_slot(int frame_number, int max_pending_size, int timeout_sec,
+                           int count = 1);
+    /**
+     * @brief release a completed or failed in-flight slot
+    */
+    void release_inflight_slot(RequestPending *pend);
+    /**
+     * @brief request thread announces it will sleep until a slot is released
+     * @return false if a slot became available meanwhile, do not sleep
+    */
+    bool prepare_wait_inflight_slot(int frame_number, int max_pending_size, int count = 1);
+    /**
+     * @brief account one request thread wake up which ended with a submitted request
+    */
+    void record_wake_to_submit(nsecs_t latency);
+    /**
+     * @brief account the request thread cpu time spent to submit frame_count requests
+    */
+    void record_submit_cpu(int64_t cpu_ns, int frame_count);
 public:
     camera_metadata_t *_camera_characteristics;
     android::CameraMetadata _init_metadata;
@@ -226,6 +389,24 @@ public:
     //Thread for request and result
     CameraThreadData *_request_thread;
     CameraThreadData *_result_thread;
+    // capture result from HAL callback to result thread, multi producer single consumer
+    QCamxLockFreeQueue<CameraPostProcessMsg, CAMX_RESULT_RING_SIZE> _result_ring;
+    // per-frame latency from submit to the buffers back in their pools
+    QCamxFrameTimeline _timeline;
+    // frame rate, jitter and drops of every stream type from the sensor timestamps
+    QCamxStreamMetrics _stream_metrics;
+    // zero copy frames for any number of subscribers per stream type
+    QCamxFrameHub _frame_hub;
+    // frames of the hub for other processes, running when enabled by the config
+    QCamxFrameExport _frame_export;
+    // last frames of the snapshot stream for zero shutter lag, running when enabled by the case
+    QCamxZslRing _zsl_ring;
+    // adjusts the in-flight request limit when enabled by the config
+    QCamxInflightController _inflight_controller;
+    // writes frame dumps off the post process thread
+    QCamxDumpWriter _dump_writer;
+    // every dump of the session in one file, open when enabled by the config
+    QCamxDumpContainer _dump_container;
 
     // Stream info of CameraDevice
     CameraStream *_camera_streams[MAXSTREAM];
@@ -234,23 +415,42 @@ public:
     DeviceCallback *_callback;
     //current use metadata
     android::CameraMetadata _current_metadata;
-    // living _pending_vector support ext append items
+    // in-flight request limit ext append items
     int _living_request_ext_append;
 private:
     camera_module_t *_camera_module;
     int _camera_id;
     QCamxConfig *_config;
+    int _partial_result_count;  ///< ANDROID_REQUEST_PARTIAL_RESULT_COUNT, the last is final
+    bool _hal_buffer_managed;   ///< the HAL requests the stream buffers, set on open
+    std::atomic<uint64_t> _hal_buffer_requests;  ///< stream buffer requests of the HAL
+    std::atomic<uint64_t> _hal_buffer_failures;  ///< requests answered without buffers
 private:
     class CallbackOps : public camera3_callback_ops {
     public:
         CallbackOps(QCamxDevice *parent)
-            : camera3_callback_ops({&ProcessCaptureResult, &Notify}), mParent(parent) {}
+            : camera3_callback_ops(
+                  {&ProcessCaptureResult, &Notify, &RequestStreamBuffers, &ReturnStreamBuffers}),
+              mParent(parent) {}
         /**
          * @brief callback for process capture result
         */
         static void ProcessCaptureResult(const camera3_callback_ops *cb,
                                          const camera3_capture_result *hal_result);
         static void Notify(const struct camera3_callback_ops *cb, const camera3_notify_msg_t *msg);
+        /**
+         * @brief the HAL asks for stream buffers, only when the buffers are managed by the HAL
+        */
+        static camera3_buffer_request_status_t RequestStreamBuffers(
+            const struct camera3_callback_ops *cb, uint32_t num_buffer_reqs,
+            const camera3_buffer_request_t *buffer_reqs, uint32_t *num_returned_buf_reqs,
+            camera3_stream_buffer_ret_t *returned_buf_reqs);
+        /**
+         * @brief the HAL gives back requested buffers it did not use
+        */
+        static void ReturnStreamBuffers(const struct camera3_callback_ops *cb,
+                                        uint32_t num_buffers,
+                                        const camera3_stream_buffer_t *const *buffers);
     private:
         QCamxDevice *mParent;
     };
@@ -260,10 +460,26 @@ private:
 private:
     SyncBufferMode _sync_buffer_mode;
     pthread_mutex_t _setting_metadata_lock;
-    std::list<android::CameraMetadata> _setting_metadata_list;
-    android::CameraMetadata setting;
+    QCamxRequestSettings _request_settings;
+    uint32_t _settings_sent;      ///< requests with settings, request thread only
+    uint32_t _settings_requests;  ///< requests of the session, request thread only
 private:
+    RequestPending _pending_ring[CAMX_INFLIGHT_RING_SIZE];  ///< indexed by frame_number % size
+    std::atomic<int> _pending_count;                        ///< in-flight request count
+    std::atomic<int> _pending_waiters;                      ///< threads in wait_inflight_slot
+    int _inflight_event_fd;              ///< eventfd, signaled on slot release while waiting
+    std::atomic<int> _inflight_waiting;  ///< request thread waits on _inflight_event_fd
+    // only used when the ring is full
     pthread_mutex_t _pending_lock;
     pthread_cond_t _pending_cond;
-    android::KeyedVector<int, RequestPending *> _pending_vector;
+private:
+    // wake up to request submit latency of the request thread
+    std::atomic<uint64_t> _wake_to_submit_count;
+    std::atomic<uint64_t> _wake_to_submit_total_ns;
+    std::atomic<uint64_t> _wake_to_submit_max_ns;
+    // request thread cpu time of the submitted requests
+    int _request_batch_size;
+    std::atomic<uint64_t> _submit_cpu_ns;
+    std::atomic<uint64_t> _submit_frames;
+    std::atomic<uint64_t> _submit_calls;
 };
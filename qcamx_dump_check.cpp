@@ -0,0 +1,439 @@
+/**
+ * @file  qcamx_dump_check.cpp
+ * @brief write frames into a dump container from several writer threads, read them back and
+ *        extract them like qcamx-dump-extract, fail if a header, a payload or an extracted file
+ *        differs from the frame that was dumped, also for a container without index and trailer
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "qcamx_dump_container.h"
+#include "qcamx_frame_dump.h"
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxDumpCheck"
+
+// preallocation of the checked containers, small so the frames grow it several times
+#define DUMP_CHECK_PREALLOCATE (256 * 1024)
+
+struct CheckFormat {
+    uint32_t format;
+    StreamType type;
+    int width;
+    int height;
+    int stride_pad;  ///< bytes added to the tight row
+    int slice_pad;   ///< rows added to the luma plane of yuv
+};
+
+// odd sizes, padded and tight layouts, and a payload of exactly DUMP_CONTAINER_ALIGN bytes
+static const CheckFormat check_formats[] = {
+    {HAL_PIXEL_FORMAT_RAW10, RAW_SNAPSHOT_TYPE, 4056, 12, 6, 0},
+    {HAL_PIXEL_FORMAT_YCBCR_420_888, PREVIEW_TYPE, 641, 37, 63, 7},
+    {HAL_PIXEL_FORMAT_Y16, DEPTH_TYPE, 64, 32, 0, 0},
+    {HAL_PIXEL_FORMAT_YCBCR_420_888, VIDEO_TYPE, 320, 240, 0, 0},
+    {HAL_PIXEL_FORMAT_RAW12, RAW_SNAPSHOT_TYPE, 1001, 9, 10, 0},
+    {HAL_PIXEL_FORMAT_Y16, IRBG_TYPE, 99, 17, 34, 0},
+};
+
+static const char usage[] = "\
+usage: qcamx-dump-check [-d dir] [-n frames] [-t threads] \n\
+  -d: directory of the containers and the extracted files, default " CAMERA_STORAGE_DIR " \n\
+  -n: frames dumped, default 48 \n\
+  -t: writer threads appending at once, default 4 \n\
+";
+
+struct CheckFrame {
+    BufferInfo info;
+    std::vector<uint8_t> data;
+    unsigned int frame_num;
+    StreamType type;
+    nsecs_t timestamp;
+};
+
+struct WriterData {
+    QCamxDumpContainer *container;
+    std::vector<CheckFrame> *frames;
+    int first;
+    int step;
+    int failed;
+};
+
+static void make_frame(CheckFrame *frame, unsigned int frame_num) {
+    const CheckFormat &f = check_formats[frame_num % (sizeof(check_formats) /
+                                                      sizeof(check_formats[0]))];
+    int stride;
+    int slice = f.height;
+    size_t size;
+    if (f.format == HAL_PIXEL_FORMAT_RAW10 || f.format == HAL_PIXEL_FORMAT_RAW12) {
+        int bits = f.format == HAL_PIXEL_FORMAT_RAW10 ? 10 : 12;
+        stride = (f.width * bits + 7) / 8 + f.stride_pad;
+        size = (size_t)stride * f.height;
+    } else if (f.format == HAL_PIXEL_FORMAT_Y16) {
+        stride = f.width * 2 + f.stride_pad;
+        size = (size_t)stride * f.height;
+    } else {
+        stride = (f.width + 1) / 2 * 2 + f.stride_pad;
+        slice = f.height + f.slice_pad;
+        size = (size_t)stride * slice + (size_t)stride * ((f.height + 1) / 2);
+    }
+    frame->data.resize(size);
+    uint32_t seed = frame_num * 2654435761u + 1;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        frame->data[i] = (uint8_t)(seed >> 16);
+    }
+    memset(&frame->info, 0, sizeof(frame->info));
+    frame->info.vaddr = frame->data.data();
+    frame->info.size = (int)size;
+    frame->info.width = f.width;
+    frame->info.height = f.height;
+    frame->info.stride = stride;
+    frame->info.slice = slice;
+    frame->info.fd = -1;
+    frame->info.format = f.format;
+    frame->frame_num = frame_num;
+    frame->type = f.type;
+    frame->timestamp = (nsecs_t)frame_num * 33333333 + 1000;
+}
+
+static void *writer_thread(void *arg) {
+    WriterData *writer = (WriterData *)arg;
+    std::vector<CheckFrame> &frames = *writer->frames;
+    for (size_t i = writer->first; i < frames.size(); i += writer->step) {
+        CheckFrame &frame = frames[i];
+        if (writer->container->append(&frame.info, frame.frame_num, frame.type, YUV420NV12,
+                                      frame.timestamp) != (size_t)frame.info.size) {
+            writer->failed++;
+        }
+    }
+    return NULL;
+}
+
+static int copy_file(const char *src_path, const char *dst_path, uint64_t max_bytes) {
+    int src = open(src_path, O_RDONLY | O_CLOEXEC);
+    if (src < 0) {
+        QCAMX_PRINT("open %s failed:%s\n", src_path, strerror(errno));
+        return -1;
+    }
+    int dst = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dst < 0) {
+        QCAMX_PRINT("open %s failed:%s\n", dst_path, strerror(errno));
+        close(src);
+        return -1;
+    }
+    int res = 0;
+    uint8_t buffer[64 * 1024];
+    uint64_t copied = 0;
+    while (copied < max_bytes) {
+        size_t want = max_bytes - copied < sizeof(buffer) ? max_bytes - copied : sizeof(buffer);
+        ssize_t bytes = read(src, buffer, want);
+        if (bytes <= 0) {
+            res = bytes < 0 ? -1 : 0;
+            break;
+        }
+        if (write(dst, buffer, bytes) != bytes) {
+            res = -1;
+            break;
+        }
+        copied += bytes;
+    }
+    close(src);
+    close(dst);
+    return res;
+}
+
+/**
+ * @brief append all frames, spread over threads writer threads
+ * @param copy_path if not NULL, copy the container there before it is closed, as a killed run
+ *                  leaves it
+*/
+static int write_container(const char *path, std::vector<CheckFrame> &frames, int threads,
+                           const char *copy_path) {
+    QCamxDumpContainer container;
+    if (container.open(path, DUMP_CHECK_PREALLOCATE) != 0) {
+        return -1;
+    }
+    std::vector<pthread_t> tids(threads);
+    std::vector<WriterData> writers(threads);
+    for (int i = 0; i < threads; i++) {
+        writers[i] = {&container, &frames, i, threads, 0};
+        pthread_create(&tids[i], NULL, writer_thread, &writers[i]);
+    }
+    int failed = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        failed += writers[i].failed;
+    }
+    if (failed > 0) {
+        QCAMX_PRINT("%d frames failed to append to %s\n", failed, path);
+        return -1;
+    }
+    if (copy_path != NULL && copy_file(path, copy_path, UINT64_MAX) != 0) {
+        return -1;
+    }
+    container.close();
+    return 0;
+}
+
+/**
+ * @brief compare the frames read back with the dumped ones
+ * @param expected_count frames the reader has to find, the first ones in file order
+ * @return number of differences
+*/
+static int check_frames(QCamxDumpContainerReader &reader, std::vector<CheckFrame> &frames,
+                        size_t expected_count) {
+    int errors = 0;
+    if (reader.get_frame_count() != expected_count) {
+        QCAMX_PRINT("read %zu frames, expected %zu\n", reader.get_frame_count(), expected_count);
+        errors++;
+    }
+    std::vector<bool> seen(frames.size(), false);
+    for (size_t i = 0; i < reader.get_frame_count(); i++) {
+        const DumpFrameHeader *header = reader.get_frame(i);
+        if (header->frame_num >= frames.size() || seen[header->frame_num]) {
+            QCAMX_PRINT("frame %zu has an unknown or repeated frame number %u\n", i,
+                        header->frame_num);
+            errors++;
+            continue;
+        }
+        seen[header->frame_num] = true;
+        CheckFrame &frame = frames[header->frame_num];
+        if (header->stream_type != (uint32_t)frame.type ||
+            header->format != frame.info.format || header->subformat != YUV420NV12 ||
+            header->width != frame.info.width || header->height != frame.info.height ||
+            header->stride != frame.info.stride || header->slice != frame.info.slice ||
+            header->timestamp_ns != frame.timestamp ||
+            header->payload_size != (uint64_t)frame.info.size ||
+            header->payload_offset % DUMP_CONTAINER_ALIGN != 0) {
+            QCAMX_PRINT("frame %u header differs\n", header->frame_num);
+            errors++;
+            continue;
+        }
+        if (memcmp(reader.get_payload(i), frame.data.data(), frame.data.size()) != 0) {
+            QCAMX_PRINT("frame %u payload differs\n", header->frame_num);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+static int make_dir(const std::string &dir) {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        QCAMX_PRINT("create %s failed:%s\n", dir.c_str(), strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void remove_dir(const std::string &dir) {
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            unlink((dir + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(d);
+    rmdir(dir.c_str());
+}
+
+static bool files_equal(const std::string &path0, const std::string &path1) {
+    FILE *f0 = fopen(path0.c_str(), "rb");
+    FILE *f1 = fopen(path1.c_str(), "rb");
+    bool equal = f0 != NULL && f1 != NULL;
+    while (equal) {
+        int c0 = fgetc(f0);
+        int c1 = fgetc(f1);
+        equal = c0 == c1;
+        if (c0 == EOF || c1 == EOF) {
+            break;
+        }
+    }
+    if (f0 != NULL) {
+        fclose(f0);
+    }
+    if (f1 != NULL) {
+        fclose(f1);
+    }
+    return equal;
+}
+
+/**
+ * @brief extract the frames like qcamx-dump-extract does, dump the originals straight to files
+ *        with the same times, both directories have to hold the same files
+ * @return number of differences
+*/
+static int check_extract(QCamxDumpContainerReader &reader, std::vector<CheckFrame> &frames,
+                         const std::string &dir) {
+    std::string extract_dir = dir + "/extract";
+    std::string direct_dir = dir + "/direct";
+    remove_dir(extract_dir);
+    remove_dir(direct_dir);
+    if (make_dir(extract_dir) != 0 || make_dir(direct_dir) != 0) {
+        return 1;
+    }
+    int errors = 0;
+    for (size_t i = 0; i < reader.get_frame_count(); i++) {
+        const DumpFrameHeader *frame = reader.get_frame(i);
+        time_t wall_time = (time_t)(frame->wall_time_ns / 1000000000LL);
+        BufferInfo info;
+        memset(&info, 0, sizeof(info));
+        info.vaddr = (void *)reader.get_payload(i);
+        info.size = (int)frame->payload_size;
+        info.width = frame->width;
+        info.height = frame->height;
+        info.stride = frame->stride;
+        info.slice = frame->slice;
+        info.fd = -1;
+        info.format = frame->format;
+        CheckFrame &original = frames[frame->frame_num];
+        if (QCamxFrameDump::write_file(extract_dir.c_str(), &info, frame->frame_num,
+                                       (StreamType)frame->stream_type,
+                                       (Implsubformat)frame->subformat, wall_time) == 0 ||
+            QCamxFrameDump::write_file(direct_dir.c_str(), &original.info, original.frame_num,
+                                       original.type, YUV420NV12, wall_time) == 0) {
+            errors++;
+        }
+    }
+    size_t compared = 0;
+    DIR *d = opendir(direct_dir.c_str());
+    struct dirent *entry;
+    while (d != NULL && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        compared++;
+        if (!files_equal(direct_dir + "/" + entry->d_name, extract_dir + "/" + entry->d_name)) {
+            QCAMX_PRINT("extracted %s differs from the direct dump\n", entry->d_name);
+            errors++;
+        }
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+    if (compared != reader.get_frame_count()) {
+        QCAMX_PRINT("%zu direct dump files for %zu frames\n", compared, reader.get_frame_count());
+        errors++;
+    }
+    remove_dir(extract_dir);
+    remove_dir(direct_dir);
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+    std::string base_dir = CAMERA_STORAGE_DIR;
+    int frame_count = 48;
+    int threads = 4;
+    int c;
+    while ((c = getopt(argc, argv, "hd:n:t:")) != -1) {
+        switch (c) {
+            case 'd':
+                base_dir = optarg;
+                break;
+            case 'n':
+                frame_count = atoi(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    if (frame_count <= 1 || threads <= 0) {
+        printf("%s", usage);
+        return 1;
+    }
+    std::string dir = base_dir + "/qcamx_dump_check";
+    if (make_dir(dir) != 0) {
+        return 1;
+    }
+    std::string path = dir + "/check.qcxdump";
+    std::string killed_path = dir + "/killed.qcxdump";
+    std::string torn_path = dir + "/torn.qcxdump";
+
+    std::vector<CheckFrame> frames(frame_count);
+    for (int i = 0; i < frame_count; i++) {
+        make_frame(&frames[i], i);
+    }
+    if (write_container(path.c_str(), frames, threads, killed_path.c_str()) != 0) {
+        return 1;
+    }
+
+    int errors = 0;
+    QCamxDumpContainerReader reader;
+    // closed container, the index comes from the trailer
+    if (reader.open(path.c_str()) != 0) {
+        return 1;
+    }
+    if (!reader.has_index()) {
+        QCAMX_PRINT("closed container has no index\n");
+        errors++;
+    }
+    errors += check_frames(reader, frames, frames.size());
+    errors += check_extract(reader, frames, dir);
+    QCAMX_PRINT("closed container: %zu frames %d errors\n", reader.get_frame_count(), errors);
+
+    // the copy taken before close has neither index nor trailer, the frames are scanned
+    int killed_errors = 0;
+    if (reader.open(killed_path.c_str()) != 0) {
+        return 1;
+    }
+    if (reader.has_index()) {
+        QCAMX_PRINT("container without trailer has an index\n");
+        killed_errors++;
+    }
+    killed_errors += check_frames(reader, frames, frames.size());
+    killed_errors += check_extract(reader, frames, dir);
+    QCAMX_PRINT("container without trailer: %zu frames %d errors\n", reader.get_frame_count(),
+                killed_errors);
+    errors += killed_errors;
+
+    // cut in the middle of the last payload, the scan keeps the frames before it
+    uint64_t last_end = 0;
+    uint64_t torn_size = 0;
+    for (size_t i = 0; i < reader.get_frame_count(); i++) {
+        const DumpFrameHeader *frame = reader.get_frame(i);
+        if (frame->payload_offset > last_end) {
+            last_end = frame->payload_offset;
+            torn_size = frame->payload_offset + frame->payload_size / 2;
+        }
+    }
+    reader.close();
+    int torn_errors = 0;
+    if (copy_file(killed_path.c_str(), torn_path.c_str(), torn_size) != 0 ||
+        reader.open(torn_path.c_str()) != 0) {
+        return 1;
+    }
+    torn_errors += check_frames(reader, frames, frames.size() - 1);
+    QCAMX_PRINT("container with a torn last frame: %zu frames %d errors\n",
+                reader.get_frame_count(), torn_errors);
+    errors += torn_errors;
+    reader.close();
+
+    unlink(path.c_str());
+    unlink(killed_path.c_str());
+    unlink(torn_path.c_str());
+    rmdir(dir.c_str());
+    return errors == 0 ? 0 : 1;
+}
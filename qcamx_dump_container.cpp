@@ -0,0 +1,319 @@
+/**
+ * @file  qcamx_dump_container.cpp
+ * @brief streaming dump container implementation
+*/
+
+#include "qcamx_dump_container.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxDumpContainer"
+
+// padding source for the tail of every block
+static const uint8_t zero_block[DUMP_CONTAINER_ALIGN] = {0};
+
+static int64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+QCamxDumpContainer::QCamxDumpContainer() {
+    _fd = -1;
+    pthread_mutex_init(&_lock, NULL);
+    _write_offset = 0;
+    _allocated_bytes = 0;
+    _preallocate_bytes = 0;
+    _failed_count = 0;
+}
+
+QCamxDumpContainer::~QCamxDumpContainer() {
+    close();
+    pthread_mutex_destroy(&_lock);
+}
+
+/*************************public method*****************************/
+
+int QCamxDumpContainer::open(const char *path, uint64_t preallocate_bytes) {
+    if (_fd >= 0) {
+        close();
+    }
+    _fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        QCAMX_ERR("open dump container %s failed:%s\n", path, strerror(errno));
+        return -1;
+    }
+    _preallocate_bytes = align_up(preallocate_bytes);
+    _allocated_bytes = 0;
+    if (_preallocate_bytes > 0) {
+        // keep the file size, so a killed run leaves no trailing zeros to walk over
+        if (fallocate(_fd, FALLOC_FL_KEEP_SIZE, 0, _preallocate_bytes) == 0) {
+            _allocated_bytes = _preallocate_bytes;
+        } else {
+            QCAMX_INFO("preallocate dump container failed:%s\n", strerror(errno));
+        }
+    }
+
+    DumpContainerHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, DUMP_CONTAINER_MAGIC, sizeof(header.magic));
+    header.version = DUMP_CONTAINER_VERSION;
+    header.align = DUMP_CONTAINER_ALIGN;
+    header.create_time_ns = realtime_ns();
+    struct iovec iov[2] = {{&header, sizeof(header)},
+                           {(void *)zero_block, DUMP_CONTAINER_ALIGN - sizeof(header)}};
+    if (write_block(iov, 2, 0) != 0) {
+        ::close(_fd);
+        _fd = -1;
+        return -1;
+    }
+    _write_offset = DUMP_CONTAINER_ALIGN;
+    _index.clear();
+    _failed_count = 0;
+    QCAMX_PRINT("dump container %s preallocated:%" PRIu64 "MB\n", path,
+                _allocated_bytes >> 20);
+    return 0;
+}
+
+void QCamxDumpContainer::close() {
+    if (_fd < 0) {
+        return;
+    }
+    uint64_t index_offset = _write_offset;
+    DumpContainerTrailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    memcpy(trailer.magic, DUMP_CONTAINER_INDEX_MAGIC, sizeof(trailer.magic));
+    trailer.index_offset = index_offset;
+    trailer.index_count = (uint32_t)_index.size();
+    struct iovec iov[2] = {{_index.data(), _index.size() * sizeof(DumpFrameHeader)},
+                           {&trailer, sizeof(trailer)}};
+    uint64_t end = index_offset + iov[0].iov_len + iov[1].iov_len;
+    if (write_block(iov, 2, index_offset) != 0) {
+        QCAMX_ERR("write dump container index failed, frames are still found by scanning\n");
+        end = index_offset;
+    }
+    // release the preallocated space which was not used
+    if (ftruncate(_fd, end) != 0) {
+        QCAMX_ERR("truncate dump container failed:%s\n", strerror(errno));
+    }
+    ::close(_fd);
+    _fd = -1;
+    QCAMX_PRINT("dump container frames:%zu failed:%" PRIu64 " size:%" PRIu64 "MB\n",
+                _index.size(), _failed_count, end >> 20);
+    _index.clear();
+}
+
+size_t QCamxDumpContainer::append(BufferInfo *info, unsigned int frame_num, StreamType dump_type,
+                                  Implsubformat subformat, nsecs_t timestamp) {
+    if (_fd < 0 || info == NULL || info->vaddr == NULL || info->size <= 0) {
+        return 0;
+    }
+    uint64_t payload_size = (uint64_t)info->size;
+    uint64_t block_size = DUMP_CONTAINER_ALIGN + align_up(payload_size);
+
+    pthread_mutex_lock(&_lock);
+    uint64_t offset = _write_offset;
+    _write_offset += block_size;
+    if (_preallocate_bytes > 0 && _write_offset > _allocated_bytes) {
+        uint64_t grow = block_size > _preallocate_bytes ? align_up(block_size) : _preallocate_bytes;
+        if (fallocate(_fd, FALLOC_FL_KEEP_SIZE, _allocated_bytes, grow) == 0) {
+            _allocated_bytes += grow;
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+
+    DumpFrameHeader frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.magic = DUMP_FRAME_MAGIC;
+    frame.frame_num = frame_num;
+    frame.stream_type = dump_type;
+    frame.format = info->format;
+    frame.subformat = subformat;
+    frame.width = info->width;
+    frame.height = info->height;
+    frame.stride = info->stride;
+    frame.slice = info->slice;
+    frame.payload_offset = offset + DUMP_CONTAINER_ALIGN;
+    frame.payload_size = payload_size;
+    frame.timestamp_ns = timestamp;
+    frame.wall_time_ns = realtime_ns();
+
+    // header, payload straight from the stream buffer, then padding, in one write
+    struct iovec iov[4] = {
+        {&frame, sizeof(frame)},
+        {(void *)zero_block, DUMP_CONTAINER_ALIGN - sizeof(frame)},
+        {info->vaddr, (size_t)payload_size},
+        {(void *)zero_block, (size_t)(align_up(payload_size) - payload_size)},
+    };
+    int ret = write_block(iov, 4, offset);
+
+    pthread_mutex_lock(&_lock);
+    if (ret == 0) {
+        _index.push_back(frame);
+    } else {
+        // the hole stays, the frame header is not found by the reader either way
+        _failed_count++;
+    }
+    pthread_mutex_unlock(&_lock);
+    return ret == 0 ? (size_t)payload_size : 0;
+}
+
+/*************************private method*****************************/
+
+int QCamxDumpContainer::write_block(const struct iovec *iov, int iov_count, uint64_t offset) {
+    struct iovec pending[4];
+    int count = 0;
+    for (int i = 0; i < iov_count && count < 4; i++) {
+        if (iov[i].iov_len > 0) {
+            pending[count++] = iov[i];
+        }
+    }
+    int first = 0;
+    while (first < count) {
+        ssize_t written = pwritev(_fd, &pending[first], count - first, (off_t)offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            QCAMX_ERR("write dump container at %" PRIu64 " failed:%s\n", offset,
+                      strerror(errno));
+            return -1;
+        }
+        offset += written;
+        // skip what the short write already covered
+        while (first < count && (size_t)written >= pending[first].iov_len) {
+            written -= pending[first].iov_len;
+            first++;
+        }
+        if (first < count) {
+            pending[first].iov_base = (uint8_t *)pending[first].iov_base + written;
+            pending[first].iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+QCamxDumpContainerReader::QCamxDumpContainerReader() {
+    _fd = -1;
+    _data = NULL;
+    _size = 0;
+    _has_index = false;
+}
+
+QCamxDumpContainerReader::~QCamxDumpContainerReader() {
+    close();
+}
+
+/*************************public method*****************************/
+
+int QCamxDumpContainerReader::open(const char *path) {
+    close();
+    _fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (_fd < 0) {
+        QCAMX_ERR("open dump container %s failed:%s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(_fd, &st) != 0 || (uint64_t)st.st_size < DUMP_CONTAINER_ALIGN) {
+        QCAMX_ERR("dump container %s is too small\n", path);
+        close();
+        return -1;
+    }
+    _size = (uint64_t)st.st_size;
+    void *data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED) {
+        QCAMX_ERR("map dump container %s failed:%s\n", path, strerror(errno));
+        close();
+        return -1;
+    }
+    _data = (uint8_t *)data;
+    madvise(_data, _size, MADV_SEQUENTIAL);
+
+    const DumpContainerHeader *header = (const DumpContainerHeader *)_data;
+    if (strncmp(header->magic, DUMP_CONTAINER_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != DUMP_CONTAINER_VERSION || header->align != DUMP_CONTAINER_ALIGN) {
+        QCAMX_ERR("%s is not a dump container of version %d\n", path, DUMP_CONTAINER_VERSION);
+        close();
+        return -1;
+    }
+    _has_index = load_index();
+    if (!_has_index) {
+        QCAMX_INFO("dump container %s has no index, scan the frames\n", path);
+        scan_frames();
+    }
+    return 0;
+}
+
+void QCamxDumpContainerReader::close() {
+    if (_data != NULL) {
+        munmap(_data, _size);
+        _data = NULL;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _size = 0;
+    _has_index = false;
+    _frames.clear();
+}
+
+/*************************private method*****************************/
+
+bool QCamxDumpContainerReader::load_index() {
+    if (_size < DUMP_CONTAINER_ALIGN + sizeof(DumpContainerTrailer)) {
+        return false;
+    }
+    const DumpContainerTrailer *trailer =
+        (const DumpContainerTrailer *)(_data + _size - sizeof(DumpContainerTrailer));
+    if (memcmp(trailer->magic, DUMP_CONTAINER_INDEX_MAGIC, sizeof(trailer->magic)) != 0) {
+        return false;
+    }
+    uint64_t index_bytes = (uint64_t)trailer->index_count * sizeof(DumpFrameHeader);
+    if (trailer->index_offset + index_bytes + sizeof(DumpContainerTrailer) != _size) {
+        return false;
+    }
+    _frames.resize(trailer->index_count);
+    memcpy(_frames.data(), _data + trailer->index_offset, index_bytes);
+    for (size_t i = 0; i < _frames.size(); i++) {
+        if (!frame_is_valid(&_frames[i])) {
+            _frames.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void QCamxDumpContainerReader::scan_frames() {
+    _frames.clear();
+    uint64_t offset = DUMP_CONTAINER_ALIGN;
+    while (offset + DUMP_CONTAINER_ALIGN <= _size) {
+        DumpFrameHeader frame;
+        memcpy(&frame, _data + offset, sizeof(frame));
+        if (!frame_is_valid(&frame) || frame.payload_offset != offset + DUMP_CONTAINER_ALIGN) {
+            break;
+        }
+        _frames.push_back(frame);
+        offset = frame.payload_offset +
+                 ((frame.payload_size + DUMP_CONTAINER_ALIGN - 1) &
+                  ~(uint64_t)(DUMP_CONTAINER_ALIGN - 1));
+    }
+}
+
+bool QCamxDumpContainerReader::frame_is_valid(const DumpFrameHeader *frame) {
+    return frame->magic == DUMP_FRAME_MAGIC && frame->payload_offset <= _size &&
+           frame->payload_size <= _size - frame->payload_offset;
+}
@@ -0,0 +1,134 @@
+/**
+ * @file  qcamx_dump_container.h
+ * @brief streaming dump container, frames are appended to one preallocated file
+ *
+ * layout, every block starts on a DUMP_CONTAINER_ALIGN boundary:
+ *   DumpContainerHeader
+ *   DumpFrameHeader, payload    repeated for every frame
+ *   DumpFrameHeader[count]      index, written on close
+ *   DumpContainerTrailer
+ * a container without trailer (killed run) is read by walking the frame headers
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+
+#include <vector>
+
+#include "qcamx_buffer_manager.h"
+#include "qcamx_define.h"
+
+#define DUMP_CONTAINER_ALIGN (4096)
+#define DUMP_CONTAINER_VERSION (1)
+#define DUMP_CONTAINER_MAGIC "QCXDUMP"
+#define DUMP_CONTAINER_INDEX_MAGIC "QCXINDEX"
+#define DUMP_FRAME_MAGIC (0x46584351)  // "QCXF"
+
+struct DumpContainerHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t align;
+    int64_t create_time_ns;  ///< CLOCK_REALTIME
+};
+
+struct DumpFrameHeader {
+    uint32_t magic;
+    uint32_t frame_num;
+    uint32_t stream_type;  ///< StreamType
+    uint32_t format;       ///< HAL pixel format
+    uint32_t subformat;    ///< Implsubformat
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    int32_t slice;
+    uint32_t reserved;
+    uint64_t payload_offset;  ///< from the start of the file
+    uint64_t payload_size;    ///< without the alignment padding
+    int64_t timestamp_ns;     ///< CLOCK_MONOTONIC when the frame was handed to the dump
+    int64_t wall_time_ns;     ///< CLOCK_REALTIME, used for the extracted file name
+};
+
+struct DumpContainerTrailer {
+    char magic[8];
+    uint64_t index_offset;
+    uint32_t index_count;
+    uint32_t reserved;
+};
+
+class QCamxDumpContainer {
+public:
+    QCamxDumpContainer();
+    ~QCamxDumpContainer();
+public:
+    /**
+     * @brief create the container and preallocate its space
+     * @param preallocate_bytes grown by the same amount whenever it is used up
+    */
+    int open(const char *path, uint64_t preallocate_bytes);
+    /**
+     * @brief write the index and the trailer, release the unused preallocation
+    */
+    void close();
+    bool is_open() { return _fd >= 0; }
+    /**
+     * @brief append one frame, safe to call from several writer threads
+     * @return payload bytes written, 0 on failure
+    */
+    size_t append(BufferInfo *info, unsigned int frame_num, StreamType dump_type,
+                  Implsubformat subformat, nsecs_t timestamp);
+private:
+    static uint64_t align_up(uint64_t size) {
+        return (size + DUMP_CONTAINER_ALIGN - 1) & ~(uint64_t)(DUMP_CONTAINER_ALIGN - 1);
+    }
+    /**
+     * @brief write a whole block at offset, retries short writes
+    */
+    int write_block(const struct iovec *iov, int iov_count, uint64_t offset);
+    // Do not support the copy constructor or assignment operator
+    QCamxDumpContainer(const QCamxDumpContainer &) = delete;
+    QCamxDumpContainer &operator=(const QCamxDumpContainer &) = delete;
+private:
+    int _fd;
+    pthread_mutex_t _lock;
+    // reserved under _lock, the frame is written outside of it
+    uint64_t _write_offset;
+    uint64_t _allocated_bytes;
+    uint64_t _preallocate_bytes;
+    std::vector<DumpFrameHeader> _index;
+    uint64_t _failed_count;
+};
+
+class QCamxDumpContainerReader {
+public:
+    QCamxDumpContainerReader();
+    ~QCamxDumpContainerReader();
+public:
+    /**
+     * @brief map a container and load its index
+    */
+    int open(const char *path);
+    void close();
+    size_t get_frame_count() { return _frames.size(); }
+    const DumpFrameHeader *get_frame(size_t index) { return &_frames[index]; }
+    const uint8_t *get_payload(size_t index) { return _data + _frames[index].payload_offset; }
+    /**
+     * @brief whether the index came from the trailer instead of walking the frames
+    */
+    bool has_index() { return _has_index; }
+private:
+    bool load_index();
+    void scan_frames();
+    bool frame_is_valid(const DumpFrameHeader *frame);
+    // Do not support the copy constructor or assignment operator
+    QCamxDumpContainerReader(const QCamxDumpContainerReader &) = delete;
+    QCamxDumpContainerReader &operator=(const QCamxDumpContainerReader &) = delete;
+private:
+    int _fd;
+    uint8_t *_data;
+    uint64_t _size;
+    bool _has_index;
+    std::vector<DumpFrameHeader> _frames;
+};
@@ -0,0 +1,112 @@
+/**
+ * @file  qcamx_dump_extract.cpp
+ * @brief split a dump container back into one file per frame
+*/
+
+#include <inttypes.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "qcamx_dump_container.h"
+#include "qcamx_frame_dump.h"
+#include "qcamx_image_kernels.h"
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxDumpExtract"
+
+static const char usage[] = "\
+usage: qcamx-dump-extract [-l] [-u threads] container [output dir] \n\
+  -l: list the frames only \n\
+  -u: write RAW10/RAW12 frames unpacked to 16 bit, using threads threads \n\
+  output dir: defaults to the directory of the container \n\
+";
+
+int main(int argc, char *argv[]) {
+    bool list_only = false;
+    int unpack_threads = 0;
+    int c;
+    while ((c = getopt(argc, argv, "hlu:")) != -1) {
+        switch (c) {
+            case 'l':
+                list_only = true;
+                break;
+            case 'u':
+                unpack_threads = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        printf("%s", usage);
+        return 1;
+    }
+    const char *path = argv[optind];
+    std::string dir;
+    if (optind + 1 < argc) {
+        dir = argv[optind + 1];
+    } else {
+        std::string path_copy(path);
+        dir = dirname(&path_copy[0]);
+    }
+
+    if (unpack_threads > 0) {
+        QCamxImageKernels::set_worker_threads(unpack_threads);
+        QCamxFrameDump::set_unpack_raw(true);
+    }
+
+    QCamxDumpContainerReader reader;
+    if (reader.open(path) != 0) {
+        return 1;
+    }
+    size_t count = reader.get_frame_count();
+    QCAMX_PRINT("%s frames:%zu%s\n", path, count, reader.has_index() ? "" : " (scanned)");
+
+    uint64_t total_bytes = 0;
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        const DumpFrameHeader *frame = reader.get_frame(i);
+        StreamType type = (StreamType)frame->stream_type;
+        if (list_only) {
+            QCAMX_PRINT("%s frame:%u format:%u %dx%d stride:%d slice:%d size:%" PRIu64
+                        " ts:%" PRId64 "\n",
+                        QCamxFrameDump::get_stream_type_string(type), frame->frame_num,
+                        frame->format, frame->width, frame->height, frame->stride, frame->slice,
+                        frame->payload_size, frame->timestamp_ns);
+            continue;
+        }
+        BufferInfo info;
+        memset(&info, 0, sizeof(info));
+        info.vaddr = (void *)reader.get_payload(i);
+        info.size = (int)frame->payload_size;
+        info.width = frame->width;
+        info.height = frame->height;
+        info.stride = frame->stride;
+        info.slice = frame->slice;
+        info.fd = -1;
+        info.format = frame->format;
+        size_t written =
+            QCamxFrameDump::write_file(dir.c_str(), &info, frame->frame_num, type,
+                                       (Implsubformat)frame->subformat,
+                                       (time_t)(frame->wall_time_ns / 1000000000LL));
+        if (written == 0) {
+            failed++;
+        }
+        total_bytes += written;
+    }
+    if (!list_only) {
+        QCAMX_PRINT("extracted frames:%zu failed:%zu bytes:%" PRIu64 " to %s\n", count - failed,
+                    failed, total_bytes, dir.c_str());
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file  qcamx_dump_writer.cpp
+ * @brief asynchronous frame dump writer implementation
+*/
+
+#include "qcamx_dump_writer.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <utils/Timers.h>
+
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxDumpWriter"
+
+QCamxDumpWriter::QCamxDumpWriter() {
+    _running = false;
+    _policy = DUMP_POLICY_DROP_OLDEST;
+    _container = NULL;
+    _queue_depth = 0;
+    _head = 0;
+    _count = 0;
+    _stopping = false;
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, NULL);
+    _written_count = 0;
+    _dropped_count = 0;
+    _written_bytes = 0;
+    _first_write_ns = 0;
+    _last_write_ns = 0;
+}
+
+QCamxDumpWriter::~QCamxDumpWriter() {
+    stop();
+    pthread_mutex_destroy(&_lock);
+    pthread_cond_destroy(&_cond);
+}
+
+/*************************public method*****************************/
+
+int QCamxDumpWriter::start(int num_threads, int queue_depth, int policy,
+                           QCamxDumpContainer *container) {
+    if (_running || num_threads <= 0) {
+        return 0;
+    }
+    if (num_threads > DUMP_WRITER_THREADS_MAX) {
+        num_threads = DUMP_WRITER_THREADS_MAX;
+    }
+    if (queue_depth < 1) {
+        queue_depth = 1;
+    } else if (queue_depth > DUMP_QUEUE_DEPTH_MAX) {
+        queue_depth = DUMP_QUEUE_DEPTH_MAX;
+    }
+    _queue_depth = queue_depth;
+    _policy = policy;
+    _container = container;
+    _head = 0;
+    _count = 0;
+    _stopping = false;
+    _written_count = 0;
+    _dropped_count = 0;
+    _written_bytes = 0;
+    _first_write_ns = 0;
+    _last_write_ns = 0;
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, writer_thread_entry, this) != 0) {
+            QCAMX_ERR("create dump writer thread failed:%s\n", strerror(errno));
+            break;
+        }
+        _threads.push_back(thread);
+    }
+    _running = !_threads.empty();
+    if (!_running) {
+        return -1;
+    }
+    QCAMX_INFO("dump writer threads:%zu queue depth:%d policy:%d\n", _threads.size(),
+               _queue_depth, _policy);
+    return 0;
+}
+
+void QCamxDumpWriter::stop() {
+    if (!_running) {
+        return;
+    }
+    pthread_mutex_lock(&_lock);
+    _stopping = true;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_lock);
+    for (size_t i = 0; i < _threads.size(); i++) {
+        pthread_join(_threads[i], NULL);
+    }
+    _threads.clear();
+    _running = false;
+    report();
+}
+
+bool QCamxDumpWriter::enqueue(QCamxBufferManager *buffer_manager, buffer_handle_t *buffer,
+                              unsigned int frame_num, StreamType dump_type,
+                              Implsubformat subformat, DumpWriteFunc write_func) {
+    DumpJob job = {buffer_manager, buffer, frame_num, dump_type, subformat, write_func,
+                   systemTime()};
+    DumpJob dropped;
+    bool has_dropped = false;
+
+    // the reference keeps the buffer out of the pool until the write is done
+    buffer_manager->acquire_buffer(buffer);
+    pthread_mutex_lock(&_lock);
+    if (_count == _queue_depth) {
+        if (_policy == DUMP_POLICY_SKIP_NEW) {
+            pthread_mutex_unlock(&_lock);
+            _dropped_count.fetch_add(1, std::memory_order_relaxed);
+            buffer_manager->return_buffer(buffer);
+            return false;
+        }
+        dropped = _jobs[_head];
+        _head = (_head + 1) % _queue_depth;
+        _count--;
+        has_dropped = true;
+    }
+    _jobs[(_head + _count) % _queue_depth] = job;
+    _count++;
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    if (has_dropped) {
+        _dropped_count.fetch_add(1, std::memory_order_relaxed);
+        dropped.buffer_manager->return_buffer(dropped.buffer);
+    }
+    return true;
+}
+
+/*************************private method*****************************/
+
+void *QCamxDumpWriter::writer_thread_entry(void *data) {
+    QCamxDumpWriter *writer = (QCamxDumpWriter *)data;
+    writer->writer_loop();
+    return NULL;
+}
+
+void QCamxDumpWriter::writer_loop() {
+    for (;;) {
+        pthread_mutex_lock(&_lock);
+        while (_count == 0 && !_stopping) {
+            pthread_cond_wait(&_cond, &_lock);
+        }
+        // queued dumps are still written on stop
+        if (_count == 0) {
+            pthread_mutex_unlock(&_lock);
+            return;
+        }
+        DumpJob job = _jobs[_head];
+        _head = (_head + 1) % _queue_depth;
+        _count--;
+        pthread_mutex_unlock(&_lock);
+        write_job(job);
+    }
+}
+
+void QCamxDumpWriter::write_job(const DumpJob &job) {
+    nsecs_t start = systemTime();
+    int64_t expected = 0;
+    _first_write_ns.compare_exchange_strong(expected, start, std::memory_order_relaxed);
+
+    BufferInfo *info = job.buffer_manager->get_buffer_info(job.buffer);
+    size_t bytes = 0;
+    if (info != NULL && _container != NULL && _container->is_open()) {
+        bytes = _container->append(info, job.frame_num, job.dump_type, job.subformat,
+                                   job.timestamp);
+    } else if (info != NULL) {
+        bytes = job.write_func(info, job.frame_num, job.dump_type, job.subformat);
+    }
+    job.buffer_manager->return_buffer(job.buffer);
+
+    nsecs_t end = systemTime();
+    int64_t last = _last_write_ns.load(std::memory_order_relaxed);
+    while (end > last &&
+           !_last_write_ns.compare_exchange_weak(last, end, std::memory_order_relaxed)) {
+    }
+    _written_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    _written_count.fetch_add(1, std::memory_order_relaxed);
+    QCAMX_DBG("dump frame:%u bytes:%zu in %" PRId64 "us\n", job.frame_num, bytes,
+              (int64_t)(end - start) / 1000);
+}
+
+void QCamxDumpWriter::report() {
+    uint64_t written = _written_count.load();
+    uint64_t dropped = _dropped_count.load();
+    if (written == 0 && dropped == 0) {
+        return;
+    }
+    uint64_t bytes = _written_bytes.load();
+    int64_t elapsed_ns = _last_write_ns.load() - _first_write_ns.load();
+    double mb_per_sec = elapsed_ns > 0 ? (double)bytes / 1048576.0 * 1e9 / elapsed_ns : 0;
+    QCAMX_PRINT("dump writer written:%" PRIu64 " dropped:%" PRIu64 " bytes:%" PRIu64
+                " %.1fMB/s\n",
+                written, dropped, bytes, mb_per_sec);
+}
@@ -0,0 +1,98 @@
+/**
+ * @file  qcamx_dump_writer.h
+ * @brief asynchronous frame dump writer
+ *        dumps are written by a small thread pool, the post process thread never waits on disk
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "qcamx_buffer_manager.h"
+#include "qcamx_dump_container.h"
+#include "qcamx_define.h"
+
+#define DUMP_WRITER_THREADS_MAX (8)
+#define DUMP_QUEUE_DEPTH_MAX (64)
+
+typedef enum {
+    DUMP_POLICY_DROP_OLDEST = 0,  ///< queue full, drop the oldest queued dump
+    DUMP_POLICY_SKIP_NEW = 1,     ///< queue full, skip the new dump
+} DumpQueuePolicy;
+
+/**
+ * @brief write one frame to a file
+ * @return bytes written
+*/
+typedef size_t (*DumpWriteFunc)(BufferInfo *info, unsigned int frame_num, StreamType dump_type,
+                                Implsubformat subformat);
+
+class QCamxDumpWriter {
+public:
+    QCamxDumpWriter();
+    ~QCamxDumpWriter();
+public:
+    /**
+     * @brief start the writer threads
+     * @param num_threads 0 disables the writer, dumps are written by the caller
+     * @param container dumps are appended to it while it is open, else one file per frame
+    */
+    int start(int num_threads, int queue_depth, int policy, QCamxDumpContainer *container);
+    /**
+     * @brief write every queued dump, then stop the writer threads
+    */
+    void stop();
+    bool is_running() { return _running; }
+    /**
+     * @brief queue one dump, holds a reference on the buffer until it is written
+     * @return false if the dump was skipped
+    */
+    bool enqueue(QCamxBufferManager *buffer_manager, buffer_handle_t *buffer,
+                 unsigned int frame_num, StreamType dump_type, Implsubformat subformat,
+                 DumpWriteFunc write_func);
+private:
+    struct DumpJob {
+        QCamxBufferManager *buffer_manager;
+        buffer_handle_t *buffer;
+        unsigned int frame_num;
+        StreamType dump_type;
+        Implsubformat subformat;
+        DumpWriteFunc write_func;
+        nsecs_t timestamp;
+    };
+    static void *writer_thread_entry(void *data);
+    void writer_loop();
+    /**
+     * @brief write one dump and drop its buffer reference
+    */
+    void write_job(const DumpJob &job);
+    void report();
+    // Do not support the copy constructor or assignment operator
+    QCamxDumpWriter(const QCamxDumpWriter &) = delete;
+    QCamxDumpWriter &operator=(const QCamxDumpWriter &) = delete;
+private:
+    bool _running;
+    int _policy;
+    QCamxDumpContainer *_container;
+    std::vector<pthread_t> _threads;
+
+    // bounded queue, only touched with _lock held
+    DumpJob _jobs[DUMP_QUEUE_DEPTH_MAX];
+    int _queue_depth;
+    int _head;
+    int _count;
+    bool _stopping;
+    pthread_mutex_t _lock;
+    pthread_cond_t _cond;
+
+    // statistics printed on stop
+    std::atomic<uint64_t> _written_count;
+    std::atomic<uint64_t> _dropped_count;
+    std::atomic<uint64_t> _written_bytes;
+    std::atomic<int64_t> _first_write_ns;  ///< wall time of the first write start
+    std::atomic<int64_t> _last_write_ns;   ///< wall time of the latest write end
+};
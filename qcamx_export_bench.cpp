@@ -0,0 +1,154 @@
+/**
+ * @file  qcamx_export_bench.cpp
+ * @brief measure the frame export of a running camx-hal3-test from another process
+ *        frame rate, skipped frames, descriptor latency and the read bandwidth of the mappings
+*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "qcamx_frame_export_client.h"
+
+static const char usage[] = "\
+usage: qcamx-export-bench [-c camera id] [-p socket] [-s mask] [-t seconds] [-H held] [-r] \n\
+  -c: camera whose default socket is used, default 0 \n\
+  -p: socket path, overrides -c \n\
+  -s: 1 << stream type of every stream, default 1 (preview) \n\
+  -t: measured time, default 10 \n\
+  -H: frames held at a time, released oldest first, default 1 \n\
+  -r: read every byte of each frame \n\
+";
+
+static int64_t get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief read the frame like an analytics consumer would, the sum keeps the loads
+*/
+static uint64_t read_frame(const qcamx_export_frame_t *frame) {
+    const uint64_t *words = (const uint64_t *)frame->vaddr;
+    size_t count = frame->buffer->size / sizeof(uint64_t);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += words[i];
+    }
+    return sum;
+}
+
+int main(int argc, char *argv[]) {
+    int camera_id = 0;
+    const char *path = NULL;
+    uint32_t stream_mask = 1;
+    int seconds = 10;
+    uint32_t held = 1;
+    bool read_frames = false;
+    int c;
+    while ((c = getopt(argc, argv, "hc:p:s:t:H:r")) != -1) {
+        switch (c) {
+            case 'c':
+                camera_id = atoi(optarg);
+                break;
+            case 'p':
+                path = optarg;
+                break;
+            case 's':
+                stream_mask = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                break;
+            case 'H':
+                held = atoi(optarg);
+                break;
+            case 'r':
+                read_frames = true;
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    if (seconds <= 0 || held == 0 || held > QCAMX_EXPORT_MAX_HELD) {
+        printf("%s", usage);
+        return 1;
+    }
+    char default_path[128];
+    if (path == NULL) {
+        snprintf(default_path, sizeof(default_path), QCAMX_EXPORT_SOCKET_FORMAT, camera_id);
+        path = default_path;
+    }
+
+    qcamx_export_client_t *client = qcamx_export_connect(path, stream_mask, held);
+    if (client == NULL) {
+        printf("connect %s failed: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (held > qcamx_export_get_max_held(client)) {
+        held = qcamx_export_get_max_held(client);
+    }
+    printf("connected to %s, holding %u frames\n", path, held);
+
+    std::vector<qcamx_export_frame_t> held_frames;
+    std::vector<int64_t> latencies;
+    uint64_t frames = 0;
+    uint64_t skipped = 0;
+    uint64_t bytes = 0;
+    int64_t read_ns = 0;
+    uint64_t checksum = 0;
+    int64_t begin = get_time_ns();
+    int64_t end = begin + (int64_t)seconds * 1000000000LL;
+    int rc = 0;
+    while (get_time_ns() < end) {
+        qcamx_export_frame_t frame;
+        rc = qcamx_export_next_frame(client, &frame, 1000);
+        if (rc == -ETIMEDOUT) {
+            continue;
+        } else if (rc != 0) {
+            printf("receive failed: %s\n", strerror(-rc));
+            break;
+        }
+        latencies.push_back(get_time_ns() - frame.desc.send_time_ns);
+        frames++;
+        skipped += frame.desc.skipped;
+        if (read_frames) {
+            int64_t read_begin = get_time_ns();
+            checksum += read_frame(&frame);
+            read_ns += get_time_ns() - read_begin;
+            bytes += frame.buffer->size;
+        }
+        held_frames.push_back(frame);
+        if (held_frames.size() >= held) {
+            qcamx_export_release(client, &held_frames.front());
+            held_frames.erase(held_frames.begin());
+        }
+    }
+    int64_t elapsed = get_time_ns() - begin;
+    qcamx_export_disconnect(client);
+
+    if (frames == 0) {
+        printf("no frame received\n");
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    printf("frames:%" PRIu64 " fps:%.2f skipped:%" PRIu64 " latency p50:%" PRId64
+           "us p99:%" PRId64 "us max:%" PRId64 "us\n",
+           frames, frames * 1e9 / elapsed, skipped, latencies[(n - 1) / 2] / 1000,
+           latencies[(n - 1) * 99 / 100] / 1000, latencies[n - 1] / 1000);
+    if (read_frames && read_ns > 0) {
+        printf("read:%.2f GB/s checksum:%" PRIx64 "\n", (double)bytes / read_ns, checksum);
+    }
+    return rc == 0 || rc == -ETIMEDOUT ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file  qcamx_frame_dump.cpp
+ * @brief write one frame to its own dump file implementation
+*/
+
+#include "qcamx_frame_dump.h"
+
+#include <errno.h>
+#include <math.h>  // ceil
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "qcamx_image_kernels.h"
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxFrameDump"
+
+/* Tile info for supported UBWC formats */
+static const UBWCYUVTileInfo SupportedUBWCYUVTileInfo[] = {
+    {48, 64, 4, 256, 16, 4, 3},  // UBWC_TP10-Y
+
+    {64, 64, 4, 256, 16, 1, 1},  // UBWC_NV12-4R-Y
+
+    {32, 32, 8, 128, 32, 1, 1},  // UBWC_NV12-Y/UBWCNV12
+
+    {32, 64, 4, 256, 16, 2, 1},  // UBWC_P010
+};
+
+static inline uint32_t ALIGN(uint32_t operand, uint32_t alignment) {
+    uint32_t remainder = (operand % alignment);
+    return (0 == remainder) ? operand : operand - remainder + alignment;
+}
+
+// RAW10/RAW12 frames are written unpacked to 16 bit per pixel
+static bool s_unpack_raw = false;
+
+/**
+ * @brief scratch for packed frames, one per writer thread, kept between frames
+*/
+static uint8_t *get_pack_buffer(size_t size) {
+    static thread_local std::vector<uint8_t> pack_buffer;
+    if (pack_buffer.size() < size) {
+        pack_buffer.resize(size);
+    }
+    return pack_buffer.data();
+}
+
+/*************************public method*****************************/
+
+size_t QCamxFrameDump::write_file(const char *dir, BufferInfo *info, unsigned int frame_num,
+                                  StreamType dump_type, Implsubformat subformat,
+                                  time_t wall_time) {
+    uint8_t *data = (uint8_t *)info->vaddr;
+    int size = info->size;
+    int width = info->width;
+    int height = info->height;
+    int stride = info->stride;
+    int slice = info->slice;
+    uint32_t format = info->format;
+    int plane_cnt = 1;
+    int pixel_byte = 1;
+
+    if ((static_cast<uint32_t>(HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED) == format) &&
+        ((YUV420NV12 == subformat) || (YUV420NV21 == subformat))) {
+        format = HAL_PIXEL_FORMAT_YCBCR_420_888;
+    }
+
+    bool unpack_raw =
+        s_unpack_raw && (format == HAL_PIXEL_FORMAT_RAW10 || format == HAL_PIXEL_FORMAT_RAW12);
+
+    char fname[256];
+    // dumps may be written by several writer threads at once
+    struct tm tm_now;
+    struct tm *t = localtime_r(&wall_time, &tm_now);
+    snprintf(fname, sizeof(fname), "%s/%s_w[%d]_h[%d]_id[%d]_%4d%02d%02d_%02d%02d%02d.%s", dir,
+             get_stream_type_string(dump_type), width, height, frame_num,
+             t->tm_year + 1900, t->tm_mon + 1, t->tm_mday, t->tm_hour, t->tm_min, t->tm_sec,
+             unpack_raw ? "raw16" : get_file_type_string(format));
+
+    FILE *fd = fopen(fname, "wb");
+    if (fd == NULL) {
+        QCAMX_ERR("open dump file %s failed:%s\n", fname, strerror(errno));
+        return 0;
+    }
+    // row writes are gathered into large writes
+    setvbuf(fd, NULL, _IOFBF, 1 << 20);
+
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RAW10:
+        case HAL_PIXEL_FORMAT_RAW12: {
+            if (!unpack_raw) {
+                fwrite(data, size, 1, fd);
+                break;
+            }
+            // the stride is in bytes of the packed rows
+            size_t unpacked_size = (size_t)width * height * 2;
+            uint8_t *unpacked = get_pack_buffer(unpacked_size);
+            int bits = format == HAL_PIXEL_FORMAT_RAW10 ? 10 : 12;
+            QCamxImageKernels::unpack_mipi_raw((uint16_t *)unpacked, data, bits, width, height,
+                                               stride);
+            fwrite(unpacked, unpacked_size, 1, fd);
+            break;
+        }
+        case HAL_PIXEL_FORMAT_BLOB: {
+            struct Camera3JPEGBlob jpegBlob;
+            size_t jpeg_eof_offset = (size_t)(size - (size_t)sizeof(jpegBlob));
+            uint8_t *jpeg_eof = &data[jpeg_eof_offset];
+            memcpy(&jpegBlob, jpeg_eof, sizeof(Camera3JPEGBlob));
+
+            if (jpegBlob.JPEGBlobId == JPEG_BLOB_ID) {
+                fwrite(data, jpegBlob.JPEGBlobSize, 1, fd);
+            } else {
+                QCAMX_ERR("Failed to Get Picture size:%d\n", size);
+                fwrite(data, size, 1, fd);
+            }
+            break;
+        }
+        case HAL_PIXEL_FORMAT_YCBCR_420_888:
+        case HAL_PIXEL_FORMAT_Y16: {
+            pixel_byte = format == HAL_PIXEL_FORMAT_Y16 ? 2 : 1;
+            size_t packed_size = format == HAL_PIXEL_FORMAT_Y16
+                                     ? (size_t)width * pixel_byte * height
+                                     : QCamxImageKernels::get_yuv420_size(width, height);
+            if (stride == width * pixel_byte && slice == height) {
+                // rows and planes are contiguous, write them at once
+                fwrite(data, packed_size, 1, fd);
+                break;
+            }
+            // drop the stride padding in one pass, then write the frame at once
+            uint8_t *packed = get_pack_buffer(packed_size);
+            if (format == HAL_PIXEL_FORMAT_Y16) {
+                QCamxImageKernels::pack_16bit((uint16_t *)packed, data, width, height, stride);
+            } else {
+                QCamxImageKernels::convert_yuv420(packed, YUV420_NV12, data, YUV420_NV12, width,
+                                                  height, stride, slice);
+            }
+            fwrite(packed, packed_size, 1, fd);
+            break;
+        }
+        case HAL_PIXEL_FORMAT_RAW16: {
+            // RAW16, 2 Bytes hold 1 pixel data, the stride is in pixels
+            pixel_byte = 2;
+            size_t packed_size = (size_t)width * pixel_byte * height;
+            if (stride == width) {
+                fwrite(data, packed_size, 1, fd);
+                break;
+            }
+            uint8_t *packed = get_pack_buffer(packed_size);
+            QCamxImageKernels::pack_16bit((uint16_t *)packed, data, width, height,
+                                          (size_t)stride * pixel_byte);
+            fwrite(packed, packed_size, 1, fd);
+            break;
+        }
+        case HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED: {
+            const UBWCYUVTileInfo *pTileInfo = &SupportedUBWCYUVTileInfo[0];
+            YUVFormat Plane[2];
+            plane_cnt = 2;
+            memset(Plane, 0, sizeof(Plane));
+
+            for (int idx = 0; idx < plane_cnt; idx++) {
+                // calculate plane size
+                Plane[idx].width = width;
+                Plane[idx].height = height >> idx;
+                unsigned int localWidth = ALIGN(Plane[idx].width, pTileInfo->widthPixels);
+                Plane[idx].width =
+                    (localWidth / pTileInfo->BPPDenominator) * pTileInfo->BPPNumerator;
+                float local1 = static_cast<float>(static_cast<float>(Plane[idx].width) /
+                                                  pTileInfo->widthBytes) /
+                               64;
+                Plane[idx].metadataStride = static_cast<uint32_t>(ceil(local1)) * 1024;
+                float local2 =
+                    static_cast<float>(static_cast<float>(Plane[idx].height) / pTileInfo->height) /
+                    16;
+                unsigned int localMetaSize =
+                    static_cast<uint32_t>(ceil(local2)) * Plane[idx].metadataStride;
+                Plane[idx].metadataSize = ALIGN(localMetaSize, 4096);
+                Plane[idx].metadataHeight = Plane[idx].metadataSize / Plane[idx].metadataStride;
+                Plane[idx].planeStride = ALIGN(Plane[idx].width, pTileInfo->widthMacroTile);
+                Plane[idx].sliceHeight = ALIGN(Plane[idx].height, pTileInfo->heightMacroTile);
+                Plane[idx].pixelPlaneSize =
+                    ALIGN((Plane[idx].planeStride * Plane[idx].sliceHeight), 4096);
+                Plane[idx].planeSize = Plane[idx].metadataSize + Plane[idx].pixelPlaneSize;
+                // write data
+                fwrite(data, Plane[idx].planeSize, 1, fd);
+                data += Plane[idx].planeSize;
+            }
+            break;
+        }
+        default: {
+            QCAMX_ERR("No matched formats!");
+            break;
+        }
+    }
+    size_t written = (size_t)ftell(fd);
+    fclose(fd);
+    return written;
+}
+
+void QCamxFrameDump::set_unpack_raw(bool unpack) {
+    s_unpack_raw = unpack;
+}
+
+const char *QCamxFrameDump::get_stream_type_string(StreamType type) {
+    switch (type) {
+        case PREVIEW_TYPE:
+            return "preview";
+            break;
+        case VIDEO_TYPE:
+            return "video";
+            break;
+        case SNAPSHOT_TYPE:
+            return "snapshot";
+            break;
+        case RAW_SNAPSHOT_TYPE:
+            return "raw";
+            break;
+        case DEPTH_TYPE:
+            return "depth";
+            break;
+        case IRBG_TYPE:
+            return "irbg";
+            break;
+    }
+    return "";
+}
+
+const char *QCamxFrameDump::get_file_type_string(uint32_t format) {
+    if (format == HAL_PIXEL_FORMAT_Y16) {
+        return "y16";
+    } else if (format == HAL_PIXEL_FORMAT_RAW10 || format == HAL_PIXEL_FORMAT_RAW16 ||
+               format == HAL_PIXEL_FORMAT_RAW12) {
+        return "raw";
+    } else if (format == HAL_PIXEL_FORMAT_BLOB) {
+        return "jpg";
+    } else if (format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED) {
+        return "ubwc";
+    } else {
+        return "yuv";
+    }
+}
@@ -0,0 +1,72 @@
+/**
+ * @file  qcamx_frame_dump.h
+ * @brief write one frame to its own dump file
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include "qcamx_buffer_manager.h"
+#include "qcamx_define.h"
+
+#define DUMP_FILE_DIR "/data/misc/camera/"
+#define JPEG_BLOB_ID (0xFF)
+
+struct Camera3JPEGBlob {
+    uint16_t JPEGBlobId;
+    uint32_t JPEGBlobSize;
+};
+
+struct UBWCYUVTileInfo {
+    unsigned int widthPixels;      ///< Tile width in pixels
+    unsigned int widthBytes;       ///< Tile width in pixels
+    unsigned int height;           ///< Tile height
+    unsigned int widthMacroTile;   ///< Macro tile width
+    unsigned int heightMacroTile;  ///< Macro tile height
+    unsigned int BPPNumerator;     ///< Bytes per pixel (numerator)
+    unsigned int BPPDenominator;   ///< Bytes per pixel (denominator)
+};
+
+struct YUVFormat {
+    uint32_t width;   ///< Width of the YUV plane in pixels.
+                      ///  Tile aligned width in bytes for UBWC
+    uint32_t height;  ///< Height of the YUV plane in pixels.
+    uint32_t
+        planeStride;  ///< The number of bytes between the first byte of two sequential lines on plane 1. It may be
+    ///  greater than nWidth * nDepth / 8 if the line includes padding.
+    ///  Macro-tile width aligned for UBWC
+    uint32_t
+        sliceHeight;  ///< The number of lines in the plane which can be equal to or larger than actual frame height.
+    ///  Tile height aligned for UBWC
+
+    uint32_t metadataStride;  ///< Aligned meta data plane stride in bytes, used for UBWC formats
+    uint32_t metadataHeight;  ///< Aligned meta data plane height in bytes, used for UBWC formats
+    uint32_t metadataSize;    ///< Aligned metadata plane size in bytes, used for UBWC formats
+    uint32_t
+        pixelPlaneSize;  ///< Aligned pixel plane size in bytes, calculated once for UBWC formats
+                         ///< and stored thereafter, since the calculations are expensive
+    size_t planeSize;    ///< Size in pixels for this plane.
+};
+
+class QCamxFrameDump {
+public:
+    /**
+     * @brief write one frame to a file named after its stream, size, frame number and time
+     * @param dir output directory
+     * @param wall_time time put in the file name
+     * @return bytes written
+    */
+    static size_t write_file(const char *dir, BufferInfo *info, unsigned int frame_num,
+                             StreamType dump_type, Implsubformat subformat, time_t wall_time);
+    /**
+     * @brief write RAW10/RAW12 frames unpacked to one pixel per 16 bit, file type raw16
+     * @detail set before any dump is written
+    */
+    static void set_unpack_raw(bool unpack);
+    static const char *get_stream_type_string(StreamType type);
+    static const char *get_file_type_string(uint32_t format);
+private:
+    QCamxFrameDump() = delete;
+};
@@ -0,0 +1,391 @@
+/**
+ * @file  qcamx_frame_export.cpp
+ * @brief hands the stream buffers to other processes over a unix socket implementation
+*/
+
+#include "qcamx_frame_export.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "qcamx_frame_timeline.h"
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxFrameExport"
+
+#define FRAME_EXPORT_LISTEN_BACKLOG (4)
+
+QCamxFrameExport::QCamxFrameExport() {
+    _running = false;
+    _camera_id = 0;
+    _max_held = 0;
+    _hub = NULL;
+    _listen_fd = -1;
+    _epoll_fd = -1;
+    _stop_fd = -1;
+    _next_client_id = 0;
+    memset(_stream_held, 0, sizeof(_stream_held));
+    pthread_mutex_init(&_lock, NULL);
+}
+
+QCamxFrameExport::~QCamxFrameExport() {
+    stop();
+    pthread_mutex_destroy(&_lock);
+}
+
+/*************************public method*****************************/
+
+int QCamxFrameExport::start(const char *path, int camera_id, int max_held, QCamxFrameHub *hub) {
+    stop();
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        QCAMX_ERR("export socket path too long:%s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    _listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (_listen_fd < 0) {
+        QCAMX_ERR("create export socket failed:%s\n", strerror(errno));
+        return -1;
+    }
+    // a socket file left by an earlier run
+    unlink(path);
+    if (bind(_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(_listen_fd, FRAME_EXPORT_LISTEN_BACKLOG) != 0) {
+        QCAMX_ERR("listen on %s failed:%s\n", path, strerror(errno));
+        close(_listen_fd);
+        _listen_fd = -1;
+        return -1;
+    }
+    _path = path;
+    _camera_id = camera_id;
+    _max_held = get_hold_budget(max_held);
+    memset(_stream_held, 0, sizeof(_stream_held));
+    _hub = hub;
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    _stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    bool ready = _epoll_fd >= 0 && _stop_fd >= 0 &&
+                 epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _listen_fd, &event) == 0;
+    event.data.ptr = &_stop_fd;
+    ready = ready && epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _stop_fd, &event) == 0;
+    if (!ready || pthread_create(&_thread, NULL, server_thread_entry, this) != 0) {
+        QCAMX_ERR("start export server failed:%s\n", strerror(errno));
+        if (_epoll_fd >= 0) {
+            close(_epoll_fd);
+        }
+        if (_stop_fd >= 0) {
+            close(_stop_fd);
+        }
+        close(_listen_fd);
+        unlink(path);
+        _epoll_fd = _stop_fd = _listen_fd = -1;
+        return -1;
+    }
+
+    _running = true;
+    for (int type = 0; type < QCAMX_EXPORT_STREAM_TYPES; type++) {
+        // inline, sending a descriptor never blocks
+        int id = _hub->subscribe((StreamType)type, frame_callback, this, 0,
+                                 FRAME_POLICY_DROP_OLDEST);
+        if (id >= 0) {
+            _subscriptions.push_back(id);
+        }
+    }
+    QCAMX_PRINT("frame export on %s max held:%d\n", path, _max_held);
+    return 0;
+}
+
+void QCamxFrameExport::stop() {
+    if (!_running) {
+        return;
+    }
+    // no export_frame runs once the subscriptions are gone
+    for (size_t i = 0; i < _subscriptions.size(); i++) {
+        _hub->unsubscribe(_subscriptions[i]);
+    }
+    _subscriptions.clear();
+    uint64_t value = 1;
+    if (write(_stop_fd, &value, sizeof(value)) != sizeof(value)) {
+        QCAMX_ERR("wake export server failed:%s\n", strerror(errno));
+    }
+    pthread_join(_thread, NULL);
+    while (!_clients.empty()) {
+        close_client(_clients.back());
+    }
+    close(_epoll_fd);
+    close(_stop_fd);
+    close(_listen_fd);
+    unlink(_path.c_str());
+    _epoll_fd = _stop_fd = _listen_fd = -1;
+    _running = false;
+}
+
+/*************************private method*****************************/
+
+void QCamxFrameExport::frame_callback(QCamxFrame *frame, void *user_data) {
+    ((QCamxFrameExport *)user_data)->export_frame(frame);
+}
+
+void QCamxFrameExport::export_frame(QCamxFrame *frame) {
+    if (frame->info->fd < 0 || frame->buffer_slot < 0 ||
+        frame->buffer_slot >= QCAMX_EXPORT_POOL_SLOTS || frame->stream_index < 0 ||
+        frame->stream_index >= QCAMX_EXPORT_MAX_STREAMS) {
+        return;
+    }
+    uint32_t buffer_id = frame->stream_index * QCAMX_EXPORT_POOL_SLOTS + frame->buffer_slot;
+    pthread_mutex_lock(&_lock);
+    for (size_t i = 0; i < _clients.size(); i++) {
+        Client *client = _clients[i];
+        if (!(client->stream_mask & (1U << frame->type))) {
+            continue;
+        }
+        // the budget of the stream is shared, its pool only has that many buffers to spare
+        if (client->held_count >= client->max_held ||
+            _stream_held[frame->stream_index] >= _max_held) {
+            client->skipped++;
+            client->skipped_frames++;
+            continue;
+        }
+        int rc = 0;
+        if (!client->buffer_sent[buffer_id]) {
+            rc = send_buffer(client, frame, buffer_id);
+            if (rc == 0) {
+                client->buffer_sent[buffer_id] = true;
+            }
+        }
+        if (rc == 0) {
+            rc = send_frame(client, frame, buffer_id, client->next_sequence);
+        }
+        if (rc == -EAGAIN) {
+            // the client does not read fast enough, it only misses frames
+            client->skipped++;
+            client->skipped_frames++;
+            continue;
+        } else if (rc != 0) {
+            // the server thread sees the hang up and closes the client
+            shutdown(client->fd, SHUT_RDWR);
+            client->stream_mask = 0;
+            continue;
+        }
+        int free_index = 0;
+        while (client->held[free_index].frame != NULL) {
+            free_index++;
+        }
+        frame->acquire();
+        client->held[free_index].sequence = client->next_sequence++;
+        client->held[free_index].frame = frame;
+        client->held_count++;
+        _stream_held[frame->stream_index]++;
+        client->skipped = 0;
+        client->sent_frames++;
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+int QCamxFrameExport::send_buffer(Client *client, QCamxFrame *frame, uint32_t buffer_id) {
+    qcamx_export_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = QCAMX_EXPORT_MSG_BUFFER;
+    msg.buffer.buffer_id = buffer_id;
+    msg.buffer.stream_type = frame->type;
+    msg.buffer.stream_index = frame->stream_index;
+    msg.buffer.format = frame->info->format;
+    msg.buffer.width = frame->info->width;
+    msg.buffer.height = frame->info->height;
+    msg.buffer.stride = frame->info->stride;
+    msg.buffer.slice = frame->info->slice;
+    msg.buffer.size = frame->info->size;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {&msg, sizeof(msg)};
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &frame->info->fd, sizeof(int));
+    if (sendmsg(client->fd, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)sizeof(msg)) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? -EAGAIN : -errno;
+    }
+    return 0;
+}
+
+int QCamxFrameExport::send_frame(Client *client, QCamxFrame *frame, uint32_t buffer_id,
+                                 uint64_t sequence) {
+    qcamx_export_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = QCAMX_EXPORT_MSG_FRAME;
+    msg.frame.sequence = sequence;
+    msg.frame.timestamp_ns = frame->metadata.timestamp;
+    msg.frame.buffer_id = buffer_id;
+    msg.frame.stream_type = frame->type;
+    msg.frame.stream_index = frame->stream_index;
+    msg.frame.frame_number = frame->frame_number;
+    msg.frame.skipped = client->skipped;
+    msg.frame.exposure_ns = frame->metadata.exposure_ns;
+    msg.frame.sensitivity = frame->metadata.sensitivity;
+    msg.frame.send_time_ns = QCamxFrameTimeline::now_ns();
+    if (send(client->fd, &msg, sizeof(msg), MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)sizeof(msg)) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? -EAGAIN : -errno;
+    }
+    return 0;
+}
+
+void *QCamxFrameExport::server_thread_entry(void *data) {
+    ((QCamxFrameExport *)data)->server_loop();
+    return NULL;
+}
+
+void QCamxFrameExport::server_loop() {
+    for (;;) {
+        struct epoll_event events[8];
+        int count = epoll_wait(_epoll_fd, events, 8, -1);
+        if (count < 0 && errno != EINTR) {
+            QCAMX_ERR("export server wait failed:%s\n", strerror(errno));
+            return;
+        }
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == &_stop_fd) {
+                return;
+            } else if (events[i].data.ptr == NULL) {
+                accept_client();
+            } else {
+                Client *client = (Client *)events[i].data.ptr;
+                if (!handle_client_message(client)) {
+                    close_client(client);
+                }
+            }
+        }
+    }
+}
+
+void QCamxFrameExport::accept_client() {
+    int fd = accept4(_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        QCAMX_ERR("accept export client failed:%s\n", strerror(errno));
+        return;
+    }
+    Client *client = new Client();
+    client->fd = fd;
+    client->id = _next_client_id++;
+    client->stream_mask = 0;
+    client->max_held = _max_held;
+    client->held_count = 0;
+    memset(client->held, 0, sizeof(client->held));
+    client->buffer_sent.assign(QCAMX_EXPORT_MAX_BUFFERS, false);
+    client->next_sequence = 0;
+    client->skipped = 0;
+    client->sent_frames = 0;
+    client->skipped_frames = 0;
+
+    qcamx_export_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = QCAMX_EXPORT_MSG_HELLO;
+    msg.hello.version = QCAMX_EXPORT_VERSION;
+    msg.hello.camera_id = _camera_id;
+    msg.hello.max_held = _max_held;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = client;
+    if (send(fd, &msg, sizeof(msg), MSG_NOSIGNAL) != (ssize_t)sizeof(msg) ||
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        QCAMX_ERR("setup export client failed:%s\n", strerror(errno));
+        close(fd);
+        delete client;
+        return;
+    }
+    pthread_mutex_lock(&_lock);
+    _clients.push_back(client);
+    pthread_mutex_unlock(&_lock);
+    QCAMX_INFO("export client %d connected\n", client->id);
+}
+
+bool QCamxFrameExport::handle_client_message(Client *client) {
+    qcamx_export_msg_t msg;
+    ssize_t len = recv(client->fd, &msg, sizeof(msg), MSG_DONTWAIT);
+    if (len < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return true;
+    } else if (len != (ssize_t)sizeof(msg)) {
+        // disconnected, or not speaking the protocol
+        return false;
+    }
+    QCamxFrame *released = NULL;
+    pthread_mutex_lock(&_lock);
+    if (msg.type == QCAMX_EXPORT_MSG_SUBSCRIBE) {
+        client->stream_mask = msg.subscribe.stream_mask;
+        if (msg.subscribe.max_held > 0 && (int)msg.subscribe.max_held < _max_held) {
+            client->max_held = msg.subscribe.max_held;
+        }
+        QCAMX_INFO("export client %d streams:0x%x max held:%d\n", client->id,
+                   client->stream_mask, client->max_held);
+    } else if (msg.type == QCAMX_EXPORT_MSG_RELEASE) {
+        for (int i = 0; i < QCAMX_EXPORT_MAX_HELD; i++) {
+            if (client->held[i].frame != NULL && client->held[i].sequence == msg.release.sequence) {
+                released = client->held[i].frame;
+                client->held[i].frame = NULL;
+                client->held_count--;
+                _stream_held[released->stream_index]--;
+                break;
+            }
+        }
+        if (released == NULL) {
+            QCAMX_ERR("export client %d released unknown frame %" PRIu64 "\n", client->id,
+                      msg.release.sequence);
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    // may return the buffer to its pool
+    if (released != NULL) {
+        released->release();
+    }
+    return true;
+}
+
+void QCamxFrameExport::close_client(Client *client) {
+    pthread_mutex_lock(&_lock);
+    for (size_t i = 0; i < _clients.size(); i++) {
+        if (_clients[i] == client) {
+            _clients.erase(_clients.begin() + i);
+            break;
+        }
+    }
+    for (int i = 0; i < QCAMX_EXPORT_MAX_HELD; i++) {
+        if (client->held[i].frame != NULL) {
+            _stream_held[client->held[i].frame->stream_index]--;
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    for (int i = 0; i < QCAMX_EXPORT_MAX_HELD; i++) {
+        if (client->held[i].frame != NULL) {
+            client->held[i].frame->release();
+        }
+    }
+    QCAMX_PRINT("export client %d closed, sent:%" PRIu64 " skipped:%" PRIu64 "\n", client->id,
+                client->sent_frames, client->skipped_frames);
+    delete client;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file  qcamx_frame_export.h
+ * @brief hands the stream buffers to other processes over a unix socket without copying them
+ *        the buffer fds go to a client once in SCM_RIGHTS, then every frame is a small
+ *        descriptor, a frame held by a client keeps its buffer until the client releases it
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "qcamx_frame_export_protocol.h"
+#include "qcamx_frame_hub.h"
+
+class QCamxFrameExport {
+public:
+    QCamxFrameExport();
+    ~QCamxFrameExport();
+public:
+    /**
+     * @brief listen on path and export the frames published to hub
+     * @param max_held frames of one stream all clients together may hold, limited to
+     *        QCAMX_EXPORT_MAX_HELD, see get_hold_budget
+    */
+    int start(const char *path, int camera_id, int max_held, QCamxFrameHub *hub);
+    /**
+     * @brief buffers the clients may hold of each exported stream, which its pool needs on top
+     *        of the buffers of the HAL or the camera waits for the clients
+    */
+    static int get_hold_budget(int max_held) {
+        return max_held < QCAMX_EXPORT_MAX_HELD ? max_held : QCAMX_EXPORT_MAX_HELD;
+    }
+    /**
+     * @brief disconnect every client and release the frames they hold
+    */
+    void stop();
+    bool is_running() { return _running; }
+private:
+    struct HeldFrame {
+        uint64_t sequence;
+        QCamxFrame *frame;  ///< NULL if the entry is free
+    };
+    struct Client {
+        int fd;
+        int id;
+        uint32_t stream_mask;
+        int max_held;
+        int held_count;
+        HeldFrame held[QCAMX_EXPORT_MAX_HELD];
+        std::vector<bool> buffer_sent;  ///< by buffer id
+        uint64_t next_sequence;
+        uint32_t skipped;  ///< since the last descriptor sent
+
+        uint64_t sent_frames;
+        uint64_t skipped_frames;
+    };
+    static void frame_callback(QCamxFrame *frame, void *user_data);
+    /**
+     * @brief send a frame to every client of its stream, on the publishing thread
+    */
+    void export_frame(QCamxFrame *frame);
+    /**
+     * @return 0 on success, -EAGAIN if the socket is full, other -errno if the client is gone
+    */
+    int send_buffer(Client *client, QCamxFrame *frame, uint32_t buffer_id);
+    int send_frame(Client *client, QCamxFrame *frame, uint32_t buffer_id, uint64_t sequence);
+    static void *server_thread_entry(void *data);
+    void server_loop();
+    void accept_client();
+    /**
+     * @return false if the client is gone
+    */
+    bool handle_client_message(Client *client);
+    /**
+     * @brief remove a client, release the frames it held, only on the server thread or after it
+    */
+    void close_client(Client *client);
+    // Do not support the copy constructor or assignment operator
+    QCamxFrameExport(const QCamxFrameExport &) = delete;
+    QCamxFrameExport &operator=(const QCamxFrameExport &) = delete;
+private:
+    bool _running;
+    std::string _path;
+    int _camera_id;
+    int _max_held;
+    QCamxFrameHub *_hub;
+    std::vector<int> _subscriptions;  ///< frame hub ids, one per stream type
+
+    int _listen_fd;
+    int _epoll_fd;
+    int _stop_fd;  ///< eventfd waking the server thread on stop
+    pthread_t _thread;
+    int _next_client_id;
+
+    pthread_mutex_t _lock;  ///< guards _clients and their state
+    std::vector<Client *> _clients;
+    int _stream_held[QCAMX_EXPORT_MAX_STREAMS];  ///< frames held by all clients, by stream index
+};
@@ -0,0 +1,238 @@
+/**
+ * @file  qcamx_frame_export_client.c
+ * @brief reference client of the camx-hal3-test frame export socket implementation
+*/
+
+#include "qcamx_frame_export_client.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef struct {
+    qcamx_export_buffer_t layout;
+    int fd;  ///< -1 until the buffer was sent
+    void *vaddr;
+} qcamx_export_mapping_t;
+
+struct qcamx_export_client {
+    int fd;
+    uint32_t max_held;
+    qcamx_export_mapping_t buffers[QCAMX_EXPORT_MAX_BUFFERS];
+};
+
+static void unmap_buffer(qcamx_export_mapping_t *mapping) {
+    if (mapping->vaddr != NULL) {
+        munmap(mapping->vaddr, mapping->layout.size);
+        mapping->vaddr = NULL;
+    }
+    if (mapping->fd >= 0) {
+        close(mapping->fd);
+        mapping->fd = -1;
+    }
+}
+
+/**
+ * @brief receive one message and the fd coming with it
+ * @return 0 on success, -errno on failure
+*/
+static int receive_message(qcamx_export_client_t *client, qcamx_export_msg_t *msg, int *fd,
+                           int timeout_ms) {
+    struct pollfd pfd = {client->fd, POLLIN, 0};
+    int rc = poll(&pfd, 1, timeout_ms);
+    if (rc == 0) {
+        return -ETIMEDOUT;
+    } else if (rc < 0) {
+        return -errno;
+    }
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {msg, sizeof(*msg)};
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+    ssize_t len = recvmsg(client->fd, &hdr, MSG_CMSG_CLOEXEC);
+    if (len < 0) {
+        return -errno;
+    } else if (len == 0) {
+        return -EPIPE;
+    }
+    *fd = -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (len != (ssize_t)sizeof(*msg)) {
+        if (*fd >= 0) {
+            close(*fd);
+        }
+        return -EPROTO;
+    }
+    return 0;
+}
+
+static int send_message(qcamx_export_client_t *client, const qcamx_export_msg_t *msg) {
+    if (send(client->fd, msg, sizeof(*msg), MSG_NOSIGNAL) != (ssize_t)sizeof(*msg)) {
+        return -errno;
+    }
+    return 0;
+}
+
+/**
+ * @brief map a buffer sent by the server, replaces an older buffer of the same id
+*/
+static int map_buffer(qcamx_export_client_t *client, const qcamx_export_buffer_t *layout,
+                      int fd) {
+    if (fd < 0 || layout->buffer_id >= QCAMX_EXPORT_MAX_BUFFERS || layout->size <= 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -EPROTO;
+    }
+    qcamx_export_mapping_t *mapping = &client->buffers[layout->buffer_id];
+    unmap_buffer(mapping);
+    void *vaddr = mmap(NULL, layout->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (vaddr == MAP_FAILED) {
+        int rc = -errno;
+        close(fd);
+        return rc;
+    }
+    mapping->layout = *layout;
+    mapping->fd = fd;
+    mapping->vaddr = vaddr;
+    return 0;
+}
+
+/**
+ * @brief check the hello of the server and send the stream selection
+*/
+static int handshake(qcamx_export_client_t *client, uint32_t stream_mask, uint32_t max_held) {
+    qcamx_export_msg_t msg;
+    int fd = -1;
+    int rc = receive_message(client, &msg, &fd, 1000);
+    if (rc != 0) {
+        return rc;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (msg.type != QCAMX_EXPORT_MSG_HELLO || msg.hello.version != QCAMX_EXPORT_VERSION) {
+        return -EPROTO;
+    }
+    client->max_held = msg.hello.max_held;
+    if (max_held > 0 && max_held < client->max_held) {
+        client->max_held = max_held;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = QCAMX_EXPORT_MSG_SUBSCRIBE;
+    msg.subscribe.stream_mask = stream_mask;
+    msg.subscribe.max_held = client->max_held;
+    return send_message(client, &msg);
+}
+
+qcamx_export_client_t *qcamx_export_connect(const char *path, uint32_t stream_mask,
+                                            uint32_t max_held) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    strcpy(addr.sun_path, path);
+
+    qcamx_export_client_t *client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < QCAMX_EXPORT_MAX_BUFFERS; i++) {
+        client->buffers[i].fd = -1;
+    }
+    int rc = 0;
+    client->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        rc = -errno;
+    } else {
+        rc = handshake(client, stream_mask, max_held);
+    }
+    if (rc != 0) {
+        if (client->fd >= 0) {
+            close(client->fd);
+        }
+        free(client);
+        errno = -rc;
+        return NULL;
+    }
+    return client;
+}
+
+void qcamx_export_disconnect(qcamx_export_client_t *client) {
+    if (client == NULL) {
+        return;
+    }
+    close(client->fd);
+    for (int i = 0; i < QCAMX_EXPORT_MAX_BUFFERS; i++) {
+        unmap_buffer(&client->buffers[i]);
+    }
+    free(client);
+}
+
+int qcamx_export_get_fd(qcamx_export_client_t *client) {
+    return client->fd;
+}
+
+uint32_t qcamx_export_get_max_held(qcamx_export_client_t *client) {
+    return client->max_held;
+}
+
+int qcamx_export_next_frame(qcamx_export_client_t *client, qcamx_export_frame_t *frame,
+                            int timeout_ms) {
+    for (;;) {
+        qcamx_export_msg_t msg;
+        int fd = -1;
+        int rc = receive_message(client, &msg, &fd, timeout_ms);
+        if (rc != 0) {
+            return rc;
+        }
+        if (msg.type == QCAMX_EXPORT_MSG_BUFFER) {
+            rc = map_buffer(client, &msg.buffer, fd);
+            if (rc != 0) {
+                return rc;
+            }
+            continue;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (msg.type != QCAMX_EXPORT_MSG_FRAME) {
+            continue;
+        }
+        if (msg.frame.buffer_id >= QCAMX_EXPORT_MAX_BUFFERS ||
+            client->buffers[msg.frame.buffer_id].vaddr == NULL) {
+            return -EPROTO;
+        }
+        qcamx_export_mapping_t *mapping = &client->buffers[msg.frame.buffer_id];
+        frame->desc = msg.frame;
+        frame->buffer = &mapping->layout;
+        frame->vaddr = mapping->vaddr;
+        return 0;
+    }
+}
+
+int qcamx_export_release(qcamx_export_client_t *client, const qcamx_export_frame_t *frame) {
+    qcamx_export_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = QCAMX_EXPORT_MSG_RELEASE;
+    msg.release.sequence = frame->desc.sequence;
+    msg.release.buffer_id = frame->desc.buffer_id;
+    return send_message(client, &msg);
+}
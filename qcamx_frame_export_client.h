@@ -0,0 +1,62 @@
+/**
+ * @file  qcamx_frame_export_client.h
+ * @brief reference client of the camx-hal3-test frame export socket
+ *        maps every exported buffer once, then hands out frames without copying them, a frame
+ *        keeps its buffer away from the camera until qcamx_export_release
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "qcamx_frame_export_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct qcamx_export_client qcamx_export_client_t;
+
+typedef struct {
+    qcamx_export_frame_desc_t desc;
+    const qcamx_export_buffer_t *buffer;  ///< layout of the buffer, valid until disconnect
+    const void *vaddr;                    ///< read only mapping, valid until disconnect
+} qcamx_export_frame_t;
+
+/**
+ * @brief connect to the export socket and select the streams
+ * @param stream_mask 1 << stream type of every stream wanted
+ * @param max_held frames held at a time, 0 keeps the server limit
+ * @return NULL on failure, errno is set
+*/
+qcamx_export_client_t *qcamx_export_connect(const char *path, uint32_t stream_mask,
+                                            uint32_t max_held);
+/**
+ * @brief close the socket and unmap the buffers, the server releases the frames still held
+*/
+void qcamx_export_disconnect(qcamx_export_client_t *client);
+/**
+ * @return socket fd to poll for POLLIN
+*/
+int qcamx_export_get_fd(qcamx_export_client_t *client);
+/**
+ * @return limit of held frames told by the server
+*/
+uint32_t qcamx_export_get_max_held(qcamx_export_client_t *client);
+/**
+ * @brief wait for the next frame, buffers sent before it are mapped on the way
+ * @param timeout_ms -1 waits forever
+ * @return 0 with a frame, -ETIMEDOUT, -EPIPE when the server stopped, other -errno on failure
+*/
+int qcamx_export_next_frame(qcamx_export_client_t *client, qcamx_export_frame_t *frame,
+                            int timeout_ms);
+/**
+ * @brief give a frame back, its buffer may be reused by the camera once every holder released it
+ * @return 0 on success, -errno on failure
+*/
+int qcamx_export_release(qcamx_export_client_t *client, const qcamx_export_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,90 @@
+/**
+ * @file  qcamx_frame_export_protocol.h
+ * @brief messages of the frame export socket, shared by the camx-hal3-test server and the clients
+ *        a SOCK_SEQPACKET unix socket, one qcamx_export_msg_t per packet, the fd of a buffer is
+ *        sent once in SCM_RIGHTS with its BUFFER message, then only FRAME descriptors follow
+ *        plain C, clients do not depend on the camera headers
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef CAMERA_STORAGE_DIR
+#define CAMERA_STORAGE_DIR "/data/misc/camera/"
+#endif
+// socket path of a camera, formatted with the camera id
+#define QCAMX_EXPORT_SOCKET_FORMAT CAMERA_STORAGE_DIR "qcamx-export-%d.sock"
+
+#define QCAMX_EXPORT_VERSION (2)
+// stream types of the camera, the bit of a type in a stream mask is 1 << type
+#define QCAMX_EXPORT_STREAM_TYPES (6)
+// streams configured at a time, several streams may have the same type
+#define QCAMX_EXPORT_MAX_STREAMS (8)
+// buffer id is stream index * QCAMX_EXPORT_POOL_SLOTS + slot of the buffer in its pool
+#define QCAMX_EXPORT_POOL_SLOTS (256)
+#define QCAMX_EXPORT_MAX_BUFFERS (QCAMX_EXPORT_MAX_STREAMS * QCAMX_EXPORT_POOL_SLOTS)
+// frames one client may hold at a time
+#define QCAMX_EXPORT_MAX_HELD (32)
+
+typedef enum {
+    QCAMX_EXPORT_MSG_HELLO = 1,      ///< server, first message after accept
+    QCAMX_EXPORT_MSG_BUFFER = 2,     ///< server, carries the buffer fd in SCM_RIGHTS
+    QCAMX_EXPORT_MSG_FRAME = 3,      ///< server, one frame of a buffer already sent
+    QCAMX_EXPORT_MSG_SUBSCRIBE = 4,  ///< client, select the streams, replaces the last selection
+    QCAMX_EXPORT_MSG_RELEASE = 5,    ///< client, done with a frame, its buffer may be reused
+} qcamx_export_msg_type_t;
+
+typedef struct {
+    uint32_t version;
+    int32_t camera_id;
+    uint32_t max_held;  ///< frames a client may hold, more are skipped for it
+} qcamx_export_hello_t;
+
+typedef struct {
+    uint32_t buffer_id;
+    uint32_t stream_type;
+    uint32_t stream_index;  ///< tells apart the streams of the same type
+    uint32_t format;        ///< HAL pixel format
+    int32_t width;
+    int32_t height;
+    int32_t stride;  ///< in pixels for RAW16, in bytes else
+    int32_t slice;
+    int32_t size;  ///< bytes to map
+} qcamx_export_buffer_t;
+
+typedef struct {
+    uint64_t sequence;     ///< per client, identifies the frame in its RELEASE
+    int64_t timestamp_ns;  ///< sensor timestamp, 0 if not known
+    int64_t send_time_ns;  ///< CLOCK_MONOTONIC when the server sent the descriptor
+    int64_t exposure_ns;   ///< ANDROID_SENSOR_EXPOSURE_TIME, 0 if not known
+    int32_t sensitivity;   ///< ANDROID_SENSOR_SENSITIVITY, 0 if not known
+    uint32_t buffer_id;
+    uint32_t stream_type;
+    uint32_t frame_number;
+    uint32_t skipped;  ///< frames of the client skipped since its last descriptor
+    uint32_t stream_index;
+} qcamx_export_frame_desc_t;
+
+typedef struct {
+    uint32_t stream_mask;  ///< 1 << stream type
+    uint32_t max_held;     ///< 0 keeps the server limit
+} qcamx_export_subscribe_t;
+
+typedef struct {
+    uint64_t sequence;
+    uint32_t buffer_id;
+    uint32_t reserved;
+} qcamx_export_release_t;
+
+typedef struct {
+    uint32_t type;  ///< qcamx_export_msg_type_t
+    uint32_t reserved;
+    union {
+        qcamx_export_hello_t hello;
+        qcamx_export_buffer_t buffer;
+        qcamx_export_frame_desc_t frame;
+        qcamx_export_subscribe_t subscribe;
+        qcamx_export_release_t release;
+    };
+} qcamx_export_msg_t;
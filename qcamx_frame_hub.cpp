@@ -0,0 +1,399 @@
+/**
+ * @file  qcamx_frame_hub.cpp
+ * @brief hands the buffers of a stream to any number of subscribers implementation
+*/
+
+#include "qcamx_frame_hub.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#include "qcamx_frame_dump.h"
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxFrameHub"
+
+/*************************QCamxFrame*****************************/
+
+void QCamxFrame::release() {
+    if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        _hub->free_frame(this);
+    }
+}
+
+/*************************QCamxFrameHub*****************************/
+
+QCamxFrameHub::QCamxFrameHub() {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, NULL);
+    _next_id = 0;
+    _live_frames = 0;
+    _flushing = false;
+    _pool_misses = 0;
+    for (uint32_t i = 0; i < FRAME_POOL_SIZE; i++) {
+        _frames[i]._hub = this;
+        _free_frames.push(i);
+    }
+    for (int i = 0; i < FRAME_METADATA_RING; i++) {
+        _metadata[i].timestamp_frame.store(-1, std::memory_order_relaxed);
+        _metadata[i].result_frame.store(-1, std::memory_order_relaxed);
+    }
+}
+
+QCamxFrameHub::~QCamxFrameHub() {
+    pthread_mutex_lock(&_lock);
+    std::vector<Subscriber *> subscribers;
+    subscribers.swap(_subscribers);
+    pthread_mutex_unlock(&_lock);
+    for (size_t i = 0; i < subscribers.size(); i++) {
+        delete_subscriber(subscribers[i]);
+    }
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_lock);
+}
+
+/*************************public method*****************************/
+
+int QCamxFrameHub::subscribe(StreamType type, FrameSubscriberFunc func, void *user_data,
+                             int queue_depth, int policy) {
+    if (func == NULL || queue_depth < 0) {
+        QCAMX_ERR("invalid subscription of stream %d\n", type);
+        return -1;
+    }
+    if (queue_depth > FRAME_QUEUE_DEPTH_MAX) {
+        queue_depth = FRAME_QUEUE_DEPTH_MAX;
+    }
+    Subscriber *subscriber = new Subscriber();
+    subscriber->hub = this;
+    subscriber->type = type;
+    subscriber->func = func;
+    subscriber->user_data = user_data;
+    subscriber->policy = policy;
+    subscriber->users = 0;
+    subscriber->has_thread = false;
+    subscriber->queue_depth = queue_depth;
+    subscriber->head = 0;
+    subscriber->count = 0;
+    subscriber->stopping = false;
+    subscriber->delivered = 0;
+    subscriber->dropped = 0;
+    pthread_mutex_init(&subscriber->lock, NULL);
+    pthread_cond_init(&subscriber->cond, NULL);
+    if (queue_depth > 0) {
+        if (pthread_create(&subscriber->thread, NULL, subscriber_thread_entry, subscriber) != 0) {
+            QCAMX_ERR("create subscriber thread failed:%s\n", strerror(errno));
+            delete_subscriber(subscriber);
+            return -1;
+        }
+        subscriber->has_thread = true;
+    }
+
+    pthread_mutex_lock(&_lock);
+    if (_subscribers.size() >= FRAME_SUBSCRIBERS_MAX) {
+        pthread_mutex_unlock(&_lock);
+        QCAMX_ERR("too many frame subscribers, max %d\n", FRAME_SUBSCRIBERS_MAX);
+        delete_subscriber(subscriber);
+        return -1;
+    }
+    subscriber->id = _next_id++;
+    _subscribers.push_back(subscriber);
+    pthread_mutex_unlock(&_lock);
+    QCAMX_INFO("subscriber %d of stream %s queue depth:%d policy:%d\n", subscriber->id,
+               QCamxFrameDump::get_stream_type_string(type), queue_depth, policy);
+    return subscriber->id;
+}
+
+void QCamxFrameHub::unsubscribe(int id) {
+    Subscriber *subscriber = NULL;
+    pthread_mutex_lock(&_lock);
+    for (size_t i = 0; i < _subscribers.size(); i++) {
+        if (_subscribers[i]->id == id) {
+            subscriber = _subscribers[i];
+            _subscribers.erase(_subscribers.begin() + i);
+            break;
+        }
+    }
+    // a publish may still deliver to it outside the lock
+    while (subscriber != NULL && subscriber->users > 0) {
+        pthread_cond_wait(&_cond, &_lock);
+    }
+    pthread_mutex_unlock(&_lock);
+    if (subscriber != NULL) {
+        delete_subscriber(subscriber);
+    }
+}
+
+bool QCamxFrameHub::has_subscribers(StreamType type) {
+    bool found = false;
+    pthread_mutex_lock(&_lock);
+    for (size_t i = 0; i < _subscribers.size() && !found; i++) {
+        found = _subscribers[i]->type == type;
+    }
+    pthread_mutex_unlock(&_lock);
+    return found;
+}
+
+void QCamxFrameHub::publish(QCamxBufferManager *buffer_manager, buffer_handle_t *buffer,
+                            unsigned int frame_number, StreamType type, Implsubformat subformat) {
+    // the subscribers of the stream type, held by users so unsubscribe waits for this call
+    Subscriber *subscribers[FRAME_SUBSCRIBERS_MAX];
+    int count = 0;
+    pthread_mutex_lock(&_lock);
+    for (size_t i = 0; i < _subscribers.size(); i++) {
+        if (_subscribers[i]->type == type) {
+            _subscribers[i]->users++;
+            subscribers[count++] = _subscribers[i];
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    if (count == 0) {
+        return;
+    }
+
+    QCamxFrame *frame = NULL;
+    BufferInfo *info = buffer_manager->get_buffer_info(buffer);
+    uint32_t index;
+    if (info == NULL) {
+        // not a buffer of the pool, nothing to hand out
+    } else if (!_free_frames.pop(index)) {
+        _pool_misses.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        frame = &_frames[index];
+        frame->info = info;
+        frame->buffer_slot = buffer_manager->get_buffer_slot(buffer);
+        frame->stream_index = buffer_manager->get_stream_index();
+        frame->frame_number = frame_number;
+        frame->type = type;
+        frame->subformat = subformat;
+        get_frame_metadata(frame_number, &frame->metadata);
+        frame->_buffer_manager = buffer_manager;
+        frame->_buffer = buffer;
+        // the reference of this call, dropped below
+        frame->_refs = 1;
+        buffer_manager->acquire_buffer(buffer);
+        _live_frames.fetch_add(1, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < count && frame != NULL; i++) {
+        Subscriber *subscriber = subscribers[i];
+        frame->acquire();
+        if (subscriber->has_thread) {
+            enqueue(subscriber, frame);
+        } else {
+            subscriber->func(frame, subscriber->user_data);
+            subscriber->delivered.fetch_add(1, std::memory_order_relaxed);
+            frame->release();
+        }
+    }
+    if (frame != NULL) {
+        frame->release();
+    }
+
+    pthread_mutex_lock(&_lock);
+    bool idle = false;
+    for (int i = 0; i < count; i++) {
+        if (--subscribers[i]->users == 0) {
+            idle = true;
+        }
+    }
+    if (idle) {
+        pthread_cond_broadcast(&_cond);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+void QCamxFrameHub::set_frame_timestamp(uint32_t frame_number, int64_t timestamp) {
+    MetadataSlot *slot = &_metadata[frame_number % FRAME_METADATA_RING];
+    slot->timestamp_frame.store(-1, std::memory_order_relaxed);
+    slot->timestamp.store(timestamp, std::memory_order_relaxed);
+    slot->timestamp_frame.store(frame_number, std::memory_order_release);
+}
+
+void QCamxFrameHub::set_frame_result(uint32_t frame_number, int64_t exposure_ns,
+                                     int32_t sensitivity, int32_t ae_state) {
+    MetadataSlot *slot = &_metadata[frame_number % FRAME_METADATA_RING];
+    // the partial results of a frame may carry the tags apart
+    if (slot->result_frame.load(std::memory_order_relaxed) != (int64_t)frame_number) {
+        slot->result_frame.store(-1, std::memory_order_relaxed);
+        slot->exposure_ns.store(0, std::memory_order_relaxed);
+        slot->sensitivity.store(0, std::memory_order_relaxed);
+        slot->ae_state.store(-1, std::memory_order_relaxed);
+    }
+    if (exposure_ns >= 0) {
+        slot->exposure_ns.store(exposure_ns, std::memory_order_relaxed);
+    }
+    if (sensitivity >= 0) {
+        slot->sensitivity.store(sensitivity, std::memory_order_relaxed);
+    }
+    if (ae_state >= 0) {
+        slot->ae_state.store(ae_state, std::memory_order_relaxed);
+    }
+    slot->result_frame.store(frame_number, std::memory_order_release);
+}
+
+void QCamxFrameHub::get_frame_metadata(uint32_t frame_number, FrameMetadata *metadata) {
+    MetadataSlot *slot = &_metadata[frame_number % FRAME_METADATA_RING];
+    metadata->timestamp = 0;
+    metadata->exposure_ns = 0;
+    metadata->sensitivity = 0;
+    metadata->ae_state = -1;
+    // a newer frame may take the slot meanwhile, its values are dropped
+    if (slot->timestamp_frame.load(std::memory_order_acquire) == (int64_t)frame_number) {
+        int64_t timestamp = slot->timestamp.load(std::memory_order_relaxed);
+        if (slot->timestamp_frame.load(std::memory_order_acquire) == (int64_t)frame_number) {
+            metadata->timestamp = timestamp;
+        }
+    }
+    if (slot->result_frame.load(std::memory_order_acquire) == (int64_t)frame_number) {
+        int64_t exposure_ns = slot->exposure_ns.load(std::memory_order_relaxed);
+        int32_t sensitivity = slot->sensitivity.load(std::memory_order_relaxed);
+        int32_t ae_state = slot->ae_state.load(std::memory_order_relaxed);
+        if (slot->result_frame.load(std::memory_order_acquire) == (int64_t)frame_number) {
+            metadata->exposure_ns = exposure_ns;
+            metadata->sensitivity = sensitivity;
+            metadata->ae_state = ae_state;
+        }
+    }
+}
+
+void QCamxFrameHub::flush() {
+    pthread_mutex_lock(&_lock);
+    for (size_t i = 0; i < _subscribers.size(); i++) {
+        drop_queued(_subscribers[i]);
+    }
+    // a subscriber thread may still be in its callback, and any subscriber may hold frames
+    _flushing = true;
+    while (_live_frames.load() > 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        if (pthread_cond_timedwait(&_cond, &_lock, &deadline) == ETIMEDOUT &&
+            _live_frames.load() > 0) {
+            QCAMX_ERR("waiting for %d frames still held by subscribers\n", _live_frames.load());
+        }
+    }
+    _flushing = false;
+    pthread_mutex_unlock(&_lock);
+}
+
+void QCamxFrameHub::report() {
+    pthread_mutex_lock(&_lock);
+    for (size_t i = 0; i < _subscribers.size(); i++) {
+        Subscriber *subscriber = _subscribers[i];
+        QCAMX_PRINT("frame subscriber %d stream:%s delivered:%" PRIu64 " dropped:%" PRIu64 "\n",
+                    subscriber->id, QCamxFrameDump::get_stream_type_string(subscriber->type),
+                    subscriber->delivered.load(), subscriber->dropped.load());
+    }
+    pthread_mutex_unlock(&_lock);
+    if (_pool_misses.load() > 0) {
+        QCAMX_PRINT("frame pool empty, %" PRIu64 " buffers not published\n",
+                    _pool_misses.load());
+    }
+}
+
+/*************************private method*****************************/
+
+void *QCamxFrameHub::subscriber_thread_entry(void *data) {
+    Subscriber *subscriber = (Subscriber *)data;
+    subscriber->hub->subscriber_loop(subscriber);
+    return NULL;
+}
+
+void QCamxFrameHub::subscriber_loop(Subscriber *subscriber) {
+    pthread_mutex_lock(&subscriber->lock);
+    for (;;) {
+        while (subscriber->count == 0 && !subscriber->stopping) {
+            pthread_cond_wait(&subscriber->cond, &subscriber->lock);
+        }
+        if (subscriber->stopping) {
+            break;
+        }
+        QCamxFrame *frame = subscriber->frames[subscriber->head];
+        subscriber->head = (subscriber->head + 1) % subscriber->queue_depth;
+        subscriber->count--;
+        pthread_mutex_unlock(&subscriber->lock);
+
+        subscriber->func(frame, subscriber->user_data);
+        subscriber->delivered.fetch_add(1, std::memory_order_relaxed);
+        frame->release();
+
+        pthread_mutex_lock(&subscriber->lock);
+    }
+    pthread_mutex_unlock(&subscriber->lock);
+}
+
+void QCamxFrameHub::enqueue(Subscriber *subscriber, QCamxFrame *frame) {
+    QCamxFrame *dropped = NULL;
+    pthread_mutex_lock(&subscriber->lock);
+    if (subscriber->count == subscriber->queue_depth) {
+        if (subscriber->policy == FRAME_POLICY_SKIP_NEW) {
+            dropped = frame;
+            frame = NULL;
+        } else {
+            dropped = subscriber->frames[subscriber->head];
+            subscriber->head = (subscriber->head + 1) % subscriber->queue_depth;
+            subscriber->count--;
+        }
+        subscriber->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (frame != NULL) {
+        int tail = (subscriber->head + subscriber->count) % subscriber->queue_depth;
+        subscriber->frames[tail] = frame;
+        subscriber->count++;
+        pthread_cond_signal(&subscriber->cond);
+    }
+    pthread_mutex_unlock(&subscriber->lock);
+    // may return the buffer, not under the queue lock
+    if (dropped != NULL) {
+        dropped->release();
+    }
+}
+
+void QCamxFrameHub::drop_queued(Subscriber *subscriber) {
+    QCamxFrame *frames[FRAME_QUEUE_DEPTH_MAX];
+    int count = 0;
+    pthread_mutex_lock(&subscriber->lock);
+    while (subscriber->count > 0) {
+        frames[count++] = subscriber->frames[subscriber->head];
+        subscriber->head = (subscriber->head + 1) % subscriber->queue_depth;
+        subscriber->count--;
+    }
+    pthread_mutex_unlock(&subscriber->lock);
+    for (int i = 0; i < count; i++) {
+        frames[i]->release();
+    }
+    subscriber->dropped.fetch_add(count, std::memory_order_relaxed);
+}
+
+void QCamxFrameHub::delete_subscriber(Subscriber *subscriber) {
+    if (subscriber->has_thread) {
+        pthread_mutex_lock(&subscriber->lock);
+        subscriber->stopping = true;
+        pthread_cond_signal(&subscriber->cond);
+        pthread_mutex_unlock(&subscriber->lock);
+        pthread_join(subscriber->thread, NULL);
+    }
+    drop_queued(subscriber);
+    pthread_mutex_destroy(&subscriber->lock);
+    pthread_cond_destroy(&subscriber->cond);
+    delete subscriber;
+}
+
+void QCamxFrameHub::free_frame(QCamxFrame *frame) {
+    frame->_buffer_manager->return_buffer(frame->_buffer);
+    // the pool never holds more than FRAME_POOL_SIZE frames, a failed push is transient
+    while (!_free_frames.push((uint32_t)(frame - _frames))) {
+        sched_yield();
+    }
+    // only a flush waits for the count, so the lock is not taken while streaming
+    if (_live_frames.fetch_sub(1) == 1 && _flushing.load()) {
+        pthread_mutex_lock(&_lock);
+        pthread_cond_broadcast(&_cond);
+        pthread_mutex_unlock(&_lock);
+    }
+}
@@ -0,0 +1,189 @@
+/**
+ * @file  qcamx_frame_hub.h
+ * @brief hands the buffers of a stream to any number of subscribers without copying them
+ *        a frame holds a reference on its buffer, which goes back to its buffer manager when
+ *        the last subscriber released the frame
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "qcamx_buffer_manager.h"
+#include "qcamx_define.h"
+#include "qcamx_lockfree_queue.h"
+
+#define FRAME_QUEUE_DEPTH_MAX (32)
+// subscriptions of the hub, across all stream types
+#define FRAME_SUBSCRIBERS_MAX (16)
+// frames published and not yet released by every holder, across all streams
+#define FRAME_POOL_SIZE (256)
+// result metadata of the recent frames, indexed by frame_number % size
+#define FRAME_METADATA_RING (256)
+
+typedef enum {
+    FRAME_POLICY_DROP_OLDEST = 0,  ///< queue full, drop the oldest queued frame
+    FRAME_POLICY_SKIP_NEW = 1,     ///< queue full, skip the new frame
+} FrameQueuePolicy;
+
+class QCamxFrameHub;
+
+// result metadata of a frame, from its shutter notify and its capture results
+typedef struct _frame_metadata {
+    int64_t timestamp;    // sensor timestamp in ns, 0 if not known
+    int64_t exposure_ns;  // ANDROID_SENSOR_EXPOSURE_TIME, 0 if not known
+    int32_t sensitivity;  // ANDROID_SENSOR_SENSITIVITY, 0 if not known
+    int32_t ae_state;     // ANDROID_CONTROL_AE_STATE, -1 if not known
+} FrameMetadata;
+
+/**
+ * @brief one buffer of a stream plus its per-frame data, reference counted
+ * @detail the subscriber gets a reference which is dropped when its callback returns, call
+ *         acquire in the callback to hold the frame longer and release when done with it
+*/
+class QCamxFrame {
+public:
+    void acquire() { _refs.fetch_add(1, std::memory_order_relaxed); }
+    void release();
+public:
+    BufferInfo *info;  ///< mapped buffer, valid while a reference is held
+    int buffer_slot;   ///< slot of the buffer in its buffer manager
+    int stream_index;  ///< stream of the buffer in the device configuration, -1 if not known
+    unsigned int frame_number;
+    StreamType type;
+    Implsubformat subformat;
+    FrameMetadata metadata;  ///< as known when the frame was published
+private:
+    friend class QCamxFrameHub;
+    QCamxFrame() {}
+    ~QCamxFrame() {}
+    // Do not support the copy constructor or assignment operator
+    QCamxFrame(const QCamxFrame &) = delete;
+    QCamxFrame &operator=(const QCamxFrame &) = delete;
+private:
+    QCamxFrameHub *_hub;
+    QCamxBufferManager *_buffer_manager;
+    buffer_handle_t *_buffer;
+    std::atomic<int> _refs;
+};
+
+/**
+ * @brief called with one frame, the frame reference of the call is dropped on return
+*/
+typedef void (*FrameSubscriberFunc)(QCamxFrame *frame, void *user_data);
+
+class QCamxFrameHub {
+public:
+    QCamxFrameHub();
+    ~QCamxFrameHub();
+public:
+    /**
+     * @brief subscribe to the frames of one stream type
+     * @param queue_depth frames waiting for the subscriber, 0 calls it on the publishing thread
+     *        where it must not block, else it has a thread of its own
+     * @param policy FrameQueuePolicy when the queue is full
+     * @return subscription id, -1 on failure
+    */
+    int subscribe(StreamType type, FrameSubscriberFunc func, void *user_data, int queue_depth,
+                  int policy);
+    /**
+     * @brief stop a subscription, drops its queued frames, returns after its last callback
+     * @detail not from a callback of the same subscription, which would wait for itself
+    */
+    void unsubscribe(int id);
+    bool has_subscribers(StreamType type);
+    /**
+     * @brief hand one buffer to every subscriber of its stream type
+     * @detail the frame holds its own buffer reference, the caller returns its reference as usual
+     *         the subscription lock is not held across inline callbacks
+     *         the frame comes from a fixed pool, the buffer is skipped while the pool is empty
+    */
+    void publish(QCamxBufferManager *buffer_manager, buffer_handle_t *buffer,
+                 unsigned int frame_number, StreamType type, Implsubformat subformat);
+    /**
+     * @brief sensor timestamp of a frame from its shutter notify, which comes before its results
+    */
+    void set_frame_timestamp(uint32_t frame_number, int64_t timestamp);
+    /**
+     * @brief metadata of a frame from one of its capture results, a negative value is not in it
+    */
+    void set_frame_result(uint32_t frame_number, int64_t exposure_ns, int32_t sensitivity,
+                          int32_t ae_state);
+    /**
+     * @brief result metadata of one of the last FRAME_METADATA_RING frames, called on any thread
+    */
+    void get_frame_metadata(uint32_t frame_number, FrameMetadata *metadata);
+    /**
+     * @brief drop every queued frame and wait for the held ones, before the buffers are freed
+     * @detail blocks until every frame is released, no publish may run meanwhile
+    */
+    void flush();
+    /**
+     * @brief print the delivered and dropped frames of every subscription and the pool misses
+    */
+    void report();
+private:
+    struct Subscriber {
+        QCamxFrameHub *hub;
+        int id;
+        StreamType type;
+        FrameSubscriberFunc func;
+        void *user_data;
+        int policy;
+        int users;  ///< publish calls delivering to the subscriber, guarded by the hub lock
+        bool has_thread;
+        pthread_t thread;
+
+        // bounded queue, only touched with lock held
+        QCamxFrame *frames[FRAME_QUEUE_DEPTH_MAX];
+        int queue_depth;
+        int head;
+        int count;
+        bool stopping;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+
+        std::atomic<uint64_t> delivered;
+        std::atomic<uint64_t> dropped;
+    };
+    // the shutter notify and the capture results may come on different HAL threads
+    struct MetadataSlot {
+        std::atomic<int64_t> timestamp_frame;  ///< frame of timestamp, -1 if none
+        std::atomic<int64_t> timestamp;
+        std::atomic<int64_t> result_frame;  ///< frame of the result values, -1 if none
+        std::atomic<int64_t> exposure_ns;
+        std::atomic<int32_t> sensitivity;
+        std::atomic<int32_t> ae_state;
+    };
+    friend class QCamxFrame;
+    static void *subscriber_thread_entry(void *data);
+    void subscriber_loop(Subscriber *subscriber);
+    /**
+     * @brief queue a frame reference, or drop one by the policy of the subscriber
+    */
+    void enqueue(Subscriber *subscriber, QCamxFrame *frame);
+    /**
+     * @brief drop the queued frames of a subscriber
+    */
+    void drop_queued(Subscriber *subscriber);
+    void delete_subscriber(Subscriber *subscriber);
+    void free_frame(QCamxFrame *frame);
+    // Do not support the copy constructor or assignment operator
+    QCamxFrameHub(const QCamxFrameHub &) = delete;
+    QCamxFrameHub &operator=(const QCamxFrameHub &) = delete;
+private:
+    pthread_mutex_t _lock;  ///< guards _subscribers
+    pthread_cond_t _cond;   ///< a subscriber lost its last user, or the last frame was released
+    std::vector<Subscriber *> _subscribers;
+    int _next_id;
+    std::atomic<int> _live_frames;  ///< frames not yet released by every holder
+    std::atomic<bool> _flushing;    ///< flush waits for _live_frames to drop to 0
+    QCamxFrame _frames[FRAME_POOL_SIZE];
+    QCamxLockFreeQueue<uint32_t, FRAME_POOL_SIZE> _free_frames;  ///< free index of _frames
+    std::atomic<uint64_t> _pool_misses;  ///< buffers not published, no free frame
+    MetadataSlot _metadata[FRAME_METADATA_RING];
+};
@@ -0,0 +1,159 @@
+/**
+ * @file  qcamx_frame_stats.cpp
+ * @brief luma statistics of a frame implementation
+*/
+
+#include "qcamx_frame_stats.h"
+
+#include <string.h>
+
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxFrameStats"
+
+// tiles are taken in this stride over the grid, coprime to its size, so the tiles done
+// before the budget runs out are spread over the whole frame
+#define FRAME_STATS_TILE_ORDER_STRIDE (37)
+
+QCamxFrameStats::QCamxFrameStats() {
+    _running = false;
+    _format_warned = false;
+    _budget = 0;
+    _row_step = 4;
+    _luma = NULL;
+    _width = 0;
+    _height = 0;
+    _stride = 0;
+    _deadline = 0;
+    _tiles.resize(FRAME_STATS_TILES_X * FRAME_STATS_TILES_Y);
+}
+
+QCamxFrameStats::~QCamxFrameStats() {
+    stop();
+}
+
+/*************************public method*****************************/
+
+int QCamxFrameStats::start(int num_threads, int budget_us) {
+    stop();
+    _pool.start(num_threads > 0 ? num_threads : 1);
+    _budget = (nsecs_t)budget_us * 1000;
+    _row_step = 4;
+    _format_warned = false;
+    _running = true;
+    QCAMX_INFO("frame stats threads:%d budget:%dus\n", _pool.get_thread_count(), budget_us);
+    return 0;
+}
+
+void QCamxFrameStats::stop() {
+    if (!_running) {
+        return;
+    }
+    _pool.stop();
+    _running = false;
+}
+
+int QCamxFrameStats::compute(BufferInfo *info, uint32_t format, unsigned int frame_num,
+                             frame_stats_t *stats) {
+    if (format != HAL_PIXEL_FORMAT_YCBCR_420_888 && format != HAL_PIXEL_FORMAT_YCrCb_420_SP) {
+        if (!_format_warned) {
+            QCAMX_ERR("no frame stats for format 0x%x\n", format);
+            _format_warned = true;
+        }
+        return -1;
+    }
+    nsecs_t begin = systemTime();
+    _luma = (const uint8_t *)info->vaddr;
+    _width = info->width;
+    _height = info->height;
+    _stride = info->stride;
+    _deadline = _budget > 0 ? begin + _budget : 0;
+    int tile_count = (int)_tiles.size();
+    _pool.run(tile_task, this, tile_count);
+
+    LumaStats luma = {0, 0, 0};
+    uint64_t samples = 0;
+    uint64_t gradients = 0;
+    memset(stats->lumaHist, 0, sizeof(stats->lumaHist));
+    int tiles_done = 0;
+    for (int i = 0; i < tile_count; i++) {
+        const TileStats &tile = _tiles[i];
+        if (!tile.done) {
+            continue;
+        }
+        tiles_done++;
+        luma.sum += tile.luma.sum;
+        luma.clipped += tile.luma.clipped;
+        luma.gradient += tile.luma.gradient;
+        samples += tile.samples;
+        gradients += tile.gradients;
+        for (int bin = 0; bin < FRAME_STATS_HIST_BINS; bin++) {
+            stats->lumaHist[bin] += tile.hist[bin];
+        }
+    }
+    nsecs_t cost = systemTime() - begin;
+
+    stats->frameNum = frame_num;
+    stats->lumaMean = samples > 0 ? (float)luma.sum / samples : 0;
+    stats->clipRatio = samples > 0 ? (float)luma.clipped / samples : 0;
+    stats->sharpness = gradients > 0 ? (float)luma.gradient / gradients : 0;
+    stats->samples = (uint32_t)samples;
+    stats->rowStep = _row_step;
+    stats->tilesDone = tiles_done;
+    stats->tilesTotal = tile_count;
+    stats->costUs = (int)(cost / 1000);
+
+    // keep the next frames within the budget
+    if (_budget > 0) {
+        if (tiles_done < tile_count && _row_step < FRAME_STATS_MAX_ROW_STEP) {
+            _row_step *= 2;
+        } else if (tiles_done == tile_count && cost < _budget / 4 && _row_step > 1) {
+            _row_step /= 2;
+        }
+    }
+    return 0;
+}
+
+/*************************private method*****************************/
+
+void QCamxFrameStats::tile_task(void *context, int task_index) {
+    QCamxFrameStats *frame_stats = (QCamxFrameStats *)context;
+    int tile_count = (int)frame_stats->_tiles.size();
+    frame_stats->compute_tile((task_index * FRAME_STATS_TILE_ORDER_STRIDE) % tile_count);
+}
+
+void QCamxFrameStats::compute_tile(int tile) {
+    TileStats &stats = _tiles[tile];
+    memset(&stats, 0, sizeof(stats));
+    if (_deadline != 0 && systemTime() > _deadline) {
+        return;
+    }
+    int tile_x = tile % FRAME_STATS_TILES_X;
+    int tile_y = tile / FRAME_STATS_TILES_X;
+    int x0 = tile_x * _width / FRAME_STATS_TILES_X;
+    int x1 = (tile_x + 1) * _width / FRAME_STATS_TILES_X;
+    int y0 = tile_y * _height / FRAME_STATS_TILES_Y;
+    int y1 = (tile_y + 1) * _height / FRAME_STATS_TILES_Y;
+    // the last row of the frame has no row below it
+    if (y1 > _height - 1) {
+        y1 = _height - 1;
+    }
+    int width = x1 - x0;
+    if (width <= 0) {
+        stats.done = true;
+        return;
+    }
+    for (int y = y0; y < y1; y += _row_step) {
+        const uint8_t *row = _luma + y * _stride + x0;
+        QCamxImageKernels::accumulate_luma_stats(row, row + _stride, width, &stats.luma);
+        for (int x = 0; x < width; x++) {
+            stats.hist[row[x] >> 2]++;
+        }
+        stats.samples += width;
+        stats.gradients += 2 * width - 1;
+    }
+    stats.done = true;
+}
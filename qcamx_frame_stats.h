@@ -0,0 +1,71 @@
+/**
+ * @file  qcamx_frame_stats.h
+ * @brief luma statistics of a frame: mean, histogram, clipped ratio and sharpness
+ *        rows of a grid of tiles are sampled on a worker pool within a time budget per frame
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <utils/Timers.h>
+
+#include <vector>
+
+#include "qcamx_buffer_manager.h"
+#include "qcamx_config.h"
+#include "qcamx_image_kernels.h"
+#include "qcamx_worker_pool.h"
+
+#define FRAME_STATS_TILES_X (8)
+#define FRAME_STATS_TILES_Y (8)
+#define FRAME_STATS_MAX_ROW_STEP (64)
+
+class QCamxFrameStats {
+public:
+    QCamxFrameStats();
+    ~QCamxFrameStats();
+public:
+    /**
+     * @brief start the workers
+     * @param num_threads threads computing the tiles of a frame, the caller is one of them
+     * @param budget_us time a frame may take, tiles not started by then are skipped
+    */
+    int start(int num_threads, int budget_us);
+    void stop();
+    bool is_running() { return _running; }
+    /**
+     * @brief compute the statistics of the luma plane of one frame
+     * @detail the sampled rows thin out while frames run over the budget and fill in again
+     *         while they take less than a quarter of it
+     * @param format HAL format, IMPLEMENTATION_DEFINED must be resolved to YCBCR_420_888
+     * @return -1 if the format has no linear 8 bit luma plane
+    */
+    int compute(BufferInfo *info, uint32_t format, unsigned int frame_num, frame_stats_t *stats);
+private:
+    struct TileStats {
+        LumaStats luma;
+        uint32_t hist[FRAME_STATS_HIST_BINS];
+        uint64_t samples;
+        uint64_t gradients;  ///< pixel pairs in luma.gradient
+        bool done;
+    };
+    static void tile_task(void *context, int task_index);
+    void compute_tile(int tile);
+    // Do not support the copy constructor or assignment operator
+    QCamxFrameStats(const QCamxFrameStats &) = delete;
+    QCamxFrameStats &operator=(const QCamxFrameStats &) = delete;
+private:
+    QCamxWorkerPool _pool;
+    bool _running;
+    bool _format_warned;
+    nsecs_t _budget;
+    int _row_step;  ///< rows sampled in a tile are _row_step apart
+
+    // current frame, set by compute before the tiles run
+    const uint8_t *_luma;
+    int _width;
+    int _height;
+    size_t _stride;
+    nsecs_t _deadline;
+    std::vector<TileStats> _tiles;
+};
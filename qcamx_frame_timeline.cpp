@@ -0,0 +1,296 @@
+/**
+ * @file  qcamx_frame_timeline.cpp
+ * @brief per-frame latency timeline implementation
+*/
+
+#include "qcamx_frame_timeline.h"
+
+#include <inttypes.h>
+
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxFrameTimeline"
+
+/*************************QCamxLatencyHistogram*****************************/
+
+int QCamxLatencyHistogram::get_bucket_index(uint64_t latency_us) {
+    if (latency_us < 64) {
+        return (int)latency_us;
+    }
+    int msb = 63 - __builtin_clzll(latency_us);
+    int index = 64 + (msb - 6) * 16 + (int)((latency_us >> (msb - 4)) & 0xF);
+    return index < LATENCY_HISTOGRAM_BUCKETS ? index : LATENCY_HISTOGRAM_BUCKETS - 1;
+}
+
+uint64_t QCamxLatencyHistogram::get_bucket_upper_us(int index) {
+    if (index < 64) {
+        return (uint64_t)index;
+    }
+    int msb = (index - 64) / 16 + 6;
+    uint64_t sub = (uint64_t)((index - 64) % 16);
+    return ((16 + sub + 1) << (msb - 4)) - 1;
+}
+
+void QCamxLatencyHistogram::record(int64_t latency_ns) {
+    if (latency_ns < 0) {
+        latency_ns = 0;
+    }
+    _buckets[get_bucket_index((uint64_t)latency_ns / 1000)].fetch_add(1,
+                                                                      std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    int64_t max_ns = _max_ns.load(std::memory_order_relaxed);
+    while (latency_ns > max_ns &&
+           !_max_ns.compare_exchange_weak(max_ns, latency_ns, std::memory_order_relaxed)) {
+    }
+}
+
+void QCamxLatencyHistogram::reset() {
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        _buckets[i].store(0, std::memory_order_relaxed);
+    }
+    _count.store(0, std::memory_order_relaxed);
+    _max_ns.store(0, std::memory_order_relaxed);
+}
+
+int64_t QCamxLatencyHistogram::get_percentile_us(int percent) {
+    uint64_t count = get_count();
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t target = (count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += _buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            int64_t upper_us = (int64_t)get_bucket_upper_us(i);
+            return upper_us < get_max_us() ? upper_us : get_max_us();
+        }
+    }
+    return get_max_us();
+}
+
+/*************************QCamxFrameTimeline*****************************/
+
+QCamxFrameTimeline::QCamxFrameTimeline() {
+    reset(0);
+}
+
+void QCamxFrameTimeline::reset(int report_period_sec) {
+    for (int i = 0; i < TIMELINE_RING_SIZE; i++) {
+        _records[i].frame_number.store(-1, std::memory_order_relaxed);
+        _records[i].remaining.store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < FRAME_SEGMENT_MAX; i++) {
+        _frame_latency[i].reset();
+    }
+    for (int i = 0; i < TIMELINE_MAX_STREAMS; i++) {
+        for (int j = 0; j < STREAM_SEGMENT_MAX; j++) {
+            _stream_latency[i][j].reset();
+        }
+    }
+    _frame_count = 0;
+    _incomplete_count = 0;
+    _report_period_ns = (int64_t)report_period_sec * 1000000000LL;
+    _next_report_ns = now_ns() + _report_period_ns;
+}
+
+void QCamxFrameTimeline::begin_frame(uint32_t frame_number, uint32_t stream_mask) {
+    FrameRecord *record = &_records[frame_number % TIMELINE_RING_SIZE];
+    if (record->frame_number.load(std::memory_order_acquire) != -1) {
+        _incomplete_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    int num_buffers = __builtin_popcount(stream_mask);
+    record->stream_mask = stream_mask;
+    record->shutter_ns.store(0, std::memory_order_relaxed);
+    record->sensor_timestamp.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < TIMELINE_MAX_PARTIALS; i++) {
+        record->partial_ns[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < TIMELINE_MAX_STREAMS; i++) {
+        record->buffer_ns[i].store(0, std::memory_order_relaxed);
+        record->process_enter_ns[i].store(0, std::memory_order_relaxed);
+        record->process_exit_ns[i].store(0, std::memory_order_relaxed);
+        record->pool_return_ns[i].store(0, std::memory_order_relaxed);
+    }
+    record->remaining.store(2 * num_buffers + 1, std::memory_order_relaxed);
+    record->submit_ns = now_ns();
+    // publish the record before the HAL may call back
+    record->frame_number.store(frame_number, std::memory_order_release);
+}
+
+void QCamxFrameTimeline::abort_frame(uint32_t frame_number) {
+    FrameRecord *record = find_record(frame_number);
+    if (record != NULL) {
+        record->frame_number.store(-1, std::memory_order_release);
+    }
+}
+
+void QCamxFrameTimeline::stamp_shutter(uint32_t frame_number, int64_t sensor_timestamp) {
+    FrameRecord *record = find_record(frame_number);
+    if (record != NULL) {
+        record->shutter_ns.store(now_ns(), std::memory_order_relaxed);
+        record->sensor_timestamp.store(sensor_timestamp, std::memory_order_relaxed);
+    }
+}
+
+void QCamxFrameTimeline::stamp_partial(uint32_t frame_number, uint32_t partial_result,
+                                       bool is_final) {
+    FrameRecord *record = find_record(frame_number);
+    if (record == NULL || partial_result == 0) {
+        return;
+    }
+    uint32_t index = partial_result <= TIMELINE_MAX_PARTIALS ? partial_result - 1
+                                                             : TIMELINE_MAX_PARTIALS - 1;
+    record->partial_ns[index].store(now_ns(), std::memory_order_relaxed);
+    if (is_final) {
+        finish_event(record);
+    }
+}
+
+void QCamxFrameTimeline::stamp_buffer(uint32_t frame_number, int stream_index) {
+    FrameRecord *record = find_record(frame_number);
+    if (record != NULL && stream_index >= 0 && stream_index < TIMELINE_MAX_STREAMS) {
+        record->buffer_ns[stream_index].store(now_ns(), std::memory_order_relaxed);
+    }
+}
+
+void QCamxFrameTimeline::stamp_process_enter(uint32_t frame_number, int stream_index) {
+    FrameRecord *record = find_record(frame_number);
+    if (record != NULL && stream_index >= 0 && stream_index < TIMELINE_MAX_STREAMS) {
+        record->process_enter_ns[stream_index].store(now_ns(), std::memory_order_relaxed);
+    }
+}
+
+void QCamxFrameTimeline::stamp_process_exit(uint32_t frame_number, int stream_index) {
+    stamp_final(frame_number, stream_index, &FrameRecord::process_exit_ns);
+}
+
+void QCamxFrameTimeline::stamp_pool_return(uint32_t frame_number, int stream_index) {
+    stamp_final(frame_number, stream_index, &FrameRecord::pool_return_ns);
+}
+
+void QCamxFrameTimeline::report(const char *reason) {
+    static const char *frame_segment_name[FRAME_SEGMENT_MAX] = {
+        "submit->shutter",
+        "submit->metadata",
+    };
+    static const char *stream_segment_name[STREAM_SEGMENT_MAX] = {
+        "submit->buffer", "buffer->process", "process", "process->pool", "submit->pool",
+    };
+    QCAMX_PRINT("frame timeline [%s] frames:%" PRIu64 " incomplete:%" PRIu64 "\n", reason,
+                _frame_count.load(), _incomplete_count.load());
+    for (int i = 0; i < FRAME_SEGMENT_MAX; i++) {
+        QCamxLatencyHistogram *histogram = &_frame_latency[i];
+        if (histogram->get_count() == 0) {
+            continue;
+        }
+        QCAMX_PRINT("  frame   %-16s p50:%" PRId64 "us p99:%" PRId64 "us max:%" PRId64 "us\n",
+                    frame_segment_name[i], histogram->get_percentile_us(50),
+                    histogram->get_percentile_us(99), histogram->get_max_us());
+    }
+    for (int i = 0; i < TIMELINE_MAX_STREAMS; i++) {
+        for (int j = 0; j < STREAM_SEGMENT_MAX; j++) {
+            QCamxLatencyHistogram *histogram = &_stream_latency[i][j];
+            if (histogram->get_count() == 0) {
+                continue;
+            }
+            QCAMX_PRINT("  stream%d %-16s p50:%" PRId64 "us p99:%" PRId64 "us max:%" PRId64
+                        "us\n",
+                        i, stream_segment_name[j], histogram->get_percentile_us(50),
+                        histogram->get_percentile_us(99), histogram->get_max_us());
+        }
+    }
+}
+
+void QCamxFrameTimeline::report_if_due() {
+    if (_report_period_ns <= 0) {
+        return;
+    }
+    int64_t now = now_ns();
+    if (now >= _next_report_ns) {
+        _next_report_ns = now + _report_period_ns;
+        report("periodic");
+    }
+}
+
+/*************************private method*****************************/
+
+QCamxFrameTimeline::FrameRecord *QCamxFrameTimeline::find_record(uint32_t frame_number) {
+    FrameRecord *record = &_records[frame_number % TIMELINE_RING_SIZE];
+    if (record->frame_number.load(std::memory_order_acquire) != (int64_t)frame_number) {
+        return NULL;
+    }
+    return record;
+}
+
+void QCamxFrameTimeline::stamp_final(
+    uint32_t frame_number, int stream_index,
+    std::atomic<int64_t> (FrameRecord::*stamps)[TIMELINE_MAX_STREAMS]) {
+    FrameRecord *record = find_record(frame_number);
+    if (record == NULL || stream_index < 0 || stream_index >= TIMELINE_MAX_STREAMS ||
+        (record->stream_mask & (1u << stream_index)) == 0) {
+        return;
+    }
+    // counted once per buffer, ignore a second stamp of the same event
+    int64_t expected = 0;
+    if ((record->*stamps)[stream_index].compare_exchange_strong(expected, now_ns(),
+                                                                std::memory_order_relaxed)) {
+        finish_event(record);
+    }
+}
+
+void QCamxFrameTimeline::finish_event(FrameRecord *record) {
+    // the thread finishing the last event sees every stamp of the other threads
+    if (record->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        fold_record(record);
+        record->frame_number.store(-1, std::memory_order_release);
+    }
+}
+
+void QCamxFrameTimeline::fold_record(FrameRecord *record) {
+    int64_t submit_ns = record->submit_ns;
+    int64_t shutter_ns = record->shutter_ns.load(std::memory_order_relaxed);
+    if (shutter_ns != 0) {
+        _frame_latency[FRAME_SUBMIT_TO_SHUTTER].record(shutter_ns - submit_ns);
+    }
+    int64_t metadata_ns = 0;
+    for (int i = 0; i < TIMELINE_MAX_PARTIALS; i++) {
+        int64_t partial_ns = record->partial_ns[i].load(std::memory_order_relaxed);
+        if (partial_ns > metadata_ns) {
+            metadata_ns = partial_ns;
+        }
+    }
+    if (metadata_ns != 0) {
+        _frame_latency[FRAME_SUBMIT_TO_METADATA].record(metadata_ns - submit_ns);
+    }
+
+    for (int i = 0; i < TIMELINE_MAX_STREAMS; i++) {
+        if ((record->stream_mask & (1u << i)) == 0) {
+            continue;
+        }
+        QCamxLatencyHistogram *latency = _stream_latency[i];
+        int64_t buffer_ns = record->buffer_ns[i].load(std::memory_order_relaxed);
+        int64_t enter_ns = record->process_enter_ns[i].load(std::memory_order_relaxed);
+        int64_t exit_ns = record->process_exit_ns[i].load(std::memory_order_relaxed);
+        int64_t pool_ns = record->pool_return_ns[i].load(std::memory_order_relaxed);
+        if (buffer_ns != 0) {
+            latency[STREAM_SUBMIT_TO_BUFFER].record(buffer_ns - submit_ns);
+        }
+        if (buffer_ns != 0 && enter_ns != 0) {
+            latency[STREAM_BUFFER_TO_PROCESS].record(enter_ns - buffer_ns);
+        }
+        if (enter_ns != 0 && exit_ns != 0) {
+            latency[STREAM_PROCESS].record(exit_ns - enter_ns);
+        }
+        if (exit_ns != 0 && pool_ns != 0) {
+            latency[STREAM_PROCESS_TO_POOL].record(pool_ns - exit_ns);
+        }
+        if (pool_ns != 0) {
+            latency[STREAM_SUBMIT_TO_POOL].record(pool_ns - submit_ns);
+        }
+    }
+    _frame_count.fetch_add(1, std::memory_order_relaxed);
+}
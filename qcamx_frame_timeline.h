@@ -0,0 +1,136 @@
+/**
+ * @file  qcamx_frame_timeline.h
+ * @brief per-frame latency timeline
+ *        submit -> shutter -> metadata -> buffer -> post process -> back to the buffer pool
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+
+// frames kept in flight by the timeline, covers in-flight requests plus buffers held by consumers
+#define TIMELINE_RING_SIZE (256)
+#define TIMELINE_MAX_STREAMS (4)
+#define TIMELINE_MAX_PARTIALS (4)
+// 64 linear buckets of 1us, then 16 buckets per power of two up to ~67s
+#define LATENCY_HISTOGRAM_BUCKETS (384)
+
+/**
+ * @brief lock-free latency histogram, ~6% resolution
+*/
+class QCamxLatencyHistogram {
+public:
+    QCamxLatencyHistogram() { reset(); }
+    void record(int64_t latency_ns);
+    void reset();
+    uint64_t get_count() { return _count.load(std::memory_order_relaxed); }
+    /**
+     * @brief upper bound of the bucket holding the given percentile, in us
+    */
+    int64_t get_percentile_us(int percent);
+    int64_t get_max_us() { return _max_ns.load(std::memory_order_relaxed) / 1000; }
+private:
+    static int get_bucket_index(uint64_t latency_us);
+    static uint64_t get_bucket_upper_us(int index);
+private:
+    std::atomic<uint32_t> _buckets[LATENCY_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> _count;
+    std::atomic<int64_t> _max_ns;
+};
+
+class QCamxFrameTimeline {
+public:
+    QCamxFrameTimeline();
+    ~QCamxFrameTimeline() {}
+public:
+    static int64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+    /**
+     * @brief drop all records and statistics, only call while not streaming
+     * @param report_period_sec periodic summary interval, 0 only reports on stop
+    */
+    void reset(int report_period_sec);
+    /**
+     * @brief start a frame right before process_capture_request
+     * @param stream_mask bit i set when the request carries a buffer of stream i
+    */
+    void begin_frame(uint32_t frame_number, uint32_t stream_mask);
+    /**
+     * @brief forget a frame the HAL rejected
+    */
+    void abort_frame(uint32_t frame_number);
+    void stamp_shutter(uint32_t frame_number, int64_t sensor_timestamp);
+    /**
+     * @brief stamp one partial metadata, the final one completes the metadata part of the frame
+    */
+    void stamp_partial(uint32_t frame_number, uint32_t partial_result, bool is_final);
+    void stamp_buffer(uint32_t frame_number, int stream_index);
+    void stamp_process_enter(uint32_t frame_number, int stream_index);
+    void stamp_process_exit(uint32_t frame_number, int stream_index);
+    /**
+     * @brief stamp the buffer back to its pool, the frame completes after the final metadata,
+     *        every process exit and every pool return
+    */
+    void stamp_pool_return(uint32_t frame_number, int stream_index);
+    /**
+     * @brief print p50/p99/max of every segment
+    */
+    void report(const char *reason);
+    /**
+     * @brief print the periodic summary when its interval elapsed, called by the result thread
+    */
+    void report_if_due();
+private:
+    typedef enum {
+        FRAME_SUBMIT_TO_SHUTTER = 0,
+        FRAME_SUBMIT_TO_METADATA,
+        FRAME_SEGMENT_MAX,
+    } FrameSegment;
+    typedef enum {
+        STREAM_SUBMIT_TO_BUFFER = 0,
+        STREAM_BUFFER_TO_PROCESS,
+        STREAM_PROCESS,
+        STREAM_PROCESS_TO_POOL,
+        STREAM_SUBMIT_TO_POOL,
+        STREAM_SEGMENT_MAX,
+    } StreamSegment;
+    struct FrameRecord {
+        std::atomic<int64_t> frame_number;  ///< -1 means the record is free
+        // final metadata, plus process exit and pool return per buffer
+        std::atomic<int> remaining;
+        uint32_t stream_mask;
+        int64_t submit_ns;
+        std::atomic<int64_t> shutter_ns;
+        std::atomic<int64_t> sensor_timestamp;
+        std::atomic<int64_t> partial_ns[TIMELINE_MAX_PARTIALS];
+        std::atomic<int64_t> buffer_ns[TIMELINE_MAX_STREAMS];
+        std::atomic<int64_t> process_enter_ns[TIMELINE_MAX_STREAMS];
+        std::atomic<int64_t> process_exit_ns[TIMELINE_MAX_STREAMS];
+        std::atomic<int64_t> pool_return_ns[TIMELINE_MAX_STREAMS];
+    };
+    FrameRecord *find_record(uint32_t frame_number);
+    /**
+     * @brief stamp a per-buffer event which is counted to complete the frame
+    */
+    void stamp_final(uint32_t frame_number, int stream_index,
+                     std::atomic<int64_t> (FrameRecord::*stamps)[TIMELINE_MAX_STREAMS]);
+    void finish_event(FrameRecord *record);
+    void fold_record(FrameRecord *record);
+    // Do not support the copy constructor or assignment operator
+    QCamxFrameTimeline(const QCamxFrameTimeline &) = delete;
+    QCamxFrameTimeline &operator=(const QCamxFrameTimeline &) = delete;
+private:
+    FrameRecord _records[TIMELINE_RING_SIZE];  ///< indexed by frame_number % size
+    QCamxLatencyHistogram _frame_latency[FRAME_SEGMENT_MAX];
+    QCamxLatencyHistogram _stream_latency[TIMELINE_MAX_STREAMS][STREAM_SEGMENT_MAX];
+    std::atomic<uint64_t> _frame_count;       ///< frames with every stamp folded in
+    std::atomic<uint64_t> _incomplete_count;  ///< records overwritten before they completed
+    int64_t _report_period_ns;
+    int64_t _next_report_ns;
+};
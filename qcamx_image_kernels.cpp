@@ -0,0 +1,828 @@
+/**
+ * @file  qcamx_image_kernels.cpp
+ * @brief plane packing and yuv420 layout kernels implementation
+*/
+
+#include "qcamx_image_kernels.h"
+
+#include <string.h>
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMAGE_KERNELS_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define IMAGE_KERNELS_NEON
+#endif
+
+#include "qcamx_log.h"
+#include "qcamx_worker_pool.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxImageKernels"
+
+// row kernels, a frame kernel walks the rows and calls one of them per row
+struct ImageKernelTable {
+    ImageKernelIsa isa;
+    void (*copy_row)(uint8_t *dst, const uint8_t *src, size_t bytes);
+    // swap the two bytes of every pair, NV12 <-> NV21 chroma
+    void (*swap_pairs_row)(uint8_t *dst, const uint8_t *src, size_t pairs);
+    // split interleaved pairs into two planes, NV12 chroma -> I420 chroma
+    void (*split_pairs_row)(uint8_t *dst0, uint8_t *dst1, const uint8_t *src, size_t pairs);
+    void (*shift16_row)(uint16_t *dst, const uint8_t *src, size_t count, int shift);
+    // MIPI packed raw to one pixel per 16 bit, src_bytes limits the vector loads
+    void (*unpack_raw10_row)(uint16_t *dst, const uint8_t *src, size_t width, size_t src_bytes);
+    void (*unpack_raw12_row)(uint16_t *dst, const uint8_t *src, size_t width, size_t src_bytes);
+    // luma sum, clipped pixels and squared gradients of a row, next is the row below it
+    void (*luma_stats_row)(const uint8_t *row, const uint8_t *next, size_t width,
+                           LumaStats *stats);
+};
+
+/*************************scalar*****************************/
+
+static void copy_row_scalar(uint8_t *dst, const uint8_t *src, size_t bytes) {
+    memcpy(dst, src, bytes);
+}
+
+static void swap_pairs_row_scalar(uint8_t *dst, const uint8_t *src, size_t pairs) {
+    for (size_t i = 0; i < pairs; i++) {
+        uint8_t first = src[2 * i];
+        dst[2 * i] = src[2 * i + 1];
+        dst[2 * i + 1] = first;
+    }
+}
+
+static void split_pairs_row_scalar(uint8_t *dst0, uint8_t *dst1, const uint8_t *src,
+                                   size_t pairs) {
+    for (size_t i = 0; i < pairs; i++) {
+        dst0[i] = src[2 * i];
+        dst1[i] = src[2 * i + 1];
+    }
+}
+
+static void shift16_row_scalar(uint16_t *dst, const uint8_t *src, size_t count, int shift) {
+    if (shift == 0) {
+        memcpy(dst, src, count * sizeof(uint16_t));
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint16_t value;
+        memcpy(&value, src + 2 * i, sizeof(value));
+        dst[i] = value >> shift;
+    }
+}
+
+// RAW10: 4 pixels in 5 bytes, the high 8 bits of each, then the low 2 bits of all four
+// a last group cut by src_bytes keeps the bytes it has, pixels past src_bytes are 0
+static void unpack_raw10_row_scalar(uint16_t *dst, const uint8_t *src, size_t width,
+                                    size_t src_bytes) {
+    size_t i = 0;
+    for (; i + 4 <= width && src_bytes >= 5; i += 4, src += 5, src_bytes -= 5) {
+        uint8_t low = src[4];
+        dst[i] = (uint16_t)((src[0] << 2) | (low & 0x3));
+        dst[i + 1] = (uint16_t)((src[1] << 2) | ((low >> 2) & 0x3));
+        dst[i + 2] = (uint16_t)((src[2] << 2) | ((low >> 4) & 0x3));
+        dst[i + 3] = (uint16_t)((src[3] << 2) | (low >> 6));
+    }
+    uint8_t low = src_bytes >= 5 ? src[4] : 0;
+    for (size_t k = 0; i < width && k < 4 && k < src_bytes; i++, k++) {
+        dst[i] = (uint16_t)((src[k] << 2) | ((low >> (2 * k)) & 0x3));
+    }
+    for (; i < width; i++) {
+        dst[i] = 0;
+    }
+}
+
+// RAW12: 2 pixels in 3 bytes, the high 8 bits of each, then the low 4 bits of both
+// a last group cut by src_bytes keeps the bytes it has, pixels past src_bytes are 0
+static void unpack_raw12_row_scalar(uint16_t *dst, const uint8_t *src, size_t width,
+                                    size_t src_bytes) {
+    size_t i = 0;
+    for (; i + 2 <= width && src_bytes >= 3; i += 2, src += 3, src_bytes -= 3) {
+        dst[i] = (uint16_t)((src[0] << 4) | (src[2] & 0xf));
+        dst[i + 1] = (uint16_t)((src[1] << 4) | (src[2] >> 4));
+    }
+    uint8_t low = src_bytes >= 3 ? src[2] : 0;
+    for (size_t k = 0; i < width && k < 2 && k < src_bytes; i++, k++) {
+        dst[i] = (uint16_t)((src[k] << 4) | ((low >> (4 * k)) & 0xf));
+    }
+    for (; i < width; i++) {
+        dst[i] = 0;
+    }
+}
+
+static void luma_stats_row_scalar(const uint8_t *row, const uint8_t *next, size_t width,
+                                  LumaStats *stats) {
+    uint64_t sum = 0;
+    uint64_t clipped = 0;
+    uint64_t gradient = 0;
+    for (size_t i = 0; i < width; i++) {
+        int value = row[i];
+        sum += value;
+        clipped += value <= LUMA_CLIP_LOW || value >= LUMA_CLIP_HIGH;
+        int dy = next[i] - value;
+        gradient += dy * dy;
+        if (i + 1 < width) {
+            int dx = row[i + 1] - value;
+            gradient += dx * dx;
+        }
+    }
+    stats->sum += sum;
+    stats->clipped += clipped;
+    stats->gradient += gradient;
+}
+
+static const ImageKernelTable scalar_kernels = {
+    IMAGE_KERNEL_SCALAR,
+    copy_row_scalar,
+    swap_pairs_row_scalar,
+    split_pairs_row_scalar,
+    shift16_row_scalar,
+    unpack_raw10_row_scalar,
+    unpack_raw12_row_scalar,
+    luma_stats_row_scalar,
+};
+
+#ifdef IMAGE_KERNELS_X86
+/*************************sse2*****************************/
+
+__attribute__((target("sse2"))) static void copy_row_sse2(uint8_t *dst, const uint8_t *src,
+                                                          size_t bytes) {
+    size_t i = 0;
+    for (; i + 64 <= bytes; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + i + 48));
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), b);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), c);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), d);
+    }
+    memcpy(dst + i, src + i, bytes - i);
+}
+
+__attribute__((target("sse2"))) static void swap_pairs_row_sse2(uint8_t *dst, const uint8_t *src,
+                                                                size_t pairs) {
+    size_t i = 0;
+    for (; i + 8 <= pairs; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), v);
+    }
+    swap_pairs_row_scalar(dst + 2 * i, src + 2 * i, pairs - i);
+}
+
+__attribute__((target("sse2"))) static void split_pairs_row_sse2(uint8_t *dst0, uint8_t *dst1,
+                                                                 const uint8_t *src,
+                                                                 size_t pairs) {
+    const __m128i low_mask = _mm_set1_epi16(0x00ff);
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+        __m128i first = _mm_packus_epi16(_mm_and_si128(a, low_mask), _mm_and_si128(b, low_mask));
+        __m128i second = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *)(dst0 + i), first);
+        _mm_storeu_si128((__m128i *)(dst1 + i), second);
+    }
+    split_pairs_row_scalar(dst0 + i, dst1 + i, src + 2 * i, pairs - i);
+}
+
+__attribute__((target("sse2"))) static void shift16_row_sse2(uint16_t *dst, const uint8_t *src,
+                                                             size_t count, int shift) {
+    if (shift == 0) {
+        copy_row_sse2((uint8_t *)dst, src, count * sizeof(uint16_t));
+        return;
+    }
+    const __m128i bits = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_srl_epi16(v, bits));
+    }
+    shift16_row_scalar(dst + i, src + 2 * i, count - i, shift);
+}
+
+// the squared gradients add up in 32 bit lanes, which holds rows of up to 128K pixels
+__attribute__((target("sse2"))) static void luma_stats_row_sse2(const uint8_t *row,
+                                                                const uint8_t *next, size_t width,
+                                                                LumaStats *stats) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i low = _mm_set1_epi8((char)LUMA_CLIP_LOW);
+    const __m128i high = _mm_set1_epi8((char)LUMA_CLIP_HIGH);
+    __m128i sum = zero;
+    __m128i clipped = zero;
+    __m128i gradient = zero;
+    size_t i = 0;
+    // the horizontal gradient reads one pixel ahead
+    for (; i + 17 <= width; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i right = _mm_loadu_si128((const __m128i *)(row + i + 1));
+        __m128i below = _mm_loadu_si128((const __m128i *)(next + i));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+        __m128i clip = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, low), v),
+                                    _mm_cmpeq_epi8(_mm_max_epu8(v, high), v));
+        clipped = _mm_add_epi64(clipped, _mm_sad_epu8(_mm_and_si128(clip, one), zero));
+        __m128i dx = _mm_or_si128(_mm_subs_epu8(v, right), _mm_subs_epu8(right, v));
+        __m128i dy = _mm_or_si128(_mm_subs_epu8(v, below), _mm_subs_epu8(below, v));
+        __m128i dx_low = _mm_unpacklo_epi8(dx, zero);
+        __m128i dx_high = _mm_unpackhi_epi8(dx, zero);
+        __m128i dy_low = _mm_unpacklo_epi8(dy, zero);
+        __m128i dy_high = _mm_unpackhi_epi8(dy, zero);
+        gradient = _mm_add_epi32(gradient, _mm_madd_epi16(dx_low, dx_low));
+        gradient = _mm_add_epi32(gradient, _mm_madd_epi16(dx_high, dx_high));
+        gradient = _mm_add_epi32(gradient, _mm_madd_epi16(dy_low, dy_low));
+        gradient = _mm_add_epi32(gradient, _mm_madd_epi16(dy_high, dy_high));
+    }
+    uint64_t sums[2];
+    uint64_t clips[2];
+    uint32_t gradients[4];
+    _mm_storeu_si128((__m128i *)sums, sum);
+    _mm_storeu_si128((__m128i *)clips, clipped);
+    _mm_storeu_si128((__m128i *)gradients, gradient);
+    stats->sum += sums[0] + sums[1];
+    stats->clipped += clips[0] + clips[1];
+    stats->gradient += (uint64_t)gradients[0] + gradients[1] + gradients[2] + gradients[3];
+    // the gradient between the last vector and the tail was counted by the vector
+    luma_stats_row_scalar(row + i, next + i, width - i, stats);
+}
+
+// SSE2 has no byte shuffle, the MIPI unpack stays scalar on this level
+static const ImageKernelTable sse2_kernels = {
+    IMAGE_KERNEL_SSE2,
+    copy_row_sse2,
+    swap_pairs_row_sse2,
+    split_pairs_row_sse2,
+    shift16_row_sse2,
+    unpack_raw10_row_scalar,
+    unpack_raw12_row_scalar,
+    luma_stats_row_sse2,
+};
+
+/*************************avx2*****************************/
+
+__attribute__((target("avx2"))) static void copy_row_avx2(uint8_t *dst, const uint8_t *src,
+                                                          size_t bytes) {
+    size_t i = 0;
+    for (; i + 128 <= bytes; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(src + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(src + i + 96));
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), b);
+        _mm256_storeu_si256((__m256i *)(dst + i + 64), c);
+        _mm256_storeu_si256((__m256i *)(dst + i + 96), d);
+    }
+    memcpy(dst + i, src + i, bytes - i);
+}
+
+__attribute__((target("avx2"))) static void swap_pairs_row_avx2(uint8_t *dst, const uint8_t *src,
+                                                                size_t pairs) {
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i), v);
+    }
+    swap_pairs_row_scalar(dst + 2 * i, src + 2 * i, pairs - i);
+}
+
+__attribute__((target("avx2"))) static void split_pairs_row_avx2(uint8_t *dst0, uint8_t *dst1,
+                                                                 const uint8_t *src,
+                                                                 size_t pairs) {
+    const __m256i low_mask = _mm256_set1_epi16(0x00ff);
+    size_t i = 0;
+    for (; i + 32 <= pairs; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * i + 32));
+        __m256i first =
+            _mm256_packus_epi16(_mm256_and_si256(a, low_mask), _mm256_and_si256(b, low_mask));
+        __m256i second = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        // packus works per 128 bit lane, put the quarters back in order
+        first = _mm256_permute4x64_epi64(first, 0xd8);
+        second = _mm256_permute4x64_epi64(second, 0xd8);
+        _mm256_storeu_si256((__m256i *)(dst0 + i), first);
+        _mm256_storeu_si256((__m256i *)(dst1 + i), second);
+    }
+    split_pairs_row_sse2(dst0 + i, dst1 + i, src + 2 * i, pairs - i);
+}
+
+__attribute__((target("avx2"))) static void shift16_row_avx2(uint16_t *dst, const uint8_t *src,
+                                                             size_t count, int shift) {
+    if (shift == 0) {
+        copy_row_avx2((uint8_t *)dst, src, count * sizeof(uint16_t));
+        return;
+    }
+    const __m128i bits = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_srl_epi16(v, bits));
+    }
+    shift16_row_scalar(dst + i, src + 2 * i, count - i, shift);
+}
+
+// 16 pixels per loop, each 128 bit lane unpacks 8 of them from its own 16 byte load
+__attribute__((target("avx2"))) static void unpack_raw10_row_avx2(uint16_t *dst,
+                                                                  const uint8_t *src,
+                                                                  size_t width,
+                                                                  size_t src_bytes) {
+    const __m256i high_index =
+        _mm256_setr_epi8(0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1, 0, -1, 1, -1, 2,
+                         -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1);
+    const __m256i low_index =
+        _mm256_setr_epi8(4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1, 4, -1, 4, -1, 4,
+                         -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1);
+    // the multiply moves the 2 bits of each pixel to bit 6, no per lane shift needed
+    const __m256i low_scale = _mm256_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1, 64, 16,
+                                                4, 1);
+    const __m256i low_mask = _mm256_set1_epi16(0x3);
+    size_t i = 0;
+    for (; i + 16 <= width && i / 4 * 5 + 26 <= src_bytes; i += 16) {
+        const uint8_t *s = src + i / 4 * 5;
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)s)),
+            _mm_loadu_si128((const __m128i *)(s + 10)), 1);
+        __m256i high = _mm256_slli_epi16(_mm256_shuffle_epi8(v, high_index), 2);
+        __m256i low = _mm256_mullo_epi16(_mm256_shuffle_epi8(v, low_index), low_scale);
+        low = _mm256_and_si256(_mm256_srli_epi16(low, 6), low_mask);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(high, low));
+    }
+    unpack_raw10_row_scalar(dst + i, src + i / 4 * 5, width - i, src_bytes - i / 4 * 5);
+}
+
+__attribute__((target("avx2"))) static void unpack_raw12_row_avx2(uint16_t *dst,
+                                                                  const uint8_t *src,
+                                                                  size_t width,
+                                                                  size_t src_bytes) {
+    const __m256i high_index =
+        _mm256_setr_epi8(0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1, 0, -1, 1, -1,
+                         3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1);
+    const __m256i low_index =
+        _mm256_setr_epi8(2, -1, 2, -1, 5, -1, 5, -1, 8, -1, 8, -1, 11, -1, 11, -1, 2, -1, 2, -1,
+                         5, -1, 5, -1, 8, -1, 8, -1, 11, -1, 11, -1);
+    const __m256i low_scale = _mm256_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1,
+                                                16, 1);
+    const __m256i low_mask = _mm256_set1_epi16(0xf);
+    size_t i = 0;
+    for (; i + 16 <= width && i / 2 * 3 + 28 <= src_bytes; i += 16) {
+        const uint8_t *s = src + i / 2 * 3;
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)s)),
+            _mm_loadu_si128((const __m128i *)(s + 12)), 1);
+        __m256i high = _mm256_slli_epi16(_mm256_shuffle_epi8(v, high_index), 4);
+        __m256i low = _mm256_mullo_epi16(_mm256_shuffle_epi8(v, low_index), low_scale);
+        low = _mm256_and_si256(_mm256_srli_epi16(low, 4), low_mask);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(high, low));
+    }
+    unpack_raw12_row_scalar(dst + i, src + i / 2 * 3, width - i, src_bytes - i / 2 * 3);
+}
+
+__attribute__((target("avx2"))) static void luma_stats_row_avx2(const uint8_t *row,
+                                                                const uint8_t *next, size_t width,
+                                                                LumaStats *stats) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i low = _mm256_set1_epi8((char)LUMA_CLIP_LOW);
+    const __m256i high = _mm256_set1_epi8((char)LUMA_CLIP_HIGH);
+    __m256i sum = zero;
+    __m256i clipped = zero;
+    __m256i gradient = zero;
+    size_t i = 0;
+    for (; i + 33 <= width; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(row + i));
+        __m256i right = _mm256_loadu_si256((const __m256i *)(row + i + 1));
+        __m256i below = _mm256_loadu_si256((const __m256i *)(next + i));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(v, zero));
+        __m256i clip = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(v, low), v),
+                                       _mm256_cmpeq_epi8(_mm256_max_epu8(v, high), v));
+        clipped = _mm256_add_epi64(clipped, _mm256_sad_epu8(_mm256_and_si256(clip, one), zero));
+        __m256i dx = _mm256_or_si256(_mm256_subs_epu8(v, right), _mm256_subs_epu8(right, v));
+        __m256i dy = _mm256_or_si256(_mm256_subs_epu8(v, below), _mm256_subs_epu8(below, v));
+        // the in lane unpack reorders the pixels, which a sum does not mind
+        __m256i dx_low = _mm256_unpacklo_epi8(dx, zero);
+        __m256i dx_high = _mm256_unpackhi_epi8(dx, zero);
+        __m256i dy_low = _mm256_unpacklo_epi8(dy, zero);
+        __m256i dy_high = _mm256_unpackhi_epi8(dy, zero);
+        gradient = _mm256_add_epi32(gradient, _mm256_madd_epi16(dx_low, dx_low));
+        gradient = _mm256_add_epi32(gradient, _mm256_madd_epi16(dx_high, dx_high));
+        gradient = _mm256_add_epi32(gradient, _mm256_madd_epi16(dy_low, dy_low));
+        gradient = _mm256_add_epi32(gradient, _mm256_madd_epi16(dy_high, dy_high));
+    }
+    uint64_t sums[4];
+    uint64_t clips[4];
+    uint32_t gradients[8];
+    _mm256_storeu_si256((__m256i *)sums, sum);
+    _mm256_storeu_si256((__m256i *)clips, clipped);
+    _mm256_storeu_si256((__m256i *)gradients, gradient);
+    for (int k = 0; k < 4; k++) {
+        stats->sum += sums[k];
+        stats->clipped += clips[k];
+        stats->gradient += (uint64_t)gradients[2 * k] + gradients[2 * k + 1];
+    }
+    luma_stats_row_scalar(row + i, next + i, width - i, stats);
+}
+
+static const ImageKernelTable avx2_kernels = {
+    IMAGE_KERNEL_AVX2,
+    copy_row_avx2,
+    swap_pairs_row_avx2,
+    split_pairs_row_avx2,
+    shift16_row_avx2,
+    unpack_raw10_row_avx2,
+    unpack_raw12_row_avx2,
+    luma_stats_row_avx2,
+};
+#endif
+
+#ifdef IMAGE_KERNELS_NEON
+/*************************neon*****************************/
+
+static void copy_row_neon(uint8_t *dst, const uint8_t *src, size_t bytes) {
+    size_t i = 0;
+    for (; i + 64 <= bytes; i += 64) {
+        uint8x16_t a = vld1q_u8(src + i);
+        uint8x16_t b = vld1q_u8(src + i + 16);
+        uint8x16_t c = vld1q_u8(src + i + 32);
+        uint8x16_t d = vld1q_u8(src + i + 48);
+        vst1q_u8(dst + i, a);
+        vst1q_u8(dst + i + 16, b);
+        vst1q_u8(dst + i + 32, c);
+        vst1q_u8(dst + i + 48, d);
+    }
+    memcpy(dst + i, src + i, bytes - i);
+}
+
+static void swap_pairs_row_neon(uint8_t *dst, const uint8_t *src, size_t pairs) {
+    size_t i = 0;
+    for (; i + 8 <= pairs; i += 8) {
+        vst1q_u8(dst + 2 * i, vrev16q_u8(vld1q_u8(src + 2 * i)));
+    }
+    swap_pairs_row_scalar(dst + 2 * i, src + 2 * i, pairs - i);
+}
+
+static void split_pairs_row_neon(uint8_t *dst0, uint8_t *dst1, const uint8_t *src,
+                                 size_t pairs) {
+    size_t i = 0;
+    for (; i + 16 <= pairs; i += 16) {
+        uint8x16x2_t v = vld2q_u8(src + 2 * i);
+        vst1q_u8(dst0 + i, v.val[0]);
+        vst1q_u8(dst1 + i, v.val[1]);
+    }
+    split_pairs_row_scalar(dst0 + i, dst1 + i, src + 2 * i, pairs - i);
+}
+
+static void shift16_row_neon(uint16_t *dst, const uint8_t *src, size_t count, int shift) {
+    if (shift == 0) {
+        copy_row_neon((uint8_t *)dst, src, count * sizeof(uint16_t));
+        return;
+    }
+    // a negative left shift is a right shift, the count needs no immediate
+    const int16x8_t bits = vdupq_n_s16((int16_t)-shift);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(src + 2 * i));
+        vst1q_u16(dst + i, vshlq_u16(v, bits));
+    }
+    shift16_row_scalar(dst + i, src + 2 * i, count - i, shift);
+}
+
+#ifdef __aarch64__
+// 8 pixels per loop, the table lookup is the NEON counterpart of the byte shuffle
+static void unpack_raw10_row_neon(uint16_t *dst, const uint8_t *src, size_t width,
+                                  size_t src_bytes) {
+    static const uint8_t high_table[16] = {0, 255, 1, 255, 2, 255, 3, 255,
+                                           5, 255, 6, 255, 7, 255, 8, 255};
+    static const uint8_t low_table[16] = {4, 255, 4, 255, 4, 255, 4, 255,
+                                          9, 255, 9, 255, 9, 255, 9, 255};
+    static const uint16_t low_scale_table[8] = {64, 16, 4, 1, 64, 16, 4, 1};
+    const uint8x16_t high_index = vld1q_u8(high_table);
+    const uint8x16_t low_index = vld1q_u8(low_table);
+    const uint16x8_t low_scale = vld1q_u16(low_scale_table);
+    const uint16x8_t low_mask = vdupq_n_u16(0x3);
+    size_t i = 0;
+    for (; i + 8 <= width && i / 4 * 5 + 16 <= src_bytes; i += 8) {
+        uint8x16_t v = vld1q_u8(src + i / 4 * 5);
+        uint16x8_t high = vshlq_n_u16(vreinterpretq_u16_u8(vqtbl1q_u8(v, high_index)), 2);
+        uint16x8_t low = vmulq_u16(vreinterpretq_u16_u8(vqtbl1q_u8(v, low_index)), low_scale);
+        low = vandq_u16(vshrq_n_u16(low, 6), low_mask);
+        vst1q_u16(dst + i, vorrq_u16(high, low));
+    }
+    unpack_raw10_row_scalar(dst + i, src + i / 4 * 5, width - i, src_bytes - i / 4 * 5);
+}
+
+static void unpack_raw12_row_neon(uint16_t *dst, const uint8_t *src, size_t width,
+                                  size_t src_bytes) {
+    static const uint8_t high_table[16] = {0, 255, 1, 255, 3, 255, 4, 255,
+                                           6, 255, 7, 255, 9, 255, 10, 255};
+    static const uint8_t low_table[16] = {2, 255, 2, 255, 5, 255, 5, 255,
+                                          8, 255, 8, 255, 11, 255, 11, 255};
+    static const uint16_t low_scale_table[8] = {16, 1, 16, 1, 16, 1, 16, 1};
+    const uint8x16_t high_index = vld1q_u8(high_table);
+    const uint8x16_t low_index = vld1q_u8(low_table);
+    const uint16x8_t low_scale = vld1q_u16(low_scale_table);
+    const uint16x8_t low_mask = vdupq_n_u16(0xf);
+    size_t i = 0;
+    for (; i + 8 <= width && i / 2 * 3 + 16 <= src_bytes; i += 8) {
+        uint8x16_t v = vld1q_u8(src + i / 2 * 3);
+        uint16x8_t high = vshlq_n_u16(vreinterpretq_u16_u8(vqtbl1q_u8(v, high_index)), 4);
+        uint16x8_t low = vmulq_u16(vreinterpretq_u16_u8(vqtbl1q_u8(v, low_index)), low_scale);
+        low = vandq_u16(vshrq_n_u16(low, 4), low_mask);
+        vst1q_u16(dst + i, vorrq_u16(high, low));
+    }
+    unpack_raw12_row_scalar(dst + i, src + i / 2 * 3, width - i, src_bytes - i / 2 * 3);
+}
+#else
+// 32 bit NEON has no 16 byte table lookup
+#define unpack_raw10_row_neon unpack_raw10_row_scalar
+#define unpack_raw12_row_neon unpack_raw12_row_scalar
+#endif
+
+static void luma_stats_row_neon(const uint8_t *row, const uint8_t *next, size_t width,
+                                LumaStats *stats) {
+    const uint8x16_t low = vdupq_n_u8(LUMA_CLIP_LOW);
+    const uint8x16_t high = vdupq_n_u8(LUMA_CLIP_HIGH);
+    uint64x2_t sum = vdupq_n_u64(0);
+    uint64x2_t clipped = vdupq_n_u64(0);
+    uint32x4_t gradient = vdupq_n_u32(0);
+    size_t i = 0;
+    for (; i + 17 <= width; i += 16) {
+        uint8x16_t v = vld1q_u8(row + i);
+        uint8x16_t right = vld1q_u8(row + i + 1);
+        uint8x16_t below = vld1q_u8(next + i);
+        sum = vpadalq_u32(sum, vpaddlq_u16(vpaddlq_u8(v)));
+        uint8x16_t clip = vorrq_u8(vcleq_u8(v, low), vcgeq_u8(v, high));
+        clipped = vpadalq_u32(clipped, vpaddlq_u16(vpaddlq_u8(vshrq_n_u8(clip, 7))));
+        uint8x16_t dx = vabdq_u8(v, right);
+        uint8x16_t dy = vabdq_u8(v, below);
+        gradient = vpadalq_u16(gradient, vmull_u8(vget_low_u8(dx), vget_low_u8(dx)));
+        gradient = vpadalq_u16(gradient, vmull_u8(vget_high_u8(dx), vget_high_u8(dx)));
+        gradient = vpadalq_u16(gradient, vmull_u8(vget_low_u8(dy), vget_low_u8(dy)));
+        gradient = vpadalq_u16(gradient, vmull_u8(vget_high_u8(dy), vget_high_u8(dy)));
+    }
+    stats->sum += vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+    stats->clipped += vgetq_lane_u64(clipped, 0) + vgetq_lane_u64(clipped, 1);
+    uint64x2_t gradient_pairs = vpaddlq_u32(gradient);
+    stats->gradient += vgetq_lane_u64(gradient_pairs, 0) + vgetq_lane_u64(gradient_pairs, 1);
+    luma_stats_row_scalar(row + i, next + i, width - i, stats);
+}
+
+static const ImageKernelTable neon_kernels = {
+    IMAGE_KERNEL_NEON,
+    copy_row_neon,
+    swap_pairs_row_neon,
+    split_pairs_row_neon,
+    shift16_row_neon,
+    unpack_raw10_row_neon,
+    unpack_raw12_row_neon,
+    luma_stats_row_neon,
+};
+#endif
+
+/*************************dispatch*****************************/
+
+static const ImageKernelTable *find_kernels(ImageKernelIsa isa) {
+#ifdef IMAGE_KERNELS_X86
+    // may run before the constructors which init the cpu model
+    __builtin_cpu_init();
+#endif
+    switch (isa) {
+        case IMAGE_KERNEL_SCALAR:
+            return &scalar_kernels;
+#ifdef IMAGE_KERNELS_X86
+        case IMAGE_KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2") ? &sse2_kernels : NULL;
+        case IMAGE_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif
+#ifdef IMAGE_KERNELS_NEON
+        case IMAGE_KERNEL_NEON:
+            // built with NEON enabled, so the target cpu has it
+            return &neon_kernels;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+static std::atomic<const ImageKernelTable *> s_kernels(NULL);
+
+static const ImageKernelTable *get_kernels() {
+    const ImageKernelTable *kernels = s_kernels.load(std::memory_order_acquire);
+    if (kernels != NULL) {
+        return kernels;
+    }
+    static const ImageKernelIsa preferred[] = {IMAGE_KERNEL_AVX2, IMAGE_KERNEL_NEON,
+                                               IMAGE_KERNEL_SSE2, IMAGE_KERNEL_SCALAR};
+    for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+        kernels = find_kernels(preferred[i]);
+        if (kernels != NULL) {
+            break;
+        }
+    }
+    // racing first callers resolve the same table
+    s_kernels.store(kernels, std::memory_order_release);
+    QCAMX_INFO("image kernels:%s\n", QCamxImageKernels::get_isa_name(kernels->isa));
+    return kernels;
+}
+
+struct UnpackJob {
+    const ImageKernelTable *kernels;
+    uint16_t *dst;
+    const uint8_t *src;
+    int bits;
+    int width;
+    int height;
+    size_t src_stride;
+    size_t src_row_bytes;
+    int rows_per_band;
+};
+
+static void unpack_band(void *context, int band) {
+    UnpackJob *job = (UnpackJob *)context;
+    int first_row = band * job->rows_per_band;
+    int last_row = first_row + job->rows_per_band;
+    if (last_row > job->height) {
+        last_row = job->height;
+    }
+    for (int h = first_row; h < last_row; h++) {
+        const uint8_t *src = job->src + h * job->src_stride;
+        uint16_t *dst = job->dst + (size_t)h * job->width;
+        if (job->bits == 10) {
+            job->kernels->unpack_raw10_row(dst, src, job->width, job->src_row_bytes);
+        } else {
+            job->kernels->unpack_raw12_row(dst, src, job->width, job->src_row_bytes);
+        }
+    }
+}
+
+static pthread_mutex_t s_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_pool_cond = PTHREAD_COND_INITIALIZER;  ///< the last user left the pool
+static QCamxWorkerPool *s_pool = NULL;
+static int s_pool_users = 0;  ///< unpacks running on s_pool, guarded by s_pool_lock
+
+/*************************public method*****************************/
+
+void QCamxImageKernels::pack_plane(uint8_t *dst, const uint8_t *src, size_t row_bytes, int rows,
+                                   size_t src_stride) {
+    const ImageKernelTable *kernels = get_kernels();
+    if (src_stride == row_bytes) {
+        kernels->copy_row(dst, src, row_bytes * rows);
+        return;
+    }
+    for (int h = 0; h < rows; h++) {
+        kernels->copy_row(dst, src, row_bytes);
+        dst += row_bytes;
+        src += src_stride;
+    }
+}
+
+void QCamxImageKernels::pack_16bit(uint16_t *dst, const uint8_t *src, int width, int height,
+                                   size_t src_stride, int shift) {
+    const ImageKernelTable *kernels = get_kernels();
+    if (src_stride == (size_t)width * sizeof(uint16_t)) {
+        kernels->shift16_row(dst, src, (size_t)width * height, shift);
+        return;
+    }
+    for (int h = 0; h < height; h++) {
+        kernels->shift16_row(dst, src, width, shift);
+        dst += width;
+        src += src_stride;
+    }
+}
+
+void QCamxImageKernels::convert_yuv420(uint8_t *dst, Yuv420Layout dst_layout,
+                                       const uint8_t *src, Yuv420Layout src_layout, int width,
+                                       int height, size_t stride, int slice) {
+    const ImageKernelTable *kernels = get_kernels();
+    pack_plane(dst, src, width, height, stride);
+
+    size_t chroma_pairs = (width + 1) / 2;
+    int chroma_rows = (height + 1) / 2;
+    const uint8_t *src_chroma = src + stride * slice;
+    uint8_t *dst_chroma = dst + (size_t)width * height;
+    if (dst_layout == src_layout) {
+        pack_plane(dst_chroma, src_chroma, chroma_pairs * 2, chroma_rows, stride);
+    } else if (dst_layout == YUV420_I420) {
+        uint8_t *dst_u = dst_chroma;
+        uint8_t *dst_v = dst_chroma + chroma_pairs * chroma_rows;
+        uint8_t *dst0 = src_layout == YUV420_NV12 ? dst_u : dst_v;
+        uint8_t *dst1 = src_layout == YUV420_NV12 ? dst_v : dst_u;
+        for (int h = 0; h < chroma_rows; h++) {
+            kernels->split_pairs_row(dst0, dst1, src_chroma, chroma_pairs);
+            dst0 += chroma_pairs;
+            dst1 += chroma_pairs;
+            src_chroma += stride;
+        }
+    } else {
+        // NV12 <-> NV21
+        for (int h = 0; h < chroma_rows; h++) {
+            kernels->swap_pairs_row(dst_chroma, src_chroma, chroma_pairs);
+            dst_chroma += chroma_pairs * 2;
+            src_chroma += stride;
+        }
+    }
+}
+
+int QCamxImageKernels::unpack_mipi_raw(uint16_t *dst, const uint8_t *src, int bits, int width,
+                                       int height, size_t src_stride) {
+    if (bits != 10 && bits != 12) {
+        QCAMX_ERR("unsupported raw bits:%d\n", bits);
+        return -1;
+    }
+    UnpackJob job;
+    job.kernels = get_kernels();
+    job.dst = dst;
+    job.src = src;
+    job.bits = bits;
+    job.width = width;
+    job.height = height;
+    job.src_stride = src_stride;
+    // the vector loads may read into the stride padding, but never into the next row
+    job.src_row_bytes = src_stride;
+
+    // the lock only hands the pool out, the pool serializes the runs itself
+    pthread_mutex_lock(&s_pool_lock);
+    QCamxWorkerPool *pool = s_pool;
+    if (pool != NULL) {
+        s_pool_users++;
+    }
+    pthread_mutex_unlock(&s_pool_lock);
+    int threads = pool != NULL ? pool->get_thread_count() : 1;
+    // a few bands per thread, so a late thread does not hold up the frame
+    int bands = threads > 1 ? threads * 4 : 1;
+    if (bands > height) {
+        bands = height > 0 ? height : 1;
+    }
+    job.rows_per_band = (height + bands - 1) / bands;
+    if (pool != NULL) {
+        pool->run(unpack_band, &job, bands);
+    } else {
+        unpack_band(&job, 0);
+    }
+    if (pool != NULL) {
+        pthread_mutex_lock(&s_pool_lock);
+        if (--s_pool_users == 0) {
+            pthread_cond_broadcast(&s_pool_cond);
+        }
+        pthread_mutex_unlock(&s_pool_lock);
+    }
+    return 0;
+}
+
+void QCamxImageKernels::accumulate_luma_stats(const uint8_t *row, const uint8_t *next, int width,
+                                              LumaStats *stats) {
+    get_kernels()->luma_stats_row(row, next, width, stats);
+}
+
+void QCamxImageKernels::set_worker_threads(int num_threads) {
+    pthread_mutex_lock(&s_pool_lock);
+    if (s_pool != NULL) {
+        // new unpacks run on the calling thread meanwhile, the running ones finish on the pool
+        QCamxWorkerPool *pool = s_pool;
+        s_pool = NULL;
+        while (s_pool_users > 0) {
+            pthread_cond_wait(&s_pool_cond, &s_pool_lock);
+        }
+        delete pool;
+    }
+    if (num_threads > 1) {
+        s_pool = new QCamxWorkerPool();
+        s_pool->start(num_threads);
+    }
+    pthread_mutex_unlock(&s_pool_lock);
+}
+
+ImageKernelIsa QCamxImageKernels::get_isa() {
+    return get_kernels()->isa;
+}
+
+const char *QCamxImageKernels::get_isa_name(ImageKernelIsa isa) {
+    switch (isa) {
+        case IMAGE_KERNEL_SCALAR:
+            return "scalar";
+        case IMAGE_KERNEL_SSE2:
+            return "sse2";
+        case IMAGE_KERNEL_AVX2:
+            return "avx2";
+        case IMAGE_KERNEL_NEON:
+            return "neon";
+    }
+    return "unknown";
+}
+
+bool QCamxImageKernels::select_isa(ImageKernelIsa isa) {
+    const ImageKernelTable *kernels = find_kernels(isa);
+    if (kernels == NULL) {
+        return false;
+    }
+    s_kernels.store(kernels, std::memory_order_release);
+    return true;
+}
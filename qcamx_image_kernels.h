@@ -0,0 +1,94 @@
+/**
+ * @file  qcamx_image_kernels.h
+ * @brief plane packing, yuv420 layout, raw unpack and luma statistics kernels
+ *        every kernel has a NEON, SSE2 and AVX2 path and a scalar fallback,
+ *        the best path of the running cpu is selected on first use
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    IMAGE_KERNEL_SCALAR = 0,
+    IMAGE_KERNEL_SSE2 = 1,
+    IMAGE_KERNEL_AVX2 = 2,
+    IMAGE_KERNEL_NEON = 3,
+} ImageKernelIsa;
+
+// luma at or beyond these levels counts as clipped
+#define LUMA_CLIP_LOW (4)
+#define LUMA_CLIP_HIGH (251)
+
+typedef enum {
+    YUV420_NV12 = 0,  ///< Y plane, then interleaved UV
+    YUV420_NV21 = 1,  ///< Y plane, then interleaved VU
+    YUV420_I420 = 2,  ///< Y plane, U plane, V plane
+} Yuv420Layout;
+
+// sums over the luma rows handed to QCamxImageKernels::accumulate_luma_stats
+struct LumaStats {
+    uint64_t sum;       ///< luma of all pixels
+    uint64_t clipped;   ///< pixels at or below LUMA_CLIP_LOW or at or above LUMA_CLIP_HIGH
+    uint64_t gradient;  ///< squared differences to the right and the lower neighbour
+};
+
+class QCamxImageKernels {
+public:
+    /**
+     * @brief copy a plane without the stride padding, one bulk copy if it has none
+     * @param row_bytes bytes kept of every row
+     * @param src_stride bytes between two rows of src
+    */
+    static void pack_plane(uint8_t *dst, const uint8_t *src, size_t row_bytes, int rows,
+                           size_t src_stride);
+    /**
+     * @brief pack a 16 bit plane (Y16, RAW16), samples are shifted right by shift bits
+     * @param src_stride bytes between two rows of src
+    */
+    static void pack_16bit(uint16_t *dst, const uint8_t *src, int width, int height,
+                           size_t src_stride, int shift = 0);
+    /**
+     * @brief pack a semi planar yuv420 frame into a tightly packed frame of another layout
+     * @param src_layout YUV420_NV12 or YUV420_NV21
+     * @param stride bytes between two rows of both src planes
+     * @param slice rows of the src Y plane including its padding
+    */
+    static void convert_yuv420(uint8_t *dst, Yuv420Layout dst_layout, const uint8_t *src,
+                               Yuv420Layout src_layout, int width, int height, size_t stride,
+                               int slice);
+    /**
+     * @brief bytes of a tightly packed yuv420 frame
+    */
+    static size_t get_yuv420_size(int width, int height) {
+        return (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    }
+    /**
+     * @brief unpack MIPI RAW10/RAW12 to one pixel per 16 bit, bands of rows run on the workers
+     * @param bits 10 or 12
+     * @param src_stride bytes between two rows of src
+     * @return -1 if bits is not supported
+    */
+    static int unpack_mipi_raw(uint16_t *dst, const uint8_t *src, int bits, int width, int height,
+                               size_t src_stride);
+    /**
+     * @brief threads the row bands of the unpack are spread over, 1 runs on the caller only
+    */
+    static void set_worker_threads(int num_threads);
+    /**
+     * @brief add one luma row to stats
+     * @param next row below, gives the vertical gradients, width pixels of it are read
+    */
+    static void accumulate_luma_stats(const uint8_t *row, const uint8_t *next, int width,
+                                      LumaStats *stats);
+    static ImageKernelIsa get_isa();
+    static const char *get_isa_name(ImageKernelIsa isa);
+    /**
+     * @brief force a path, mostly to compare them
+     * @return false if the cpu or the build does not support it
+    */
+    static bool select_isa(ImageKernelIsa isa);
+private:
+    QCamxImageKernels() = delete;
+};
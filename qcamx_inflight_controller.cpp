@@ -0,0 +1,136 @@
+/**
+ * @file  qcamx_inflight_controller.cpp
+ * @brief adaptive in-flight request limit implementation
+*/
+
+#include "qcamx_inflight_controller.h"
+
+#include <inttypes.h>
+
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxInflightController"
+
+QCamxInflightController::QCamxInflightController() {
+    reset(INFLIGHT_CONTROL_OFF, 30, INFLIGHT_LIMIT_MIN);
+}
+
+/*************************public method*****************************/
+
+void QCamxInflightController::reset(int mode, int target_fps, int max_limit) {
+    _mode = mode;
+    _target_fps = target_fps > 0 ? target_fps : 30;
+    _max_limit = max_limit;
+    _min_limit = max_limit < INFLIGHT_LIMIT_MIN ? max_limit : INFLIGHT_LIMIT_MIN;
+    // start from the fixed limit, throughput first, then probe downwards
+    _limit = max_limit;
+    _complete_count = 0;
+    _latency_total_ns = 0;
+    _limit_hit_count = 0;
+
+    _window_ns = (nsecs_t)INFLIGHT_WINDOW_FRAMES * 1000000000LL / _target_fps;
+    if (_window_ns < (nsecs_t)INFLIGHT_WINDOW_MIN_MS * 1000000LL) {
+        _window_ns = (nsecs_t)INFLIGHT_WINDOW_MIN_MS * 1000000LL;
+    }
+    _window_start = systemTime();
+    _last_empty_wait_count = 0;
+    _last_action = ACTION_NONE;
+    _last_fps = 0;
+    _last_latency_us = 0;
+    _hold_windows = 0;
+    _change_count = 0;
+    if (is_enabled()) {
+        QCAMX_PRINT("inflight control mode:%d target fps:%d limit:[%d,%d]\n", _mode, _target_fps,
+                    _min_limit, _max_limit);
+    }
+}
+
+void QCamxInflightController::update(uint64_t empty_wait_count) {
+    if (!is_enabled()) {
+        return;
+    }
+    nsecs_t now = systemTime();
+    nsecs_t elapsed = now - _window_start;
+    if (elapsed < _window_ns) {
+        return;
+    }
+    _window_start = now;
+    uint64_t frames = _complete_count.exchange(0, std::memory_order_relaxed);
+    uint64_t latency_total_ns = _latency_total_ns.exchange(0, std::memory_order_relaxed);
+    uint64_t limit_hits = _limit_hit_count.exchange(0, std::memory_order_relaxed);
+    uint64_t starved = empty_wait_count - _last_empty_wait_count;
+    _last_empty_wait_count = empty_wait_count;
+    if (frames == 0) {
+        // nothing requested or the HAL stalled, the limit is not the problem
+        _last_action = ACTION_NONE;
+        return;
+    }
+
+    double fps = (double)frames * 1e9 / (double)elapsed;
+    uint64_t latency_us = latency_total_ns / frames / 1000;
+    bool fps_ok = fps >= _target_fps * 0.95;
+    int limit = _limit.load(std::memory_order_relaxed);
+    int new_limit = limit;
+    Action action = ACTION_NONE;
+    const char *reason = "hold";
+    if (_hold_windows > 0) {
+        _hold_windows--;
+    }
+
+    if (starved > 0 && limit > _min_limit) {
+        // requests beyond the pool only block in get_buffer and add latency
+        new_limit = limit - 1;
+        reason = "pool starved";
+        _hold_windows = INFLIGHT_HOLD_WINDOWS;
+    } else if (!fps_ok) {
+        if (_last_action == ACTION_GROW && fps <= _last_fps * 1.02) {
+            // the sensor or the HAL is the bottleneck, a deeper queue only adds latency
+            new_limit = limit - 1;
+            reason = "no fps gain";
+            _hold_windows = INFLIGHT_HOLD_WINDOWS;
+        } else if (limit_hits > 0 && limit < _max_limit) {
+            new_limit = limit + 1;
+            action = ACTION_GROW;
+            reason = "fps below target";
+            if (_last_action == ACTION_SHRINK) {
+                // the last shrink went too far, settle here
+                _hold_windows = INFLIGHT_HOLD_WINDOWS;
+            }
+        }
+    } else if (_last_action == ACTION_SHRINK && latency_us >= _last_latency_us * 0.98) {
+        // latency comes from the pipeline itself now, the queue is already minimal
+        reason = "latency settled";
+        _hold_windows = INFLIGHT_HOLD_WINDOWS;
+    } else if (_hold_windows == 0 && limit > _min_limit) {
+        new_limit = limit - 1;
+        action = ACTION_SHRINK;
+        reason = "probe lower latency";
+    }
+
+    if (_mode == INFLIGHT_CONTROL_LOG) {
+        QCAMX_PRINT("inflight limit:%d->%d fps:%.1f/%d latency:%" PRIu64 "us starved:%" PRIu64
+                    " limit hits:%" PRIu64 " %s\n",
+                    limit, new_limit, fps, _target_fps, latency_us, starved, limit_hits, reason);
+    } else if (new_limit != limit) {
+        QCAMX_INFO("inflight limit:%d->%d fps:%.1f latency:%" PRIu64 "us %s\n", limit, new_limit,
+                   fps, latency_us, reason);
+    }
+    if (new_limit != limit) {
+        _limit.store(new_limit, std::memory_order_relaxed);
+        _change_count++;
+    }
+    _last_action = action;
+    _last_fps = fps;
+    _last_latency_us = latency_us;
+}
+
+void QCamxInflightController::report() {
+    if (!is_enabled()) {
+        return;
+    }
+    QCAMX_PRINT("inflight control settled limit:%d range:[%d,%d] changes:%d\n", get_limit(),
+                _min_limit, _max_limit, _change_count);
+}
@@ -0,0 +1,88 @@
+/**
+ * @file  qcamx_inflight_controller.h
+ * @brief adaptive in-flight request limit
+ *        holds the requested frame rate with the fewest requests queued in the HAL
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <utils/Timers.h>
+
+#include <atomic>
+
+#define INFLIGHT_LIMIT_MIN (2)
+#define INFLIGHT_WINDOW_MIN_MS (500)  // a decision window is at least this long
+#define INFLIGHT_WINDOW_FRAMES (15)   // and at least this many frame periods of the target fps
+#define INFLIGHT_HOLD_WINDOWS (20)    // windows to keep a settled limit before probing again
+
+typedef enum {
+    INFLIGHT_CONTROL_OFF = 0,  ///< fixed limit chosen by the test case
+    INFLIGHT_CONTROL_ON = 1,   ///< adjust the limit, log only the changes
+    INFLIGHT_CONTROL_LOG = 2,  ///< adjust the limit, log every decision window
+} InflightControlMode;
+
+class QCamxInflightController {
+public:
+    QCamxInflightController();
+    ~QCamxInflightController() {}
+public:
+    /**
+     * @brief restart the controller before streaming
+     * @param target_fps frame rate to hold, the upper bound of the requested fps range
+     * @param max_limit fixed limit of the test case, also the starting limit
+    */
+    void reset(int mode, int target_fps, int max_limit);
+    bool is_enabled() { return _mode != INFLIGHT_CONTROL_OFF; }
+    int get_limit() { return _limit.load(std::memory_order_relaxed); }
+    /**
+     * @brief account one completed request, called by the HAL callback
+    */
+    void record_complete(nsecs_t latency) {
+        _complete_count.fetch_add(1, std::memory_order_relaxed);
+        _latency_total_ns.fetch_add((uint64_t)latency, std::memory_order_relaxed);
+    }
+    /**
+     * @brief request thread had a request ready but the limit was reached
+    */
+    void record_limit_hit() { _limit_hit_count.fetch_add(1, std::memory_order_relaxed); }
+    /**
+     * @brief evaluate the last window once it elapsed, called by the result thread
+     * @param empty_wait_count total times a buffer pool was found empty
+    */
+    void update(uint64_t empty_wait_count);
+    /**
+     * @brief print the settled limit when the streams stop
+    */
+    void report();
+private:
+    typedef enum {
+        ACTION_NONE = 0,
+        ACTION_GROW,
+        ACTION_SHRINK,
+    } Action;
+    // Do not support the copy constructor or assignment operator
+    QCamxInflightController(const QCamxInflightController &) = delete;
+    QCamxInflightController &operator=(const QCamxInflightController &) = delete;
+private:
+    int _mode;
+    int _target_fps;
+    int _min_limit;
+    int _max_limit;
+    std::atomic<int> _limit;  ///< read by the request thread on every request
+
+    // current window, written by the callback and request threads
+    std::atomic<uint64_t> _complete_count;
+    std::atomic<uint64_t> _latency_total_ns;
+    std::atomic<uint64_t> _limit_hit_count;
+
+    // decision state, only touched by the result thread
+    nsecs_t _window_ns;
+    nsecs_t _window_start;
+    uint64_t _last_empty_wait_count;
+    Action _last_action;
+    double _last_fps;
+    uint64_t _last_latency_us;
+    int _hold_windows;
+    int _change_count;
+};
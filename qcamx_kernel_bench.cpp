@@ -0,0 +1,117 @@
+/**
+ * @file  qcamx_kernel_bench.cpp
+ * @brief measure the MIPI RAW10/RAW12 unpack of 12MP and 48MP frames for every kernel path
+ *        and thread count
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "qcamx_image_kernels.h"
+
+struct BenchSensor {
+    const char *name;
+    int width;
+    int height;
+};
+
+static const BenchSensor bench_sensors[] = {
+    {"12MP", 4000, 3000},
+    {"48MP", 8000, 6000},
+};
+
+static const ImageKernelIsa bench_isas[] = {
+    IMAGE_KERNEL_SCALAR,
+    IMAGE_KERNEL_SSE2,
+    IMAGE_KERNEL_AVX2,
+    IMAGE_KERNEL_NEON,
+};
+
+static const char usage[] = "\
+usage: qcamx-kernel-bench [-n iterations] [-t max threads] \n\
+  -n: unpacks measured per case, default 20 \n\
+  -t: largest thread count, default the online cpus \n\
+";
+
+static double get_time_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 20;
+    int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int c;
+    while ((c = getopt(argc, argv, "hn:t:")) != -1) {
+        switch (c) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 't':
+                max_threads = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    if (iterations <= 0 || max_threads <= 0) {
+        printf("%s", usage);
+        return 1;
+    }
+    std::vector<int> thread_counts;
+    for (int n = 1; n < max_threads; n *= 2) {
+        thread_counts.push_back(n);
+    }
+    thread_counts.push_back(max_threads);
+
+    printf("%-5s %-5s %-6s %-7s %10s %10s %12s\n", "size", "bits", "isa", "threads", "ms/frame",
+           "GB/s", "GB/s/core");
+    for (size_t s = 0; s < sizeof(bench_sensors) / sizeof(bench_sensors[0]); s++) {
+        const BenchSensor &sensor = bench_sensors[s];
+        for (int bits = 10; bits <= 12; bits += 2) {
+            // MIPI rows, 4 or 2 pixels in 5 or 3 bytes, padded like the HAL does
+            size_t row_bytes = (size_t)sensor.width * bits / 8;
+            size_t stride = (row_bytes + 15) & ~(size_t)15;
+            std::vector<uint8_t> src(stride * sensor.height);
+            for (size_t i = 0; i < src.size(); i++) {
+                src[i] = (uint8_t)(i * 131 + 7);
+            }
+            std::vector<uint16_t> dst((size_t)sensor.width * sensor.height);
+            // bytes read and written by one unpack
+            double frame_bytes = (double)row_bytes * sensor.height + dst.size() * sizeof(uint16_t);
+
+            for (size_t k = 0; k < sizeof(bench_isas) / sizeof(bench_isas[0]); k++) {
+                if (!QCamxImageKernels::select_isa(bench_isas[k])) {
+                    continue;
+                }
+                for (size_t t = 0; t < thread_counts.size(); t++) {
+                    int threads = thread_counts[t];
+                    QCamxImageKernels::set_worker_threads(threads);
+                    // warm the pages and the workers up
+                    QCamxImageKernels::unpack_mipi_raw(dst.data(), src.data(), bits, sensor.width,
+                                                       sensor.height, stride);
+                    double begin = get_time_sec();
+                    for (int i = 0; i < iterations; i++) {
+                        QCamxImageKernels::unpack_mipi_raw(dst.data(), src.data(), bits,
+                                                           sensor.width, sensor.height, stride);
+                    }
+                    double elapsed = get_time_sec() - begin;
+                    double gbps = frame_bytes * iterations / elapsed / 1e9;
+                    printf("%-5s %-5d %-6s %-7d %10.2f %10.2f %12.2f\n", sensor.name, bits,
+                           QCamxImageKernels::get_isa_name(bench_isas[k]), threads,
+                           elapsed * 1000 / iterations, gbps, gbps / threads);
+                }
+            }
+        }
+    }
+    QCamxImageKernels::set_worker_threads(1);
+    return 0;
+}
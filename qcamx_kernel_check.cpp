@@ -0,0 +1,254 @@
+/**
+ * @file  qcamx_kernel_check.cpp
+ * @brief run every image kernel on the SSE2, AVX2 and NEON paths the cpu supports and fail if
+ *        one result differs from the scalar path, over odd sizes, row tails and tight strides
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "qcamx_image_kernels.h"
+
+struct CheckSize {
+    int width;
+    int height;
+};
+
+// odd widths leave a tail after every vector width, 1 and 2 have no full vector at all
+static const CheckSize check_sizes[] = {
+    {1, 1},     {2, 3},     {3, 2},    {7, 5},     {15, 4},    {16, 4},     {17, 3},
+    {31, 7},    {33, 9},    {63, 2},   {64, 2},    {65, 3},    {127, 5},    {129, 6},
+    {255, 3},   {257, 4},   {641, 11}, {1280, 16}, {1921, 13}, {4000, 8},   {4056, 7},
+};
+
+static const ImageKernelIsa check_isas[] = {
+    IMAGE_KERNEL_SSE2,
+    IMAGE_KERNEL_AVX2,
+    IMAGE_KERNEL_NEON,
+};
+
+static const char usage[] = "\
+usage: qcamx-kernel-check [-r rounds] [-s seed] [-t threads] \n\
+  -r: rounds over all sizes with new random pixels, default 4 \n\
+  -s: seed of the random pixels, default 1 \n\
+  -t: worker threads of the raw unpack, default 4 \n\
+";
+
+static uint32_t s_seed = 1;
+
+static uint32_t get_random() {
+    // xorshift32, the same pixels for the same seed on every cpu
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 17;
+    s_seed ^= s_seed << 5;
+    return s_seed;
+}
+
+static void fill_random(std::vector<uint8_t> &buffer) {
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = (uint8_t)get_random();
+    }
+}
+
+/**
+ * @brief run one kernel case on the scalar path and on every vector path, compare the outputs
+ * @param run fills out from the shared input on the selected path
+ * @return number of vector paths that differ
+*/
+template <typename T, typename Run>
+static int check_case(const char *name, const CheckSize &size, size_t out_size, Run run,
+                      int *checked) {
+    std::vector<T> expected(out_size);
+    std::vector<T> actual(out_size);
+    QCamxImageKernels::select_isa(IMAGE_KERNEL_SCALAR);
+    run(expected.data());
+    int failures = 0;
+    for (size_t k = 0; k < sizeof(check_isas) / sizeof(check_isas[0]); k++) {
+        if (!QCamxImageKernels::select_isa(check_isas[k])) {
+            continue;
+        }
+        // poison the output so a skipped write shows up
+        memset(actual.data(), 0xa5, out_size * sizeof(T));
+        run(actual.data());
+        (*checked)++;
+        if (memcmp(expected.data(), actual.data(), out_size * sizeof(T)) == 0) {
+            continue;
+        }
+        size_t at = 0;
+        while (at < out_size && expected[at] == actual[at]) {
+            at++;
+        }
+        printf("MISMATCH %s %s %dx%d: element %zu is %u, scalar %u\n", name,
+               QCamxImageKernels::get_isa_name(check_isas[k]), size.width, size.height, at,
+               (unsigned)actual[at], (unsigned)expected[at]);
+        failures++;
+    }
+    return failures;
+}
+
+static int check_pack_plane(const CheckSize &size, int *checked) {
+    int failures = 0;
+    for (int pad = 0; pad <= 64; pad += 64) {
+        size_t stride = size.width + pad;
+        std::vector<uint8_t> src(stride * size.height);
+        fill_random(src);
+        failures += check_case<uint8_t>(
+            "pack_plane", size, (size_t)size.width * size.height,
+            [&](uint8_t *dst) {
+                QCamxImageKernels::pack_plane(dst, src.data(), size.width, size.height, stride);
+            },
+            checked);
+    }
+    return failures;
+}
+
+static int check_pack_16bit(const CheckSize &size, int *checked) {
+    int failures = 0;
+    for (int pad = 0; pad <= 32; pad += 32) {
+        size_t stride = (size_t)size.width * 2 + pad;
+        std::vector<uint8_t> src(stride * size.height);
+        fill_random(src);
+        for (int shift = 0; shift <= 6; shift += 2) {
+            failures += check_case<uint16_t>(
+                "pack_16bit", size, (size_t)size.width * size.height,
+                [&](uint16_t *dst) {
+                    QCamxImageKernels::pack_16bit(dst, src.data(), size.width, size.height,
+                                                  stride, shift);
+                },
+                checked);
+        }
+    }
+    return failures;
+}
+
+static int check_convert_yuv420(const CheckSize &size, int *checked) {
+    static const Yuv420Layout src_layouts[] = {YUV420_NV12, YUV420_NV21};
+    static const Yuv420Layout dst_layouts[] = {YUV420_NV12, YUV420_NV21, YUV420_I420};
+    static const char *const names[] = {"convert nv12", "convert nv21"};
+    // the chroma rows of an odd width carry a whole last pair
+    size_t row_bytes = (size_t)(size.width + 1) / 2 * 2;
+    int failures = 0;
+    for (int pad = 0; pad <= 64; pad += 64) {
+        size_t stride = row_bytes + pad;
+        int slice = size.height + pad / 16;
+        std::vector<uint8_t> src(stride * slice + stride * ((size.height + 1) / 2));
+        fill_random(src);
+        for (size_t s = 0; s < sizeof(src_layouts) / sizeof(src_layouts[0]); s++) {
+            for (size_t d = 0; d < sizeof(dst_layouts) / sizeof(dst_layouts[0]); d++) {
+                failures += check_case<uint8_t>(
+                    names[s], size, QCamxImageKernels::get_yuv420_size(size.width, size.height),
+                    [&](uint8_t *dst) {
+                        QCamxImageKernels::convert_yuv420(dst, dst_layouts[d], src.data(),
+                                                          src_layouts[s], size.width, size.height,
+                                                          stride, slice);
+                    },
+                    checked);
+            }
+        }
+    }
+    return failures;
+}
+
+static int check_unpack_raw(const CheckSize &size, int bits, int threads, int *checked) {
+    const char *name = bits == 10 ? "unpack raw10" : "unpack raw12";
+    // tight rows end the buffer on the last packed byte, vector loads must not run past it
+    size_t row_bytes = ((size_t)size.width * bits + 7) / 8;
+    int failures = 0;
+    for (int pad = 0; pad <= 16; pad += 16) {
+        size_t stride = row_bytes + pad;
+        std::vector<uint8_t> src(stride * size.height);
+        fill_random(src);
+        for (int t = 1; t <= threads; t = t < threads ? threads : threads + 1) {
+            QCamxImageKernels::set_worker_threads(t);
+            failures += check_case<uint16_t>(
+                name, size, (size_t)size.width * size.height,
+                [&](uint16_t *dst) {
+                    QCamxImageKernels::unpack_mipi_raw(dst, src.data(), bits, size.width,
+                                                       size.height, stride);
+                },
+                checked);
+        }
+    }
+    QCamxImageKernels::set_worker_threads(1);
+    return failures;
+}
+
+static int check_luma_stats(const CheckSize &size, int *checked) {
+    std::vector<uint8_t> src((size_t)size.width * (size.height + 1));
+    fill_random(src);
+    // clip some pixels, random bytes rarely reach both ends
+    for (size_t i = 0; i < src.size(); i += 7) {
+        src[i] = i % 2 ? 255 : 0;
+    }
+    return check_case<uint64_t>(
+        "luma_stats", size, sizeof(LumaStats) / sizeof(uint64_t),
+        [&](uint64_t *out) {
+            LumaStats stats = {};
+            for (int y = 0; y < size.height; y++) {
+                const uint8_t *row = src.data() + (size_t)y * size.width;
+                QCamxImageKernels::accumulate_luma_stats(row, row + size.width, size.width,
+                                                         &stats);
+            }
+            memcpy(out, &stats, sizeof(stats));
+        },
+        checked);
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = 4;
+    int threads = 4;
+    int c;
+    while ((c = getopt(argc, argv, "hr:s:t:")) != -1) {
+        switch (c) {
+            case 'r':
+                rounds = atoi(optarg);
+                break;
+            case 's':
+                s_seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    if (rounds <= 0 || threads <= 0 || s_seed == 0) {
+        printf("%s", usage);
+        return 1;
+    }
+
+    ImageKernelIsa best = QCamxImageKernels::get_isa();
+    printf("vector paths:");
+    for (size_t k = 0; k < sizeof(check_isas) / sizeof(check_isas[0]); k++) {
+        if (QCamxImageKernels::select_isa(check_isas[k])) {
+            printf(" %s", QCamxImageKernels::get_isa_name(check_isas[k]));
+        }
+    }
+    printf("\n");
+
+    int failures = 0;
+    int checked = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (size_t s = 0; s < sizeof(check_sizes) / sizeof(check_sizes[0]); s++) {
+            const CheckSize &size = check_sizes[s];
+            failures += check_pack_plane(size, &checked);
+            failures += check_pack_16bit(size, &checked);
+            failures += check_convert_yuv420(size, &checked);
+            failures += check_unpack_raw(size, 10, threads, &checked);
+            failures += check_unpack_raw(size, 12, threads, &checked);
+            failures += check_luma_stats(size, &checked);
+        }
+    }
+    QCamxImageKernels::select_isa(best);
+
+    printf("%d of %d comparisons against the scalar path differ\n", failures, checked);
+    // no vector path on this cpu compares nothing, that is not a pass
+    return failures == 0 && checked > 0 ? 0 : 1;
+}
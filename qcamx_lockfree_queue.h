@@ -0,0 +1,115 @@
+/**
+ * @file  qcamx_lockfree_queue.h
+ * @brief bounded lock-free multi-producer/multi-consumer queue
+ *        (sequence numbered ring, one CAS per push/pop)
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#define QCAMX_CACHE_LINE_SIZE (64)
+
+template <typename T, size_t kCapacity>
+class QCamxLockFreeQueue {
+    static_assert(kCapacity >= 2 && (kCapacity & (kCapacity - 1)) == 0,
+                  "QCamxLockFreeQueue capacity must be a power of two");
+public:
+    QCamxLockFreeQueue() { reset(); }
+public:
+    /**
+     * @brief push one item, never blocks
+     * @return false when the queue is full, or transiently while a preempted consumer
+     *         still owns the cell one lap ahead
+    */
+    bool push(const T &data) {
+        size_t pos;
+        Cell *cell = acquire_push_cell(&pos);
+        if (cell == NULL) {
+            return false;
+        }
+        cell->data = data;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    /**
+     * @brief pop one item, never blocks
+     * @return false when the queue is empty
+    */
+    bool pop(T &data) {
+        Cell *cell;
+        size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &_cells[pos & kMask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        data = cell->data;
+        cell->sequence.store(pos + kMask + 1, std::memory_order_release);
+        return true;
+    }
+    /**
+     * @brief approximate number of queued items
+    */
+    size_t size() const {
+        size_t enqueue_pos = _enqueue_pos.load(std::memory_order_acquire);
+        size_t dequeue_pos = _dequeue_pos.load(std::memory_order_acquire);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+    /**
+     * @brief drop all items, only safe while no other thread uses the queue
+    */
+    void reset() {
+        for (size_t i = 0; i < kCapacity; i++) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        _enqueue_pos.store(0, std::memory_order_relaxed);
+        _dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+    static constexpr size_t capacity() { return kCapacity; }
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    Cell *acquire_push_cell(size_t *push_pos) {
+        Cell *cell;
+        size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &_cells[pos & kMask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return NULL;
+            } else {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        *push_pos = pos;
+        return cell;
+    }
+    // Do not support the copy constructor or assignment operator
+    QCamxLockFreeQueue(const QCamxLockFreeQueue &) = delete;
+    QCamxLockFreeQueue &operator=(const QCamxLockFreeQueue &) = delete;
+private:
+    static constexpr size_t kMask = kCapacity - 1;
+    Cell _cells[kCapacity];
+    alignas(QCAMX_CACHE_LINE_SIZE) std::atomic<size_t> _enqueue_pos;
+    alignas(QCAMX_CACHE_LINE_SIZE) std::atomic<size_t> _dequeue_pos;
+};
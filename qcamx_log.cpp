@@ -1,6 +1,12 @@
 
 #include "qcamx_log.h"
 
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 namespace qcamx {
 
 #ifdef LOG_TAG
@@ -10,75 +16,371 @@ namespace qcamx {
 
 #define LOG_LENGHT 256
 
+#define LOG_MODULE_MAX 64
+#define LOG_RULE_MAX 32
+#define LOG_TAG_LENGTH 32
+
+// level configured for a tag, applied to its module when it registers
+typedef struct _log_rule {
+    char tag[LOG_TAG_LENGTH];
+    int level;
+} LogRule;
+
+static pthread_mutex_t s_log_module_lock = PTHREAD_MUTEX_INITIALIZER;
+static QCamxLogModule s_log_modules[LOG_MODULE_MAX];
+static int s_log_module_count = 0;
+static LogRule s_log_rules[LOG_RULE_MAX];
+static int s_log_rule_count = 0;
+static int s_log_default_level = QCAMX_LOG_LEVEL_DEFAULT;
+static bool s_log_env_loaded = false;
+
+static int parse_log_level(const char *value, int *level) {
+    static const char *const names[] = {"off", "err", "info", "dbg"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(value, names[i]) == 0) {
+            *level = QCAMX_LOG_LEVEL_OFF + i;
+            return 0;
+        }
+    }
+    char *end = NULL;
+    long number = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || number < QCAMX_LOG_LEVEL_OFF ||
+        number > QCAMX_LOG_LEVEL_DBG) {
+        return -1;
+    }
+    *level = (int)number;
+    return 0;
+}
+
+static int find_log_rule(const char *tag) {
+    for (int i = 0; i < s_log_rule_count; i++) {
+        if (strcmp(s_log_rules[i].tag, tag) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief apply one "level" or "tag=level" entry, s_log_module_lock held
+ */
+static int apply_log_level(const char *entry) {
+    char tag[LOG_TAG_LENGTH] = "*";
+    const char *value = entry;
+    const char *equal = strchr(entry, '=');
+    if (equal != NULL) {
+        size_t length = equal - entry;
+        if (length == 0 || length >= LOG_TAG_LENGTH) {
+            return -1;
+        }
+        memcpy(tag, entry, length);
+        tag[length] = '\0';
+        value = equal + 1;
+    }
+    int level = 0;
+    if (parse_log_level(value, &level) != 0) {
+        return -1;
+    }
+
+    if (strcmp(tag, "*") == 0) {
+        // every module without a level of its own
+        s_log_default_level = level;
+        for (int i = 0; i < s_log_module_count; i++) {
+            if (find_log_rule(s_log_modules[i].tag) < 0) {
+                s_log_modules[i].level.store(level, std::memory_order_relaxed);
+            }
+        }
+        return 0;
+    }
+    int rule = find_log_rule(tag);
+    if (rule < 0) {
+        if (s_log_rule_count == LOG_RULE_MAX) {
+            return -1;
+        }
+        rule = s_log_rule_count++;
+        strcpy(s_log_rules[rule].tag, tag);
+    }
+    s_log_rules[rule].level = level;
+    for (int i = 0; i < s_log_module_count; i++) {
+        if (strcmp(s_log_modules[i].tag, tag) == 0) {
+            s_log_modules[i].level.store(level, std::memory_order_relaxed);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief apply a comma separated list of entries, s_log_module_lock held
+ */
+static int apply_log_levels(const char *spec) {
+    char entry[LOG_TAG_LENGTH + 8];
+    const char *begin = spec;
+    while (*begin != '\0') {
+        const char *end = strchr(begin, ',');
+        size_t length = end != NULL ? (size_t)(end - begin) : strlen(begin);
+        if (length >= sizeof(entry)) {
+            return -1;
+        }
+        memcpy(entry, begin, length);
+        entry[length] = '\0';
+        if (length > 0 && apply_log_level(entry) != 0) {
+            return -1;
+        }
+        begin += end != NULL ? length + 1 : length;
+    }
+    return 0;
+}
+
+static void load_log_env() {
+    if (s_log_env_loaded) {
+        return;
+    }
+    s_log_env_loaded = true;
+    const char *spec = getenv("QCAMX_LOG_LEVEL");
+    if (spec != NULL && apply_log_levels(spec) != 0) {
+        fprintf(stderr, "QCAMX_LOG_LEVEL=%s malformed, use tag=off|err|info|dbg,...\n", spec);
+    }
+}
+
+QCamxLogModule *get_log_module(const char *tag) {
+    if (tag == NULL) {
+        tag = "";
+    }
+    pthread_mutex_lock(&s_log_module_lock);
+    load_log_env();
+    QCamxLogModule *module = NULL;
+    for (int i = 0; i < s_log_module_count && module == NULL; i++) {
+        if (strcmp(s_log_modules[i].tag, tag) == 0) {
+            module = &s_log_modules[i];
+        }
+    }
+    if (module == NULL) {
+        // the last module is shared by the tags beyond the table
+        int index = s_log_module_count < LOG_MODULE_MAX ? s_log_module_count++ : LOG_MODULE_MAX - 1;
+        module = &s_log_modules[index];
+        if (module->tag == NULL) {
+            module->tag = tag;
+            int rule = find_log_rule(tag);
+            int level = rule >= 0 ? s_log_rules[rule].level : s_log_default_level;
+            module->level.store(level, std::memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&s_log_module_lock);
+    return module;
+}
+
+int set_log_levels(const char *spec) {
+    pthread_mutex_lock(&s_log_module_lock);
+    load_log_env();
+    int res = apply_log_levels(spec);
+    pthread_mutex_unlock(&s_log_module_lock);
+    return res;
+}
+
+QCamxLogRateLimiter::QCamxLogRateLimiter(int per_second, int burst) {
+    _interval_ns = 1000000000LL / (per_second > 0 ? per_second : 1);
+    _burst_ns = _interval_ns * (burst > 1 ? burst - 1 : 0);
+    _next_ns = 0;
+    _suppressed = 0;
+}
+
+bool QCamxLogRateLimiter::allow(uint32_t *suppressed) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t now = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    int64_t next = _next_ns.load(std::memory_order_relaxed);
+    int64_t update = 0;
+    do {
+        int64_t start = next > now ? next : now;
+        if (start - now > _burst_ns) {
+            // the bucket is empty
+            _suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        update = start + _interval_ns;
+    } while (!_next_ns.compare_exchange_weak(next, update, std::memory_order_relaxed));
+    uint32_t dropped = _suppressed.exchange(0, std::memory_order_relaxed);
+    if (suppressed != NULL) {
+        *suppressed = dropped;
+    }
+    return true;
+}
+
+/**
+ * @brief whether a path gets the binary records instead of their text
+ */
+static bool is_binary_path(const std::string &log_path) {
+    static const std::string suffix = ".qlog";
+    return log_path.size() > suffix.size() &&
+           log_path.compare(log_path.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
 void QCamxLog::set_path(std::string log_path) {
+    // the messages queued before go to the previous path
+    QCamxBinaryLog::get_instance()->flush();
+    pthread_mutex_lock(&_lock);
     if (log_path == "std") {
         _log_type = LOGTYPE_STDIO;
     } else if (log_path == "ALOGE") {
         _log_type = LOGTYPE_ALOGE;
     } else {
-        _log_type = LOGTYPE_FILE;
+        _log_type = is_binary_path(log_path) ? LOGTYPE_BINARY : LOGTYPE_FILE;
         if (log_path != _path) {
             _is_new_path = true;
             _path = log_path;
         }
     }
+    pthread_mutex_unlock(&_lock);
 }
 
-int QCamxLog::print(const char *format, ...) {
-    int res = 0;
-
-    char message[LOG_LENGHT];
-    va_list ap;
-    va_start(ap, format);
-    vsnprintf(message, LOG_LENGHT, format, ap);
-    va_end(ap);
-
+void QCamxLog::write_record(const BinaryLogRecord *record, const char *format) {
+    pthread_mutex_lock(&_lock);
+    if ((_log_type == LOGTYPE_FILE || _log_type == LOGTYPE_BINARY) && _is_new_path) {
+        open_new_path();
+    }
     switch (_log_type) {
-        case LOGTYPE_STDIO: {
-            printf("%s %s \n", _tag.c_str(), message);
+        case LOGTYPE_STDIO:
+        case LOGTYPE_FILE: {
+            char message[LOG_LENGHT];
+            format_binary_log_message(record, format, message, sizeof(message));
+            if (_batch_length + _tag.size() + LOG_LENGHT + 4 > sizeof(_batch)) {
+                write_batch();
+            }
+            const char *line_format = _log_type == LOGTYPE_STDIO ? "%s %s \n" : "%s %s";
+            _batch_length += snprintf(_batch + _batch_length, sizeof(_batch) - _batch_length,
+                                      line_format, _tag.c_str(), message);
             break;
         }
         case LOGTYPE_ALOGE: {
+            char message[LOG_LENGHT];
+            format_binary_log_message(record, format, message, sizeof(message));
             __android_log_write(ANDROID_LOG_INFO, _tag.c_str(), message);
             break;
         }
-        case LOGTYPE_FILE: {
-            if (_is_new_path) {
-                FILE *new_file_handle = fopen(_path.c_str(), "w+");
-                fclose(_file_handle);
-                _file_handle = new_file_handle;
-                _is_new_path = false;
-                printf("New QCamx log begin \n");
+        case LOGTYPE_BINARY: {
+            // the decoder meets the format of a message before the message
+            uint16_t id = record->format_id;
+            if ((_format_written[id / 8] & (1 << (id % 8))) == 0) {
+                write_definition(BINARY_LOG_FORMAT, id, format);
+                _format_written[id / 8] |= 1 << (id % 8);
             }
-            res = fprintf(_file_handle, "%s %s", _tag.c_str(), message);
+            write_bytes(record, record->size);
             break;
         }
         default:
             break;
     }
-    return res;
+    pthread_mutex_unlock(&_lock);
 }
 
-QCamxLog::QCamxLog() {}
+void QCamxLog::flush_batch() {
+    pthread_mutex_lock(&_lock);
+    if (_batch_length > 0) {
+        write_batch();
+        fflush(_log_type == LOGTYPE_STDIO ? stdout : _file_handle);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+QCamxLog::QCamxLog() {
+    init("std");
+    _tag = "";
+}
 
 QCamxLog::~QCamxLog() {
-    if (_log_type == LOGTYPE_FILE) {
+    // hands the queued messages over before the file goes
+    QCamxBinaryLog *binary_log = QCamxBinaryLog::get_instance();
+    binary_log->unregister_sink(_sink);
+    if (binary_log->get_dropped() > 0) {
+        QCAMX_ERR("binary log dropped %" PRIu64 " messages on full rings\n",
+                  binary_log->get_dropped());
+    }
+    pthread_mutex_lock(&_lock);
+    write_batch();
+    if (_file_handle != stderr) {
         fclose(_file_handle);
     }
     _is_new_path = false;
+    pthread_mutex_unlock(&_lock);
+    pthread_mutex_destroy(&_lock);
 }
 
 QCamxLog::QCamxLog(std::string log_path) {
+    init(log_path);
+    _tag = "[META] ";
+}
+
+void QCamxLog::init(std::string log_path) {
+    pthread_mutex_init(&_lock, NULL);
     _file_handle = stderr;
-    if (log_path.empty()) {
+    if (log_path.empty() || log_path == "std") {
         _log_type = LOGTYPE_STDIO;
         _is_new_path = false;
     } else {
-        _log_type = LOGTYPE_FILE;
+        _log_type = is_binary_path(log_path) ? LOGTYPE_BINARY : LOGTYPE_FILE;
         _is_new_path = true;
     }
     _path = log_path;
-    _tag = "[META] ";
+    _batch_length = 0;
+    memset(_format_written, 0, sizeof(_format_written));
+    _sink = QCamxBinaryLog::get_instance()->register_sink(this);
+}
+
+void QCamxLog::open_new_path() {
+    write_batch();
+    FILE *new_file_handle = fopen(_path.c_str(), _log_type == LOGTYPE_BINARY ? "wb" : "w+");
+    if (_file_handle != stderr) {
+        fclose(_file_handle);
+    }
+    _is_new_path = false;
+    if (new_file_handle == NULL) {
+        QCAMX_ERR("open log file %s failed, the log goes to stderr\n", _path.c_str());
+        _file_handle = stderr;
+        _log_type = LOGTYPE_FILE;
+        return;
+    }
+    _file_handle = new_file_handle;
+    printf("New QCamx log begin \n");
+    if (_log_type == LOGTYPE_BINARY) {
+        char magic[8] = BINARY_LOG_FILE_MAGIC;
+        write_bytes(magic, sizeof(magic));
+        write_definition(BINARY_LOG_TAG, 0, _tag.c_str());
+        memset(_format_written, 0, sizeof(_format_written));
+    }
+}
+
+void QCamxLog::write_definition(uint8_t kind, uint16_t id, const char *text) {
+    size_t length = strlen(text) + 1;
+    size_t padded = (length + 7) & ~(size_t)7;
+    BinaryLogRecord record;
+    memset(&record, 0, sizeof(record));
+    record.size = (uint16_t)(sizeof(record) + padded);
+    record.kind = kind;
+    record.sink = (uint16_t)_sink;
+    record.format_id = id;
+    static const char zeros[8] = {0};
+    write_bytes(&record, sizeof(record));
+    write_bytes(text, length);
+    write_bytes(zeros, padded - length);
+}
+
+void QCamxLog::write_bytes(const void *data, size_t size) {
+    if (_batch_length + size > sizeof(_batch)) {
+        write_batch();
+    }
+    if (size > sizeof(_batch)) {
+        fwrite(data, 1, size, _file_handle);
+        return;
+    }
+    memcpy(_batch + _batch_length, data, size);
+    _batch_length += size;
+}
+
+void QCamxLog::write_batch() {
+    if (_batch_length > 0) {
+        fwrite(_batch, 1, _batch_length, _log_type == LOGTYPE_STDIO ? stdout : _file_handle);
+        _batch_length = 0;
+    }
 }
 
-}  // namespace qcamx
\ No newline at end of file
+}  // namespace qcamx
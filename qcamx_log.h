@@ -5,24 +5,80 @@
 #pragma once
 
 #include <log/log.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include <atomic>
 #include <string>
 
-#define QCAMX_ERR(fmt, args...)                          \
-    do {                                                 \
-        ALOGE("%s %d:" fmt, __func__, __LINE__, ##args); \
+#include "qcamx_binary_log.h"
+
+// log/log.h does the same, the module of a file without a tag
+#ifndef LOG_TAG
+#define LOG_TAG NULL
+#endif
+
+/*
+ * log levels, a message goes out when its level is at most the level of its module
+ * QCAMX_PRINT is the console output of the test and is never filtered
+ */
+#define QCAMX_LOG_LEVEL_OFF (-1)
+#define QCAMX_LOG_LEVEL_ERR (0)
+#define QCAMX_LOG_LEVEL_INFO (1)
+#define QCAMX_LOG_LEVEL_DBG (2)
+
+// levels above it are compiled out, with their arguments
+#ifndef QCAMX_LOG_LEVEL_MAX
+#define QCAMX_LOG_LEVEL_MAX QCAMX_LOG_LEVEL_DBG
+#endif
+// level of a module not set by the QCAMX_LOG_LEVEL environment or the log command
+#define QCAMX_LOG_LEVEL_DEFAULT QCAMX_LOG_LEVEL_INFO
+
+// token bucket of a rate limited call site
+#define QCAMX_LOG_RATE_PER_SEC (5)
+#define QCAMX_LOG_RATE_BURST (10)
+
+/**
+ * @brief whether the messages of level are enabled for the module LOG_TAG of the call site
+ * @detail the module is looked up once per call site, then it costs an atomic load
+*/
+#define QCAMX_LOG_ENABLED(log_level)                                                \
+    (QCAMX_LOG_LEVEL_##log_level <= QCAMX_LOG_LEVEL_MAX &&                          \
+     QCAMX_LOG_LEVEL_##log_level <=                                                 \
+         ([]() -> qcamx::QCamxLogModule * {                                         \
+             static qcamx::QCamxLogModule *module = qcamx::get_log_module(LOG_TAG); \
+             return module;                                                         \
+         }())->level.load(std::memory_order_relaxed))
+
+/**
+ * @brief QCAMX_LOG_ENABLED and a token of the call site bucket, guards per frame work
+*/
+#define QCAMX_LOG_RATELIMIT_ENABLED(log_level)                                                   \
+    (QCAMX_LOG_ENABLED(log_level) && []() -> bool {                                              \
+        static qcamx::QCamxLogRateLimiter limiter(QCAMX_LOG_RATE_PER_SEC, QCAMX_LOG_RATE_BURST); \
+        return limiter.allow(NULL);                                                              \
+    }())
+
+#define QCAMX_ERR(fmt, args...)                              \
+    do {                                                     \
+        if (QCAMX_LOG_ENABLED(ERR)) {                        \
+            ALOGE("%s %d:" fmt, __func__, __LINE__, ##args); \
+        }                                                    \
     } while (0)
 
-#define QCAMX_INFO(fmt, args...)                         \
-    do {                                                 \
-        ALOGI("%s %d:" fmt, __func__, __LINE__, ##args); \
+#define QCAMX_INFO(fmt, args...)                             \
+    do {                                                     \
+        if (QCAMX_LOG_ENABLED(INFO)) {                       \
+            ALOGI("%s %d:" fmt, __func__, __LINE__, ##args); \
+        }                                                    \
     } while (0)
 
-#define QCAMX_DBG(fmt, args...)                          \
-    do {                                                 \
-        ALOGD("%s %d:" fmt, __func__, __LINE__, ##args); \
-        printf(fmt, ##args);                             \
+#define QCAMX_DBG(fmt, args...)                              \
+    do {                                                     \
+        if (QCAMX_LOG_ENABLED(DBG)) {                        \
+            ALOGD("%s %d:" fmt, __func__, __LINE__, ##args); \
+            printf(fmt, ##args);                             \
+        }                                                    \
     } while (0)
 
 #define QCAMX_PRINT(fmt, args...)                        \
@@ -31,30 +87,131 @@
         printf(fmt, ##args);                             \
     } while (0)
 
+/**
+ * @brief QCAMX_ERR/QCAMX_INFO for the per frame call sites, at most QCAMX_LOG_RATE_PER_SEC
+ *        messages a second after a burst of QCAMX_LOG_RATE_BURST, the dropped ones are counted
+*/
+#define QCAMX_LOG_RATELIMIT(log_level, alog, fmt, args...)                              \
+    do {                                                                                \
+        if (QCAMX_LOG_ENABLED(log_level)) {                                             \
+            static qcamx::QCamxLogRateLimiter qcamx_log_limiter(QCAMX_LOG_RATE_PER_SEC, \
+                                                                QCAMX_LOG_RATE_BURST);  \
+            uint32_t qcamx_log_suppressed = 0;                                          \
+            if (qcamx_log_limiter.allow(&qcamx_log_suppressed)) {                       \
+                if (qcamx_log_suppressed > 0) {                                         \
+                    alog("%s %d: %u messages suppressed", __func__, __LINE__,           \
+                         qcamx_log_suppressed);                                         \
+                }                                                                       \
+                alog("%s %d:" fmt, __func__, __LINE__, ##args);                         \
+            }                                                                           \
+        }                                                                               \
+    } while (0)
+
+#define QCAMX_ERR_RATELIMIT(fmt, args...) QCAMX_LOG_RATELIMIT(ERR, ALOGE, fmt, ##args)
+#define QCAMX_INFO_RATELIMIT(fmt, args...) QCAMX_LOG_RATELIMIT(INFO, ALOGI, fmt, ##args)
+
 namespace qcamx {
 
-class QCamxLog {
+// log level of a LOG_TAG
+typedef struct _qcamx_log_module {
+    const char *tag;
+    std::atomic<int> level;
+} QCamxLogModule;
+
+/**
+ * @brief module of a LOG_TAG, registered on the first call with its configured level
+ * @detail the levels are read from the QCAMX_LOG_LEVEL environment on the first call
+*/
+QCamxLogModule *get_log_module(const char *tag);
+/**
+ * @brief set module levels from "level" or "tag=level,..." with "*" for every module
+ * @param spec level is off, err, info, dbg or -1 to 2
+ * @return 0 on success, -1 on a malformed entry, the entries before it are applied
+*/
+int set_log_levels(const char *spec);
+
+// token bucket of one call site, lock free
+class QCamxLogRateLimiter {
 public:
+    QCamxLogRateLimiter(int per_second, int burst);
     /**
-    * @brief set camera file log path
+     * @brief take a token
+     * @param suppressed set to the messages dropped since the last allowed one, may be NULL
+    */
+    bool allow(uint32_t *suppressed);
+private:
+    // Do not support the copy constructor or assignment operator
+    QCamxLogRateLimiter(const QCamxLogRateLimiter &) = delete;
+    QCamxLogRateLimiter &operator=(const QCamxLogRateLimiter &) = delete;
+private:
+    int64_t _interval_ns;
+    int64_t _burst_ns;                ///< how far the next token may run ahead of now
+    std::atomic<int64_t> _next_ns;    ///< theoretical arrival time of the next message
+    std::atomic<uint32_t> _suppressed;
+};
+
+class QCamxLog : public QCamxBinaryLogSink {
+public:
+    /**
+    * @brief set camera file log path, "std" for stdout, "ALOGE" for logcat, a file else
+    * @detail a .qlog file keeps the binary records, qcamx-log-decode prints them as text
     */
     void set_path(std::string log_path);
-    int print(const char *format, ...);
+    /**
+    * @brief queue a message, it is formatted and written on the writer thread of the backend
+    * @param format a string literal, the record keeps its address
+    * @return 0, -1 if the message is dropped
+    */
+    template <typename... Args>
+    int print(const char *format, Args... args) {
+        const BinaryLogArg arg_list[] = {BinaryLogArg(args)..., BinaryLogArg()};
+        return QCamxBinaryLog::get_instance()->write(_sink, format, arg_list,
+                                                     (int)sizeof...(args));
+    }
+public:  // override QCamxBinaryLogSink
+    virtual void write_record(const BinaryLogRecord *record, const char *format) override;
+    virtual void flush_batch() override;
 public:
     QCamxLog();
     QCamxLog(std::string log_path);
     ~QCamxLog();
+private:
+    void init(std::string log_path);
+    /**
+     * @brief open the new path on the writer thread, _lock held
+    */
+    void open_new_path();
+    /**
+     * @brief a .qlog record of the tag or of a format string, _lock held
+    */
+    void write_definition(uint8_t kind, uint16_t id, const char *text);
+    /**
+     * @brief append to the batch, _lock held
+    */
+    void write_bytes(const void *data, size_t size);
+    void write_batch();
+    // Do not support the copy constructor or assignment operator
+    QCamxLog(const QCamxLog &) = delete;
+    QCamxLog &operator=(const QCamxLog &) = delete;
 private:
     enum LogType {
         LOGTYPE_STDIO,
         LOGTYPE_ALOGE,
         LOGTYPE_FILE,
+        LOGTYPE_BINARY,
     } LogType;
     enum LogType _log_type;
     FILE *_file_handle;
     std::string _path;
     std::string _tag;
     bool _is_new_path;
+    int _sink;
+    pthread_mutex_t _lock;  ///< the output state, set_path and the writer thread
+    // text of the current batch, written at once
+    char _batch[BINARY_LOG_BATCH_SIZE];
+    size_t _batch_length;
+    // formats already written to the .qlog file
+    uint8_t _format_written[BINARY_LOG_FORMAT_MAX / 8];
 };
 
 }  // namespace qcamx
@@ -0,0 +1,323 @@
+/**
+ * @file  qcamx_log_check.cpp
+ * @brief log the same messages to a text log and to a .qlog binary log, decode the binary log
+ *        with qcamx-log-decode and fail if its text differs from the text log or from vsnprintf
+*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "qcamx_binary_log.h"
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxLogCheck"
+
+#define LOG_CHECK_FLUSH_PERIOD (64)  // messages of a thread between two flushes, no ring fills up
+
+using namespace qcamx;
+
+static const char usage[] = "\
+usage: qcamx-log-check [-d dir] [-x decoder] [-t threads] [-n messages] \n\
+  -d: directory of the logs, default " CAMERA_STORAGE_DIR " \n\
+  -x: the decoder run on the binary log, default qcamx-log-decode from PATH \n\
+  -t: threads logging at once, default 4 \n\
+  -n: messages of every thread, default 2000 \n\
+";
+
+// both logs of the check, the text the messages have to decode to
+struct LogPair {
+    QCamxLog *text;
+    QCamxLog *binary;
+    std::string expected;
+};
+
+enum CheckEnum {
+    CHECK_ENUM_FIRST = 7,
+};
+
+/**
+ * @brief log one message to both logs, append what vsnprintf makes of it to the expected text
+*/
+template <typename... Args>
+static void log_both(LogPair *logs, const char *format, Args... args) {
+    logs->text->print(format, args...);
+    logs->binary->print(format, args...);
+    char message[BINARY_LOG_MESSAGE_LENGTH];
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-security"
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+    snprintf(message, sizeof(message), format, args...);
+#pragma GCC diagnostic pop
+    // QCamxLog writes the tag of the log in front of every message
+    logs->expected.append("[META]  ").append(message);
+}
+
+static void log_formats(LogPair *logs) {
+    std::string long_string(400, 'x');
+    long_string[100] = 'y';
+    std::string full_line(BINARY_LOG_MESSAGE_LENGTH - 30, 'z');
+    int value = 12345;
+    log_both(logs, "plain text without arguments\n");
+    log_both(logs, "percent %% and %d%%\n", 50);
+    log_both(logs, "int %d %i %d %d\n", 0, -1, INT_MAX, INT_MIN);
+    log_both(logs, "unsigned %u %x %X %o %#x %#o\n", UINT_MAX, 0xdeadbeefu, 0xabcdefu, 0777u,
+             255u, 8u);
+    log_both(logs, "64 bit %" PRId64 " %" PRId64 " %" PRIu64 " %" PRIx64 "\n", INT64_MAX,
+             INT64_MIN, UINT64_MAX, (uint64_t)0x0123456789abcdefULL);
+    log_both(logs, "short %hd %hu %hhd %hhu\n", (short)-2, (unsigned short)65535,
+             (signed char)-3, (unsigned char)250);
+    log_both(logs, "narrowed %hhd %hhu %hd %hu\n", 300, 300, 70000, 70000);
+    log_both(logs, "size %zu %zd long %ld %lu\n", (size_t)4096, (ssize_t)-4096, -70000L,
+             70000UL);
+    log_both(logs, "width [%5d] [%-5d] [%05d] [%+d] [% d] [%*d] [%-*d]\n", 42, 42, 42, 42, 42, 8,
+             42, 8, 42);
+    log_both(logs, "precision [%.3d] [%8.3d] [%.*d] [%*.*d]\n", 7, 7, 4, 7, 9, 4, 7);
+    log_both(logs, "double %f %.2f %e %.3E %g %G %10.4f %-10.1f|\n", 3.14159265358979, -2.5,
+             123456.789, 0.000123, 1e-10, 1e20, 2.0 / 3.0, 9.99);
+    log_both(logs, "float %f %.1f %a\n", 1.5f, -0.25f, 1.0);
+    log_both(logs, "char [%c] [%3c] [%-3c]\n", 'a', 'b', 'c');
+    log_both(logs, "string [%s] [%10s] [%-10s] [%.3s] [%*s] [%s]\n", "abc", "right", "left",
+             "truncated", 6, "star", "");
+    log_both(logs, "pointer %p %p\n", (void *)&value, (void *)NULL);
+    log_both(logs, "enum %d bool %d\n", CHECK_ENUM_FIRST, true);
+    log_both(logs, "mixed %s=%d %s=%.2f %s=%" PRIu64 " %s=%c\n", "int", -7, "double", 0.5,
+             "u64", (uint64_t)1 << 40, "char", 'z');
+    log_both(logs, "long string arg %s\n", long_string.c_str());
+    log_both(logs, "%s %d %s\n", full_line.c_str(), 1234567, "past the end of the message");
+    log_both(logs, "trailing text without newline ");
+    log_both(logs, "after it\n");
+}
+
+struct LoggerData {
+    LogPair *logs;
+    int id;
+    int messages;
+};
+
+static void *logger_thread(void *arg) {
+    LoggerData *data = (LoggerData *)arg;
+    for (int i = 0; i < data->messages; i++) {
+        // the lines of all threads are compared as sets, the expected text is not used
+        data->logs->text->print("thread %d seq %d value %.3f tag %s\n", data->id, i, i * 0.5,
+                                "camera");
+        data->logs->binary->print("thread %d seq %d value %.3f tag %s\n", data->id, i, i * 0.5,
+                                  "camera");
+        if (i % LOG_CHECK_FLUSH_PERIOD == 0) {
+            QCamxBinaryLog::get_instance()->flush();
+        }
+    }
+    return NULL;
+}
+
+static bool read_file(const std::string &path, std::string *content) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        QCAMX_PRINT("open %s failed:%s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    char buffer[4096];
+    size_t bytes;
+    content->clear();
+    while ((bytes = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        content->append(buffer, bytes);
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * @brief run decoder on the binary log, its text goes to output
+*/
+static bool run_decoder(const char *decoder, const std::string &binary_path,
+                        const std::string &output_path) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        QCAMX_PRINT("fork failed:%s\n", strerror(errno));
+        return false;
+    }
+    if (pid == 0) {
+        execlp(decoder, decoder, binary_path.c_str(), output_path.c_str(), (char *)NULL);
+        fprintf(stderr, "run %s failed:%s\n", decoder, strerror(errno));
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        QCAMX_PRINT("%s %s failed, status:0x%x\n", decoder, binary_path.c_str(), status);
+        return false;
+    }
+    return true;
+}
+
+static std::string get_line(const std::string &text, size_t start) {
+    if (start >= text.size()) {
+        return "";
+    }
+    size_t end = text.find('\n', start);
+    return text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+/**
+ * @brief print where two texts start to differ
+ * @return whether they are equal
+*/
+static bool compare_text(const char *name, const std::string &actual,
+                         const std::string &expected) {
+    if (actual == expected) {
+        return true;
+    }
+    size_t at = 0;
+    while (at < actual.size() && at < expected.size() && actual[at] == expected[at]) {
+        at++;
+    }
+    // print the line the difference is in
+    size_t line_start = at == 0 ? std::string::npos : expected.rfind('\n', at - 1);
+    line_start = line_start == std::string::npos ? 0 : line_start + 1;
+    std::string expected_line = get_line(expected, line_start);
+    std::string actual_line = get_line(actual, line_start);
+    QCAMX_PRINT("%s differs at byte %zu of %zu, expected %zu bytes\n", name, at, actual.size(),
+                expected.size());
+    QCAMX_PRINT("  expected: %s\n", expected_line.c_str());
+    QCAMX_PRINT("  actual:   %s\n", actual_line.c_str());
+    return false;
+}
+
+static std::vector<std::string> get_sorted_lines(const std::string &text) {
+    std::vector<std::string> lines;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        end = end == std::string::npos ? text.size() : end + 1;
+        lines.push_back(text.substr(start, end - start));
+        start = end;
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+/**
+ * @brief log to a new pair of logs, decode the binary one and compare the texts
+ * @param threads 0 logs the format cases on the calling thread, compared byte for byte
+ * @return number of differences
+*/
+static int check_logs(const std::string &dir, const char *decoder, int threads, int messages) {
+    std::string name = threads == 0 ? "formats" : "threads";
+    std::string text_path = dir + "/qcamx_log_check_" + name + ".log";
+    std::string binary_path = dir + "/qcamx_log_check_" + name + ".qlog";
+    std::string decoded_path = dir + "/qcamx_log_check_" + name + ".decoded";
+
+    LogPair logs;
+    logs.text = new QCamxLog(text_path);
+    logs.binary = new QCamxLog(binary_path);
+    uint64_t dropped = QCamxBinaryLog::get_instance()->get_dropped();
+    if (threads == 0) {
+        log_formats(&logs);
+    } else {
+        std::vector<pthread_t> tids(threads);
+        std::vector<LoggerData> loggers(threads);
+        for (int i = 0; i < threads; i++) {
+            loggers[i] = {&logs, i, messages};
+            pthread_create(&tids[i], NULL, logger_thread, &loggers[i]);
+        }
+        for (int i = 0; i < threads; i++) {
+            pthread_join(tids[i], NULL);
+        }
+    }
+    // hands every queued message over and closes both files
+    delete logs.text;
+    delete logs.binary;
+    dropped = QCamxBinaryLog::get_instance()->get_dropped() - dropped;
+
+    int errors = 0;
+    std::string text;
+    std::string decoded;
+    if (!run_decoder(decoder, binary_path, decoded_path) || !read_file(text_path, &text) ||
+        !read_file(decoded_path, &decoded)) {
+        return 1;
+    }
+    if (dropped > 0) {
+        QCAMX_PRINT("%s: %" PRIu64 " messages dropped, the logs can not be compared\n",
+                    name.c_str(), dropped);
+        errors++;
+    } else if (threads == 0) {
+        errors += compare_text("text log", text, logs.expected) ? 0 : 1;
+        errors += compare_text("decoded binary log", decoded, logs.expected) ? 0 : 1;
+    } else {
+        // the writer orders the records of the threads by time, each log on its own
+        std::vector<std::string> text_lines = get_sorted_lines(text);
+        std::vector<std::string> decoded_lines = get_sorted_lines(decoded);
+        if (text_lines.size() != (size_t)threads * messages) {
+            QCAMX_PRINT("%s: text log has %zu lines, expected %d\n", name.c_str(),
+                        text_lines.size(), threads * messages);
+            errors++;
+        }
+        if (text_lines != decoded_lines) {
+            std::vector<std::string> differ;
+            std::set_symmetric_difference(text_lines.begin(), text_lines.end(),
+                                          decoded_lines.begin(), decoded_lines.end(),
+                                          std::back_inserter(differ));
+            QCAMX_PRINT("%s: decoded binary log has %zu lines, %zu lines are in one log only\n",
+                        name.c_str(), decoded_lines.size(), differ.size());
+            errors++;
+        }
+    }
+    QCAMX_PRINT("%s: text log %zu bytes, decoded binary log %zu bytes, %d differences\n",
+                name.c_str(), text.size(), decoded.size(), errors);
+    if (errors == 0) {
+        unlink(text_path.c_str());
+        unlink(binary_path.c_str());
+        unlink(decoded_path.c_str());
+    }
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+    std::string dir = CAMERA_STORAGE_DIR;
+    const char *decoder = "qcamx-log-decode";
+    int threads = 4;
+    int messages = 2000;
+    int c;
+    while ((c = getopt(argc, argv, "hd:x:t:n:")) != -1) {
+        switch (c) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'x':
+                decoder = optarg;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'n':
+                messages = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    if (threads <= 0 || messages <= 0) {
+        printf("%s", usage);
+        return 1;
+    }
+    int errors = check_logs(dir, decoder, 0, 0);
+    errors += check_logs(dir, decoder, threads, messages);
+    return errors == 0 ? 0 : 1;
+}
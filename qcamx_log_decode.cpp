@@ -0,0 +1,130 @@
+/**
+ * @file  qcamx_log_decode.cpp
+ * @brief print a .qlog binary log as the text QCamxLog writes to a log file
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "qcamx_binary_log.h"
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxLogDecode"
+
+using namespace qcamx;
+
+static const char usage[] = "\
+usage: qcamx-log-decode [-t] log.qlog [output] \n\
+  -t: prefix every message with its CLOCK_MONOTONIC timestamp in seconds \n\
+  output: defaults to stdout \n\
+";
+
+int main(int argc, char *argv[]) {
+    bool timestamps = false;
+    int c;
+    while ((c = getopt(argc, argv, "ht")) != -1) {
+        switch (c) {
+            case 't':
+                timestamps = true;
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        printf("%s", usage);
+        return 1;
+    }
+    const char *path = argv[optind];
+    FILE *input = fopen(path, "rb");
+    if (input == NULL) {
+        QCAMX_PRINT("open %s failed\n", path);
+        return 1;
+    }
+    FILE *output = stdout;
+    if (optind + 1 < argc) {
+        output = fopen(argv[optind + 1], "w");
+        if (output == NULL) {
+            QCAMX_PRINT("open %s failed\n", argv[optind + 1]);
+            fclose(input);
+            return 1;
+        }
+    }
+
+    char magic[8] = {0};
+    if (fread(magic, 1, sizeof(magic), input) != sizeof(magic) ||
+        memcmp(magic, BINARY_LOG_FILE_MAGIC, sizeof(magic)) != 0) {
+        QCAMX_PRINT("%s is not a binary log\n", path);
+        fclose(input);
+        return 1;
+    }
+
+    std::vector<std::string> formats(BINARY_LOG_FORMAT_MAX);
+    std::vector<bool> known(BINARY_LOG_FORMAT_MAX, false);
+    std::string tag;
+    // a record is at most 64KB, its size field is 16 bits
+    std::vector<uint8_t> buffer(UINT16_MAX + 1);
+    BinaryLogRecord *record = (BinaryLogRecord *)buffer.data();
+    char message[BINARY_LOG_MESSAGE_LENGTH];
+    uint64_t messages = 0;
+    uint64_t unknown = 0;
+    int res = 0;
+    while (fread(record, 1, sizeof(BinaryLogRecord), input) == sizeof(BinaryLogRecord)) {
+        size_t payload = record->size - sizeof(BinaryLogRecord);
+        if (record->size < sizeof(BinaryLogRecord) ||
+            fread(record + 1, 1, payload, input) != payload) {
+            QCAMX_PRINT("%s truncated after %" PRIu64 " messages\n", path, messages);
+            res = 1;
+            break;
+        }
+        const char *text = (const char *)(record + 1);
+        switch (record->kind) {
+            case BINARY_LOG_TAG:
+                tag.assign(text, strnlen(text, payload));
+                break;
+            case BINARY_LOG_FORMAT:
+                if (record->format_id < BINARY_LOG_FORMAT_MAX) {
+                    formats[record->format_id].assign(text, strnlen(text, payload));
+                    known[record->format_id] = true;
+                }
+                break;
+            case BINARY_LOG_MESSAGE: {
+                if (record->format_id >= BINARY_LOG_FORMAT_MAX || !known[record->format_id]) {
+                    unknown++;
+                    break;
+                }
+                format_binary_log_message(record, formats[record->format_id].c_str(), message,
+                                          sizeof(message));
+                if (timestamps) {
+                    fprintf(output, "[%" PRId64 ".%09" PRId64 "] ", record->timestamp / 1000000000,
+                            record->timestamp % 1000000000);
+                }
+                // as the log file of QCamxLog
+                fprintf(output, "%s %s", tag.c_str(), message);
+                messages++;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (unknown > 0) {
+        QCAMX_PRINT("%" PRIu64 " messages without their format skipped\n", unknown);
+    }
+    fclose(input);
+    if (output != stdout) {
+        fclose(output);
+    }
+    return res;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file  qcamx_metadata_watch.cpp
+ * @brief table of watched result metadata tags implementation
+*/
+
+#include "qcamx_metadata_watch.h"
+
+#include <camera/CameraMetadata.h>
+#include <camera/VendorTagDescriptor.h>
+
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxMetadataWatch"
+
+/*************************public method*****************************/
+
+void QCamxMetadataWatch::clear() {
+    _count = 0;
+    memset(_hash, 0, sizeof(_hash));
+    // found_sequence of a fresh watch never matches
+    _scan_sequence = 1;
+}
+
+int QCamxMetadataWatch::add(uint32_t tag) {
+    int id = find_watch(tag);
+    if (id >= 0) {
+        return id;
+    }
+    if (_count >= METADATA_WATCH_MAX) {
+        QCAMX_ERR("too many watched tags, drop tag:%x\n", tag);
+        return -1;
+    }
+    id = _count++;
+    Watch *watch = &_watches[id];
+    memset(watch, 0, sizeof(Watch));
+    watch->tag = tag;
+    uint32_t slot = hash_tag(tag);
+    while (_hash[slot] != 0) {
+        slot = (slot + 1) & (METADATA_WATCH_HASH_SIZE - 1);
+    }
+    _hash[slot] = (uint8_t)(id + 1);
+    return id;
+}
+
+int QCamxMetadataWatch::add(const char *tag_name) {
+    android::sp<android::VendorTagDescriptor> vendor_tag_descriptor =
+        android::VendorTagDescriptor::getGlobalVendorTagDescriptor();
+    uint32_t tag = 0;
+    if (android::CameraMetadata::getTagFromName(tag_name, vendor_tag_descriptor.get(), &tag) !=
+        0) {
+        QCAMX_ERR("unknown tag:%s\n", tag_name);
+        return -1;
+    }
+    return add(tag);
+}
+
+void QCamxMetadataWatch::scan(const camera_metadata_t *metadata) {
+    _scan_sequence++;
+    if (metadata == NULL || _count == 0) {
+        return;
+    }
+    size_t entry_count = get_camera_metadata_entry_count(metadata);
+    for (size_t i = 0; i < entry_count; i++) {
+        camera_metadata_ro_entry entry;
+        if (get_camera_metadata_ro_entry(metadata, i, &entry) != 0) {
+            continue;
+        }
+        int id = find_watch(entry.tag);
+        if (id < 0) {
+            continue;
+        }
+        Watch *watch = &_watches[id];
+        size_t bytes = entry.count * camera_metadata_type_size[entry.type];
+        if (bytes > METADATA_WATCH_VALUE_BYTES) {
+            bytes = METADATA_WATCH_VALUE_BYTES;
+        }
+        memcpy(watch->values, entry.data.u8, bytes);
+        watch->type = entry.type;
+        watch->count = (uint32_t)entry.count;
+        watch->bytes = (uint32_t)bytes;
+        watch->found_sequence = _scan_sequence;
+    }
+}
+
+/*************************private method*****************************/
+
+int QCamxMetadataWatch::find_watch(uint32_t tag) const {
+    uint32_t slot = hash_tag(tag);
+    while (_hash[slot] != 0) {
+        int id = _hash[slot] - 1;
+        if (_watches[id].tag == tag) {
+            return id;
+        }
+        slot = (slot + 1) & (METADATA_WATCH_HASH_SIZE - 1);
+    }
+    return -1;
+}
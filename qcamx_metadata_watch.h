@@ -0,0 +1,82 @@
+/**
+ * @file  qcamx_metadata_watch.h
+ * @brief table of watched result metadata tags
+ *        tags are resolved once, every result is read with a single pass over its entries
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <system/camera_metadata.h>
+
+#define METADATA_WATCH_MAX (32)
+#define METADATA_WATCH_VALUE_BYTES (64)  // values beyond this are not kept
+#define METADATA_WATCH_HASH_SIZE (64)    // power of two, at least twice METADATA_WATCH_MAX
+
+class QCamxMetadataWatch {
+public:
+    QCamxMetadataWatch() { clear(); }
+    ~QCamxMetadataWatch() {}
+public:
+    /**
+     * @brief stop watching every tag
+    */
+    void clear();
+    /**
+     * @brief watch a tag, a tag added twice shares one watch
+     * @return watch id, -1 if the table is full
+    */
+    int add(uint32_t tag);
+    /**
+     * @brief watch a vendor tag, the name is resolved here once
+     * @return watch id, -1 if the name is unknown or the table is full
+    */
+    int add(const char *tag_name);
+    bool empty() { return _count == 0; }
+    /**
+     * @brief copy the values of all watched tags out of one result
+    */
+    void scan(const camera_metadata_t *metadata);
+    /**
+     * @brief whether the last scanned result carried the tag
+    */
+    bool found(int id) const {
+        return id >= 0 && id < _count && _watches[id].found_sequence == _scan_sequence;
+    }
+    /**
+     * @brief number of values of the tag in the last scanned result
+    */
+    size_t get_count(int id) const { return found(id) ? _watches[id].count : 0; }
+    /**
+     * @brief read one value of the last scanned result
+     * @param default_value returned when the tag or the value is missing
+    */
+    template <typename T>
+    T get(int id, size_t index, T default_value) const {
+        if (!found(id) || (index + 1) * sizeof(T) > _watches[id].bytes) {
+            return default_value;
+        }
+        T value;
+        memcpy(&value, _watches[id].values + index * sizeof(T), sizeof(T));
+        return value;
+    }
+private:
+    struct Watch {
+        uint32_t tag;
+        uint8_t type;
+        uint32_t count;
+        uint32_t bytes;
+        uint32_t found_sequence;
+        alignas(8) uint8_t values[METADATA_WATCH_VALUE_BYTES];
+    };
+    static uint32_t hash_tag(uint32_t tag) {
+        return ((tag * 2654435761u) >> 16) & (METADATA_WATCH_HASH_SIZE - 1);
+    }
+    int find_watch(uint32_t tag) const;
+private:
+    Watch _watches[METADATA_WATCH_MAX];
+    int _count;
+    uint8_t _hash[METADATA_WATCH_HASH_SIZE];  ///< watch id + 1, 0 means empty
+    uint32_t _scan_sequence;
+};
@@ -0,0 +1,981 @@
+/**
+ * @file  qcamx_mock_camera_module.cpp
+ * @brief mock camera3 HAL implementation
+ *        a sensor thread ticks at the configured fps and sends shutter and partial metadata,
+ *        a result thread fills the buffers pipeline_depth frames later and sends the final result
+*/
+
+#include "qcamx_mock_camera_module.h"
+
+#include <errno.h>
+#include <hardware/gralloc.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxMockCamera"
+
+#define MOCK_SENSOR_WIDTH (3840)
+#define MOCK_SENSOR_HEIGHT (2160)
+#define MOCK_RESULT_EXTRA_ENTRIES (8)  // room for the dynamic entries added to the settings
+#define MOCK_RESULT_EXTRA_DATA (64)
+#define MOCK_RAMP_LENGTH (16384)
+#define MOCK_NS_PER_SECOND (1000000000LL)
+
+namespace qcamx {
+
+static const int32_t s_mock_sizes[][2] = {
+    {3840, 2160}, {2560, 1440}, {1920, 1080}, {1280, 720}, {720, 480}, {640, 480}, {320, 240},
+};
+
+static inline uint32_t mock_align(uint32_t operand, uint32_t alignment) {
+    uint32_t remainder = (operand % alignment);
+    return (remainder == 0) ? operand : operand - remainder + alignment;
+}
+
+static int64_t mock_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * MOCK_NS_PER_SECOND + ts.tv_nsec;
+}
+
+static void mock_sleep_until_ns(int64_t wake_ns) {
+    struct timespec ts;
+    ts.tv_sec = wake_ns / MOCK_NS_PER_SECOND;
+    ts.tv_nsec = wake_ns % MOCK_NS_PER_SECOND;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static int get_env_int(const char *name, int default_value, int min_value, int max_value) {
+    const char *value = getenv(name);
+    if (value == NULL || value[0] == '\0') {
+        return default_value;
+    }
+    int result = atoi(value);
+    if (result < min_value || result > max_value) {
+        QCAMX_PRINT("mock: %s=%d out of range [%d, %d], use %d\n", name, result, min_value,
+                    max_value, default_value);
+        return default_value;
+    }
+    return result;
+}
+
+/**
+ * @brief empty a metadata buffer for reuse, reallocate it only when it is too small
+*/
+static camera_metadata_t *reset_metadata(camera_metadata_t *metadata, size_t entry_capacity,
+                                         size_t data_capacity) {
+    if (metadata != NULL && get_camera_metadata_entry_capacity(metadata) >= entry_capacity &&
+        get_camera_metadata_data_capacity(metadata) >= data_capacity) {
+        return place_camera_metadata(metadata, get_camera_metadata_size(metadata),
+                                     get_camera_metadata_entry_capacity(metadata),
+                                     get_camera_metadata_data_capacity(metadata));
+    }
+    if (metadata != NULL) {
+        free_camera_metadata(metadata);
+    }
+    return allocate_camera_metadata(entry_capacity, data_capacity);
+}
+
+static camera_metadata_t *copy_metadata(camera_metadata_t *dst, const camera_metadata_t *src,
+                                        size_t extra_entries, size_t extra_data) {
+    dst = reset_metadata(dst, get_camera_metadata_entry_count(src) + extra_entries,
+                         get_camera_metadata_data_count(src) + extra_data);
+    if (dst != NULL && append_camera_metadata(dst, src) != 0) {
+        QCAMX_ERR("mock: append metadata failed\n");
+    }
+    return dst;
+}
+
+static int set_metadata_entry(camera_metadata_t *metadata, uint32_t tag, const void *data,
+                              size_t count) {
+    camera_metadata_entry_t entry;
+    if (find_camera_metadata_entry(metadata, tag, &entry) == 0) {
+        return update_camera_metadata_entry(metadata, entry.index, data, count, NULL);
+    }
+    return add_camera_metadata_entry(metadata, tag, data, count);
+}
+
+static camera_metadata_t *build_static_metadata(const QCamxMockConfig &config) {
+    std::vector<int32_t> stream_configs;
+    std::vector<int64_t> min_durations;
+    int64_t min_frame_duration = MOCK_NS_PER_SECOND / config.fps;
+    const int32_t processed_formats[] = {HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED,
+                                         HAL_PIXEL_FORMAT_YCBCR_420_888, HAL_PIXEL_FORMAT_BLOB};
+    for (int32_t format : processed_formats) {
+        for (const auto &size : s_mock_sizes) {
+            stream_configs.insert(stream_configs.end(),
+                                  {format, size[0], size[1],
+                                   ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT});
+            min_durations.insert(min_durations.end(),
+                                 {format, size[0], size[1], min_frame_duration});
+        }
+    }
+    const int32_t raw_formats[] = {HAL_PIXEL_FORMAT_RAW10, HAL_PIXEL_FORMAT_RAW12,
+                                   HAL_PIXEL_FORMAT_RAW16};
+    for (int32_t format : raw_formats) {
+        stream_configs.insert(stream_configs.end(),
+                              {format, MOCK_SENSOR_WIDTH, MOCK_SENSOR_HEIGHT,
+                               ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT});
+        min_durations.insert(min_durations.end(),
+                             {format, MOCK_SENSOR_WIDTH, MOCK_SENSOR_HEIGHT, min_frame_duration});
+    }
+    stream_configs.insert(stream_configs.end(),
+                          {HAL_PIXEL_FORMAT_Y16, 640, 480,
+                           ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT});
+    min_durations.insert(min_durations.end(), {HAL_PIXEL_FORMAT_Y16, 640, 480, min_frame_duration});
+
+    std::vector<int32_t> fps_ranges = {15, 30, 30, 30};
+    if (config.fps != 30) {
+        fps_ranges.insert(fps_ranges.end(), {config.fps, config.fps});
+    }
+
+    size_t data_capacity =
+        1024 + stream_configs.size() * sizeof(int32_t) + min_durations.size() * sizeof(int64_t);
+    camera_metadata_t *metadata = allocate_camera_metadata(32, data_capacity);
+    if (metadata == NULL) {
+        return NULL;
+    }
+    uint8_t facing = ANDROID_LENS_FACING_BACK;
+    add_camera_metadata_entry(metadata, ANDROID_LENS_FACING, &facing, 1);
+    uint8_t hardware_level = ANDROID_INFO_SUPPORTED_HARDWARE_LEVEL_FULL;
+    add_camera_metadata_entry(metadata, ANDROID_INFO_SUPPORTED_HARDWARE_LEVEL, &hardware_level, 1);
+    uint8_t capability = ANDROID_REQUEST_AVAILABLE_CAPABILITIES_BACKWARD_COMPATIBLE;
+    add_camera_metadata_entry(metadata, ANDROID_REQUEST_AVAILABLE_CAPABILITIES, &capability, 1);
+    int32_t partial_result_count = MOCK_PARTIAL_RESULT_COUNT;
+    add_camera_metadata_entry(metadata, ANDROID_REQUEST_PARTIAL_RESULT_COUNT,
+                              &partial_result_count, 1);
+    uint8_t pipeline_max_depth = (uint8_t)config.pipeline_depth;
+    add_camera_metadata_entry(metadata, ANDROID_REQUEST_PIPELINE_MAX_DEPTH, &pipeline_max_depth, 1);
+    int32_t active_array[4] = {0, 0, MOCK_SENSOR_WIDTH, MOCK_SENSOR_HEIGHT};
+    add_camera_metadata_entry(metadata, ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE, active_array, 4);
+    add_camera_metadata_entry(metadata, ANDROID_SENSOR_INFO_PIXEL_ARRAY_SIZE, &active_array[2], 2);
+    uint8_t timestamp_source = ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE_UNKNOWN;
+    add_camera_metadata_entry(metadata, ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE, &timestamp_source,
+                              1);
+    int64_t exposure_range[2] = {100000, MOCK_NS_PER_SECOND / 10};
+    add_camera_metadata_entry(metadata, ANDROID_SENSOR_INFO_EXPOSURE_TIME_RANGE, exposure_range,
+                              2);
+    int32_t sensitivity_range[2] = {100, 1600};
+    add_camera_metadata_entry(metadata, ANDROID_SENSOR_INFO_SENSITIVITY_RANGE, sensitivity_range,
+                              2);
+    int32_t ae_comp_range[2] = {-12, 12};
+    add_camera_metadata_entry(metadata, ANDROID_CONTROL_AE_COMPENSATION_RANGE, ae_comp_range, 2);
+    camera_metadata_rational_t ae_comp_step = {1, 6};
+    add_camera_metadata_entry(metadata, ANDROID_CONTROL_AE_COMPENSATION_STEP, &ae_comp_step, 1);
+    add_camera_metadata_entry(metadata, ANDROID_CONTROL_AE_AVAILABLE_TARGET_FPS_RANGES,
+                              fps_ranges.data(), fps_ranges.size());
+    add_camera_metadata_entry(metadata, ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS,
+                              stream_configs.data(), stream_configs.size());
+    add_camera_metadata_entry(metadata, ANDROID_SCALER_AVAILABLE_MIN_FRAME_DURATIONS,
+                              min_durations.data(), min_durations.size());
+    int32_t jpeg_max_size = MOCK_SENSOR_WIDTH * MOCK_SENSOR_HEIGHT * 3 / 2;
+    add_camera_metadata_entry(metadata, ANDROID_JPEG_MAX_SIZE, &jpeg_max_size, 1);
+    if (config.hal_buffers) {
+        uint8_t buffer_management =
+            ANDROID_INFO_SUPPORTED_BUFFER_MANAGEMENT_VERSION_HIDL_DEVICE_3_5;
+        add_camera_metadata_entry(metadata, ANDROID_INFO_SUPPORTED_BUFFER_MANAGEMENT_VERSION,
+                                  &buffer_management, 1);
+    }
+    return metadata;
+}
+
+/**
+ * @brief pick the largest known camx yuv alignment that fits in the mapped buffer
+*/
+static void guess_yuv_layout(uint32_t width, uint32_t height, size_t size, uint32_t *stride,
+                             uint32_t *slice) {
+    static const uint32_t alignments[][2] = {{512, 512}, {128, 32}, {64, 64}, {1, 1}};
+    for (const auto &alignment : alignments) {
+        *stride = mock_align(width, alignment[0]);
+        *slice = mock_align(height, alignment[1]);
+        if ((size_t)*stride * *slice * 3 / 2 <= size) {
+            return;
+        }
+    }
+    *stride = width;
+    *slice = height;
+}
+
+static void fill_ramp_rows(uint8_t *data, size_t size, const uint8_t *ramp, uint32_t row_bytes,
+                           uint32_t stride, uint32_t rows, uint32_t phase) {
+    if (row_bytes > MOCK_RAMP_LENGTH) {
+        row_bytes = MOCK_RAMP_LENGTH;
+    }
+    for (uint32_t y = 0; y < rows; y++) {
+        size_t offset = (size_t)y * stride;
+        if (offset + row_bytes > size) {
+            break;
+        }
+        memcpy(data + offset, ramp + ((y + phase) & 0xFF), row_bytes);
+    }
+}
+
+static void fill_jpeg_blob(uint8_t *data, size_t size, uint32_t frame_number) {
+    if (size < 64 + sizeof(camera3_jpeg_blob_t)) {
+        return;
+    }
+    // SOI, COM segment carrying the frame number, EOI
+    char comment[48];
+    int comment_length = snprintf(comment, sizeof(comment), "qcamx mock frame %u", frame_number);
+    uint32_t offset = 0;
+    data[offset++] = 0xFF;
+    data[offset++] = 0xD8;
+    data[offset++] = 0xFF;
+    data[offset++] = 0xFE;
+    data[offset++] = (uint8_t)((comment_length + 2) >> 8);
+    data[offset++] = (uint8_t)((comment_length + 2) & 0xFF);
+    memcpy(data + offset, comment, comment_length);
+    offset += comment_length;
+    data[offset++] = 0xFF;
+    data[offset++] = 0xD9;
+
+    camera3_jpeg_blob_t blob;
+    blob.jpeg_blob_id = CAMERA3_JPEG_BLOB_ID;
+    blob.jpeg_size = offset;
+    memcpy(data + size - sizeof(blob), &blob, sizeof(blob));
+}
+
+/*************************camera3_device_ops*****************************/
+
+static QCamxMockCamera *get_mock_camera(const camera3_device *device) {
+    return (QCamxMockCamera *)device->priv;
+}
+
+static int mock_initialize(const camera3_device *device,
+                           const camera3_callback_ops_t *callback_ops) {
+    return get_mock_camera(device)->initialize(callback_ops);
+}
+
+static int mock_configure_streams(const camera3_device *device,
+                                  camera3_stream_configuration_t *stream_list) {
+    return get_mock_camera(device)->configure_streams(stream_list);
+}
+
+static const camera_metadata_t *mock_construct_default_request_settings(
+    const camera3_device *device, int type) {
+    return get_mock_camera(device)->construct_default_request_settings(type);
+}
+
+static int mock_process_capture_request(const camera3_device *device,
+                                        camera3_capture_request_t *request) {
+    return get_mock_camera(device)->process_capture_request(request);
+}
+
+static int mock_flush(const camera3_device *device) {
+    return get_mock_camera(device)->flush();
+}
+
+static camera3_device_ops_t s_mock_device_ops = {
+    .initialize = mock_initialize,
+    .configure_streams = mock_configure_streams,
+    .register_stream_buffers = NULL,
+    .construct_default_request_settings = mock_construct_default_request_settings,
+    .process_capture_request = mock_process_capture_request,
+    .get_metadata_vendor_tag_ops = NULL,
+    .dump = NULL,
+    .flush = mock_flush,
+};
+
+static QCamxMockCamera *s_mock_cameras[MOCK_MAX_CAMERAS];
+static pthread_mutex_t s_mock_cameras_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int mock_close(hw_device_t *device) {
+    QCamxMockCamera *camera = get_mock_camera((camera3_device *)device);
+    camera->close();
+    pthread_mutex_lock(&s_mock_cameras_lock);
+    s_mock_cameras[camera->get_camera_id()] = NULL;
+    pthread_mutex_unlock(&s_mock_cameras_lock);
+    delete camera;
+    return 0;
+}
+
+/*************************QCamxMockCamera*****************************/
+
+QCamxMockCamera::QCamxMockCamera(int camera_id, hw_module_t *module,
+                                 const QCamxMockConfig &config,
+                                 const camera_metadata_t *static_metadata) {
+    memset(&_device, 0, sizeof(_device));
+    _device.common.tag = HARDWARE_DEVICE_TAG;
+    _device.common.version = CAMERA_DEVICE_API_VERSION_3_5;
+    _device.common.module = module;
+    _device.common.close = mock_close;
+    _device.ops = &s_mock_device_ops;
+    _device.priv = this;
+
+    _camera_id = camera_id;
+    _config = config;
+    _static_metadata = static_metadata;
+    _callback_ops = NULL;
+    memset(_default_settings, 0, sizeof(_default_settings));
+    _last_settings = NULL;
+    _frame_period_ns = MOCK_NS_PER_SECOND / _config.fps;
+    _max_inflight = (uint32_t)_config.max_buffers;
+
+    memset(_requests, 0, sizeof(_requests));
+    _submit_index = 0;
+    _sensor_index = 0;
+    _result_index = 0;
+    pthread_mutex_init(&_lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_request_cond, &attr);
+    pthread_cond_init(&_result_cond, &attr);
+    pthread_cond_init(&_space_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    _running = false;
+    _flushing = false;
+
+    _num_mappings = 0;
+    _ramp = new uint8_t[MOCK_RAMP_LENGTH + 256];
+    for (int i = 0; i < MOCK_RAMP_LENGTH + 256; i++) {
+        _ramp[i] = (uint8_t)i;
+    }
+
+    _frame_count = 0;
+    _missed_ticks = 0;
+    _blocked_requests = 0;
+    _requested_buffers = 0;
+    _failed_buffer_requests = 0;
+}
+
+QCamxMockCamera::~QCamxMockCamera() {
+    for (int i = 0; i < CAMERA3_TEMPLATE_COUNT; i++) {
+        if (_default_settings[i] != NULL) {
+            free_camera_metadata(_default_settings[i]);
+        }
+    }
+    if (_last_settings != NULL) {
+        free_camera_metadata(_last_settings);
+    }
+    for (int i = 0; i < MOCK_MAX_INFLIGHT; i++) {
+        if (_requests[i].metadata != NULL) {
+            free_camera_metadata(_requests[i].metadata);
+        }
+        if (_requests[i].partial != NULL) {
+            free_camera_metadata(_requests[i].partial);
+        }
+    }
+    delete[] _ramp;
+    pthread_cond_destroy(&_request_cond);
+    pthread_cond_destroy(&_result_cond);
+    pthread_cond_destroy(&_space_cond);
+    pthread_mutex_destroy(&_lock);
+}
+
+/*************************public method*****************************/
+
+int QCamxMockCamera::initialize(const camera3_callback_ops_t *callback_ops) {
+    if (callback_ops == NULL) {
+        return -EINVAL;
+    }
+    _callback_ops = callback_ops;
+    return 0;
+}
+
+int QCamxMockCamera::configure_streams(camera3_stream_configuration_t *stream_list) {
+    if (_callback_ops == NULL) {
+        QCAMX_ERR("mock camera %d: configure before initialize\n", _camera_id);
+        return -ENODEV;
+    }
+    if (stream_list == NULL || stream_list->streams == NULL || stream_list->num_streams == 0 ||
+        stream_list->num_streams > MOCK_MAX_STREAMS) {
+        return -EINVAL;
+    }
+    for (uint32_t i = 0; i < stream_list->num_streams; i++) {
+        camera3_stream_t *stream = stream_list->streams[i];
+        if (stream == NULL || stream->stream_type != CAMERA3_STREAM_OUTPUT || stream->width == 0 ||
+            stream->height == 0) {
+            QCAMX_ERR("mock camera %d: unsupported stream %u\n", _camera_id, i);
+            return -EINVAL;
+        }
+    }
+
+    flush();
+    stop_threads();
+    unmap_all_buffers();
+    if (_last_settings != NULL) {
+        free_camera_metadata(_last_settings);
+        _last_settings = NULL;
+    }
+
+    for (uint32_t i = 0; i < stream_list->num_streams; i++) {
+        camera3_stream_t *stream = stream_list->streams[i];
+        stream->max_buffers = _config.max_buffers;
+        stream->usage |= GRALLOC_USAGE_HW_CAMERA_WRITE;
+        QCAMX_PRINT("mock camera %d: stream %u format:0x%x %ux%u max_buffers:%u\n", _camera_id, i,
+                    stream->format, stream->width, stream->height, stream->max_buffers);
+    }
+    return start_threads();
+}
+
+const camera_metadata_t *QCamxMockCamera::construct_default_request_settings(int type) {
+    if (type < CAMERA3_TEMPLATE_PREVIEW || type >= CAMERA3_TEMPLATE_COUNT) {
+        return NULL;
+    }
+    if (_default_settings[type] != NULL) {
+        return _default_settings[type];
+    }
+
+    uint8_t intent = ANDROID_CONTROL_CAPTURE_INTENT_PREVIEW;
+    uint8_t af_mode = ANDROID_CONTROL_AF_MODE_CONTINUOUS_PICTURE;
+    switch (type) {
+        case CAMERA3_TEMPLATE_STILL_CAPTURE:
+            intent = ANDROID_CONTROL_CAPTURE_INTENT_STILL_CAPTURE;
+            break;
+        case CAMERA3_TEMPLATE_VIDEO_RECORD:
+            intent = ANDROID_CONTROL_CAPTURE_INTENT_VIDEO_RECORD;
+            af_mode = ANDROID_CONTROL_AF_MODE_CONTINUOUS_VIDEO;
+            break;
+        case CAMERA3_TEMPLATE_VIDEO_SNAPSHOT:
+            intent = ANDROID_CONTROL_CAPTURE_INTENT_VIDEO_SNAPSHOT;
+            af_mode = ANDROID_CONTROL_AF_MODE_CONTINUOUS_VIDEO;
+            break;
+        case CAMERA3_TEMPLATE_ZERO_SHUTTER_LAG:
+            intent = ANDROID_CONTROL_CAPTURE_INTENT_ZERO_SHUTTER_LAG;
+            break;
+        case CAMERA3_TEMPLATE_MANUAL:
+            intent = ANDROID_CONTROL_CAPTURE_INTENT_MANUAL;
+            af_mode = ANDROID_CONTROL_AF_MODE_OFF;
+            break;
+        default:
+            break;
+    }
+
+    camera_metadata_t *settings = allocate_camera_metadata(24, 256);
+    if (settings == NULL) {
+        return NULL;
+    }
+    add_camera_metadata_entry(settings, ANDROID_CONTROL_CAPTURE_INTENT, &intent, 1);
+    uint8_t control_mode = ANDROID_CONTROL_MODE_AUTO;
+    add_camera_metadata_entry(settings, ANDROID_CONTROL_MODE, &control_mode, 1);
+    uint8_t ae_mode = ANDROID_CONTROL_AE_MODE_ON;
+    add_camera_metadata_entry(settings, ANDROID_CONTROL_AE_MODE, &ae_mode, 1);
+    uint8_t awb_mode = ANDROID_CONTROL_AWB_MODE_AUTO;
+    add_camera_metadata_entry(settings, ANDROID_CONTROL_AWB_MODE, &awb_mode, 1);
+    add_camera_metadata_entry(settings, ANDROID_CONTROL_AF_MODE, &af_mode, 1);
+    uint8_t antibanding = ANDROID_CONTROL_AE_ANTIBANDING_MODE_AUTO;
+    add_camera_metadata_entry(settings, ANDROID_CONTROL_AE_ANTIBANDING_MODE, &antibanding, 1);
+    int32_t ae_comp = 0;
+    add_camera_metadata_entry(settings, ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION, &ae_comp, 1);
+    int32_t fps_range[2] = {_config.fps < 30 ? _config.fps : 30, _config.fps};
+    add_camera_metadata_entry(settings, ANDROID_CONTROL_AE_TARGET_FPS_RANGE, fps_range, 2);
+    int64_t exposure_time = _frame_period_ns / 2;
+    add_camera_metadata_entry(settings, ANDROID_SENSOR_EXPOSURE_TIME, &exposure_time, 1);
+    int32_t sensitivity = 100;
+    add_camera_metadata_entry(settings, ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1);
+    add_camera_metadata_entry(settings, ANDROID_SENSOR_FRAME_DURATION, &_frame_period_ns, 1);
+    uint8_t color_correction = ANDROID_COLOR_CORRECTION_MODE_FAST;
+    add_camera_metadata_entry(settings, ANDROID_COLOR_CORRECTION_MODE, &color_correction, 1);
+    uint8_t jpeg_quality = 95;
+    add_camera_metadata_entry(settings, ANDROID_JPEG_QUALITY, &jpeg_quality, 1);
+    int32_t crop_region[4] = {0, 0, MOCK_SENSOR_WIDTH, MOCK_SENSOR_HEIGHT};
+    add_camera_metadata_entry(settings, ANDROID_SCALER_CROP_REGION, crop_region, 4);
+
+    _default_settings[type] = settings;
+    return settings;
+}
+
+int QCamxMockCamera::process_capture_request(camera3_capture_request_t *request) {
+    if (request == NULL || request->output_buffers == NULL || request->num_output_buffers == 0 ||
+        request->num_output_buffers > MOCK_MAX_STREAMS) {
+        return -EINVAL;
+    }
+    if (request->input_buffer != NULL) {
+        QCAMX_ERR("mock camera %d: reprocess request is not supported\n", _camera_id);
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&_lock);
+    if (request->settings == NULL && _last_settings == NULL) {
+        pthread_mutex_unlock(&_lock);
+        QCAMX_ERR("mock camera %d: first request frame:%u without settings\n", _camera_id,
+                  request->frame_number);
+        return -EINVAL;
+    }
+    if (_running && _submit_index - _result_index >= _max_inflight) {
+        _blocked_requests++;
+        struct timespec timeout;
+        clock_gettime(CLOCK_MONOTONIC, &timeout);
+        timeout.tv_sec += 1;
+        while (_running && _submit_index - _result_index >= _max_inflight) {
+            if (pthread_cond_timedwait(&_space_cond, &_lock, &timeout) == ETIMEDOUT) {
+                break;
+            }
+        }
+    }
+    if (!_running || _submit_index - _result_index >= _max_inflight) {
+        pthread_mutex_unlock(&_lock);
+        QCAMX_ERR("mock camera %d: can not queue frame:%u\n", _camera_id, request->frame_number);
+        return -ENODEV;
+    }
+
+    if (request->settings != NULL) {
+        _last_settings = copy_metadata(_last_settings, request->settings, 0, 0);
+    }
+    MockRequest *slot = &_requests[_submit_index % MOCK_MAX_INFLIGHT];
+    slot->frame_number = request->frame_number;
+    slot->num_output_buffers = request->num_output_buffers;
+    memcpy(slot->output_buffers, request->output_buffers,
+           request->num_output_buffers * sizeof(camera3_stream_buffer_t));
+    slot->metadata = copy_metadata(slot->metadata, _last_settings, MOCK_RESULT_EXTRA_ENTRIES,
+                                   MOCK_RESULT_EXTRA_DATA);
+    slot->timestamp_ns = 0;
+    slot->due_ns = 0;
+    slot->error = false;
+    _submit_index++;
+    pthread_cond_signal(&_request_cond);
+    pthread_mutex_unlock(&_lock);
+    return 0;
+}
+
+int QCamxMockCamera::flush() {
+    pthread_mutex_lock(&_lock);
+    _flushing = true;
+    pthread_cond_signal(&_request_cond);
+    while (_running && _result_index != _submit_index) {
+        pthread_cond_wait(&_space_cond, &_lock);
+    }
+    _flushing = false;
+    pthread_mutex_unlock(&_lock);
+    return 0;
+}
+
+void QCamxMockCamera::close() {
+    flush();
+    stop_threads();
+    unmap_all_buffers();
+    QCAMX_PRINT("mock camera %d: frames:%" PRIu64 " missed sensor ticks:%" PRIu64
+                " blocked requests:%" PRIu64 " requested buffers:%" PRIu64 " failed:%" PRIu64
+                "\n",
+                _camera_id, _frame_count, _missed_ticks, _blocked_requests, _requested_buffers,
+                _failed_buffer_requests);
+}
+
+/*************************private method*****************************/
+
+void *QCamxMockCamera::sensor_thread_entry(void *data) {
+    ((QCamxMockCamera *)data)->sensor_loop();
+    return NULL;
+}
+
+void *QCamxMockCamera::result_thread_entry(void *data) {
+    ((QCamxMockCamera *)data)->result_loop();
+    return NULL;
+}
+
+int QCamxMockCamera::start_threads() {
+    _submit_index = 0;
+    _sensor_index = 0;
+    _result_index = 0;
+    _running = true;
+    if (pthread_create(&_sensor_thread, NULL, sensor_thread_entry, this) != 0) {
+        _running = false;
+        return -ENOMEM;
+    }
+    if (pthread_create(&_result_thread, NULL, result_thread_entry, this) != 0) {
+        pthread_mutex_lock(&_lock);
+        _running = false;
+        pthread_cond_broadcast(&_request_cond);
+        pthread_mutex_unlock(&_lock);
+        pthread_join(_sensor_thread, NULL);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+void QCamxMockCamera::stop_threads() {
+    pthread_mutex_lock(&_lock);
+    if (!_running) {
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+    _running = false;
+    pthread_cond_broadcast(&_request_cond);
+    pthread_cond_broadcast(&_result_cond);
+    pthread_cond_broadcast(&_space_cond);
+    pthread_mutex_unlock(&_lock);
+    pthread_join(_sensor_thread, NULL);
+    pthread_join(_result_thread, NULL);
+}
+
+void QCamxMockCamera::sensor_loop() {
+    int64_t next_tick_ns = 0;
+    unsigned int seed = (unsigned int)(_camera_id + 1);
+    pthread_mutex_lock(&_lock);
+    while (_running) {
+        if (_sensor_index == _submit_index) {
+            pthread_cond_wait(&_request_cond, &_lock);
+            continue;
+        }
+        bool flushing = _flushing;
+        MockRequest *request = &_requests[_sensor_index % MOCK_MAX_INFLIGHT];
+        pthread_mutex_unlock(&_lock);
+
+        int64_t now_ns = mock_now_ns();
+        if (flushing || next_tick_ns == 0) {
+            next_tick_ns = now_ns;
+        } else if (now_ns > next_tick_ns + _frame_period_ns) {
+            // the client did not queue a request in time, the sensor skipped these frames
+            _missed_ticks += (now_ns - next_tick_ns) / _frame_period_ns;
+            next_tick_ns = now_ns;
+        }
+        if (!flushing) {
+            int64_t jitter_ns = 0;
+            if (_config.jitter_us > 0) {
+                jitter_ns = ((int64_t)(rand_r(&seed) % (2 * _config.jitter_us + 1)) -
+                             _config.jitter_us) *
+                            1000;
+            }
+            mock_sleep_until_ns(next_tick_ns + jitter_ns);
+            next_tick_ns += _frame_period_ns;
+        }
+
+        request->timestamp_ns = mock_now_ns();
+        request->error = flushing;
+        request->due_ns =
+            flushing ? request->timestamp_ns
+                     : request->timestamp_ns + (_config.pipeline_depth - 1) * _frame_period_ns;
+        notify_shutter(request->frame_number, request->timestamp_ns);
+        send_partial_result(request);
+
+        pthread_mutex_lock(&_lock);
+        _sensor_index++;
+        pthread_cond_signal(&_result_cond);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+void QCamxMockCamera::result_loop() {
+    pthread_mutex_lock(&_lock);
+    for (;;) {
+        if (_result_index == _sensor_index) {
+            if (!_running) {
+                break;
+            }
+            pthread_cond_wait(&_result_cond, &_lock);
+            continue;
+        }
+        MockRequest *request = &_requests[_result_index % MOCK_MAX_INFLIGHT];
+        pthread_mutex_unlock(&_lock);
+
+        if (!request->error) {
+            mock_sleep_until_ns(request->due_ns);
+        }
+        complete_request(request);
+
+        pthread_mutex_lock(&_lock);
+        _result_index++;
+        pthread_cond_broadcast(&_space_cond);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+void QCamxMockCamera::send_partial_result(MockRequest *request) {
+    request->partial = reset_metadata(request->partial, 4, 16);
+    if (request->partial == NULL) {
+        return;
+    }
+    uint8_t ae_state = ANDROID_CONTROL_AE_STATE_CONVERGED;
+    add_camera_metadata_entry(request->partial, ANDROID_CONTROL_AE_STATE, &ae_state, 1);
+    uint8_t awb_state = ANDROID_CONTROL_AWB_STATE_CONVERGED;
+    add_camera_metadata_entry(request->partial, ANDROID_CONTROL_AWB_STATE, &awb_state, 1);
+    uint8_t af_state = ANDROID_CONTROL_AF_STATE_PASSIVE_FOCUSED;
+    add_camera_metadata_entry(request->partial, ANDROID_CONTROL_AF_STATE, &af_state, 1);
+
+    camera3_capture_result_t result;
+    memset(&result, 0, sizeof(result));
+    result.frame_number = request->frame_number;
+    result.result = request->partial;
+    result.partial_result = 1;
+    _callback_ops->process_capture_result(_callback_ops, &result);
+}
+
+void QCamxMockCamera::complete_request(MockRequest *request) {
+    for (uint32_t i = 0; i < request->num_output_buffers; i++) {
+        camera3_stream_buffer_t *buffer = &request->output_buffers[i];
+        // a HAL managed buffer is only taken once the frame is ready to be written
+        bool has_buffer = buffer->buffer != NULL || (!request->error && request_buffer(buffer));
+        buffer->acquire_fence = -1;
+        buffer->release_fence = -1;
+        if (request->error || !has_buffer) {
+            buffer->status = CAMERA3_BUFFER_STATUS_ERROR;
+            notify_buffer_error(request->frame_number, buffer->stream);
+        } else {
+            fill_buffer(buffer->stream, buffer->buffer, request->frame_number);
+            buffer->status = CAMERA3_BUFFER_STATUS_OK;
+        }
+    }
+
+    if (request->metadata != NULL) {
+        set_metadata_entry(request->metadata, ANDROID_SENSOR_TIMESTAMP, &request->timestamp_ns, 1);
+        set_metadata_entry(request->metadata, ANDROID_SENSOR_FRAME_DURATION, &_frame_period_ns, 1);
+        uint8_t pipeline_depth = (uint8_t)_config.pipeline_depth;
+        set_metadata_entry(request->metadata, ANDROID_REQUEST_PIPELINE_DEPTH, &pipeline_depth, 1);
+    }
+
+    camera3_capture_result_t result;
+    memset(&result, 0, sizeof(result));
+    result.frame_number = request->frame_number;
+    result.result = request->metadata;
+    result.num_output_buffers = request->num_output_buffers;
+    result.output_buffers = request->output_buffers;
+    result.partial_result = MOCK_PARTIAL_RESULT_COUNT;
+    _callback_ops->process_capture_result(_callback_ops, &result);
+    _frame_count++;
+}
+
+bool QCamxMockCamera::request_buffer(camera3_stream_buffer_t *buffer) {
+    if (_callback_ops->request_stream_buffers == NULL) {
+        return false;
+    }
+    camera3_buffer_request_t buffer_request;
+    buffer_request.stream = buffer->stream;
+    buffer_request.num_buffers_requested = 1;
+    camera3_stream_buffer_ret_t buffer_ret;
+    memset(&buffer_ret, 0, sizeof(buffer_ret));
+    buffer_ret.output_buffers = buffer;
+    uint32_t num_returned = 0;
+    camera3_buffer_request_status_t status = _callback_ops->request_stream_buffers(
+        _callback_ops, 1, &buffer_request, &num_returned, &buffer_ret);
+    if (status != CAMERA3_BUF_REQ_OK || num_returned != 1 ||
+        buffer_ret.status != CAMERA3_PS_BUF_REQ_OK || buffer_ret.num_output_buffers != 1) {
+        _failed_buffer_requests++;
+        buffer->buffer = NULL;
+        return false;
+    }
+    _requested_buffers++;
+    return true;
+}
+
+void QCamxMockCamera::fill_buffer(const camera3_stream_t *stream, buffer_handle_t *buffer,
+                                  uint32_t frame_number) {
+    if (_config.fill == 0 && stream->format != HAL_PIXEL_FORMAT_BLOB) {
+        return;
+    }
+    MockMapping *mapping = map_buffer(buffer);
+    if (mapping == NULL) {
+        return;
+    }
+    uint8_t *data = mapping->addr;
+    size_t size = mapping->size;
+    uint32_t width = stream->width;
+    uint32_t height = stream->height;
+    uint32_t phase = frame_number * 2;
+    switch (stream->format) {
+        case HAL_PIXEL_FORMAT_BLOB: {
+            fill_jpeg_blob(data, size, frame_number);
+            break;
+        }
+        case HAL_PIXEL_FORMAT_RAW10:
+        case HAL_PIXEL_FORMAT_RAW12: {
+            uint32_t stride = stream->format == HAL_PIXEL_FORMAT_RAW10
+                                  ? mock_align(width * 5 / 4, 16)
+                                  : mock_align(width * 3 / 2, 16);
+            fill_ramp_rows(data, size, _ramp, stride, stride, height, phase);
+            break;
+        }
+        case HAL_PIXEL_FORMAT_RAW16:
+        case HAL_PIXEL_FORMAT_Y16: {
+            uint32_t stride = width * 2;
+            for (uint32_t y = 0; y < height && (size_t)(y + 1) * stride <= size; y++) {
+                uint16_t *row = (uint16_t *)(data + (size_t)y * stride);
+                for (uint32_t x = 0; x < width; x++) {
+                    row[x] = (uint16_t)((x + y + phase) & 0x3FF);
+                }
+            }
+            break;
+        }
+        default: {
+            // IMPLEMENTATION_DEFINED and YCbCr_420_888 are NV12, moving luma gradient, grey chroma
+            uint32_t stride;
+            uint32_t slice;
+            guess_yuv_layout(width, height, size, &stride, &slice);
+            fill_ramp_rows(data, size, _ramp, width, stride, height, phase);
+            size_t chroma_offset = (size_t)stride * slice;
+            for (uint32_t y = 0; y < height / 2; y++) {
+                size_t offset = chroma_offset + (size_t)y * stride;
+                if (offset + width > size) {
+                    break;
+                }
+                memset(data + offset, 0x80, width);
+            }
+            break;
+        }
+    }
+}
+
+QCamxMockCamera::MockMapping *QCamxMockCamera::map_buffer(buffer_handle_t *buffer) {
+    if (buffer == NULL || *buffer == NULL || (*buffer)->numFds < 1) {
+        return NULL;
+    }
+    int fd = (*buffer)->data[0];
+    for (int i = 0; i < _num_mappings; i++) {
+        if (_mappings[i].fd == fd) {
+            return &_mappings[i];
+        }
+    }
+
+    off_t length = lseek(fd, 0, SEEK_END);
+    if (length <= 0) {
+        QCAMX_ERR("mock camera %d: can not get size of buffer fd:%d\n", _camera_id, fd);
+        return NULL;
+    }
+    void *addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        QCAMX_ERR("mock camera %d: mmap buffer fd:%d failed:%s\n", _camera_id, fd,
+                  strerror(errno));
+        return NULL;
+    }
+    if (_num_mappings == MOCK_MAX_MAPPINGS) {
+        unmap_all_buffers();
+    }
+    MockMapping *mapping = &_mappings[_num_mappings++];
+    mapping->fd = fd;
+    mapping->addr = (uint8_t *)addr;
+    mapping->size = (size_t)length;
+    return mapping;
+}
+
+void QCamxMockCamera::unmap_all_buffers() {
+    for (int i = 0; i < _num_mappings; i++) {
+        munmap(_mappings[i].addr, _mappings[i].size);
+    }
+    _num_mappings = 0;
+}
+
+void QCamxMockCamera::notify_shutter(uint32_t frame_number, int64_t timestamp_ns) {
+    camera3_notify_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = CAMERA3_MSG_SHUTTER;
+    msg.message.shutter.frame_number = frame_number;
+    msg.message.shutter.timestamp = (uint64_t)timestamp_ns;
+    _callback_ops->notify(_callback_ops, &msg);
+}
+
+void QCamxMockCamera::notify_buffer_error(uint32_t frame_number, camera3_stream_t *stream) {
+    camera3_notify_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = CAMERA3_MSG_ERROR;
+    msg.message.error.frame_number = frame_number;
+    msg.message.error.error_stream = stream;
+    msg.message.error.error_code = CAMERA3_MSG_ERROR_BUFFER;
+    _callback_ops->notify(_callback_ops, &msg);
+}
+
+/*************************camera_module_t*****************************/
+
+static QCamxMockConfig s_mock_config;
+static camera_metadata_t *s_mock_static_metadata;
+static pthread_once_t s_mock_once = PTHREAD_ONCE_INIT;
+
+static void mock_load_module() {
+    s_mock_config.fps = get_env_int("QCAMX_MOCK_FPS", 30, 1, 960);
+    s_mock_config.pipeline_depth = get_env_int("QCAMX_MOCK_PIPELINE_DEPTH", 4, 1, 16);
+    s_mock_config.jitter_us = get_env_int("QCAMX_MOCK_JITTER_US", 0, 0, 1000000);
+    s_mock_config.max_buffers = get_env_int("QCAMX_MOCK_MAX_BUFFERS", 8, 1, MOCK_MAX_INFLIGHT);
+    s_mock_config.num_cameras = get_env_int("QCAMX_MOCK_NUM_CAMERAS", 1, 1, MOCK_MAX_CAMERAS);
+    s_mock_config.fill = get_env_int("QCAMX_MOCK_FILL", 1, 0, 1);
+    s_mock_config.hal_buffers = get_env_int("QCAMX_MOCK_HAL_BUFFERS", 0, 0, 1);
+    if (s_mock_config.max_buffers < s_mock_config.pipeline_depth) {
+        QCAMX_PRINT("mock: max_buffers %d below pipeline depth %d, fps will drop\n",
+                    s_mock_config.max_buffers, s_mock_config.pipeline_depth);
+    }
+    s_mock_static_metadata = build_static_metadata(s_mock_config);
+    QCAMX_PRINT("mock camera module: cameras:%d fps:%d pipeline depth:%d jitter:%dus "
+                "max_buffers:%d fill:%d hal buffers:%d\n",
+                s_mock_config.num_cameras, s_mock_config.fps, s_mock_config.pipeline_depth,
+                s_mock_config.jitter_us, s_mock_config.max_buffers, s_mock_config.fill,
+                s_mock_config.hal_buffers);
+}
+
+static int mock_init() {
+    pthread_once(&s_mock_once, mock_load_module);
+    return s_mock_static_metadata != NULL ? 0 : -ENOMEM;
+}
+
+static int mock_get_number_of_cameras() {
+    return mock_init() == 0 ? s_mock_config.num_cameras : 0;
+}
+
+static int mock_get_camera_info(int camera_id, struct camera_info *info) {
+    if (mock_init() != 0) {
+        return -ENOMEM;
+    }
+    if (info == NULL || camera_id < 0 || camera_id >= s_mock_config.num_cameras) {
+        return -EINVAL;
+    }
+    memset(info, 0, sizeof(*info));
+    info->facing = CAMERA_FACING_BACK;
+    info->orientation = 0;
+    info->device_version = CAMERA_DEVICE_API_VERSION_3_5;
+    info->static_camera_characteristics = s_mock_static_metadata;
+    return 0;
+}
+
+static int mock_set_callbacks(const camera_module_callbacks_t *callbacks) {
+    return 0;
+}
+
+static int mock_open(const hw_module_t *module, const char *id, hw_device_t **device) {
+    if (mock_init() != 0) {
+        return -ENOMEM;
+    }
+    int camera_id = atoi(id);
+    if (camera_id < 0 || camera_id >= s_mock_config.num_cameras) {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&s_mock_cameras_lock);
+    if (s_mock_cameras[camera_id] != NULL) {
+        pthread_mutex_unlock(&s_mock_cameras_lock);
+        return -EBUSY;
+    }
+    QCamxMockCamera *camera = new QCamxMockCamera(camera_id, (hw_module_t *)module, s_mock_config,
+                                                  s_mock_static_metadata);
+    s_mock_cameras[camera_id] = camera;
+    pthread_mutex_unlock(&s_mock_cameras_lock);
+    *device = &camera->get_device()->common;
+    return 0;
+}
+
+static hw_module_methods_t s_mock_module_methods = {
+    .open = mock_open,
+};
+
+}  // namespace qcamx
+
+extern "C" {
+__attribute__((visibility("default"))) camera_module_t HAL_MODULE_INFO_SYM = {
+    .common =
+        {
+            .tag = HARDWARE_MODULE_TAG,
+            .module_api_version = CAMERA_MODULE_API_VERSION_2_4,
+            .hal_api_version = HARDWARE_HAL_API_VERSION,
+            .id = CAMERA_HARDWARE_MODULE_ID,
+            .name = "QCamx mock camera HAL",
+            .author = "camx_hal3_test",
+            .methods = &qcamx::s_mock_module_methods,
+            .dso = NULL,
+            .reserved = {0},
+        },
+    .get_number_of_cameras = qcamx::mock_get_number_of_cameras,
+    .get_camera_info = qcamx::mock_get_camera_info,
+    .set_callbacks = qcamx::mock_set_callbacks,
+    .get_vendor_tag_ops = NULL,
+    .open_legacy = NULL,
+    .set_torch_mode = NULL,
+    .init = qcamx::mock_init,
+};
+}
@@ -0,0 +1,139 @@
+/**
+ * @file  qcamx_mock_camera_module.h
+ * @brief mock camera3 HAL, streams synthetic frames without camera hardware
+ *        built as a separate shared library and loaded with "camx-hal3-test -l <path>"
+*/
+
+#pragma once
+
+#include <hardware/camera3.h>
+#include <hardware/camera_common.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#define MOCK_MAX_CAMERAS (4)
+#define MOCK_MAX_INFLIGHT (64)  // request ring capacity, upper bound of max in-flight
+#define MOCK_MAX_STREAMS (8)
+#define MOCK_MAX_MAPPINGS (128)
+#define MOCK_PARTIAL_RESULT_COUNT (2)
+
+namespace qcamx {
+
+/**
+ * @brief mock behaviour, read once from the environment when the module is initialized
+ *        QCAMX_MOCK_FPS / QCAMX_MOCK_PIPELINE_DEPTH / QCAMX_MOCK_JITTER_US /
+ *        QCAMX_MOCK_MAX_BUFFERS / QCAMX_MOCK_NUM_CAMERAS / QCAMX_MOCK_FILL /
+ *        QCAMX_MOCK_HAL_BUFFERS
+*/
+struct QCamxMockConfig {
+    int fps;             // sensor frame rate
+    int pipeline_depth;  // frames between shutter and buffer done
+    int jitter_us;       // +/- random offset applied to every sensor tick
+    int max_buffers;     // max_buffers reported per stream, also the max in-flight requests
+    int num_cameras;
+    int fill;  // 0: only write the jpeg blob trailer, 1: write the full synthetic pattern
+    // 1: advertise the HAL buffer management, a request without buffer gets one from
+    // request_stream_buffers when its frame is done
+    int hal_buffers;
+};
+
+class QCamxMockCamera {
+public:
+    QCamxMockCamera(int camera_id, hw_module_t *module, const QCamxMockConfig &config,
+                    const camera_metadata_t *static_metadata);
+    ~QCamxMockCamera();
+public:
+    camera3_device_t *get_device() { return &_device; }
+    int get_camera_id() { return _camera_id; }
+    int initialize(const camera3_callback_ops_t *callback_ops);
+    int configure_streams(camera3_stream_configuration_t *stream_list);
+    const camera_metadata_t *construct_default_request_settings(int type);
+    /**
+     * @brief queue one request, blocks while max_buffers requests are in flight
+    */
+    int process_capture_request(camera3_capture_request_t *request);
+    /**
+     * @brief finish all queued requests as fast as possible, unexposed ones with error buffers
+    */
+    int flush();
+    /**
+     * @brief flush and stop the sensor and result threads
+    */
+    void close();
+private:
+    struct MockRequest {
+        uint32_t frame_number;
+        uint32_t num_output_buffers;
+        camera3_stream_buffer_t output_buffers[MOCK_MAX_STREAMS];
+        camera_metadata_t *metadata;  // request settings, completed in place as final result
+        camera_metadata_t *partial;   // 3A states sent as the first partial result
+        int64_t timestamp_ns;
+        int64_t due_ns;
+        bool error;
+    };
+    struct MockMapping {
+        int fd;
+        uint8_t *addr;
+        size_t size;
+    };
+    static void *sensor_thread_entry(void *data);
+    static void *result_thread_entry(void *data);
+    void sensor_loop();
+    void result_loop();
+    int start_threads();
+    void stop_threads();
+    void send_partial_result(MockRequest *request);
+    void complete_request(MockRequest *request);
+    /**
+     * @brief get the buffer of a request sent without one from the client
+     * @return false if the client had no buffer
+    */
+    bool request_buffer(camera3_stream_buffer_t *buffer);
+    void fill_buffer(const camera3_stream_t *stream, buffer_handle_t *buffer,
+                     uint32_t frame_number);
+    MockMapping *map_buffer(buffer_handle_t *buffer);
+    void unmap_all_buffers();
+    void notify_shutter(uint32_t frame_number, int64_t timestamp_ns);
+    void notify_buffer_error(uint32_t frame_number, camera3_stream_t *stream);
+    // Do not support the copy constructor or assignment operator
+    QCamxMockCamera(const QCamxMockCamera &) = delete;
+    QCamxMockCamera &operator=(const QCamxMockCamera &) = delete;
+private:
+    camera3_device_t _device;
+    int _camera_id;
+    QCamxMockConfig _config;
+    const camera_metadata_t *_static_metadata;
+    const camera3_callback_ops_t *_callback_ops;
+    camera_metadata_t *_default_settings[CAMERA3_TEMPLATE_COUNT];
+    camera_metadata_t *_last_settings;
+    int64_t _frame_period_ns;
+    uint32_t _max_inflight;
+
+    // request ring, _result_index <= _sensor_index <= _submit_index
+    MockRequest _requests[MOCK_MAX_INFLIGHT];
+    uint64_t _submit_index;
+    uint64_t _sensor_index;
+    uint64_t _result_index;
+    pthread_mutex_t _lock;
+    pthread_cond_t _request_cond;  // new request queued, sensor thread waits on it
+    pthread_cond_t _result_cond;   // frame exposed, result thread waits on it
+    pthread_cond_t _space_cond;    // request finished, process_capture_request/flush wait on it
+    bool _running;
+    bool _flushing;
+    pthread_t _sensor_thread;
+    pthread_t _result_thread;
+
+    // only touched by the result thread while streaming
+    MockMapping _mappings[MOCK_MAX_MAPPINGS];
+    int _num_mappings;
+    uint8_t *_ramp;
+
+    // statistics printed on close
+    uint64_t _frame_count;
+    uint64_t _missed_ticks;
+    uint64_t _blocked_requests;
+    uint64_t _requested_buffers;
+    uint64_t _failed_buffer_requests;
+};
+
+}  // namespace qcamx
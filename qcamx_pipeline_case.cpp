@@ -0,0 +1,441 @@
+#include "qcamx_pipeline_case.h"
+
+#include <string.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxHAL3Test"
+
+static_assert(PIPELINE_STREAM_MAX <= MAXSTREAM, "device can not configure every pipeline stream");
+
+void QCamxPipelineCase::capture_post_process(DeviceCallback *cb, camera3_capture_result *result) {
+    const camera3_stream_buffer_t *buffers = result->output_buffers;
+    bool dump_due = _dump_interval == 0 || result->frame_number % _dump_interval == 0;
+
+    for (uint32_t i = 0; i < result->num_output_buffers; i++) {
+        int index = _device->find_stream_index(buffers[i].stream);
+        if (index < 0 || index >= _stream_num) {
+            continue;
+        }
+        PipelineRoute *route = &_routes[index];
+        CameraStream *stream = _device->_camera_streams[index];
+        buffer_handle_t *buffer = buffers[i].buffer;
+
+        if (route->consumers & PIPELINE_CONSUMER_EXPORT) {
+            publish_frame(stream, buffer, result->frame_number, route->type, route->subformat);
+        }
+        if (route->consumers & PIPELINE_CONSUMER_STATS) {
+            compute_frame_stats(stream->buffer_manager->get_buffer_info(buffer), route->type,
+                                route->subformat, result->frame_number, route->stats);
+        }
+        if ((route->consumers & PIPELINE_CONSUMER_DUMP) &&
+            (route->on_demand || (route->dump_num > 0 && dump_due))) {
+            dump_frame_async(stream, buffer, result->frame_number, route->type, route->subformat);
+            if (!route->on_demand && _dump_interval == 0) {
+                route->dump_num--;
+            }
+        }
+        if ((route->consumers & PIPELINE_CONSUMER_ENCODER) && !_stop) {
+            enqueue_frame_buffer(stream, buffer);
+        } else if (_device->get_sync_buffer_mode() == SYNC_BUFFER_EXTERNAL) {
+            // else the device returns the buffers of the result itself
+            stream->buffer_manager->return_buffer(buffer);
+        }
+        if (route->record_metrics) {
+            update_stream_metrics(route->type, result->frame_number);
+        }
+    }
+}
+
+void QCamxPipelineCase::handle_metadata(DeviceCallback *cb, camera3_capture_result *result) {
+    QCamxCase::handle_metadata(cb, result);
+    if (_video_index < 0 || result->partial_result < 1) {
+        return;
+    }
+    if (_config->_meta_dump.SatCamId >= 0) {
+        int id = _watch_ids[META_WATCH_SAT_CAMERA_ID];
+        if (_metadata_watch.found(id)) {
+            int camera_id = _metadata_watch.get<int32_t>(id, 0, 0);
+            QCAMX_INFO_RATELIMIT("frame_number: %d, SAT CameraId: %d\n", result->frame_number,
+                                 camera_id);
+            _config->_meta_stat.camId = camera_id;
+        }
+    }
+    int id = _watch_ids[META_WATCH_SAT_ACTIVE_ARRAY];
+    if (_metadata_watch.found(id)) {
+        for (int i = 0; i < 4; i++) {
+            _config->_meta_stat.activeArray[i] = _metadata_watch.get<int32_t>(id, i, 0);
+        }
+        QCAMX_DBG("frame_number: %d, SAT ActiveSensorArray: [%d,%d,%d,%d]", result->frame_number,
+                  _config->_meta_stat.activeArray[0], _config->_meta_stat.activeArray[1],
+                  _config->_meta_stat.activeArray[2], _config->_meta_stat.activeArray[3]);
+    }
+    id = _watch_ids[META_WATCH_SAT_CROP_REGION];
+    if (_metadata_watch.found(id)) {
+        for (int i = 0; i < 4; i++) {
+            _config->_meta_stat.cropRegion[i] = _metadata_watch.get<int32_t>(id, i, 0);
+        }
+        QCAMX_INFO_RATELIMIT("frame_number: %d, SAT ScalerCropRegion: [%d,%d,%d,%d]",
+                             result->frame_number, _config->_meta_stat.cropRegion[0],
+                             _config->_meta_stat.cropRegion[1], _config->_meta_stat.cropRegion[2],
+                             _config->_meta_stat.cropRegion[3]);
+    }
+}
+
+int QCamxPipelineCase::pre_init_stream() {
+    _streams.resize(_stream_num);
+    for (int i = 0; i < _stream_num; i++) {
+        const pipeline_stream_t *config = &_config->_pipeline_streams[i];
+        camera3_stream_t *stream = &_pipeline_streams[i];
+        memset(stream, 0, sizeof(camera3_stream_t));
+        stream->stream_type = CAMERA3_STREAM_OUTPUT;
+        stream->width = config->width;
+        stream->height = config->height;
+        stream->format = config->format;
+        stream->rotation = CAMERA3_STREAM_ROTATION_0;
+        stream->priv = 0;
+
+        int buffers = 0;
+        switch (config->type) {
+            case PREVIEW_TYPE:
+                stream->usage = GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_HW_TEXTURE |
+                                GRALLOC_USAGE_HW_CAMERA_WRITE;
+                stream->data_space =
+                    config->format == HAL_PIXEL_FORMAT_Y16 ? HAL_DATASPACE_DEPTH
+                                                           : HAL_DATASPACE_UNKNOWN;
+                buffers = _config->_fps_range[1] > 60 ? HFR_PREVIEW_STREAM_BUFFER_MAX
+                                                      : PREVIEW_STREAM_BUFFER_MAX;
+                break;
+            case VIDEO_TYPE:
+                stream->usage = GRALLOC_USAGE_PRIVATE_0 | GRALLOC_USAGE_HW_VIDEO_ENCODER |
+                                GRALLOC_USAGE_HW_CAMERA_WRITE;
+                stream->data_space = HAL_DATASPACE_BT709;
+                if (config->subformat == UBWCTP10) {
+                    stream->usage = GRALLOC_USAGE_HW_VIDEO_ENCODER | GRALLOC_USAGE_PRIVATE_0 |
+                                    GRALLOC_USAGE_PRIVATE_2;
+                    stream->data_space = HAL_DATASPACE_TRANSFER_GAMMA2_8;
+                } else if (config->subformat == P010) {
+                    stream->usage = GRALLOC_USAGE_HW_VIDEO_ENCODER | GRALLOC_USAGE_PRIVATE_2;
+                    stream->data_space = HAL_DATASPACE_TRANSFER_GAMMA2_8;
+                }
+                buffers = _config->_fps_range[1] > 60 ? HFR_VIDEO_STREAM_BUFFER_MAX
+                                                      : VIDEO_STREAM_BUFFER_MAX;
+                break;
+            case SNAPSHOT_TYPE:
+                stream->usage = GRALLOC_USAGE_SW_READ_OFTEN;
+                stream->data_space = config->format == HAL_PIXEL_FORMAT_BLOB
+                                         ? HAL_DATASPACE_V0_JFIF
+                                         : HAL_DATASPACE_UNKNOWN;
+                buffers = SNAPSHOT_STREAM_BUFFER_MAX;
+                break;
+            default:
+                stream->usage = GRALLOC_USAGE_SW_READ_OFTEN;
+                stream->data_space = HAL_DATASPACE_UNKNOWN;
+                buffers = RAW_STREAM_BUFFER_MAX;
+                break;
+        }
+        if (config->usage != 0) {
+            stream->usage = config->usage;
+            if (config->type == PREVIEW_TYPE && (config->usage & GRALLOC_USAGE_HW_VIDEO_ENCODER)) {
+                stream->data_space = HAL_DATASPACE_BT709;
+            }
+        }
+        stream->max_buffers = config->buffers > 0 ? config->buffers : buffers;
+        QCAMX_DBG("pipeline stream %d max buffers: %d\n", i, stream->max_buffers);
+
+        _stream_infos[i].pstream = stream;
+        _stream_infos[i].type = config->type;
+        _stream_infos[i].subformat = config->subformat;
+        _streams[i] = &_stream_infos[i];
+    }
+
+    _device->pre_allocate_streams(_streams);
+    return 0;
+}
+
+void QCamxPipelineCase::run() {
+    _stop = false;
+    _device->set_callback(this);
+    if (init_pipeline_streams() != 0) {
+        return;
+    }
+    // a lone preview keeps the default depth of requests in flight
+    if (_stream_num > 1 || _video_index >= 0) {
+        _device->_living_request_ext_append =
+            _video_mode > VIDEO_MODE_HFR60 ? HFR_LIVING_REQUEST_APPEND : LIVING_REQUEST_APPEND;
+    }
+#ifdef ENABLE_VIDEO_ENCODER
+    if (_video_encoder != NULL) {
+        _video_encoder->run();
+    }
+#endif
+
+    CameraThreadData *result_thread = new CameraThreadData();
+    CameraThreadData *request_thread = new CameraThreadData();
+    for (int i = 0; i < _stream_num; i++) {
+        int divider = _config->_pipeline_streams[i].divider;
+        if (divider > 0) {
+            request_thread->request_number[i] = REQUEST_NUMBER_UMLIMIT;
+            request_thread->skip_pattern[i] = divider;
+        }
+        QCAMX_INFO("pipeline stream %d divider:%d consumers:0x%x\n", i, divider,
+                   _routes[i].consumers);
+    }
+    _device->process_capture_request_on(request_thread, result_thread);
+}
+
+void QCamxPipelineCase::stop() {
+    _stop = true;
+#ifdef ENABLE_VIDEO_ENCODER
+    if (_video_encoder != NULL) {
+        _video_encoder->stop();
+    }
+#endif
+    _device->stop_streams();
+#ifdef ENABLE_VIDEO_ENCODER
+    delete _video_encoder;
+    _video_encoder = NULL;
+#endif
+    _device->set_sync_buffer_mode(SYNC_BUFFER_INTERNAL);
+}
+
+void QCamxPipelineCase::request_capture(StreamCapture request) {
+    CameraRequestMsg *msg = new CameraRequestMsg();
+    memset(msg, 0, sizeof(CameraRequestMsg));
+    for (int i = 0; i < _stream_num; i++) {
+        // a snapshot request captures the raw streams with the snapshot streams
+        bool matched = _routes[i].type == request.type ||
+                       (request.type == SNAPSHOT_TYPE && _routes[i].type == RAW_SNAPSHOT_TYPE);
+        if (_routes[i].on_demand && matched) {
+            msg->request_number[i] = request.count;
+            msg->mask |= 1 << i;
+        }
+    }
+    if (msg->mask == 0) {
+        QCAMX_PRINT("no pipeline stream of type %d captures on demand\n", request.type);
+        delete msg;
+        return;
+    }
+    msg->message_type = REQUEST_CHANGE;
+    _device->post_request_message(msg);
+}
+
+void QCamxPipelineCase::trigger_dump(int count, int interval) {
+    QCamxCase::trigger_dump(count, interval);
+    for (int i = 0; i < _stream_num; i++) {
+        _routes[i].dump_num = count;
+    }
+}
+
+QCamxPipelineCase::QCamxPipelineCase(camera_module_t *module, QCamxConfig *config) {
+    init(module, config);
+
+    _stop = true;
+    _stream_num = _config->_pipeline_stream_num;
+    _encoder_index = -1;
+    _video_index = -1;
+    memset(_route_stats, 0, sizeof(_route_stats));
+    build_routes();
+    _video_mode = _video_index >= 0 ? get_video_mode(_config->_fps_range[1]) : VIDEO_MODE_NORMAL;
+#ifdef ENABLE_VIDEO_ENCODER
+    _video_encoder = NULL;
+    if (_encoder_index >= 0) {
+        // the encoder takes its input size and format from the video stream config
+        const pipeline_stream_t *stream = &_config->_pipeline_streams[_encoder_index];
+        _config->_video_stream.width = stream->width;
+        _config->_video_stream.height = stream->height;
+        _config->_video_stream.format = stream->format;
+        _config->_video_stream.subformat = stream->subformat;
+        _video_encoder = new QCamxTestVideoEncoder(_config);
+    }
+#endif
+}
+
+QCamxPipelineCase::~QCamxPipelineCase() {
+    deinit();
+}
+
+/******************************** private method ******************************************/
+
+void QCamxPipelineCase::build_routes() {
+    bool type_seen[IRBG_TYPE + 1] = {false};
+    bool stats_needed = false;
+    for (int i = 0; i < _stream_num; i++) {
+        const pipeline_stream_t *config = &_config->_pipeline_streams[i];
+        PipelineRoute *route = &_routes[i];
+        route->type = config->type;
+        route->subformat = config->subformat;
+        route->consumers = config->consumers;
+        route->on_demand = config->divider == 0;
+        route->record_metrics = !type_seen[config->type];
+        route->dump_num = 0;
+
+        // the first preview and video streams keep their statistics where the other cases do
+        route->stats = &_route_stats[i];
+        if (config->type == PREVIEW_TYPE && !type_seen[PREVIEW_TYPE]) {
+            route->stats = &_config->_meta_stat.previewStats;
+        } else if (config->type == VIDEO_TYPE && !type_seen[VIDEO_TYPE]) {
+            route->stats = &_config->_meta_stat.videoStats;
+        }
+        type_seen[config->type] = true;
+        if (config->type == VIDEO_TYPE && _video_index < 0) {
+            _video_index = i;
+        }
+
+        if (route->consumers & PIPELINE_CONSUMER_ENCODER) {
+            if (config->type != VIDEO_TYPE || _encoder_index >= 0) {
+                QCAMX_ERR("pipeline stream %d can not feed the video encoder, only the first "
+                          "video stream does",
+                          i);
+                route->consumers &= ~PIPELINE_CONSUMER_ENCODER;
+            } else {
+                _encoder_index = i;
+            }
+        }
+        if (route->consumers & PIPELINE_CONSUMER_STATS) {
+            stats_needed = true;
+        }
+    }
+    if (stats_needed && !_frame_stats.is_running()) {
+        _frame_stats.start(_config->_frame_stats_threads, _config->_frame_stats_budget);
+    }
+}
+
+int QCamxPipelineCase::init_pipeline_streams() {
+    for (int i = 0; i < _stream_num; i++) {
+        AvailableStream threshold = {(int)_pipeline_streams[i].width,
+                                     (int)_pipeline_streams[i].height,
+                                     _pipeline_streams[i].format};
+        std::vector<AvailableStream> output_streams;
+        int res = _device->get_valid_output_streams(output_streams, &threshold);
+        if (res < 0 || output_streams.size() == 0) {
+            QCAMX_ERR("Failed to find output stream for pipeline stream %d: w: %d, h: %d, fmt: %d",
+                      i, _pipeline_streams[i].width, _pipeline_streams[i].height,
+                      _pipeline_streams[i].format);
+            return -1;
+        }
+    }
+
+    _device->set_sync_buffer_mode(_encoder_index >= 0 ? SYNC_BUFFER_EXTERNAL
+                                                      : SYNC_BUFFER_INTERNAL);
+    uint32_t operation_mode = CAMERA3_STREAM_CONFIGURATION_NORMAL_MODE;
+    if (_video_mode >= VIDEO_MODE_HFR60) {
+        // the sensor mode is picked for the largest stream
+        int largest = 0;
+        for (int i = 1; i < _stream_num; i++) {
+            if (_pipeline_streams[i].width * _pipeline_streams[i].height >
+                _pipeline_streams[largest].width * _pipeline_streams[largest].height) {
+                largest = i;
+            }
+        }
+        operation_mode = CAMERA3_STREAM_CONFIGURATION_CONSTRAINED_HIGH_SPEED_MODE;
+        select_operate_mode(&operation_mode, _pipeline_streams[largest].width,
+                            _pipeline_streams[largest].height, _config->_fps_range[1]);
+    }
+    _device->config_streams(_streams, operation_mode);
+
+    // the request settings come from the first video stream, or the first stream without one
+    int settings_index = _video_index >= 0 ? _video_index : 0;
+    for (int i = 0; i < _stream_num; i++) {
+        camera3_request_template_t type = CAMERA3_TEMPLATE_STILL_CAPTURE;
+        if (_routes[i].type == PREVIEW_TYPE) {
+            // a preview allocated for the encoder, the yuv_ubwc_enc format
+            type = (_pipeline_streams[i].usage & GRALLOC_USAGE_HW_VIDEO_ENCODER)
+                       ? CAMERA3_TEMPLATE_VIDEO_RECORD
+                       : CAMERA3_TEMPLATE_PREVIEW;
+        } else if (_routes[i].type == VIDEO_TYPE) {
+            type = CAMERA3_TEMPLATE_VIDEO_RECORD;
+        }
+        if (i != settings_index) {
+            _device->construct_default_request_settings(i, type);
+        } else if (_metadata_ext != NULL) {
+            _device->set_current_meta(_metadata_ext);
+            _device->construct_default_request_settings(i, type);
+        } else {
+            _device->construct_default_request_settings(i, type, true);
+        }
+    }
+
+    android::CameraMetadata *meta_update = get_current_meta();
+    uint8_t antibanding = ANDROID_CONTROL_AE_ANTIBANDING_MODE_AUTO;
+    meta_update->update(ANDROID_CONTROL_AE_ANTIBANDING_MODE, &(antibanding), sizeof(antibanding));
+    if (_routes[settings_index].type == VIDEO_TYPE) {
+        uint8_t afmode = ANDROID_CONTROL_AF_MODE_CONTINUOUS_VIDEO;
+        meta_update->update(ANDROID_CONTROL_AF_MODE, &(afmode), 1);
+        uint8_t face_detect_mode = (uint8_t)ANDROID_STATISTICS_FACE_DETECT_MODE_OFF;
+        meta_update->update(ANDROID_STATISTICS_FACE_DETECT_MODE, &face_detect_mode, 1);
+    }
+    if (_video_mode != VIDEO_MODE_NORMAL) {
+        uint8_t vstab_mode = ANDROID_CONTROL_VIDEO_STABILIZATION_MODE_OFF;
+        meta_update->update(ANDROID_CONTROL_VIDEO_STABILIZATION_MODE, &vstab_mode, 1);
+        uint8_t nr = ANDROID_NOISE_REDUCTION_MODE_FAST;
+        meta_update->update(ANDROID_NOISE_REDUCTION_MODE, &(nr), 1);
+        antibanding = ANDROID_CONTROL_AE_ANTIBANDING_MODE_50HZ;
+        meta_update->update(ANDROID_CONTROL_AE_ANTIBANDING_MODE, &antibanding, 1);
+
+        // video hdr, early PCR and EIS are off in a high frame rate session
+        static const char *const off_tags[] = {
+            "org.quic.camera2.streamconfigs.HDRVideoMode",
+            "org.quic.camera.EarlyPCRenable.EarlyPCRenable",
+            "org.quic.camera.eis3enable.EISV3Enable",
+        };
+        android::sp<android::VendorTagDescriptor> vendor_tags =
+            android::VendorTagDescriptor::getGlobalVendorTagDescriptor();
+        for (size_t i = 0; i < sizeof(off_tags) / sizeof(off_tags[0]); i++) {
+            uint32_t tag = 0;
+            uint8_t off = 0;
+            if (android::CameraMetadata::getTagFromName(off_tags[i], vendor_tags.get(), &tag) ==
+                0) {
+                meta_update->update(tag, &off, 1);
+            }
+        }
+    }
+    updata_metadata(meta_update);
+    return 0;
+}
+
+void QCamxPipelineCase::select_operate_mode(uint32_t *operation_mode, int width, int height,
+                                            int fps) {
+    android::sp<android::VendorTagDescriptor> vendor_tags =
+        android::VendorTagDescriptor::getGlobalVendorTagDescriptor();
+    uint32_t tag = 0;
+    android::CameraMetadata::getTagFromName("org.quic.camera2.sensormode.info.SensorModeTable",
+                                            vendor_tags.get(), &tag);
+    camera_metadata_ro_entry entry;
+    int res = find_camera_metadata_ro_entry(_device->_camera_characteristics, tag, &entry);
+    if (res != 0 || entry.count == 0) {
+        // HAL without the sensor mode vendor tag (e.g. the mock HAL), keep the operation mode
+        QCAMX_INFO("no sensor mode table, operation mode %u unchanged\n", *operation_mode);
+        return;
+    }
+
+    const int32_t *sensor_mode_table = entry.data.i32;
+    int matched_fps = MAX_SENSOR_FPS;
+    int sensor_mode = -1;
+    int mode_count = sensor_mode_table[0];
+    int mode_size = sensor_mode_table[1];
+    for (int i = 0; i < mode_count; i++) {
+        int s_width = sensor_mode_table[2 + i * mode_size];
+        int s_height = sensor_mode_table[3 + i * mode_size];
+        int s_fps = sensor_mode_table[4 + i * mode_size];
+        if (s_width >= width && s_height >= height && s_fps >= fps && s_fps <= matched_fps) {
+            matched_fps = s_fps;
+            sensor_mode = i;
+        }
+    }
+    if (sensor_mode > 0) {
+        // use StreamConfigModeSensorMode in camx
+        *operation_mode = (*operation_mode) | ((sensor_mode + 1) << 16) | (0x1 << 24);
+        QCAMX_INFO("operation mode %u, sensor mode: %d\n", *operation_mode, sensor_mode);
+    }
+}
+
+void QCamxPipelineCase::enqueue_frame_buffer(CameraStream *stream,
+                                             buffer_handle_t *buffer_handle) {
+#ifdef ENABLE_VIDEO_ENCODER
+    _video_encoder->EnqueueFrameBuffer(stream, buffer_handle);
+#else
+    stream->buffer_manager->return_buffer(buffer_handle);
+#endif
+}
@@ -0,0 +1,86 @@
+/**
+ * @file  qcamx_pipeline_case.h
+ * @brief pipeline case, runs the stream list of the pipeline option
+ * @details every stream has its format, rate divider, consumers and buffer count, the routes
+ *          of the streams are built once so a result buffer is dispatched by its stream index
+ *          the preview, video and preview+video test modes run as presets of this case, see
+ *          QCamxConfig::build_pipeline_preset
+*/
+#pragma once
+
+#include "qcamx_case.h"
+#include "qcamx_define.h"
+#ifdef ENABLE_VIDEO_ENCODER
+#include "QCamxHAL3TestVideoEncoder.h"
+#endif
+
+class QCamxPipelineCase : public QCamxCase {
+public:  // override DeviceCallback
+    /**
+     * @brief hand every buffer of a result to the consumers of its stream
+    */
+    virtual void capture_post_process(DeviceCallback *cb, camera3_capture_result *result) override;
+    /**
+     * @brief the SAT info is shown as well when the pipeline has a video stream
+    */
+    virtual void handle_metadata(DeviceCallback *cb, camera3_capture_result *result) override;
+public:  // override QCamxCase
+    virtual int pre_init_stream() override;
+    /**
+     * @brief configure the streams and start the request of every stream with a divider
+    */
+    virtual void run() override;
+    virtual void stop() override;
+    /**
+     * @brief capture request.count frames on the streams of request.type with divider 0, a
+     *        snapshot request includes the raw streams
+    */
+    virtual void request_capture(StreamCapture request) override;
+    virtual void trigger_dump(int count, int interval = 0) override;
+public:
+    QCamxPipelineCase(camera_module_t *module, QCamxConfig *config);
+    virtual ~QCamxPipelineCase();
+private:
+    // what is done with a buffer of one stream, indexed by the stream index of the device
+    struct PipelineRoute {
+        StreamType type;
+        Implsubformat subformat;
+        uint32_t consumers;     ///< PIPELINE_CONSUMER_*
+        bool on_demand;         ///< divider 0, every frame was asked for and is dumped
+        bool record_metrics;    ///< first stream of its type, the stream metrics are per type
+        frame_stats_t *stats;   ///< where the luma statistics of the stream go
+        unsigned int dump_num;  ///< frames left to dump, set by trigger_dump
+    };
+    /**
+     * @brief resolve the consumers of the configured streams into _routes
+    */
+    void build_routes();
+    /**
+     * @brief check and configure the streams, then build the request settings
+    */
+    int init_pipeline_streams();
+    /**
+     * @brief add the sensor mode of a high speed session to the operation mode
+    */
+    void select_operate_mode(uint32_t *operation_mode, int width, int height, int fps);
+    /**
+     * @brief enqueue a frame to video encoder
+    */
+    void enqueue_frame_buffer(CameraStream *stream, buffer_handle_t *buffer_handle);
+    // Do not support the copy constructor or assignment operator
+    QCamxPipelineCase(const QCamxPipelineCase &) = delete;
+    QCamxPipelineCase &operator=(const QCamxPipelineCase &) = delete;
+private:
+    bool _stop;
+#ifdef ENABLE_VIDEO_ENCODER
+    QCamxTestVideoEncoder *_video_encoder;
+#endif
+    int _stream_num;
+    int _encoder_index;  ///< stream feeding the video encoder, -1 if none
+    int _video_index;    ///< first video stream, -1 if none
+    VideoMode _video_mode;  ///< VIDEO_MODE_NORMAL without a video stream
+    camera3_stream_t _pipeline_streams[PIPELINE_STREAM_MAX];
+    Stream _stream_infos[PIPELINE_STREAM_MAX];
+    PipelineRoute _routes[PIPELINE_STREAM_MAX];
+    frame_stats_t _route_stats[PIPELINE_STREAM_MAX];
+};
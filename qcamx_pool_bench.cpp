@@ -0,0 +1,191 @@
+/**
+ * @file  qcamx_pool_bench.cpp
+ * @brief measure the free list QCamxLockFreeQueue and the get_buffer/return_buffer path of
+ *        QCamxBufferManager under contention of 1 to 4 threads
+*/
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "qcamx_buffer_manager.h"
+#include "qcamx_lockfree_queue.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxPoolBench"
+
+#define POOL_BENCH_MAX_THREADS (4)
+
+static const char usage[] = "\
+usage: qcamx-pool-bench [-n operations] [-b buffers] \n\
+  -n: get/return pairs of each thread per case, default 1000000 \n\
+  -b: buffers in the pool, default 8 \n\
+";
+
+typedef QCamxLockFreeQueue<uint32_t, BUFFER_QUEUE_DEPTH> BenchQueue;
+
+struct BenchWorker {
+    pthread_t thread;
+    std::atomic<bool> *start;
+    BenchQueue *queue;
+    QCamxBufferManager *pool;
+    int operations;
+    uint64_t empty;  ///< pops on an empty queue
+};
+
+static double get_time_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// all the workers of a case contend from their first operation
+static void wait_start(BenchWorker *worker) {
+    while (!worker->start->load(std::memory_order_acquire)) {
+        sched_yield();
+    }
+}
+
+static void *queue_worker(void *data) {
+    BenchWorker *worker = (BenchWorker *)data;
+    wait_start(worker);
+    for (int i = 0; i < worker->operations; i++) {
+        uint32_t slot;
+        // a pop misses while a preempted thread still owns the cell of its push
+        while (!worker->queue->pop(slot)) {
+            worker->empty++;
+            sched_yield();
+        }
+        while (!worker->queue->push(slot)) {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+static void *pool_worker(void *data) {
+    BenchWorker *worker = (BenchWorker *)data;
+    wait_start(worker);
+    for (int i = 0; i < worker->operations; i++) {
+        buffer_handle_t *buffer = worker->pool->get_buffer();
+        worker->pool->return_buffer(buffer);
+    }
+    return nullptr;
+}
+
+/**
+ * @brief run the worker on threads threads at once
+ * @param empty add the pops of the workers that missed on an empty queue
+ * @return get/return pairs per second of all the threads, 0 on error
+*/
+static double run_case(void *(*routine)(void *), int threads, int operations, BenchQueue *queue,
+                       QCamxBufferManager *pool, uint64_t *empty) {
+    BenchWorker workers[POOL_BENCH_MAX_THREADS];
+    std::atomic<bool> start(false);
+    int started = 0;
+    for (; started < threads; started++) {
+        BenchWorker *worker = &workers[started];
+        worker->start = &start;
+        worker->queue = queue;
+        worker->pool = pool;
+        worker->operations = operations;
+        worker->empty = 0;
+        if (pthread_create(&worker->thread, NULL, routine, worker) != 0) {
+            QCAMX_PRINT("create bench thread failed\n");
+            break;
+        }
+    }
+    double begin = get_time_sec();
+    start.store(true, std::memory_order_release);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        *empty += workers[i].empty;
+    }
+    double elapsed = get_time_sec() - begin;
+    if (started < threads) {
+        return 0;
+    }
+    return (double)operations * threads / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    int operations = 1000000;
+    int buffers = 8;
+    int c;
+    while ((c = getopt(argc, argv, "hn:b:")) != -1) {
+        switch (c) {
+            case 'n':
+                operations = atoi(optarg);
+                break;
+            case 'b':
+                buffers = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    // every thread holds at most one buffer, the pool never runs empty
+    if (operations <= 0 || buffers < POOL_BENCH_MAX_THREADS || buffers > BUFFER_QUEUE_DEPTH) {
+        printf("%s", usage);
+        return 1;
+    }
+
+    BenchQueue *queue = new BenchQueue();
+    for (int i = 0; i < buffers; i++) {
+        queue->push((uint32_t)i);
+    }
+    QCamxBufferManager *pool = new QCamxBufferManager();
+    // small blob buffers, the bench measures the free list and not the memory
+    pool->allocate_buffers(buffers, 4096, 1, HAL_PIXEL_FORMAT_BLOB,
+                           GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN,
+                           GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN,
+                           SNAPSHOT_TYPE, None);
+    if (pool->get_free_buffer_size() != (size_t)buffers) {
+        QCAMX_PRINT("allocate %d buffers failed\n", buffers);
+        delete pool;
+        delete queue;
+        return 1;
+    }
+
+    int res = 0;
+    // empty: pops on an empty queue, or get_buffer calls that slept on an empty pool
+    printf("%-6s %-7s %14s %14s %10s\n", "path", "threads", "ops/s", "ops/s/thread", "empty");
+    for (int threads = 1; threads <= POOL_BENCH_MAX_THREADS; threads++) {
+        uint64_t empty = 0;
+        double ops = run_case(queue_worker, threads, operations, queue, pool, &empty);
+        if (ops == 0) {
+            res = 1;
+            break;
+        }
+        printf("%-6s %-7d %14.0f %14.0f %10" PRIu64 "\n", "queue", threads, ops, ops / threads,
+               empty);
+    }
+    for (int threads = 1; res == 0 && threads <= POOL_BENCH_MAX_THREADS; threads++) {
+        uint64_t empty = 0;
+        uint64_t waits = pool->get_empty_wait_count();
+        double ops = run_case(pool_worker, threads, operations, queue, pool, &empty);
+        if (ops == 0) {
+            res = 1;
+            break;
+        }
+        printf("%-6s %-7d %14.0f %14.0f %10" PRIu64 "\n", "pool", threads, ops, ops / threads,
+               pool->get_empty_wait_count() - waits);
+    }
+    if (pool->get_free_buffer_size() != (size_t)buffers) {
+        QCAMX_PRINT("%zu of %d buffers back in the pool\n", pool->get_free_buffer_size(), buffers);
+        res = 1;
+    }
+    delete pool;
+    delete queue;
+    return res;
+}
@@ -21,34 +21,32 @@ void QCamxPreviewSnapshotCase::capture_post_process(DeviceCallback *cb,
     for (uint32_t i = 0; i < result->num_output_buffers; i++) {
         int index = device->find_stream_index(buffers[i].stream);
         CameraStream *stream = device->_camera_streams[index];
-        BufferInfo *info = stream->buffer_manager->get_buffer_info(buffers[i].buffer);
         if (stream->stream_type == CAMERA3_TEMPLATE_STILL_CAPTURE) {
-            if (_callbacks != NULL && _callbacks->snapshot_cb != NULL) {
-                _callbacks->snapshot_cb(info, result->frame_number);
+            if (_device->_zsl_ring.is_running()) {
+                _device->_zsl_ring.push(stream->buffer_manager, buffers[i].buffer,
+                                        result->frame_number, _config->_snapshot_stream.subformat);
             }
+            publish_frame(stream, buffers[i].buffer, result->frame_number, SNAPSHOT_TYPE);
             if (_snapshot_num > 0) {
-                QCamxCase::dump_frame(info, result->frame_number, SNAPSHOT_TYPE,
-                                      _config->_snapshot_stream.subformat);
+                dump_frame_async(stream, buffers[i].buffer, result->frame_number, SNAPSHOT_TYPE,
+                                 _config->_snapshot_stream.subformat);
                 _snapshot_num--;
                 QCAMX_INFO("Get one picture %d last\n", _snapshot_num);
             }
+            update_stream_metrics(SNAPSHOT_TYPE, result->frame_number);
         }
         if (stream->stream_type == CAMERA3_TEMPLATE_PREVIEW) {
-            if (_callbacks != NULL && _callbacks->preview_cb != NULL) {
-                _callbacks->preview_cb(info, result->frame_number);
-            }
+            publish_frame(stream, buffers[i].buffer, result->frame_number, PREVIEW_TYPE);
             if (testsnap->_dump_preview_num > 0 &&
                 (_dump_interval == 0 ||
                  (_dump_interval > 0 && result->frame_number % _dump_interval == 0))) {
-                QCamxCase::dump_frame(info, result->frame_number, PREVIEW_TYPE,
-                                      _config->_preview_stream.subformat);
+                dump_frame_async(stream, buffers[i].buffer, result->frame_number, PREVIEW_TYPE,
+                                 _config->_preview_stream.subformat);
                 if (_dump_interval == 0) {
                     testsnap->_dump_preview_num--;
                 }
             }
-            if (_config->_show_fps) {
-                show_fps(PREVIEW_TYPE);
-            }
+            update_stream_metrics(PREVIEW_TYPE, result->frame_number);
         }
     }
 }
@@ -89,6 +87,14 @@ int QCamxPreviewSnapshotCase::pre_init_stream() {
     _snapshot_stream.usage = GRALLOC_USAGE_SW_READ_OFTEN;
     _snapshot_stream.rotation = 0;
     _snapshot_stream.max_buffers = SNAPSHOT_STREAM_BUFFER_MAX;
+    if (_config->_zsl_depth > 0 && !use_zsl_history()) {
+        QCAMX_ERR("zsl depth %d ignored, needs zsl, a yuv or raw snapshot and a depth of 1..%d\n",
+                  _config->_zsl_depth, ZSL_RING_MAX_DEPTH);
+    }
+    if (use_zsl_history()) {
+        // the history is held on top of the buffers the HAL works with
+        _snapshot_stream.max_buffers += _config->_zsl_depth;
+    }
     _snapshot_stream.priv = 0;
 
     _snapshot_streaminfo.pstream = &_snapshot_stream;
@@ -106,6 +112,16 @@ int QCamxPreviewSnapshotCase::pre_init_stream() {
 void QCamxPreviewSnapshotCase::run() {
     _device->set_callback(this);
     init_snapshot_streams();
+    if (use_zsl_history()) {
+        camera_metadata_ro_entry entry;
+        bool boottime = find_camera_metadata_ro_entry(_device->_camera_characteristics,
+                                                      ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE,
+                                                      &entry) == 0 &&
+                        entry.count > 0 &&
+                        entry.data.u8[0] == ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME;
+        _device->_zsl_ring.start(&_device->_frame_hub, _config->_zsl_depth, boottime,
+                                 _config->_frame_stats_threads, _config->_frame_stats_budget);
+    }
 
     CameraThreadData *resultThread = new CameraThreadData();
     CameraThreadData *requestThread = new CameraThreadData();
@@ -125,22 +141,23 @@ void QCamxPreviewSnapshotCase::stop() {
 }
 
 void QCamxPreviewSnapshotCase::request_capture(StreamCapture request) {
+    if (request.count > 0 && _device->_zsl_ring.is_running() && deliver_zsl_frame() == 0) {
+        // the rest of a burst comes from the frames after the shutter
+        request.count--;
+    }
     _snapshot_num = request.count;
     if (_config->_snapshot_stream.format != HAL_PIXEL_FORMAT_BLOB) {
         return;
     }
 
     // send a message to request thread
-    pthread_mutex_lock(&_device->_request_thread->mutex);
     CameraRequestMsg *msg = new CameraRequestMsg();
     memset(msg, 0, sizeof(CameraRequestMsg));
     msg->request_number[SNAPSHOT_INDEX] = request.count;
     msg->mask = 1 << SNAPSHOT_INDEX;
     msg->message_type = REQUEST_CHANGE;
-    _device->_request_thread->message_queue.push_back(msg);
     // QCAMX_DBG("Msg for capture picture mask%x \n", msg->mask);
-    pthread_cond_signal(&_device->_request_thread->cond);
-    pthread_mutex_unlock(&_device->_request_thread->mutex);
+    _device->post_request_message(msg);
 }
 
 QCamxPreviewSnapshotCase::QCamxPreviewSnapshotCase(camera_module_t *module, QCamxConfig *config) {
@@ -234,4 +251,29 @@ int QCamxPreviewSnapshotCase::init_snapshot_streams() {
     updata_metadata(metadata);
 
     return res;
-}
\ No newline at end of file
+}
+
+bool QCamxPreviewSnapshotCase::use_zsl_history() {
+    return _config->_zsl_enabled && _config->_zsl_depth > 0 &&
+           _config->_zsl_depth <= ZSL_RING_MAX_DEPTH &&
+           _config->_snapshot_stream.format != HAL_PIXEL_FORMAT_BLOB;
+}
+
+int QCamxPreviewSnapshotCase::deliver_zsl_frame() {
+    int64_t request_ns = QCamxFrameTimeline::now_ns();
+    ZslFrame frame;
+    if (_device->_zsl_ring.select(_device->_zsl_ring.now_ns(), &frame) != 0) {
+        QCAMX_PRINT("zsl history empty, snapshot from the next frame\n");
+        return -1;
+    }
+    CameraStream *stream = _device->_camera_streams[SNAPSHOT_INDEX];
+    publish_frame(stream, frame.buffer, frame.frame_number, SNAPSHOT_TYPE);
+    dump_frame_async(stream, frame.buffer, frame.frame_number, SNAPSHOT_TYPE,
+                     _config->_snapshot_stream.subformat);
+    int64_t latency_ns = QCamxFrameTimeline::now_ns() - request_ns;
+    _device->_zsl_ring.release(&frame, latency_ns);
+    QCAMX_PRINT("zsl snapshot frame:%u age:%.2fms ae_state:%d sharpness:%.1f latency:%.3fms\n",
+                frame.frame_number, frame.age / 1e6, frame.ae_state, frame.sharpness,
+                latency_ns / 1e6);
+    return 0;
+}
@@ -36,6 +36,16 @@ private:
      * @brief init streams for snapshot
     */
     int init_snapshot_streams();
+    /**
+     * @brief keep the last snapshot frames for zero shutter lag, needs a YUV or RAW snapshot
+     *        stream which is captured on every request
+    */
+    bool use_zsl_history();
+    /**
+     * @brief hand the best frame of the zsl history to the dump and the subscribers
+     * @return -1 if the history is empty
+    */
+    int deliver_zsl_frame();
 private:
     int _snapshot_num;
     camera3_stream_t _preview_stream;
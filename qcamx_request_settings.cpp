@@ -0,0 +1,88 @@
+/**
+ * @file  qcamx_request_settings.cpp
+ * @brief settings of the next capture request implementation
+*/
+
+#include "qcamx_request_settings.h"
+
+QCamxRequestSettings::QCamxRequestSettings() {
+    pthread_mutex_init(&_lock, NULL);
+    _has_pending = false;
+    _update_count = 0;
+}
+
+QCamxRequestSettings::~QCamxRequestSettings() {
+    pthread_mutex_destroy(&_lock);
+}
+
+/*************************public method*****************************/
+
+void QCamxRequestSettings::queue(const android::CameraMetadata &update) {
+    pthread_mutex_lock(&_lock);
+    _update_count++;
+    if (!_has_pending.load(std::memory_order_relaxed)) {
+        _pending = update;
+        _has_pending.store(true, std::memory_order_release);
+    } else {
+        const camera_metadata_t *buffer = update.getAndLock();
+        merge(buffer, true);
+        update.unlock(buffer);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+void QCamxRequestSettings::resend() {
+    pthread_mutex_lock(&_lock);
+    if (!_has_pending.load(std::memory_order_relaxed) && !_last.isEmpty()) {
+        _pending = _last;
+        _has_pending.store(true, std::memory_order_release);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+camera_metadata *QCamxRequestSettings::lock() {
+    // the HAL keeps the settings of the last request, nothing to send most of the time
+    if (!_has_pending.load(std::memory_order_acquire)) {
+        return NULL;
+    }
+    pthread_mutex_lock(&_lock);
+    _last.acquire(_pending);
+    _has_pending.store(false, std::memory_order_relaxed);
+    pthread_mutex_unlock(&_lock);
+    return (camera_metadata *)_last.getAndLock();
+}
+
+void QCamxRequestSettings::unlock(camera_metadata *settings, bool accepted) {
+    if (settings == NULL) {
+        return;
+    }
+    _last.unlock(settings);
+    if (accepted) {
+        return;
+    }
+    // the HAL never saw these settings, send them with the next request
+    pthread_mutex_lock(&_lock);
+    if (!_has_pending.load(std::memory_order_relaxed)) {
+        _pending = _last;
+        _has_pending.store(true, std::memory_order_release);
+    } else {
+        // an update queued meanwhile is newer, keep only the tags it does not have
+        const camera_metadata_t *buffer = _last.getAndLock();
+        merge(buffer, false);
+        _last.unlock(buffer);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+/*************************private method*****************************/
+
+void QCamxRequestSettings::merge(const camera_metadata_t *buffer, bool overwrite) {
+    size_t count = get_camera_metadata_entry_count(buffer);
+    for (size_t i = 0; i < count; i++) {
+        camera_metadata_ro_entry entry;
+        if (get_camera_metadata_ro_entry(buffer, i, &entry) == 0 &&
+            (overwrite || !_pending.exists(entry.tag))) {
+            _pending.update(entry);
+        }
+    }
+}
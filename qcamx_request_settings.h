@@ -0,0 +1,59 @@
+/**
+ * @file  qcamx_request_settings.h
+ * @brief settings of the next capture request, only sent when they changed
+ *        updates queued between two requests are merged into one settings buffer,
+ *        settings of a request the HAL rejected are queued again behind newer updates
+*/
+
+#pragma once
+
+#include <camera/CameraMetadata.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+
+class QCamxRequestSettings {
+public:
+    QCamxRequestSettings();
+    ~QCamxRequestSettings();
+public:
+    /**
+     * @brief merge an update into the settings of the next request
+     * @detail a later update wins on the tags both have
+    */
+    void queue(const android::CameraMetadata &update);
+    /**
+     * @brief queue the settings of the last request again if nothing is queued,
+     *        a new session starts without settings in the HAL
+    */
+    void resend();
+    /**
+     * @brief take the settings of the next request, request thread only
+     * @return the merged updates, locked until unlock, NULL if nothing changed since the last
+     *         request
+    */
+    camera_metadata *lock();
+    /**
+     * @brief unlock the settings of lock
+     * @param accepted false if the HAL never got the request, the settings are queued again and
+     *                 an update queued meanwhile wins on the tags both have
+    */
+    void unlock(camera_metadata *settings, bool accepted);
+    uint32_t get_update_count() { return _update_count; }
+private:
+    /**
+     * @brief copy the entries of buffer into the pending settings, _lock held
+     * @param overwrite false keeps the tags the pending settings already have
+    */
+    void merge(const camera_metadata_t *buffer, bool overwrite);
+    // Do not support the copy constructor or assignment operator
+    QCamxRequestSettings(const QCamxRequestSettings &) = delete;
+    QCamxRequestSettings &operator=(const QCamxRequestSettings &) = delete;
+private:
+    pthread_mutex_t _lock;
+    android::CameraMetadata _pending;  ///< the updates queued since the last request
+    std::atomic<bool> _has_pending;    ///< set under the lock, read without it per request
+    android::CameraMetadata _last;     ///< the settings of the last request carrying some
+    uint32_t _update_count;            ///< queued updates, guarded by the lock
+};
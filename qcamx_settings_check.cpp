@@ -0,0 +1,241 @@
+/**
+ * @file  qcamx_settings_check.cpp
+ * @brief check the settings of the next capture request: queued updates merge with the later
+ *        one winning, settings of a rejected request are queued again behind newer updates,
+ *        and under a concurrent updater no update is lost and no older value overtakes a newer
+*/
+
+#include <camera/CameraMetadata.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "qcamx_log.h"
+#include "qcamx_request_settings.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxSettingsCheck"
+
+static const char usage[] = "\
+usage: qcamx-settings-check [-n updates] [-r reject percent] \n\
+  -n: updates queued by the concurrent updater, default 20000 \n\
+  -r: requests the request thread rejects, in percent, default 25 \n\
+";
+
+static int s_errors = 0;
+
+static void expect(bool condition, const char *what) {
+    if (!condition) {
+        QCAMX_PRINT("FAILED: %s\n", what);
+        s_errors++;
+    }
+}
+
+/**
+ * @return the int32 value of tag in settings, -1 if it has none
+*/
+static int32_t get_i32(const camera_metadata *settings, uint32_t tag) {
+    camera_metadata_ro_entry entry;
+    if (settings == NULL || find_camera_metadata_ro_entry(settings, tag, &entry) != 0 ||
+        entry.count == 0) {
+        return -1;
+    }
+    return entry.data.i32[0];
+}
+
+static int32_t get_u8(const camera_metadata *settings, uint32_t tag) {
+    camera_metadata_ro_entry entry;
+    if (settings == NULL || find_camera_metadata_ro_entry(settings, tag, &entry) != 0 ||
+        entry.count == 0) {
+        return -1;
+    }
+    return entry.data.u8[0];
+}
+
+static android::CameraMetadata make_update(int32_t ae_comp, int32_t sensitivity, int32_t af_mode) {
+    android::CameraMetadata update;
+    if (ae_comp >= 0) {
+        update.update(ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION, &ae_comp, 1);
+    }
+    if (sensitivity >= 0) {
+        update.update(ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1);
+    }
+    if (af_mode >= 0) {
+        uint8_t mode = (uint8_t)af_mode;
+        update.update(ANDROID_CONTROL_AF_MODE, &mode, 1);
+    }
+    return update;
+}
+
+static void check_merge() {
+    QCamxRequestSettings settings;
+    camera_metadata *locked = settings.lock();
+    expect(locked == NULL, "nothing queued sends no settings");
+    settings.unlock(locked, true);
+
+    settings.queue(make_update(1, 100, -1));
+    settings.queue(make_update(2, -1, 1));
+    locked = settings.lock();
+    expect(get_i32(locked, ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION) == 2,
+           "the later update wins on a tag both set");
+    expect(get_i32(locked, ANDROID_SENSOR_SENSITIVITY) == 100,
+           "a tag only the earlier update set is kept");
+    expect(get_u8(locked, ANDROID_CONTROL_AF_MODE) == 1, "a tag only the later update set is kept");
+    settings.unlock(locked, true);
+    expect(settings.lock() == NULL, "accepted settings are not sent again");
+    expect(settings.get_update_count() == 2, "every queued update is counted");
+
+    // a new session resends the last settings, but never over a queued update
+    settings.resend();
+    locked = settings.lock();
+    expect(get_i32(locked, ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION) == 2 &&
+               get_i32(locked, ANDROID_SENSOR_SENSITIVITY) == 100,
+           "resend queues the last settings");
+    settings.unlock(locked, true);
+    settings.queue(make_update(3, -1, -1));
+    settings.resend();
+    locked = settings.lock();
+    expect(get_i32(locked, ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION) == 3 &&
+               get_i32(locked, ANDROID_SENSOR_SENSITIVITY) == -1,
+           "resend keeps a queued update");
+    settings.unlock(locked, true);
+}
+
+static void check_requeue() {
+    QCamxRequestSettings settings;
+    settings.queue(make_update(4, 200, -1));
+    camera_metadata *locked = settings.lock();
+    settings.unlock(locked, false);
+    locked = settings.lock();
+    expect(get_i32(locked, ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION) == 4 &&
+               get_i32(locked, ANDROID_SENSOR_SENSITIVITY) == 200,
+           "rejected settings go out with the next request");
+    settings.unlock(locked, true);
+
+    // an update queued while the rejected request was in the HAL is newer
+    settings.queue(make_update(5, 300, -1));
+    locked = settings.lock();
+    settings.queue(make_update(6, -1, 2));
+    settings.unlock(locked, false);
+    locked = settings.lock();
+    expect(get_i32(locked, ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION) == 6,
+           "a newer update wins over rejected settings");
+    expect(get_i32(locked, ANDROID_SENSOR_SENSITIVITY) == 300,
+           "a tag only the rejected settings set is kept");
+    expect(get_u8(locked, ANDROID_CONTROL_AF_MODE) == 2, "a tag only the newer update set is kept");
+    settings.unlock(locked, true);
+    expect(settings.lock() == NULL, "nothing is left after the requeued settings went out");
+}
+
+struct UpdaterData {
+    QCamxRequestSettings *settings;
+    int updates;
+    std::atomic<bool> done;
+};
+
+static void *updater_thread(void *arg) {
+    UpdaterData *data = (UpdaterData *)arg;
+    for (int i = 0; i < data->updates; i++) {
+        // the sensitivity rides along every tenth update only, it has to survive the merges
+        data->settings->queue(make_update(i, i % 10 == 0 ? i : -1, -1));
+        if (i % 8 == 0) {
+            // let the request thread in between the updates
+            sched_yield();
+        }
+    }
+    data->done.store(true, std::memory_order_release);
+    return NULL;
+}
+
+static void check_concurrent(int updates, int reject_percent) {
+    QCamxRequestSettings settings;
+    UpdaterData data;
+    data.settings = &settings;
+    data.updates = updates;
+    data.done = false;
+    pthread_t tid;
+    pthread_create(&tid, NULL, updater_thread, &data);
+
+    int32_t last_ae_comp = -1;
+    int32_t last_sensitivity = -1;
+    uint32_t seed = 1;
+    int requests = 0;
+    int sent = 0;
+    int rejected = 0;
+    bool ordered = true;
+    while (true) {
+        bool done = data.done.load(std::memory_order_acquire);
+        camera_metadata *locked = settings.lock();
+        if (locked == NULL) {
+            if (done) {
+                break;
+            }
+            continue;
+        }
+        requests++;
+        seed = seed * 1103515245u + 12345u;
+        bool accepted = (int)((seed >> 16) % 100) >= reject_percent;
+        if (accepted) {
+            sent++;
+            int32_t ae_comp = get_i32(locked, ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION);
+            int32_t sensitivity = get_i32(locked, ANDROID_SENSOR_SENSITIVITY);
+            // settings without the sensitivity leave the HAL on the last one it got
+            if (sensitivity < 0) {
+                sensitivity = last_sensitivity;
+            }
+            ordered = ordered && ae_comp >= last_ae_comp && sensitivity >= last_sensitivity;
+            last_ae_comp = ae_comp;
+            last_sensitivity = sensitivity;
+        } else {
+            rejected++;
+        }
+        settings.unlock(locked, accepted);
+    }
+    pthread_join(tid, NULL);
+
+    int32_t last_update = updates - 1;
+    QCAMX_PRINT("concurrent: %d updates, %d requests with settings, %d rejected, last ae_comp:%d "
+                "sensitivity:%d\n",
+                updates, requests, rejected, last_ae_comp, last_sensitivity);
+    expect(sent > 0, "the request thread sent settings");
+    expect(ordered, "no older value overtook a newer one");
+    expect(last_ae_comp == last_update, "the last update went out");
+    expect(last_sensitivity == last_update - last_update % 10,
+           "the last value of a tag set by some updates only went out");
+    expect(settings.get_update_count() == (uint32_t)updates, "every queued update is counted");
+}
+
+int main(int argc, char *argv[]) {
+    int updates = 20000;
+    int reject_percent = 25;
+    int c;
+    while ((c = getopt(argc, argv, "hn:r:")) != -1) {
+        switch (c) {
+            case 'n':
+                updates = atoi(optarg);
+                break;
+            case 'r':
+                reject_percent = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                printf("%s", usage);
+                return 1;
+        }
+    }
+    if (updates <= 0 || reject_percent < 0 || reject_percent >= 100) {
+        printf("%s", usage);
+        return 1;
+    }
+    check_merge();
+    check_requeue();
+    check_concurrent(updates, reject_percent);
+    QCAMX_PRINT("request settings: %d checks failed\n", s_errors);
+    return s_errors == 0 ? 0 : 1;
+}
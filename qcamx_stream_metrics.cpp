@@ -0,0 +1,160 @@
+/**
+ * @file  qcamx_stream_metrics.cpp
+ * @brief frame rate and jitter of every stream type implementation
+*/
+
+#include "qcamx_stream_metrics.h"
+
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include "qcamx_frame_dump.h"
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxStreamMetrics"
+
+// intervals needed before a gap counts as frame drops
+#define STREAM_METRICS_MIN_INTERVALS (8)
+
+QCamxStreamMetrics::QCamxStreamMetrics() {
+    reset(0, 0);
+}
+
+/*************************public method*****************************/
+
+void QCamxStreamMetrics::reset(int camera_id, int report_period_sec) {
+    for (int i = 0; i < STREAM_METRICS_TYPES; i++) {
+        StreamState *state = &_streams[i];
+        state->frames = 0;
+        state->drops = 0;
+        state->no_timestamp = 0;
+        state->last_timestamp = 0;
+        for (int j = 0; j < STREAM_METRICS_WINDOW; j++) {
+            state->window[j].store(0, std::memory_order_relaxed);
+        }
+        state->window_count = 0;
+        state->nominal_interval = 0;
+        state->intervals.reset();
+    }
+    _camera_id = camera_id;
+    _report_period_ns = (int64_t)report_period_sec * 1000000000LL;
+    _next_report_ns = QCamxFrameTimeline::now_ns() + _report_period_ns;
+}
+
+void QCamxStreamMetrics::record_frame(StreamType type, int64_t timestamp) {
+    if (type < 0 || type >= STREAM_METRICS_TYPES) {
+        return;
+    }
+    StreamState *state = &_streams[type];
+    state->frames.fetch_add(1, std::memory_order_relaxed);
+    if (timestamp <= 0) {
+        state->no_timestamp.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    int64_t last = state->last_timestamp.load(std::memory_order_relaxed);
+    if (timestamp <= last) {
+        // out of order buffer, its interval is not known
+        return;
+    }
+    state->last_timestamp.store(timestamp, std::memory_order_relaxed);
+    if (last == 0) {
+        return;
+    }
+    int64_t interval = timestamp - last;
+    int64_t nominal = state->nominal_interval;
+    // snapshots come on request, their gaps are no drops
+    bool repeating = type != SNAPSHOT_TYPE && type != RAW_SNAPSHOT_TYPE;
+    if (repeating && nominal > 0 && interval > nominal + nominal / 2) {
+        state->drops.fetch_add((interval + nominal / 2) / nominal - 1, std::memory_order_relaxed);
+    }
+    state->intervals.record(interval);
+    uint32_t count = state->window_count.load(std::memory_order_relaxed);
+    state->window[count % STREAM_METRICS_WINDOW].store(interval, std::memory_order_relaxed);
+    state->window_count.store(count + 1, std::memory_order_release);
+
+    // the nominal interval follows fps range changes within a quarter window
+    count++;
+    if (count == STREAM_METRICS_MIN_INTERVALS ||
+        (count > STREAM_METRICS_MIN_INTERVALS && count % (STREAM_METRICS_WINDOW / 4) == 0)) {
+        int64_t intervals[STREAM_METRICS_WINDOW];
+        int n = get_window(state, intervals);
+        state->nominal_interval = intervals[(n - 1) / 2];
+    }
+}
+
+bool QCamxStreamMetrics::get_snapshot(StreamType type, StreamMetricsSnapshot *snapshot) {
+    if (type < 0 || type >= STREAM_METRICS_TYPES) {
+        return false;
+    }
+    StreamState *state = &_streams[type];
+    snapshot->frames = state->frames.load(std::memory_order_relaxed);
+    if (snapshot->frames == 0) {
+        return false;
+    }
+    snapshot->drops = state->drops.load(std::memory_order_relaxed);
+    snapshot->no_timestamp = state->no_timestamp.load(std::memory_order_relaxed);
+    snapshot->last_timestamp_ns = state->last_timestamp.load(std::memory_order_relaxed);
+    snapshot->total_p50_us = state->intervals.get_percentile_us(50);
+    snapshot->total_p99_us = state->intervals.get_percentile_us(99);
+
+    int64_t intervals[STREAM_METRICS_WINDOW];
+    int n = get_window(state, intervals);
+    snapshot->fps = 0;
+    snapshot->p50_us = 0;
+    snapshot->p99_us = 0;
+    snapshot->max_us = 0;
+    if (n > 0) {
+        int64_t sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += intervals[i];
+        }
+        snapshot->fps = sum > 0 ? (double)n * 1000000000.0 / sum : 0;
+        snapshot->p50_us = intervals[(n - 1) * 50 / 100] / 1000;
+        snapshot->p99_us = intervals[(n - 1) * 99 / 100] / 1000;
+        snapshot->max_us = intervals[n - 1] / 1000;
+    }
+    return true;
+}
+
+void QCamxStreamMetrics::report(const char *reason) {
+    for (int i = 0; i < STREAM_METRICS_TYPES; i++) {
+        StreamMetricsSnapshot snapshot;
+        if (!get_snapshot((StreamType)i, &snapshot)) {
+            continue;
+        }
+        QCAMX_PRINT("stream metrics [%s] camera=%d stream=%s frames=%" PRIu64 " fps=%.2f"
+                    " p50=%" PRId64 "us p99=%" PRId64 "us max=%" PRId64 "us total_p50=%" PRId64
+                    "us total_p99=%" PRId64 "us drops=%" PRIu64 " no_timestamp=%" PRIu64 "\n",
+                    reason, _camera_id, QCamxFrameDump::get_stream_type_string((StreamType)i),
+                    snapshot.frames, snapshot.fps, snapshot.p50_us, snapshot.p99_us,
+                    snapshot.max_us, snapshot.total_p50_us, snapshot.total_p99_us,
+                    snapshot.drops, snapshot.no_timestamp);
+    }
+}
+
+void QCamxStreamMetrics::report_if_due() {
+    if (_report_period_ns <= 0) {
+        return;
+    }
+    int64_t now = QCamxFrameTimeline::now_ns();
+    if (now >= _next_report_ns) {
+        _next_report_ns = now + _report_period_ns;
+        report("periodic");
+    }
+}
+
+/*************************private method*****************************/
+
+int QCamxStreamMetrics::get_window(StreamState *state, int64_t *intervals) {
+    uint32_t count = state->window_count.load(std::memory_order_acquire);
+    int n = count < STREAM_METRICS_WINDOW ? (int)count : STREAM_METRICS_WINDOW;
+    for (int i = 0; i < n; i++) {
+        intervals[i] = state->window[i].load(std::memory_order_relaxed);
+    }
+    std::sort(intervals, intervals + n);
+    return n;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file  qcamx_stream_metrics.h
+ * @brief frame rate and jitter of every stream type from the sensor timestamps
+ *        interval histogram, frame drops from timestamp gaps, rolling p50/p99 intervals
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "qcamx_define.h"
+#include "qcamx_frame_timeline.h"
+
+#define STREAM_METRICS_TYPES (IRBG_TYPE + 1)
+// intervals the rolling fps and percentiles are computed over
+#define STREAM_METRICS_WINDOW (128)
+
+// metrics of one stream type at one point in time
+struct StreamMetricsSnapshot {
+    uint64_t frames;
+    uint64_t drops;         ///< frames missing between two buffers, from the timestamp gap
+    uint64_t no_timestamp;  ///< buffers whose frame had no sensor timestamp
+    double fps;             ///< over the rolling window
+    int64_t p50_us;         ///< rolling interval percentiles
+    int64_t p99_us;
+    int64_t max_us;
+    int64_t total_p50_us;  ///< interval percentiles since the streams started
+    int64_t total_p99_us;
+    int64_t last_timestamp_ns;
+};
+
+class QCamxStreamMetrics {
+public:
+    QCamxStreamMetrics();
+    ~QCamxStreamMetrics() {}
+public:
+    /**
+     * @brief drop all counters, only call while not streaming
+     * @param report_period_sec periodic report interval, 0 only reports on stop
+    */
+    void reset(int camera_id, int report_period_sec);
+    /**
+     * @brief count one buffer of a stream, a stream type is recorded by one thread only
+     * @param timestamp sensor timestamp of the frame of the buffer, 0 if not known
+    */
+    void record_frame(StreamType type, int64_t timestamp);
+    /**
+     * @return false if no buffer of the stream type was recorded
+    */
+    bool get_snapshot(StreamType type, StreamMetricsSnapshot *snapshot);
+    /**
+     * @brief print one line of key=value pairs per stream type seen
+    */
+    void report(const char *reason);
+    /**
+     * @brief print the periodic report when its interval elapsed, called by the result thread
+    */
+    void report_if_due();
+private:
+    struct StreamState {
+        std::atomic<uint64_t> frames;
+        std::atomic<uint64_t> drops;
+        std::atomic<uint64_t> no_timestamp;
+        std::atomic<int64_t> last_timestamp;
+        std::atomic<int64_t> window[STREAM_METRICS_WINDOW];  ///< intervals in ns
+        std::atomic<uint32_t> window_count;                  ///< intervals written to window
+        int64_t nominal_interval;  ///< rolling p50, refreshed every quarter window
+        QCamxLatencyHistogram intervals;
+    };
+    /**
+     * @brief sorted intervals of the rolling window
+     * @return number of intervals
+    */
+    static int get_window(StreamState *state, int64_t *intervals);
+    // Do not support the copy constructor or assignment operator
+    QCamxStreamMetrics(const QCamxStreamMetrics &) = delete;
+    QCamxStreamMetrics &operator=(const QCamxStreamMetrics &) = delete;
+private:
+    StreamState _streams[STREAM_METRICS_TYPES];
+    int _camera_id;
+    int64_t _report_period_ns;
+    int64_t _next_report_ns;
+};
@@ -0,0 +1,153 @@
+/**
+ * @file  qcamx_worker_pool.cpp
+ * @brief fixed pool of worker threads implementation
+*/
+
+#include "qcamx_worker_pool.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxWorkerPool"
+
+QCamxWorkerPool::QCamxWorkerPool() {
+    pthread_mutex_init(&_run_lock, NULL);
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_start_cond, NULL);
+    pthread_cond_init(&_done_cond, NULL);
+    _generation = 0;
+    _active_workers = 0;
+    _stopping = false;
+    _func = NULL;
+    _context = NULL;
+    _task_count = 0;
+    _next_task = 0;
+    _done_tasks = 0;
+}
+
+QCamxWorkerPool::~QCamxWorkerPool() {
+    stop();
+    pthread_mutex_destroy(&_run_lock);
+    pthread_mutex_destroy(&_lock);
+    pthread_cond_destroy(&_start_cond);
+    pthread_cond_destroy(&_done_cond);
+}
+
+/*************************public method*****************************/
+
+int QCamxWorkerPool::start(int num_threads) {
+    stop();
+    _stopping = false;
+    for (int i = 1; i < num_threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_thread_entry, this) != 0) {
+            QCAMX_ERR("create worker thread failed:%s\n", strerror(errno));
+            break;
+        }
+        _threads.push_back(thread);
+    }
+    return 0;
+}
+
+void QCamxWorkerPool::stop() {
+    if (_threads.empty()) {
+        return;
+    }
+    pthread_mutex_lock(&_lock);
+    _stopping = true;
+    pthread_cond_broadcast(&_start_cond);
+    pthread_mutex_unlock(&_lock);
+    for (size_t i = 0; i < _threads.size(); i++) {
+        pthread_join(_threads[i], NULL);
+    }
+    _threads.clear();
+}
+
+void QCamxWorkerPool::run(TaskFunc func, void *context, int task_count) {
+    if (task_count <= 0) {
+        return;
+    }
+    if (_threads.empty() || task_count == 1) {
+        for (int i = 0; i < task_count; i++) {
+            func(context, i);
+        }
+        return;
+    }
+    pthread_mutex_lock(&_run_lock);
+    pthread_mutex_lock(&_lock);
+    // a worker which woke up after the last run ended still reads its task counter
+    while (_active_workers > 0) {
+        pthread_cond_wait(&_done_cond, &_lock);
+    }
+    _func = func;
+    _context = context;
+    _task_count = task_count;
+    _next_task = 0;
+    _done_tasks = 0;
+    _generation++;
+    pthread_cond_broadcast(&_start_cond);
+    pthread_mutex_unlock(&_lock);
+
+    work();
+
+    pthread_mutex_lock(&_lock);
+    while (_done_tasks.load() < _task_count) {
+        pthread_cond_wait(&_done_cond, &_lock);
+    }
+    pthread_mutex_unlock(&_lock);
+    pthread_mutex_unlock(&_run_lock);
+}
+
+/*************************private method*****************************/
+
+void *QCamxWorkerPool::worker_thread_entry(void *data) {
+    QCamxWorkerPool *pool = (QCamxWorkerPool *)data;
+    pool->worker_loop();
+    return NULL;
+}
+
+void QCamxWorkerPool::worker_loop() {
+    unsigned int seen_generation = 0;
+    pthread_mutex_lock(&_lock);
+    for (;;) {
+        while (_generation == seen_generation && !_stopping) {
+            pthread_cond_wait(&_start_cond, &_lock);
+        }
+        if (_stopping) {
+            break;
+        }
+        seen_generation = _generation;
+        _active_workers++;
+        pthread_mutex_unlock(&_lock);
+
+        work();
+
+        pthread_mutex_lock(&_lock);
+        _active_workers--;
+        if (_active_workers == 0) {
+            pthread_cond_signal(&_done_cond);
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+void QCamxWorkerPool::work() {
+    int task_count = _task_count;
+    for (;;) {
+        int index = _next_task.fetch_add(1, std::memory_order_relaxed);
+        if (index >= task_count) {
+            return;
+        }
+        _func(_context, index);
+        if (_done_tasks.fetch_add(1, std::memory_order_acq_rel) + 1 == task_count) {
+            pthread_mutex_lock(&_lock);
+            pthread_cond_signal(&_done_cond);
+            pthread_mutex_unlock(&_lock);
+        }
+    }
+}
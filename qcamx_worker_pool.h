@@ -0,0 +1,55 @@
+/**
+ * @file  qcamx_worker_pool.h
+ * @brief fixed pool of worker threads running a parallel for
+*/
+
+#pragma once
+
+#include <pthread.h>
+
+#include <atomic>
+#include <vector>
+
+class QCamxWorkerPool {
+public:
+    typedef void (*TaskFunc)(void *context, int task_index);
+public:
+    QCamxWorkerPool();
+    ~QCamxWorkerPool();
+public:
+    /**
+     * @brief start the workers
+     * @param num_threads threads working on a run, the caller of run is one of them
+    */
+    int start(int num_threads);
+    void stop();
+    int get_thread_count() { return (int)_threads.size() + 1; }
+    /**
+     * @brief call func for every task index in [0, task_count), returns when all are done
+     * @detail runs of several callers are serialized
+    */
+    void run(TaskFunc func, void *context, int task_count);
+private:
+    static void *worker_thread_entry(void *data);
+    void worker_loop();
+    void work();
+    // Do not support the copy constructor or assignment operator
+    QCamxWorkerPool(const QCamxWorkerPool &) = delete;
+    QCamxWorkerPool &operator=(const QCamxWorkerPool &) = delete;
+private:
+    std::vector<pthread_t> _threads;
+    pthread_mutex_t _run_lock;  ///< one run at a time
+
+    // current run, written by run with _lock held
+    pthread_mutex_t _lock;
+    pthread_cond_t _start_cond;
+    pthread_cond_t _done_cond;
+    unsigned int _generation;
+    int _active_workers;  ///< workers still inside the current run
+    bool _stopping;
+    TaskFunc _func;
+    void *_context;
+    int _task_count;
+    std::atomic<int> _next_task;
+    std::atomic<int> _done_tasks;
+};
@@ -0,0 +1,264 @@
+/**
+ * @file  qcamx_zsl_ring.cpp
+ * @brief zero shutter lag history implementation
+*/
+
+#include "qcamx_zsl_ring.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "qcamx_log.h"
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG "QCamxZslRing"
+
+QCamxZslRing::QCamxZslRing() {
+    _running = false;
+    _hub = NULL;
+    _boottime = false;
+    _depth = 0;
+    pthread_mutex_init(&_lock, NULL);
+    memset(_entries, 0, sizeof(_entries));
+    _head = 0;
+    _count = 0;
+    _held_bytes = 0;
+    _peak_bytes = 0;
+    memset(&_stats_result, 0, sizeof(_stats_result));
+    _snapshots = 0;
+    _misses = 0;
+    _ae_fallbacks = 0;
+    _age_total = 0;
+    _age_max = 0;
+    _latency_total = 0;
+    _latency_max = 0;
+}
+
+QCamxZslRing::~QCamxZslRing() {
+    stop();
+    pthread_mutex_destroy(&_lock);
+}
+
+/*************************public method*****************************/
+
+int QCamxZslRing::start(QCamxFrameHub *hub, int depth, bool boottime, int stats_threads,
+                        int stats_budget_us) {
+    stop();
+    if (depth <= 0 || depth > ZSL_RING_MAX_DEPTH) {
+        QCAMX_ERR("zsl ring depth %d out of 1..%d\n", depth, ZSL_RING_MAX_DEPTH);
+        return -1;
+    }
+    pthread_mutex_lock(&_lock);
+    _hub = hub;
+    _depth = depth;
+    _boottime = boottime;
+    _head = 0;
+    _count = 0;
+    _held_bytes = 0;
+    _peak_bytes = 0;
+    _snapshots = 0;
+    _misses = 0;
+    _ae_fallbacks = 0;
+    _age_total = 0;
+    _age_max = 0;
+    _latency_total = 0;
+    _latency_max = 0;
+    pthread_mutex_unlock(&_lock);
+    _stats.start(stats_threads, stats_budget_us);
+    _running = true;
+    QCAMX_PRINT("zsl ring depth:%d clock:%s\n", depth, boottime ? "boottime" : "monotonic");
+    return 0;
+}
+
+void QCamxZslRing::stop() {
+    if (!_running) {
+        return;
+    }
+    report("stop");
+    pthread_mutex_lock(&_lock);
+    _running = false;
+    while (_count > 0) {
+        drop_oldest();
+    }
+    pthread_mutex_unlock(&_lock);
+    _stats.stop();
+}
+
+void QCamxZslRing::push(QCamxBufferManager *buffer_manager, buffer_handle_t *buffer,
+                        uint32_t frame_number, Implsubformat subformat) {
+    BufferInfo *info = buffer_manager->get_buffer_info(buffer);
+    if (info == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&_lock);
+    if (!_running) {
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+    if (_count == _depth) {
+        drop_oldest();
+    }
+    buffer_manager->acquire_buffer(buffer);
+    Entry *entry = &_entries[(_head + _count) % _depth];
+    entry->buffer_manager = buffer_manager;
+    entry->buffer = buffer;
+    entry->frame_number = frame_number;
+    // the shutter notify of the frame came before its buffers
+    FrameMetadata metadata;
+    _hub->get_frame_metadata(frame_number, &metadata);
+    entry->timestamp = metadata.timestamp;
+    entry->subformat = subformat;
+    entry->size = info->size;
+    entry->sharpness = -1;
+    _count++;
+    _held_bytes += entry->size;
+    if (_held_bytes > _peak_bytes) {
+        _peak_bytes = _held_bytes;
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+int QCamxZslRing::select(int64_t shutter_ns, ZslFrame *frame) {
+    pthread_mutex_lock(&_lock);
+    if (_count == 0) {
+        _misses++;
+        pthread_mutex_unlock(&_lock);
+        return -1;
+    }
+
+    // the AE converged frames are the candidates, all of them if none converged, the final
+    // metadata of a frame may come after its buffer so its AE state is read only now
+    bool converged[ZSL_RING_MAX_DEPTH];
+    int32_t ae_states[ZSL_RING_MAX_DEPTH];
+    bool any_converged = false;
+    for (int i = 0; i < _count; i++) {
+        Entry *entry = &_entries[(_head + i) % _depth];
+        FrameMetadata metadata;
+        _hub->get_frame_metadata(entry->frame_number, &metadata);
+        ae_states[i] = metadata.ae_state;
+        converged[i] = is_ae_converged(ae_states[i]);
+        any_converged = any_converged || converged[i];
+    }
+    if (!any_converged) {
+        _ae_fallbacks++;
+    }
+
+    // the closest in time, the newer one on a tie and without timestamps
+    int best = -1;
+    int64_t best_distance = INT64_MAX;
+    for (int i = 0; i < _count; i++) {
+        Entry *entry = &_entries[(_head + i) % _depth];
+        if (any_converged && !converged[i]) {
+            continue;
+        }
+        int64_t distance =
+            entry->timestamp > 0 ? llabs(shutter_ns - entry->timestamp) : INT64_MAX;
+        if (best < 0 || distance <= best_distance) {
+            best = i;
+            best_distance = distance;
+        }
+    }
+
+    // a sharper frame one frame interval around it is worth the small time shift
+    int pick = best;
+    Entry *newest = &_entries[(_head + _count - 1) % _depth];
+    Entry *before_newest = &_entries[(_head + _count - 2 + _depth) % _depth];
+    int64_t interval = _count > 1 ? newest->timestamp - before_newest->timestamp : 0;
+    Entry *best_entry = &_entries[(_head + best) % _depth];
+    if (interval > 0 && best_entry->timestamp > 0) {
+        float pick_sharpness = get_sharpness(best_entry);
+        for (int i = 0; i < _count && pick_sharpness >= 0; i++) {
+            Entry *entry = &_entries[(_head + i) % _depth];
+            if (i == best || (any_converged && !converged[i]) || entry->timestamp <= 0 ||
+                llabs(entry->timestamp - best_entry->timestamp) > interval) {
+                continue;
+            }
+            float sharpness = get_sharpness(entry);
+            if (sharpness > pick_sharpness) {
+                pick = i;
+                pick_sharpness = sharpness;
+            }
+        }
+    }
+
+    Entry *entry = &_entries[(_head + pick) % _depth];
+    entry->buffer_manager->acquire_buffer(entry->buffer);
+    frame->buffer_manager = entry->buffer_manager;
+    frame->buffer = entry->buffer;
+    frame->frame_number = entry->frame_number;
+    frame->timestamp = entry->timestamp;
+    frame->age = entry->timestamp > 0 ? shutter_ns - entry->timestamp : 0;
+    frame->ae_state = ae_states[pick];
+    frame->sharpness = entry->sharpness;
+    _snapshots++;
+    _age_total += frame->age;
+    if (frame->age > _age_max) {
+        _age_max = frame->age;
+    }
+    pthread_mutex_unlock(&_lock);
+    return 0;
+}
+
+void QCamxZslRing::release(ZslFrame *frame, int64_t latency_ns) {
+    frame->buffer_manager->return_buffer(frame->buffer);
+    pthread_mutex_lock(&_lock);
+    _latency_total += latency_ns;
+    if (latency_ns > _latency_max) {
+        _latency_max = latency_ns;
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+int64_t QCamxZslRing::now_ns() {
+    struct timespec ts;
+    clock_gettime(_boottime ? CLOCK_BOOTTIME : CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void QCamxZslRing::report(const char *reason) {
+    pthread_mutex_lock(&_lock);
+    uint64_t snapshots = _snapshots > 0 ? _snapshots : 1;
+    QCAMX_PRINT("zsl ring [%s] depth=%d held=%d held_bytes=%zu peak_bytes=%zu snapshots=%" PRIu64
+                " misses=%" PRIu64 " ae_fallbacks=%" PRIu64 " age_avg=%.2fms age_max=%.2fms"
+                " latency_avg=%.3fms latency_max=%.3fms\n",
+                reason, _depth, _count, _held_bytes, _peak_bytes, _snapshots, _misses,
+                _ae_fallbacks, _age_total / 1e6 / snapshots, _age_max / 1e6,
+                _latency_total / 1e6 / snapshots, _latency_max / 1e6);
+    pthread_mutex_unlock(&_lock);
+}
+
+/*************************private method*****************************/
+
+bool QCamxZslRing::is_ae_converged(int32_t ae_state) {
+    return ae_state == ANDROID_CONTROL_AE_STATE_CONVERGED ||
+           ae_state == ANDROID_CONTROL_AE_STATE_LOCKED ||
+           ae_state == ANDROID_CONTROL_AE_STATE_FLASH_REQUIRED;
+}
+
+float QCamxZslRing::get_sharpness(Entry *entry) {
+    if (entry->sharpness >= 0) {
+        return entry->sharpness;
+    }
+    BufferInfo *info = entry->buffer_manager->get_buffer_info(entry->buffer);
+    uint32_t format = info != NULL ? info->format : 0;
+    if (format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED &&
+        (entry->subformat == YUV420NV12 || entry->subformat == YUV420NV21)) {
+        format = HAL_PIXEL_FORMAT_YCBCR_420_888;
+    }
+    if (info != NULL && _stats.compute(info, format, entry->frame_number, &_stats_result) == 0) {
+        entry->sharpness = _stats_result.sharpness;
+    }
+    return entry->sharpness;
+}
+
+void QCamxZslRing::drop_oldest() {
+    Entry *entry = &_entries[_head];
+    entry->buffer_manager->return_buffer(entry->buffer);
+    _held_bytes -= entry->size;
+    _head = (_head + 1) % _depth;
+    _count--;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file  qcamx_zsl_ring.h
+ * @brief zero shutter lag history of a full resolution stream
+ *        the last frames of the stream stay out of their pool with their sensor timestamps, a
+ *        snapshot picks the best of them instead of capturing a new frame
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "qcamx_buffer_manager.h"
+#include "qcamx_frame_hub.h"
+#include "qcamx_frame_stats.h"
+
+// far below FRAME_METADATA_RING, the hub still has the AE state of every frame held
+#define ZSL_RING_MAX_DEPTH (32)
+
+// frame picked for a snapshot, holds a reference on its buffer until QCamxZslRing::release
+typedef struct _zsl_frame {
+    QCamxBufferManager *buffer_manager;
+    buffer_handle_t *buffer;
+    uint32_t frame_number;
+    int64_t timestamp;  // sensor timestamp in ns
+    int64_t age;        // shutter time - sensor timestamp in ns
+    int32_t ae_state;   // ANDROID_CONTROL_AE_STATE, -1 if not known
+    float sharpness;    // -1 if not computed
+} ZslFrame;
+
+class QCamxZslRing {
+public:
+    QCamxZslRing();
+    ~QCamxZslRing();
+public:
+    /**
+     * @brief hold the last depth frames pushed
+     * @param hub frame hub of the device, its result metadata gives the timestamp and the AE
+     *        state of the frames
+     * @param boottime the sensor timestamps are CLOCK_BOOTTIME, CLOCK_MONOTONIC else
+     * @param stats_threads threads computing the sharpness of the candidates of a snapshot
+     * @param stats_budget_us sharpness time budget of a candidate
+    */
+    int start(QCamxFrameHub *hub, int depth, bool boottime, int stats_threads,
+              int stats_budget_us);
+    /**
+     * @brief give every frame held back to its pool and print the report
+    */
+    void stop();
+    bool is_running() { return _running; }
+    /**
+     * @brief keep a buffer of the stream, the oldest frame goes back to its pool when full
+     * @detail the ring takes its own reference, the caller still returns its one
+    */
+    void push(QCamxBufferManager *buffer_manager, buffer_handle_t *buffer, uint32_t frame_number,
+              Implsubformat subformat);
+    /**
+     * @brief pick the frame for a shutter: the closest in time of the AE converged frames, or the
+     *        sharpest of it and the frames one frame interval around it
+     * @param shutter_ns shutter time on the clock of the sensor timestamps, see now_ns
+     * @return 0 with frame set, -1 if the ring is empty
+    */
+    int select(int64_t shutter_ns, ZslFrame *frame);
+    /**
+     * @brief drop the reference of a selected frame
+     * @param latency_ns shutter to image latency of the snapshot, for the report
+    */
+    void release(ZslFrame *frame, int64_t latency_ns);
+    /**
+     * @return now on the clock of the sensor timestamps
+    */
+    int64_t now_ns();
+    /**
+     * @brief print the memory held and the snapshot age and latency
+    */
+    void report(const char *reason);
+private:
+    struct Entry {
+        QCamxBufferManager *buffer_manager;
+        buffer_handle_t *buffer;
+        uint32_t frame_number;
+        int64_t timestamp;
+        Implsubformat subformat;
+        size_t size;
+        float sharpness;  ///< -1 until computed
+    };
+    static bool is_ae_converged(int32_t ae_state);
+    /**
+     * @brief sharpness of an entry, computed once, -1 if the format has no luma plane
+    */
+    float get_sharpness(Entry *entry);
+    /**
+     * @brief give the oldest entry back to its pool, _lock held
+    */
+    void drop_oldest();
+    // Do not support the copy constructor or assignment operator
+    QCamxZslRing(const QCamxZslRing &) = delete;
+    QCamxZslRing &operator=(const QCamxZslRing &) = delete;
+private:
+    bool _running;
+    QCamxFrameHub *_hub;
+    bool _boottime;
+    int _depth;
+
+    pthread_mutex_t _lock;  ///< guards the entries, the stats and the report counters
+    Entry _entries[ZSL_RING_MAX_DEPTH];
+    int _head;  ///< oldest entry
+    int _count;
+    size_t _held_bytes;
+    size_t _peak_bytes;
+    QCamxFrameStats _stats;
+    frame_stats_t _stats_result;
+
+    uint64_t _snapshots;
+    uint64_t _misses;        ///< snapshots with an empty ring
+    uint64_t _ae_fallbacks;  ///< snapshots without an AE converged frame
+    int64_t _age_total;
+    int64_t _age_max;
+    int64_t _latency_total;
+    int64_t _latency_max;
+};